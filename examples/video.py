@@ -35,6 +35,11 @@ def get_argument_parser():
     )
     parser.add_argument("--native", help="use GPU provided video encoder", action="store_true")
     parser.add_argument("--windows", help="use in windows transcoder (defaults to ffmpeg)", action="store_true")
+    parser.add_argument(
+        "--adaptive",
+        help="with --native, lower the frame rate while the encoder cannot keep up instead of falling behind",
+        action="store_true",
+    )
     return parser
 
 
@@ -45,11 +50,12 @@ def parse_handle(hwnd) -> int:
 
 
 class VideoRecorder:
-    def __init__(self, output: str = "video.mp4"):
+    def __init__(self, output: str = "video.mp4", adaptive: bool = False):
         self._thread: Thread | None = None
         self._monitor: Thread | None = None
         self._stop = False
         self._output = output
+        self._adaptive = adaptive
         self._camera: DXCamera | None = None
         self._video_writer: cv2.VideoWriter | None = None
         signal.signal(signal.SIGINT, self._signal_handler)
@@ -71,6 +77,12 @@ class VideoRecorder:
     ):
         index = 0
         print()
+        if native and ffmpeg and seconds_per_video > 0:
+            # the encoder starts the next file on a key frame by itself, so the capture and the encoder
+            # keep running and no frames are lost between the files.
+            total_seconds = seconds_per_video * episodes
+            self.native_encoder(self._output, x, y, w, h, fps, total_seconds, 0, ffmpeg, seconds_per_video)
+            return
         while not self._stop:
             filename = self._output
             if index > 0:
@@ -87,7 +99,17 @@ class VideoRecorder:
                 break
 
     def native_encoder(
-        self, filename: str, x: int, y: int, w: int, h: int, fps: int, max_seconds: int, index: int, ffmpeg: bool
+        self,
+        filename: str,
+        x: int,
+        y: int,
+        w: int,
+        h: int,
+        fps: int,
+        max_seconds: int,
+        index: int,
+        ffmpeg: bool,
+        segment_seconds: int = 0,
     ):
         timer = Timer()
         with DXCamera(x, y, w, h, fps=fps) as camera:
@@ -105,7 +127,12 @@ class VideoRecorder:
             request_ffmpeg = 1 if ffmpeg else 0
 
             props = EncodingProperties(
-                frame_rate=fps, quality=VideoEncodingQuality.HD720p, seconds=max_seconds, ffmpeg=request_ffmpeg
+                frame_rate=fps,
+                quality=VideoEncodingQuality.HD720p,
+                seconds=max_seconds,
+                ffmpeg=request_ffmpeg,
+                segment_seconds=segment_seconds,
+                adaptive_frame_rate=self._adaptive,
             )
 
             camera.encode_video(filename, props)
@@ -113,6 +140,11 @@ class VideoRecorder:
 
             self._monitor.join()
             print("Video saved to", filename)
+            for adjustment in camera.get_encoder_adjustments():
+                print(
+                    f"At {adjustment.time:.1f} seconds the encoder was {adjustment.load * 100:.0f}% busy, "
+                    f"changed to {adjustment.frame_rate:.1f} fps"
+                )
             ticks = camera.get_video_ticks()
             frames = camera.get_frame_times()
             self.save_video_meta(filename, ticks, frames)
@@ -140,7 +172,7 @@ class VideoRecorder:
     def monitor_video(self, camera: DXCamera, max_seconds: int):
         timer = Timer()
         timer.start()
-        while timer.ticks() < max_seconds and not self._stop:
+        while (max_seconds == 0 or timer.ticks() < max_seconds) and not self._stop:
             timer.sleep(100)
         camera.stop_encoding()
 
@@ -196,7 +228,7 @@ class VideoRecorder:
 
         if index == 0 and avg_fps < fps * 0.9:
             print(f"The video writer could not keep up with the target {fps} fps so the video will play too fast.")
-            print("Please try a smaller window or a lower target fps.")
+            print("Please try a smaller window, a lower target fps or --native --adaptive.")
 
     def report_steps(self, ticks):
         if len(ticks) > 0:
@@ -258,7 +290,7 @@ def main():
         desktop = DesktopWindow()
         x, y, w, h = desktop.find(pid)
 
-    recorder = VideoRecorder(args.output)
+    recorder = VideoRecorder(args.output, args.adaptive)
     recorder.start(x, y, w, h, args.fps, args.seconds_per_video, args.episodes, args.native, not args.windows)
     input("Press ENTER to stop recording...")
     recorder.stop()
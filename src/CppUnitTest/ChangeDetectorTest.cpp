@@ -0,0 +1,230 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include "ChangeDetector.h"
+#include "Tests.h"
+
+using namespace util;
+
+static int Pitch(int width)
+{
+	return ((width * 4 + 63) / 64) * 64;
+}
+
+// Something like a desktop: flat panels with a few busy areas of text and pictures.
+static std::vector<uint8_t> DesktopFrame(int width, int height, std::mt19937& random)
+{
+	int pitch = Pitch(width);
+	std::vector<uint8_t> pixels(static_cast<size_t>(pitch) * height);
+	for (int y = 0; y < height; y++) {
+		uint8_t* row = pixels.data() + static_cast<size_t>(y) * pitch;
+		for (int x = 0; x < width; x++) {
+			bool busy = ((x / 48) + (y / 40)) % 5 == 0;
+			uint8_t shade = busy ? static_cast<uint8_t>(random()) : static_cast<uint8_t>(0xE0 + (y * 8 / height));
+			row[x * 4] = shade;
+			row[x * 4 + 1] = busy ? static_cast<uint8_t>(random()) : shade;
+			row[x * 4 + 2] = busy ? static_cast<uint8_t>(random()) : shade;
+			row[x * 4 + 3] = 0xFF;
+		}
+	}
+	return pixels;
+}
+
+// Which tiles really differ once alpha and the ignored low bits are masked off, pixel by pixel.
+static std::vector<uint8_t> ChangedTiles(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b,
+	int width, int height, int tileSize, int ignoreBits)
+{
+	int pitch = Pitch(width);
+	int columns = (width + tileSize - 1) / tileSize;
+	int rows = (height + tileSize - 1) / tileSize;
+	uint8_t mask = static_cast<uint8_t>(0xFF << ignoreBits);
+	std::vector<uint8_t> changed(static_cast<size_t>(columns) * rows, 0);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			size_t offset = static_cast<size_t>(y) * pitch + x * 4;
+			for (int c = 0; c < 3; c++) {
+				if ((a[offset + c] & mask) != (b[offset + c] & mask)) {
+					changed[static_cast<size_t>(y / tileSize) * columns + x / tileSize] = 1;
+				}
+			}
+		}
+	}
+	return changed;
+}
+
+static void TestChangeDetectorLevels()
+{
+	// odd sizes cover the scalar tails and the partial tiles on the right and bottom.
+	const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 37, 41 }, { 100, 65 }, { 1278, 33 } };
+	for (auto& size : sizes) {
+		std::mt19937 random(size[0]);
+		auto frame = DesktopFrame(size[0], size[1], random);
+		ChangeDetector reference(32, 0, CpuLevel::Scalar);
+		reference.Update(frame.data(), Pitch(size[0]), size[0], size[1]);
+		for (int level = 1; level <= static_cast<int>(GetCpuLevel()); level++) {
+			ChangeDetector detector(32, 0, static_cast<CpuLevel>(level));
+			detector.Update(frame.data(), Pitch(size[0]), size[0], size[1]);
+			Check(detector.Hashes() == reference.Hashes(), std::string(CpuLevelName(static_cast<CpuLevel>(level))) +
+				" hashes differ from scalar at " + std::to_string(size[0]) + "x" + std::to_string(size[1]));
+		}
+	}
+}
+
+static void TestChangeDetectorSinglePixel()
+{
+	const int width = 333, height = 97;
+	std::mt19937 random(7);
+	auto frame = DesktopFrame(width, height, random);
+	ChangeDetector detector(16);
+	Check(detector.Update(frame.data(), Pitch(width), width, height) == static_cast<size_t>(detector.Columns() * detector.Rows()),
+		"the first frame should count as all changed");
+	Check(detector.Update(frame.data(), Pitch(width), width, height) == 0, "the same frame should not change");
+	for (int i = 0; i < 2000; i++) {
+		int x = random() % width;
+		int y = random() % height;
+		int channel = random() % 4;
+		uint8_t& value = frame[static_cast<size_t>(y) * Pitch(width) + x * 4 + channel];
+		value = static_cast<uint8_t>(value + 1 + random() % 255);
+		size_t changed = detector.Update(frame.data(), Pitch(width), width, height);
+		if (channel == 3) {
+			Check(changed == 0, "alpha should be ignored");
+		}
+		else {
+			Check(changed == 1 && detector.TileChanged(x / 16, y / 16), "a single pixel change was missed at " +
+				std::to_string(x) + "," + std::to_string(y));
+		}
+	}
+}
+
+// A synthetic desktop session, every frame is either unchanged or has one of the things that
+// happen on a screen. Checks the frame decisions and every tile against a pixel by pixel compare.
+static void TestChangeDetectorSequence(int ignoreBits)
+{
+	const int width = 640, height = 360, tileSize = 32;
+	const int pitch = Pitch(width);
+	std::mt19937 random(ignoreBits + 1);
+	auto frame = DesktopFrame(width, height, random);
+	ChangeDetector detector(tileSize, ignoreBits);
+	detector.Update(frame.data(), pitch, width, height);
+	size_t truePositive = 0, falsePositive = 0, falseNegative = 0, trueNegative = 0;
+	size_t tileErrors = 0;
+	for (int i = 0; i < 1000; i++) {
+		auto previous = frame;
+		switch (random() % 6) {
+		case 0: // nothing happens, most of the time on a real desktop.
+			break;
+		case 1: { // the text cursor blinks.
+			int x0 = random() % (width - 2), y0 = random() % (height - 16);
+			for (int y = y0; y < y0 + 16; y++) {
+				for (int x = x0; x < x0 + 2; x++) {
+					for (int c = 0; c < 3; c++) {
+						frame[static_cast<size_t>(y) * pitch + x * 4 + c] ^= 0xFF;
+					}
+				}
+			}
+			break;
+		}
+		case 2: { // a character is typed.
+			int x0 = random() % (width - 8), y0 = random() % (height - 12);
+			for (int y = y0; y < y0 + 12; y++) {
+				for (int x = x0; x < x0 + 8; x++) {
+					if (random() % 3 == 0) {
+						::memset(&frame[static_cast<size_t>(y) * pitch + x * 4], 0x20, 3);
+					}
+				}
+			}
+			break;
+		}
+		case 3: // a page scrolls by a line.
+			::memmove(frame.data(), frame.data() + pitch, static_cast<size_t>(pitch) * (height - 1));
+			break;
+		case 4: { // one pixel, the hardest case.
+			int x = random() % width, y = random() % height;
+			frame[static_cast<size_t>(y) * pitch + x * 4 + random() % 3] ^= static_cast<uint8_t>(1 << (random() % 8));
+			break;
+		}
+		case 5: // noise in the lowest bit, near identical.
+			for (int n = 0; n < 500; n++) {
+				frame[static_cast<size_t>(random() % height) * pitch + (random() % width) * 4 + random() % 3] ^= 1;
+			}
+			break;
+		}
+		auto expected = ChangedTiles(previous, frame, width, height, tileSize, ignoreBits);
+		bool changed = false;
+		for (auto tile : expected) {
+			changed = changed || tile != 0;
+		}
+		bool detected = detector.Update(frame.data(), pitch, width, height) > 0;
+		truePositive += (changed && detected) ? 1 : 0;
+		falsePositive += (!changed && detected) ? 1 : 0;
+		falseNegative += (changed && !detected) ? 1 : 0;
+		trueNegative += (!changed && !detected) ? 1 : 0;
+		for (int row = 0; row < detector.Rows(); row++) {
+			for (int column = 0; column < detector.Columns(); column++) {
+				tileErrors += detector.TileChanged(column, row) != (expected[static_cast<size_t>(row) * detector.Columns() + column] != 0) ? 1 : 0;
+			}
+		}
+	}
+	double precision = truePositive + falsePositive > 0 ? static_cast<double>(truePositive) / (truePositive + falsePositive) : 1;
+	double recall = truePositive + falseNegative > 0 ? static_cast<double>(truePositive) / (truePositive + falseNegative) : 1;
+	std::cout << "ignoring " << ignoreBits << " bits: " << truePositive << " changed, " << trueNegative << " unchanged, precision "
+		<< precision << ", recall " << recall << std::endl;
+	Check(recall == 1, "missed " + std::to_string(falseNegative) + " changed frames");
+	Check(precision == 1, std::to_string(falsePositive) + " unchanged frames were reported as changed");
+	Check(tileErrors == 0, std::to_string(tileErrors) + " tiles were misreported");
+	Check(trueNegative > 100, "the sequence should have unchanged frames");
+}
+
+void TestChangeDetector()
+{
+	std::cout << "Testing the frame change detector..." << std::endl;
+	TestChangeDetectorLevels();
+	TestChangeDetectorSinglePixel();
+	TestChangeDetectorSequence(0);
+	TestChangeDetectorSequence(1);
+	bool threw = false;
+	try {
+		ChangeDetector detector(20);
+	}
+	catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	Check(threw, "tile sizes that are not a multiple of 8 should be rejected");
+	std::cout << "ok" << std::endl;
+}
+
+void BenchmarkChangeDetector()
+{
+	std::cout << "Benchmarking the frame change detector..." << std::endl;
+	const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const int iterations = 100;
+	for (auto& size : sizes) {
+		int width = size[0];
+		int height = size[1];
+		std::mt19937 random(1);
+		auto frame = DesktopFrame(width, height, random);
+		std::vector<uint8_t> copy(frame.size());
+
+		auto report = [&](const std::string& name, auto run) {
+			run(); // warmup
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) {
+				run();
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			double ms = elapsed.count() / iterations;
+			std::cout << std::fixed << std::setprecision(3) << width << "x" << height << " " << std::setw(10) << name
+				<< " " << ms << " ms/frame " << std::setprecision(0) << (1000.0 / ms) << " fps" << std::endl;
+		};
+
+		report("memcpy", [&]() { ::memcpy(copy.data(), frame.data(), frame.size()); });
+		for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+			ChangeDetector detector(32, 0, static_cast<CpuLevel>(level));
+			report(CpuLevelName(static_cast<CpuLevel>(level)), [&]() { detector.Update(frame.data(), Pitch(width), width, height); });
+		}
+	}
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "Clock.h"
+#include "Tests.h"
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+using namespace util;
+
+// Every thread reading the clock as fast as it can must never see it go back.
+static void CheckMonotonic(const std::string& name)
+{
+	std::atomic<int> failures{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			int64_t last = Clock::Nanoseconds();
+			for (int i = 0; i < 200000; i++) {
+				int64_t now = Clock::Nanoseconds();
+				if (now < last) {
+					failures++;
+				}
+				last = now;
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	Check(failures == 0, name + " went back in time " + std::to_string(failures) + " times");
+}
+
+// How far the clock is from steady_clock over a sleep, as a fraction of the sleep.
+static double ErrorOverSleep(std::chrono::milliseconds period)
+{
+	int64_t steadyStart = Clock::SteadyNanoseconds();
+	int64_t start = Clock::Nanoseconds();
+	std::this_thread::sleep_for(period);
+	int64_t elapsed = Clock::Nanoseconds() - start;
+	int64_t steadyElapsed = Clock::SteadyNanoseconds() - steadyStart;
+	return std::abs(static_cast<double>(elapsed - steadyElapsed)) / steadyElapsed;
+}
+
+void TestClock()
+{
+	std::cout << "Testing the clock..." << std::endl;
+	Check(Clock::Source() == ClockSource::Steady, "the clock should start on steady_clock");
+	CheckMonotonic("steady_clock");
+	Check(ErrorOverSleep(std::chrono::milliseconds(20)) < 0.001, "the steady clock should be steady_clock");
+
+	ClockCalibration calibration;
+	calibration.ticks = 1000000;
+	calibration.nanoseconds = 5000;
+	calibration.nanosecondsPerTick = 0.25;
+	Check(calibration.ToNanoseconds(1000400) == 5100 && calibration.ToNanoseconds(999600) == 4900, "ticks should convert to nanoseconds");
+	// a nanosecond is 4 ticks here, so the round trip can only be a nanosecond's worth of ticks out.
+	uint64_t ticks = calibration.ToTicks(calibration.ToNanoseconds(123456789));
+	Check(ticks <= 123456789 && ticks + 4 > 123456789, "nanoseconds should convert back to the same ticks");
+	Check(calibration.TicksPerSecond() == 4e9, "0.25 nanoseconds per tick is 4 GHz");
+	Check(Clock::ToSeconds(Clock::FromSeconds(1.5)) == 1.5 && Clock::FromMicroseconds(3) == 3000 && Clock::ToMilliseconds(2500000) == 2.5,
+		"the conversions should round trip");
+
+	if (!Clock::HasInvariantTsc()) {
+		Check(!Clock::UseTsc(), "the clock should not use a time stamp counter that isn't invariant");
+		Check(Clock::Source() == ClockSource::Steady, "a failed switch should leave the clock alone");
+		std::cout << "no invariant time stamp counter, skipping the tsc tests" << std::endl << "ok" << std::endl;
+		return;
+	}
+	calibration = Clock::Calibrate(std::chrono::milliseconds(50));
+	std::cout << "time stamp counter at " << std::fixed << std::setprecision(3) << calibration.TicksPerSecond() / 1e9 << " GHz" << std::endl;
+	Check(calibration.TicksPerSecond() > 1e8 && calibration.TicksPerSecond() < 1e10, "the calibrated tick rate is not a cpu clock");
+	int64_t before = Clock::Nanoseconds();
+	Check(Clock::UseTsc(calibration) && Clock::Source() == ClockSource::Tsc, "the clock should switch to the time stamp counter");
+	int64_t after = Clock::Nanoseconds();
+	Check(after >= before && after - before < 1000000, "switching clocks should not jump");
+	CheckMonotonic("the time stamp counter");
+	Check(ErrorOverSleep(std::chrono::milliseconds(100)) < 0.001, "the time stamp counter should keep steady_clock time");
+
+	// a recalibration with a deliberately wrong rate must still carry on from the current time.
+	calibration.nanosecondsPerTick *= 1.01;
+	before = Clock::Nanoseconds();
+	Clock::UseTsc(calibration);
+	after = Clock::Nanoseconds();
+	Check(after >= before && after - before < 1000000, "recalibrating should not jump");
+
+	Clock::UseSteady();
+	Check(Clock::Source() == ClockSource::Steady, "the clock should switch back to steady_clock");
+	std::cout << "ok" << std::endl;
+}
+
+static int64_t MonotonicNanoseconds()
+{
+#if defined(__linux__)
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+	return Clock::SteadyNanoseconds();
+#endif
+}
+
+template <typename Read>
+static double ReadCost(Read read)
+{
+	const int iterations = 10000000;
+	int64_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		sum += static_cast<int64_t>(read());
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	if (sum == 42) {
+		std::cout << "";
+	}
+	return elapsed.count() / iterations;
+}
+
+// What each clock costs to read, and how far the time stamp counter drifts from CLOCK_MONOTONIC
+// (QueryPerformanceCounter on Windows) after calibrations of different lengths.
+void BenchmarkClock()
+{
+	std::cout << "Benchmarking clock reads..." << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "system_clock        " << ReadCost([]() { return std::chrono::system_clock::now().time_since_epoch().count(); }) << " ns" << std::endl;
+	std::cout << "steady_clock        " << ReadCost([]() { return std::chrono::steady_clock::now().time_since_epoch().count(); }) << " ns" << std::endl;
+#if defined(__linux__)
+	std::cout << "CLOCK_MONOTONIC     " << ReadCost(MonotonicNanoseconds) << " ns" << std::endl;
+#endif
+	std::cout << "Clock::Ticks        " << ReadCost(Clock::Ticks) << " ns" << std::endl;
+	std::cout << "Clock (steady)      " << ReadCost(Clock::Nanoseconds) << " ns" << std::endl;
+	if (!Clock::HasInvariantTsc()) {
+		std::cout << "no invariant time stamp counter" << std::endl;
+		return;
+	}
+	Clock::UseTsc(Clock::Calibrate(std::chrono::milliseconds(10)));
+	std::cout << "Clock (tsc)         " << ReadCost(Clock::Nanoseconds) << " ns" << std::endl;
+
+	for (int milliseconds : { 10, 100, 1000 }) {
+		Clock::UseSteady();
+		Clock::UseTsc(Clock::Calibrate(std::chrono::milliseconds(milliseconds)));
+		int64_t offset = Clock::Nanoseconds() - MonotonicNanoseconds();
+		std::cout << "calibrated for " << milliseconds << " ms, drift after";
+		for (int seconds = 1; seconds <= 10; seconds++) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			int64_t drift = Clock::Nanoseconds() - MonotonicNanoseconds() - offset;
+			if (seconds == 1 || seconds == 5 || seconds == 10) {
+				std::cout << " " << seconds << "s " << drift / 1000.0 << " us";
+			}
+			if (seconds == 10) {
+				std::cout << " (" << std::setprecision(3) << drift / 10e3 << " ppm)" << std::setprecision(1);
+			}
+		}
+		std::cout << std::endl;
+	}
+	Clock::UseSteady();
+}
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "ColorConvert.h"
+#include "Tests.h"
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/frame.h>
+}
+
+using namespace util;
+
+// A BGRA image with the same row padding ReadPixels gives us.
+struct BgraImage
+{
+	int width;
+	int height;
+	int pitch;
+	std::vector<uint8_t> pixels;
+
+	BgraImage(int w, int h, unsigned int seed) : width(w), height(h)
+	{
+		pitch = ((w * 4 + 63) / 64) * 64;
+		pixels.resize(static_cast<size_t>(pitch) * h);
+		std::mt19937 random(seed);
+		for (auto& p : pixels) {
+			p = static_cast<uint8_t>(random());
+		}
+	}
+};
+
+static AVFrame* AllocYuvFrame(int width, int height, AVPixelFormat format)
+{
+	AVFrame* frame = av_frame_alloc();
+	frame->format = format;
+	frame->width = width;
+	frame->height = height;
+	av_frame_get_buffer(frame, 32);
+	return frame;
+}
+
+static int MaxPlaneDifference(AVFrame* a, AVFrame* b, int plane, int width, int height)
+{
+	int maxDiff = 0;
+	for (int y = 0; y < height; y++) {
+		const uint8_t* pa = a->data[plane] + y * a->linesize[plane];
+		const uint8_t* pb = b->data[plane] + y * b->linesize[plane];
+		for (int x = 0; x < width; x++) {
+			maxDiff = std::max(maxDiff, std::abs(pa[x] - pb[x]));
+		}
+	}
+	return maxDiff;
+}
+
+// The same sws_scale setup FFmpegEncoder used before it had ConvertBgraToYuv420, for the benchmark.
+static SwsContext* CreateSws(const BgraImage& image)
+{
+	return sws_getContext(image.width, image.height, AV_PIX_FMT_BGRA,
+		image.width, image.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+}
+
+static void ScaleWithSws(SwsContext* sws, const BgraImage& image, AVFrame* dst)
+{
+	const uint8_t* src[1] = { image.pixels.data() };
+	int srcStride[1] = { image.pitch };
+	sws_scale(sws, src, srcStride, 0, image.height, dst->data, dst->linesize);
+}
+
+// What ConvertBgraToYuv420 should give: sws_scale converts every pixel to 4:4:4, then the chroma of
+// each 2x2 block is averaged. The bilinear 4:2:0 output of sws_scale can't be the reference, its
+// chroma filter reaches past the block, so on a noisy image it is tens of LSB away from any 2x2 one.
+static AVFrame* ReferenceYuv420(const BgraImage& image)
+{
+	AVFrame* full = AllocYuvFrame(image.width, image.height, AV_PIX_FMT_YUV444P);
+	SwsContext* sws = sws_getContext(image.width, image.height, AV_PIX_FMT_BGRA,
+		image.width, image.height, AV_PIX_FMT_YUV444P, SWS_POINT, NULL, NULL, NULL);
+	ScaleWithSws(sws, image, full);
+	sws_freeContext(sws);
+
+	AVFrame* result = AllocYuvFrame(image.width, image.height, AV_PIX_FMT_YUV420P);
+	for (int y = 0; y < image.height; y++) {
+		::memcpy(result->data[0] + y * result->linesize[0], full->data[0] + y * full->linesize[0], image.width);
+	}
+	for (int plane = 1; plane < 3; plane++) {
+		for (int y = 0; y < image.height / 2; y++) {
+			const uint8_t* s0 = full->data[plane] + (y * 2) * full->linesize[plane];
+			const uint8_t* s1 = s0 + full->linesize[plane];
+			uint8_t* d = result->data[plane] + y * result->linesize[plane];
+			for (int x = 0; x < image.width / 2; x++) {
+				d[x] = static_cast<uint8_t>((s0[x * 2] + s0[x * 2 + 1] + s1[x * 2] + s1[x * 2 + 1] + 2) >> 2);
+			}
+		}
+	}
+	av_frame_free(&full);
+	return result;
+}
+
+void TestColorConvert()
+{
+	std::cout << "Testing BGRA to YUV420 conversion against sws_scale..." << std::endl;
+	CpuLevel best = GetCpuLevel();
+	std::cout << "best cpu level is " << CpuLevelName(best) << std::endl;
+
+	// odd multiples of the SIMD widths make sure the scalar tail is covered.
+	const int sizes[][2] = { { 2, 2 }, { 30, 6 }, { 64, 16 }, { 1278, 720 }, { 1920, 1080 } };
+	for (auto& size : sizes) {
+		BgraImage image(size[0], size[1], size[0]);
+		int cw = image.width / 2;
+		int ch = image.height / 2;
+
+		AVFrame* expected = ReferenceYuv420(image);
+
+		AVFrame* reference = nullptr;
+		for (int level = 0; level <= static_cast<int>(best); level++) {
+			AVFrame* actual = AllocYuvFrame(image.width, image.height, AV_PIX_FMT_YUV420P);
+			ConvertBgraToYuv420(image.pixels.data(), image.pitch, image.width, image.height,
+				actual->data, actual->linesize, YuvFormat::I420, static_cast<CpuLevel>(level));
+
+			int dy = MaxPlaneDifference(expected, actual, 0, image.width, image.height);
+			int du = MaxPlaneDifference(expected, actual, 1, cw, ch);
+			int dv = MaxPlaneDifference(expected, actual, 2, cw, ch);
+			std::string name = std::string(CpuLevelName(static_cast<CpuLevel>(level))) + " " +
+				std::to_string(image.width) + "x" + std::to_string(image.height);
+			Check(dy <= 1 && du <= 1 && dv <= 1, name + " differs from sws_scale by more than 1 LSB");
+
+			// every SIMD path must give bit exact results with the scalar path.
+			if (reference == nullptr) {
+				reference = actual;
+			}
+			else {
+				Check(MaxPlaneDifference(reference, actual, 0, image.width, image.height) == 0 &&
+					MaxPlaneDifference(reference, actual, 1, cw, ch) == 0 &&
+					MaxPlaneDifference(reference, actual, 2, cw, ch) == 0, name + " does not match scalar");
+				av_frame_free(&actual);
+			}
+
+			// NV12 holds the same samples with U and V interleaved.
+			AVFrame* nv12 = AllocYuvFrame(image.width, image.height, AV_PIX_FMT_NV12);
+			ConvertBgraToYuv420(image.pixels.data(), image.pitch, image.width, image.height,
+				nv12->data, nv12->linesize, YuvFormat::NV12, static_cast<CpuLevel>(level));
+			Check(MaxPlaneDifference(reference, nv12, 0, image.width, image.height) == 0, name + " NV12 luma mismatch");
+			for (int y = 0; y < ch; y++) {
+				for (int x = 0; x < cw; x++) {
+					const uint8_t* uv = nv12->data[1] + y * nv12->linesize[1] + x * 2;
+					Check(uv[0] == reference->data[1][y * reference->linesize[1] + x] &&
+						uv[1] == reference->data[2][y * reference->linesize[2] + x], name + " NV12 chroma mismatch");
+				}
+			}
+			av_frame_free(&nv12);
+		}
+		av_frame_free(&reference);
+		av_frame_free(&expected);
+	}
+	std::cout << "ok" << std::endl;
+}
+
+void BenchmarkColorConvert()
+{
+	std::cout << "Benchmarking BGRA to YUV420P conversion..." << std::endl;
+	const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	const int iterations = 200;
+	for (auto& size : sizes) {
+		BgraImage image(size[0], size[1], 1);
+		AVFrame* frame = AllocYuvFrame(image.width, image.height, AV_PIX_FMT_YUV420P);
+
+		auto report = [&](const char* name, auto convert) {
+			convert(); // warmup
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) {
+				convert();
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			double ms = elapsed.count() / iterations;
+			std::cout << std::fixed << std::setprecision(3) << image.width << "x" << image.height << " " << std::setw(10) << name
+				<< " " << ms << " ms/frame " << std::setprecision(0) << (1000.0 / ms) << " fps" << std::endl;
+		};
+
+		SwsContext* sws = CreateSws(image);
+		report("sws_scale", [&]() { ScaleWithSws(sws, image, frame); });
+		sws_freeContext(sws);
+		for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+			report(CpuLevelName(static_cast<CpuLevel>(level)), [&]() {
+				ConvertBgraToYuv420(image.pixels.data(), image.pitch, image.width, image.height,
+					frame->data, frame->linesize, YuvFormat::I420, static_cast<CpuLevel>(level));
+			});
+		}
+		av_frame_free(&frame);
+	}
+}
@@ -9,58 +9,48 @@
 #include <numeric> // For std::accumulate
 #include "Timer.h"
 #include "FpsThrottle.h"
+#include "Tests.h"
 #undef min
 #undef max
 
 using namespace util;
 
-struct MinMaxAvg
-{
-	double min;
-	double max;
-	double avg;
-
-	static MinMaxAvg GetStats(std::vector<double> data) {
-		double min = std::numeric_limits<double>::max();
-		double max = std::numeric_limits<double>::min();
-		double sum = 0;
-		for (auto d : data) {
-			if (d < min) min = d;
-			if (d > max) max = d;
-			sum += std::abs(d);
-		}
-		return { min, max, sum / data.size() };
-	}
-};
-
+// Sleeps of each length with each SleepPolicy for about a second, reporting how late they wake up and
+// how much of a core they burn to do it. A sleep must never wake up early.
 void TestTimer()
 {
-	Timer t;
-	t.Start();
-
-	uint64_t microseconds = 1000000;
-	std::vector<double> errors;
-	errors.reserve(microseconds);
-
-	while (microseconds > 1) {
-		errors.clear();
+	const SleepPolicy policies[] = { SleepPolicy::Precise, SleepPolicy::Balanced, SleepPolicy::LowPower };
+	const char* names[] = { "precise  ", "balanced ", "low power" };
+	for (int64_t microseconds : { 10000, 1000, 100, 10 }) {
 		std::cout << "testing sleep for " << microseconds << " microseconds" << std::endl;
-		auto iterations = 10000000 / microseconds; // 10 seconds each
-
-		for (int i = 0; i < iterations; i++) {
-			util::Timer timer = util::Timer();
-			timer.Start();
-			timer.Sleep(microseconds);
-			auto seconds = timer.Seconds();
-			auto error = seconds - (microseconds / 1000000.0);
-			errors.push_back(error);
+		for (int p = 0; p < 3; p++) {
+			Timer timer;
+			timer.SetPolicy(policies[p]);
+			for (int i = 0; i < 20; i++) {
+				timer.Sleep(microseconds); // learn the overshoots first.
+			}
+			int64_t iterations = std::max<int64_t>(1000000 / microseconds, 100);
+			std::vector<double> errors;
+			errors.reserve(iterations);
+			Timer wall;
+			wall.Start();
+			double cpuStart = Timer::ThreadCpuSeconds();
+			for (int64_t i = 0; i < iterations; i++) {
+				timer.Start();
+				timer.Sleep(microseconds);
+				errors.push_back(timer.Microseconds() - microseconds);
+			}
+			double cpu = (Timer::ThreadCpuSeconds() - cpuStart) / wall.Seconds();
+			std::sort(errors.begin(), errors.end());
+			auto percentile = [&](double p) {
+				return errors[std::min(errors.size() - 1, static_cast<size_t>(p * errors.size()))];
+			};
+			std::cout << std::fixed << std::setprecision(1) << names[p] << " late p50=" << percentile(0.5) << "us p99="
+				<< percentile(0.99) << "us max=" << errors.back() << "us, cpu " << cpu * 100 << "%, spinning "
+				<< timer.SpinMicroseconds() << "us" << std::endl;
+			// Microseconds rounds down, so it can be a microsecond short.
+			Check(errors.front() >= -1, "a sleep of " + std::to_string(microseconds) + " microseconds woke up " + std::to_string(-errors.front()) + " early");
 		}
-
-		auto sleep_stats = MinMaxAvg::GetStats(errors);
-
-		std::cout << std::fixed << std::setprecision(6) << "sleep errors min=" << sleep_stats.min << " max=" << sleep_stats.max << " avg=" << sleep_stats.avg << std::endl;
-		
-		microseconds /= 10;
 	}
 }
 
@@ -90,10 +80,74 @@ void TestFpsThrottle() {
 	std::cout << "min=" << minStep << " max=" << maxStep << " mean=" << mean << std::endl;
 }
 
+struct TestCase
+{
+	const char* name;
+	void (*run)();
+};
 
+const TestCase tests[] = {
+	{ "FpsThrottle", TestFpsThrottle },
+	{ "Timer", TestTimer },
+	{ "ColorConvert", TestColorConvert },
+	{ "BenchmarkColorConvert", BenchmarkColorConvert },
+	{ "SpscQueue", TestSpscQueue },
+	{ "FramePipeline", TestFramePipeline },
+	{ "FFmpegPipeline", TestFFmpegPipeline },
+	{ "StreamingContainers", TestStreamingContainers },
+	{ "Segments", TestSegments },
+	{ "Replay", TestReplay },
+	{ "BenchmarkPipeline", BenchmarkPipeline },
+	{ "BenchmarkMultiStream", BenchmarkMultiStream },
+	{ "EncoderOptions", TestEncoderOptions },
+	{ "BenchmarkProfiles", BenchmarkProfiles },
+	{ "VariableFrameRate", TestVariableFrameRate },
+	{ "Mailbox", TestMailbox },
+	{ "BenchmarkMailbox", BenchmarkMailbox },
+	{ "ResourcePool", TestResourcePool },
+	{ "ReadbackRing", TestReadbackRing },
+	{ "PixelConvert", TestPixelConvert },
+	{ "BenchmarkPixelConvert", BenchmarkPixelConvert },
+	{ "Resize", TestResize },
+	{ "BenchmarkResize", BenchmarkResize },
+	{ "RegionPlan", TestRegionPlan },
+	{ "TimingLog", TestTimingLog },
+	{ "Trace", TestTrace },
+	{ "BenchmarkTrace", BenchmarkTrace },
+	{ "OutputSink", TestOutputSink },
+	{ "BenchmarkOutputSink", BenchmarkOutputSink },
+	{ "ReplayBuffer", TestReplayBuffer },
+	{ "ChangeDetector", TestChangeDetector },
+	{ "BenchmarkChangeDetector", BenchmarkChangeDetector },
+	{ "HoldLastFrame", TestHoldLastFrame },
+	{ "LoadController", TestLoadController },
+	{ "Clock", TestClock },
+	{ "BenchmarkClock", BenchmarkClock },
+	{ "FpsThrottleSchedule", TestFpsThrottleSchedule },
+	{ "FrameBuffers", TestFrameBuffers },
+};
 
-int main()
+// Runs all tests, or just the ones named on the command line.
+int main(int argc, char* argv[])
 {
-	TestFpsThrottle();
-	TestTimer();
+	int failed = 0;
+	for (auto& test : tests) {
+		bool selected = (argc < 2);
+		for (int i = 1; i < argc; i++) {
+			if (std::string(argv[i]) == test.name) {
+				selected = true;
+			}
+		}
+		if (!selected) {
+			continue;
+		}
+		try {
+			test.run();
+		}
+		catch (const std::exception& e) {
+			std::cout << test.name << " failed: " << e.what() << std::endl;
+			failed++;
+		}
+	}
+	return failed;
 }
\ No newline at end of file
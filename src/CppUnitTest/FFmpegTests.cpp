@@ -0,0 +1,24 @@
+// FFmpegTests.cpp : The tests that need FFmpeg but no Windows or GPU, for the CMake build on Linux
+// when the FFmpeg development packages are installed. CppUnitTest.cpp runs these on Windows.
+
+#include "Tests.h"
+#include "TestRunner.h"
+
+const TestCase tests[] = {
+	{ "ColorConvert", TestColorConvert, false },
+	{ "BenchmarkColorConvert", BenchmarkColorConvert, true },
+	{ "FFmpegPipeline", TestFFmpegPipeline, false },
+	{ "StreamingContainers", TestStreamingContainers, false },
+	{ "VariableFrameRate", TestVariableFrameRate, false },
+	{ "EncoderOptions", TestEncoderOptions, false },
+	{ "Segments", TestSegments, false },
+	{ "Replay", TestReplay, false },
+	{ "BenchmarkPipeline", BenchmarkPipeline, true },
+	{ "BenchmarkMultiStream", BenchmarkMultiStream, true },
+	{ "BenchmarkProfiles", BenchmarkProfiles, true },
+};
+
+int main(int argc, char* argv[])
+{
+	return RunTests(tests, argc, argv);
+}
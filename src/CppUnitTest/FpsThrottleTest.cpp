@@ -0,0 +1,167 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "FpsThrottle.h"
+#include "Tests.h"
+
+using namespace util;
+
+static double Ms(int64_t nanoseconds)
+{
+	return Clock::ToMilliseconds(nanoseconds);
+}
+
+// However long each step of the loop takes, as long as it is shorter than a frame, the steps stay on
+// the schedule so the total time is the number of steps times the interval.
+static void TestNoDrift()
+{
+	const double fps = 100;
+	const int steps = 200;
+	FpsThrottle throttle(fps, CatchUpPolicy::SkipMissed);
+	std::mt19937 random(7);
+	std::uniform_int_distribution<int> work(0, 6000);
+	throttle.Step();
+	int64_t start = Clock::Nanoseconds();
+	int early = 0;
+	for (int i = 0; i < steps; i++) {
+		std::this_thread::sleep_for(std::chrono::microseconds(work(random)));
+		throttle.Step();
+		if (Clock::Nanoseconds() < throttle.LastDeadline()) {
+			early++;
+		}
+	}
+	double elapsed = Ms(Clock::Nanoseconds() - start);
+	double expected = steps * 1000 / fps;
+	ThrottleStats stats = throttle.Stats();
+	std::cout << "  " << steps << " steps with random work took " << elapsed << " ms for " << expected << " ms, "
+		<< stats.missed << " missed" << std::endl;
+	// a whole frame of slack for the last step being late and any missed frames on a busy machine.
+	Check(elapsed >= expected - 1 && elapsed <= expected + (1 + stats.missed) * 1000 / fps + 2,
+		"steps should not drift from the schedule");
+	Check(stats.steps == steps + 1, "every step should be counted");
+	Check(early == 0, std::to_string(early) + " steps returned before their deadline");
+}
+
+// Steps once, stalls for 3.5 frames and returns the ms each of the next steps waited and the time
+// they returned at after the first one.
+static void Stall(CatchUpPolicy policy, std::vector<double>& waits, std::vector<double>& times, uint64_t& missed)
+{
+	FpsThrottle throttle(100, policy);
+	throttle.Step();
+	int64_t start = Clock::Nanoseconds();
+	std::this_thread::sleep_for(std::chrono::microseconds(35000));
+	for (int i = 0; i < 5; i++) {
+		waits.push_back(throttle.Step() * 1000);
+		times.push_back(Ms(Clock::Nanoseconds() - start));
+	}
+	missed = throttle.Stats().missed;
+}
+
+static void TestCatchUp()
+{
+	std::vector<double> waits, times;
+	uint64_t missed = 0;
+
+	Stall(CatchUpPolicy::Burst, waits, times, missed);
+	// deadlines at 10, 20 and 30 ms have passed, they return right away, then 40 and 50 are waited for.
+	Check(waits[0] == 0 && waits[1] == 0 && waits[2] == 0 && waits[3] > 0, "burst should run the missed steps back to back");
+	Check(std::abs(times[4] - 50) < 3 && missed == 0, "burst should stay on the original schedule");
+
+	waits.clear();
+	times.clear();
+	Stall(CatchUpPolicy::SkipMissed, waits, times, missed);
+	// 10 and 20 are skipped, the step for 30 is late and returns right away, then 40, 50 and so on.
+	Check(waits[0] == 0 && waits[1] > 0, "skip missed should return one late step and then wait");
+	Check(std::abs(times[1] - 40) < 3 && std::abs(times[2] - 50) < 3 && missed == 2, "skip missed should stay on the schedule");
+
+	waits.clear();
+	times.clear();
+	Stall(CatchUpPolicy::Reanchor, waits, times, missed);
+	// the schedule starts over at about 35 ms.
+	Check(waits[0] == 0 && waits[1] > 0, "reanchor should return once and then wait");
+	Check(std::abs(times[1] - times[0] - 10) < 3 && std::abs(times[1] - 40) > 2 && missed == 2, "reanchor should start a new schedule from the late step");
+	std::cout << "  catch up policies ok" << std::endl;
+}
+
+// Frames arriving at a fixed phase pull the steps to lead after them, an odd arrival at another phase
+// only moves them a little.
+static void TestAlign()
+{
+	const int64_t interval = 20000000;
+	const int64_t lead = 1000000;
+	FpsThrottle throttle(50);
+	throttle.Step();
+	int64_t arrival = Clock::Nanoseconds() - 7000000;
+	for (int i = 0; i < 40; i++) {
+		throttle.AlignTo(arrival, lead);
+	}
+	std::vector<double> phases;
+	for (int i = 0; i < 5; i++) {
+		throttle.Step();
+		int64_t phase = (Clock::Nanoseconds() - arrival - lead) % interval;
+		phases.push_back(Ms(phase > interval / 2 ? phase - interval : phase));
+	}
+	std::sort(phases.begin(), phases.end());
+	std::cout << "  median step after the frame arrival plus lead: " << phases[2] << " ms" << std::endl;
+	Check(phases[2] > -0.5 && phases[2] < 2, "steps should line up with the frame arrivals");
+
+	// an arrival half a frame off moves the schedule by no more than an eighth of a frame.
+	throttle.Step();
+	int64_t phaseBefore = (Clock::Nanoseconds() - arrival - lead) % interval;
+	throttle.AlignTo(arrival + interval / 2 - 1000, lead);
+	throttle.Step();
+	int64_t phaseAfter = (Clock::Nanoseconds() - arrival - lead) % interval;
+	double moved = Ms(std::abs(phaseAfter - phaseBefore));
+	Check(moved < Ms(interval / 8) + 2, "one odd arrival should only move the schedule a little");
+
+	// no arrival yet and a throttle that has not started are left alone.
+	throttle.AlignTo(0);
+	FpsThrottle idle(50);
+	idle.AlignTo(arrival);
+	Check(idle.Step() == 0, "the first step should start the schedule");
+}
+
+static void TestThrottleStats()
+{
+	FpsThrottle throttle(200);
+	throttle.Step();
+	for (int i = 0; i < 50; i++) {
+		throttle.Step();
+	}
+	ThrottleStats stats = throttle.Stats();
+	std::cout << std::fixed << std::setprecision(3) << "  lateness p50=" << stats.p50 * 1e6 << "us p90=" << stats.p90 * 1e6
+		<< "us p99=" << stats.p99 * 1e6 << "us max=" << stats.max * 1e6 << "us" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	Check(stats.steps == 51 && stats.missed == 0, "stats should count the steps");
+	Check(stats.p50 <= stats.p90 && stats.p90 <= stats.p99 && stats.p99 <= stats.p999 && stats.p999 <= stats.max * 1.05,
+		"percentiles should be in order");
+
+	double seconds[256];
+	uint64_t counts[256];
+	size_t buckets = throttle.Histogram().Read(seconds, counts, 256);
+	uint64_t total = 0;
+	for (size_t i = 0; i < buckets; i++) {
+		total += counts[i];
+		Check(i == 0 || seconds[i] > seconds[i - 1], "histogram buckets should be in order");
+	}
+	// the first step has no deadline so it is not in the histogram.
+	Check(buckets > 0 && total == 50, "histogram should hold every step after the first");
+
+	throttle.Reset();
+	Check(throttle.Step() == 0, "the first step after reset should start a new schedule");
+	Check(throttle.Stats().steps == 52, "reset should keep the statistics");
+}
+
+void TestFpsThrottleSchedule()
+{
+	std::cout << "Testing the FpsThrottle schedule..." << std::endl;
+	TestNoDrift();
+	TestCatchUp();
+	TestAlign();
+	TestThrottleStats();
+}
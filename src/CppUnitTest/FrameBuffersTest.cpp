@@ -0,0 +1,97 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include "FrameBuffers.h"
+#include "Tests.h"
+
+using namespace util;
+
+static void TestLendAndReturn()
+{
+	const size_t size = 1920 * 1080 * 3;
+	FrameBufferLender lender(64, 3);
+	uint8_t* a = lender.Lend(size);
+	uint8_t* b = lender.Lend(size);
+	uint8_t* c = lender.Lend(size);
+	Check(a != nullptr && b != nullptr && c != nullptr && a != b && b != c && a != c, "should lend distinct buffers");
+	for (uint8_t* buffer : { a, b, c }) {
+		Check(reinterpret_cast<uintptr_t>(buffer) % 64 == 0, "buffers should be aligned");
+		::memset(buffer, 0x5a, size); // the whole size is usable, ASan would catch an overrun.
+	}
+	Check(lender.Lend(size) == nullptr, "no more than maxBuffers should be lent");
+	Check(lender.Lent() == 3, "three buffers are out");
+
+	Check(lender.Return(b), "a lent buffer should be returned");
+	Check(!lender.Return(b), "a buffer should only be returned once");
+	int local = 0;
+	Check(!lender.Return(&local), "an address that was not lent should be refused");
+
+	// the next frame of the same size reuses the returned buffer instead of allocating one.
+	uint8_t* d = lender.Lend(size);
+	Check(d == b, "a returned buffer should be reused");
+	PoolStats stats = lender.GetStats();
+	Check(stats.created == 3 && stats.reused == 1, "lending every frame should not allocate every frame");
+
+	// a frame of another size gets its own buffer once one is free.
+	lender.Return(a);
+	uint8_t* e = lender.Lend(640 * 480 * 4);
+	Check(e != nullptr && lender.GetStats().created == 4, "another size should get a new buffer");
+	lender.Return(c);
+	lender.Return(d);
+	lender.Return(e);
+	Check(lender.Lent() == 0, "everything is back");
+}
+
+// Closing stops lending but keeps the buffers that are out valid until they come back.
+static void TestClose()
+{
+	FrameBufferLender lender(0x1000, 2);
+	uint8_t* a = lender.Lend(100);
+	Check(a != nullptr && reinterpret_cast<uintptr_t>(a) % 0x1000 == 0, "page alignment should work too");
+	Check(!lender.Close() && !lender.Done(), "a lender with buffers out is not done");
+	Check(lender.Lend(100) == nullptr, "a closed lender should not lend");
+	a[99] = 1; // still ours.
+	Check(lender.Return(a) && lender.Done(), "the lender is done when the last buffer is back");
+
+	FrameBufferLender empty(64, 2);
+	Check(empty.Close() && empty.Done(), "a lender with nothing out can be freed right away");
+}
+
+// Python returns buffers from whatever thread drops the last reference to a frame.
+static void TestReturnFromThreads()
+{
+	FrameBufferLender lender(64, 8);
+	std::vector<std::thread> threads;
+	std::atomic<int> failures{ 0 };
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (int i = 0; i < 2000; i++) {
+				uint8_t* buffer = lender.Lend(4096);
+				if (buffer == nullptr) {
+					continue; // the other threads hold them all.
+				}
+				buffer[0] = static_cast<uint8_t>(i);
+				if (!lender.Return(buffer)) {
+					failures++;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	Check(failures == 0 && lender.Lent() == 0, "buffers should be lent and returned from many threads");
+	Check(lender.GetStats().created <= 8, "no more than maxBuffers should ever be allocated");
+}
+
+void TestFrameBuffers()
+{
+	std::cout << "Testing the frame buffer lender..." << std::endl;
+	TestLendAndReturn();
+	TestClose();
+	TestReturnFromThreads();
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include "SpscQueue.h"
+#include "FramePipeline.h"
+#include "Tests.h"
+
+using namespace util;
+
+void TestSpscQueue()
+{
+	std::cout << "Testing SpscQueue..." << std::endl;
+	SpscQueue<int> queue(3);
+	Check(queue.Capacity() == 3, "capacity should be 3");
+	Check(queue.TryPush(1) && queue.TryPush(2) && queue.TryPush(3), "push into empty queue failed");
+	Check(!queue.TryPush(4), "push into full queue should fail");
+	int value = 0;
+	Check(queue.TryPop(value) && value == 1, "pop should return the first item");
+	Check(queue.Size() == 2, "size should be 2");
+
+	// one producer and one consumer thread, everything must arrive exactly once and in order.
+	SpscQueue<int> shared(16);
+	const int count = 1000000;
+	std::thread producer([&]() {
+		for (int i = 0; i < count; i++) {
+			while (!shared.TryPush(i)) {
+				std::this_thread::yield();
+			}
+		}
+	});
+	int expected = 0;
+	while (expected < count) {
+		if (shared.TryPop(value)) {
+			Check(value == expected, "items arrived out of order");
+			expected++;
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	Check(!shared.TryPop(value), "queue should be empty");
+}
+
+struct TestFrame
+{
+	int index = -1;
+	std::vector<int> visited;
+};
+
+// Runs count frames through three stages, the middle one taking stageDelay.
+static void RunTestPipeline(FramePipeline<TestFrame>& pipeline, int count,
+	std::chrono::microseconds sourceDelay, std::chrono::microseconds stageDelay, std::vector<int>& output)
+{
+	int next = 0;
+	pipeline.SetSource("source", [&, count, sourceDelay](TestFrame* frame) {
+		if (next == count) {
+			return false;
+		}
+		std::this_thread::sleep_for(sourceDelay);
+		if (frame != nullptr) {
+			frame->index = next;
+			frame->visited.clear();
+		}
+		next++;
+		return true;
+	});
+	for (int stage = 0; stage < 3; stage++) {
+		pipeline.AddStage("stage" + std::to_string(stage), [stage, stageDelay](TestFrame& frame) {
+			if (stage == 1) {
+				std::this_thread::sleep_for(stageDelay);
+			}
+			frame.visited.push_back(stage);
+		});
+	}
+	pipeline.AddStage("sink", [&output](TestFrame& frame) {
+		Check(frame.visited == std::vector<int>({ 0, 1, 2 }), "frame skipped a stage");
+		output.push_back(frame.index);
+	});
+	pipeline.Run();
+}
+
+void TestFramePipeline()
+{
+	std::cout << "Testing FramePipeline..." << std::endl;
+	{
+		// Block must deliver every frame in order even when one stage is slow.
+		FramePipeline<TestFrame> pipeline(2, DropPolicy::Block);
+		std::vector<int> output;
+		RunTestPipeline(pipeline, 200, std::chrono::microseconds(0), std::chrono::microseconds(200), output);
+		Check(output.size() == 200, "Block policy lost frames");
+		for (int i = 0; i < 200; i++) {
+			Check(output[i] == i, "Block policy delivered frames out of order");
+		}
+		Check(pipeline.Dropped() == 0, "Block policy should not drop frames");
+		auto stats = pipeline.GetStats();
+		Check(stats.size() == 5 && stats[0].frames == 200 && stats[4].frames == 200, "wrong stage stats");
+		Check(stats[2].p50 >= 150e-6 && stats[2].p50 <= stats[2].p95 && stats[2].p95 <= stats[2].p99,
+			"the slow stage should take at least its sleep per frame");
+	}
+	{
+		// DropNewest keeps the source at its own pace and drops what the slow stage can't take.
+		FramePipeline<TestFrame> pipeline(2, DropPolicy::DropNewest);
+		std::vector<int> output;
+		RunTestPipeline(pipeline, 200, std::chrono::microseconds(100), std::chrono::microseconds(2000), output);
+		std::cout << "DropNewest delivered " << output.size() << " frames and dropped " << pipeline.Dropped() << std::endl;
+		Check(output.size() + pipeline.Dropped() == 200, "DropNewest lost frames without counting them");
+		Check(pipeline.Dropped() > 0, "DropNewest should have dropped frames");
+		for (size_t i = 1; i < output.size(); i++) {
+			Check(output[i] > output[i - 1], "DropNewest delivered frames out of order");
+		}
+	}
+	{
+		// an exception in a stage stops the pipeline and comes back out of Run.
+		FramePipeline<TestFrame> pipeline(3, DropPolicy::Block);
+		int produced = 0;
+		pipeline.SetSource("source", [&](TestFrame* frame) {
+			frame->index = produced++;
+			return true;
+		});
+		pipeline.AddStage("fail", [](TestFrame& frame) {
+			if (frame.index == 10) {
+				throw std::runtime_error("stage failed");
+			}
+		});
+		bool threw = false;
+		try {
+			pipeline.Run();
+		}
+		catch (const std::exception& e) {
+			threw = std::string(e.what()) == "stage failed";
+		}
+		Check(threw, "stage error was not reported");
+	}
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "FrameSource.h"
+#include "Tests.h"
+
+using namespace util;
+
+// Delivers frameRate frames per second except between pauseStart and pauseEnd seconds, where it
+// sends nothing like a screen capture of a still screen, and waits for the next frame like it does.
+class PausingFrameSource : public FrameSource
+{
+	int _frameRate;
+	double _pauseStart;
+	double _pauseEnd;
+	uint64_t _next = 0;
+	std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+	double FrameTime(uint64_t index) const {
+		return static_cast<double>(index) / _frameRate;
+	}
+
+	// The next frame index that is not inside the pause.
+	uint64_t NextFrame() const {
+		uint64_t index = _next;
+		while (FrameTime(index) >= _pauseStart && FrameTime(index) < _pauseEnd) {
+			index++;
+		}
+		return index;
+	}
+
+	double Now() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+public:
+	PausingFrameSource(int frameRate, double pauseStart, double pauseEnd)
+		: _frameRate(frameRate), _pauseStart(pauseStart), _pauseEnd(pauseEnd) {
+	}
+
+	FrameFormat GetFormat() override {
+		return FrameFormat{ 16, 16, 64 };
+	}
+
+	double AcquireFrame(std::shared_ptr<void>& frame) override {
+		double time = 0;
+		TryAcquireFrame(frame, 1e9, time);
+		return time;
+	}
+
+	bool TryAcquireFrame(std::shared_ptr<void>& frame, double timeout, double& time) override {
+		uint64_t index = NextFrame();
+		double wait = FrameTime(index) - Now();
+		if (wait > timeout) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+			return false;
+		}
+		if (wait > 0) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+		}
+		_next = index + 1;
+		frame = std::make_shared<uint64_t>(index);
+		time = Now();
+		return true;
+	}
+
+	void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) override {
+		::memset(buffer, static_cast<int>(*static_cast<uint64_t*>(frame.get())), size);
+	}
+};
+
+// The screen goes still for a second in the middle, the encoder still has to get a frame every
+// interval and the repeats have to be the last frame that arrived.
+void TestHoldLastFrame()
+{
+	std::cout << "Testing hold last frame..." << std::endl;
+	const int frameRate = 30;
+	const double interval = 1.0 / frameRate;
+	PausingFrameSource paused(frameRate, 0.5, 1.5);
+	HoldLastFrameSource source(paused, frameRate);
+	auto start = std::chrono::steady_clock::now();
+	double last = 0;
+	double longest = 0;
+	uint64_t frames = 0;
+	uint64_t lastIndex = 0;
+	uint8_t pixels[64 * 16];
+	while (true) {
+		std::shared_ptr<void> frame;
+		if (source.AcquireFrame(frame) < 0) {
+			break;
+		}
+		double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (frames > 0) {
+			longest = std::max(longest, now - last);
+		}
+		last = now;
+		frames++;
+		uint64_t index = *static_cast<uint64_t*>(frame.get());
+		Check(index >= lastIndex, "frames went back in time");
+		if (now > 0.6 && now < 1.4) {
+			Check(index == static_cast<uint64_t>(0.5 * frameRate) - 1, "the frame before the pause should be repeated");
+		}
+		source.ReadFrame(frame, pixels, sizeof(pixels));
+		Check(pixels[0] == static_cast<uint8_t>(index), "the repeated frame should read the same pixels");
+		lastIndex = index;
+		if (now >= 2) {
+			break;
+		}
+	}
+	std::cout << frames << " frames in 2 seconds, " << source.Repeated() << " repeated, longest gap "
+		<< std::fixed << std::setprecision(1) << longest * 1000 << " ms" << std::endl;
+	// sleeps can run a few milliseconds long, but never anywhere near the length of the pause.
+	Check(longest < interval * 2, "the frame rate stalled for " + std::to_string(longest) + " seconds");
+	Check(source.Repeated() >= frameRate * 1 * 8 / 10 && source.Repeated() <= frameRate * 1 + 2,
+		"expected about a second of repeated frames, got " + std::to_string(source.Repeated()));
+	Check(frames >= 2 * frameRate * 8 / 10, "the frame rate dropped to " + std::to_string(frames / 2.0) + " fps");
+	std::cout << "ok" << std::endl;
+}
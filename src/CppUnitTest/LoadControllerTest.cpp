@@ -0,0 +1,200 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <string>
+#include "LoadController.h"
+#include "FramePipeline.h"
+#include "Tests.h"
+
+using namespace util;
+
+// A bottleneck stage in simulated time that takes cost(fps) seconds per frame, where fps is the rate
+// the controller keeps, fed by a source at frameRate that drops what doesn't fit in depth frames.
+struct SimulatedStage
+{
+	LoadController& controller;
+	double frameRate;
+	size_t depth = 3;
+	double assigned = 0;            // seconds of work handed to the stage so far.
+	double busyUntil = 0;           // when the stage gets through what it has.
+	std::deque<double> finishTimes{}; // of the frames in flight.
+	uint64_t dropped = 0;
+	uint64_t kept = 0;
+
+	void Run(double from, double to, const std::function<double(double)>& cost)
+	{
+		std::vector<double> busy(1);
+		for (uint64_t i = static_cast<uint64_t>(from * frameRate); i < static_cast<uint64_t>(to * frameRate); i++) {
+			double time = i / frameRate;
+			while (!finishTimes.empty() && finishTimes.front() <= time) {
+				finishTimes.pop_front();
+			}
+			if (!controller.Keep(time)) {
+				continue;
+			}
+			kept++;
+			bool full = finishTimes.size() >= depth;
+			busy[0] = assigned - std::max(0.0, busyUntil - time);
+			controller.Update(time, busy, dropped, full);
+			if (full) {
+				dropped++;
+				continue;
+			}
+			double seconds = cost(controller.FrameRate());
+			busyUntil = std::max(busyUntil, time) + seconds;
+			assigned += seconds;
+			finishTimes.push_back(busyUntil);
+		}
+	}
+};
+
+static std::function<double(double)> Load(double load, double atFrameRate)
+{
+	return [=](double) { return load / atFrameRate; };
+}
+
+static std::string Describe(const LoadController& controller)
+{
+	std::string text;
+	for (auto& adjustment : controller.Adjustments()) {
+		text += " " + std::to_string(adjustment.time).substr(0, 5) + "s:" + std::to_string(static_cast<int>(adjustment.frameRate + 0.5));
+	}
+	return text;
+}
+
+static void TestLoadControllerSteady()
+{
+	{
+		// plenty of room, nothing changes.
+		LoadController controller(60);
+		SimulatedStage stage{ controller, 60 };
+		stage.Run(0, 60, Load(0.6, 60));
+		Check(controller.Adjustments().empty() && stage.kept == 3600, "a load that fits should not change anything");
+	}
+	{
+		// 130% busy at 60 fps steps down to 45 (still 97%) and then 30 (65%), and stays there because
+		// going back to 45 would not leave enough room.
+		LoadController controller(60);
+		SimulatedStage stage{ controller, 60 };
+		stage.Run(0, 120, Load(1.3, 60));
+		std::cout << "130% load:" << Describe(controller) << std::endl;
+		Check(controller.FrameRate() == 30, "130% load should settle at 30 fps, got " + std::to_string(controller.FrameRate()));
+		Check(controller.Adjustments().size() == 2, "130% load should take two steps and stay," + Describe(controller));
+		Check(controller.Adjustments().back().time < 5, "130% load should settle within seconds");
+		uint64_t keptBefore = stage.kept;
+		stage.Run(120, 180, Load(1.3, 60));
+		Check(stage.kept - keptBefore >= 59 * 30 && stage.kept - keptBefore <= 61 * 30, "30 fps should keep half the frames");
+	}
+	{
+		// exactly full at 60 fps is falling behind, 45 fps is 75% and stepping back would be 100%.
+		LoadController controller(60);
+		SimulatedStage stage{ controller, 60 };
+		stage.Run(0, 120, Load(1.0, 60));
+		Check(controller.FrameRate() == 45 && controller.Adjustments().size() == 1, "100% load should settle at 45 fps," + Describe(controller));
+	}
+	{
+		// never below the minimum, however busy.
+		LoadController controller(60, 30);
+		SimulatedStage stage{ controller, 60 };
+		stage.Run(0, 60, Load(4, 60));
+		Check(controller.FrameRate() == 30, "the frame rate went below the minimum");
+	}
+}
+
+static void TestLoadControllerRecovers()
+{
+	// a burst of load, e.g. another program compiling, then back to normal.
+	LoadController controller(60);
+	SimulatedStage stage{ controller, 60 };
+	stage.Run(0, 10, Load(3, 60));
+	Check(controller.FrameRate() == 15, "300% load should go down to the lowest step, got " + std::to_string(controller.FrameRate()));
+	size_t down = controller.Adjustments().size();
+	stage.Run(10, 60, Load(0.3, 60));
+	std::cout << "burst:" << Describe(controller) << std::endl;
+	Check(controller.Level() == 0, "the frame rate should recover once the load is gone");
+	Check(controller.Adjustments().size() == down * 2, "it should recover one step at a time without going down again," + Describe(controller));
+}
+
+static void TestLoadControllerBacksOff()
+{
+	// costs more per frame at higher frame rates, so 30 fps looks like 45 fps would fit but it doesn't.
+	// Every failed step up makes it wait twice as long before the next try, up to a minute or so,
+	// where trying every 4 seconds would be 150 changes.
+	LoadController controller(60);
+	SimulatedStage stage{ controller, 60 };
+	auto cost = [](double fps) { return fps > 40 ? 0.95 / fps : 0.45 / fps; };
+	stage.Run(0, 300, cost);
+	auto adjustments = controller.Adjustments();
+	std::cout << "unpredictable load: " << adjustments.size() << " changes in 300 seconds" << std::endl;
+	Check(adjustments.size() <= 20, "the frame rate flip flopped," + Describe(controller));
+	std::vector<double> upTimes;
+	for (size_t i = 1; i < adjustments.size(); i++) {
+		if (adjustments[i].frameRate > adjustments[i - 1].frameRate) {
+			upTimes.push_back(adjustments[i].time);
+		}
+	}
+	Check(upTimes.size() >= 3, "it should keep trying to step up now and then");
+	Check(upTimes.back() - upTimes[upTimes.size() - 2] > 60, "it should wait about a minute between tries by now");
+	for (size_t i = 2; i < upTimes.size(); i++) {
+		Check(upTimes[i] - upTimes[i - 1] > upTimes[i - 1] - upTimes[i - 2] - 1, "failed step ups should be tried less and less often");
+	}
+}
+
+// The real thing: a FramePipeline with a stage that can only do about 66 frames per second behind a
+// source of 100, the way FFmpegPipeline wires it up. It should find 50 fps and stay there.
+static void TestLoadControllerPipeline()
+{
+	const int frameRate = 100;
+	const double seconds = 3;
+	LoadControllerSettings settings;
+	settings.window = 0.25;
+	LoadController controller(frameRate, 0, settings);
+	FramePipeline<int> pipeline(3, DropPolicy::Block);
+	auto start = std::chrono::steady_clock::now();
+	uint64_t index = 0;
+	std::vector<double> busy;
+	pipeline.SetSource("capture", [&](int* frame) {
+		double time = 0;
+		do {
+			std::this_thread::sleep_until(start + std::chrono::microseconds(index * 1000000 / frameRate));
+			time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			index++;
+			if (time > seconds) {
+				return false;
+			}
+		} while (!controller.Keep(time));
+		pipeline.GetBusySeconds(busy);
+		controller.Update(time, busy, pipeline.Dropped(), pipeline.InFlight() == pipeline.Depth());
+		if (frame != nullptr) {
+			*frame = static_cast<int>(index);
+		}
+		return true;
+	});
+	pipeline.AddStage("readback", [](int&) {});
+	pipeline.AddStage("encode", [](int&) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(15));
+	});
+	uint64_t encoded = 0;
+	pipeline.AddStage("mux", [&](int&) {
+		encoded++;
+	});
+	pipeline.Run();
+	std::cout << "pipeline:" << Describe(controller) << ", " << encoded << " frames" << std::endl;
+	Check(controller.FrameRate() == 50, "a stage that can do 66 fps should end up at 50, got " + std::to_string(controller.FrameRate()));
+	Check(controller.Adjustments().size() <= 3, "the pipeline did not settle," + Describe(controller));
+	Check(controller.Thinned() + encoded == index - 1, "frames went missing");
+}
+
+void TestLoadController()
+{
+	std::cout << "Testing the adaptive frame rate controller..." << std::endl;
+	TestLoadControllerSteady();
+	TestLoadControllerRecovers();
+	TestLoadControllerBacksOff();
+	TestLoadControllerPipeline();
+	std::cout << "ok" << std::endl;
+}
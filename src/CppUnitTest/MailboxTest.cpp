@@ -0,0 +1,187 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include "Mailbox.h"
+#include "Tests.h"
+
+using namespace util;
+
+// Big enough that a torn read would show up as mismatched words.
+struct TestLetter
+{
+	uint64_t words[8] = { 0 };
+};
+
+void TestMailbox()
+{
+	std::cout << "Testing Mailbox..." << std::endl;
+	{
+		Mailbox<int> mailbox;
+		int value = 0;
+		double time = 0;
+		uint64_t sequence = 0;
+		Check(!mailbox.Read(value, time, sequence), "empty mailbox should have nothing to read");
+		Check(mailbox.Publish(42, 1.5), "publish failed");
+		Check(mailbox.Read(value, time, sequence) && value == 42 && time == 1.5 && sequence == 1, "read the wrong value");
+		Check(mailbox.Publish(43, 2.5) && mailbox.Sequence() == 2, "sequence should be 2");
+		Check(mailbox.Read(value, time, sequence) && value == 43 && sequence == 2, "read the wrong value");
+	}
+	{
+		// Clear must let go of everything that is not being read.
+		auto frame = std::make_shared<int>(1);
+		Mailbox<std::shared_ptr<int>> mailbox;
+		for (int i = 0; i < 10; i++) {
+			mailbox.Publish(frame, i);
+		}
+		Check(frame.use_count() > 1, "mailbox should hold a reference");
+		mailbox.Clear();
+		Check(frame.use_count() == 1, "Clear did not release the frames");
+		std::shared_ptr<int> value;
+		double time = 0;
+		uint64_t sequence = 0;
+		Check(mailbox.Read(value, time, sequence) && value == nullptr, "Clear should publish an empty value");
+	}
+
+	// one producer and three readers, every read must be a complete letter and sequence numbers must
+	// never go backwards for any reader.
+	const uint64_t count = 200000;
+	Mailbox<TestLetter> mailbox;
+	std::atomic<bool> done{ false };
+	std::atomic<int> failures{ 0 };
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 3; r++) {
+		readers.emplace_back([&]() {
+			uint64_t last = 0;
+			while (!done) {
+				TestLetter letter;
+				double time = 0;
+				uint64_t sequence = 0;
+				if (mailbox.Read(letter, time, sequence)) {
+					for (auto word : letter.words) {
+						if (word != sequence) {
+							failures++;
+						}
+					}
+					if (time != static_cast<double>(sequence) || sequence < last) {
+						failures++;
+					}
+					last = sequence;
+				}
+				std::this_thread::yield();
+			}
+		});
+	}
+	uint64_t published = 0;
+	for (uint64_t i = 1; i <= count; i++) {
+		TestLetter letter;
+		for (auto& word : letter.words) {
+			word = published + 1;
+		}
+		if (mailbox.Publish(letter, static_cast<double>(published + 1))) {
+			published++;
+		}
+		if (i % 64 == 0) {
+			std::this_thread::yield();
+		}
+	}
+	done = true;
+	for (auto& t : readers) {
+		t.join();
+	}
+	std::cout << "published " << published << " values, dropped " << mailbox.Dropped() << std::endl;
+	Check(failures == 0, "readers saw torn or out of order values");
+	Check(published + mailbox.Dropped() == count, "publish count mismatch");
+	Check(mailbox.Sequence() == published, "sequence should count the published values");
+}
+
+// What ScreenCapture did before the Mailbox: every capture callback takes a process wide lock and
+// then a per capture lock to swap the current frame.
+static std::mutex globalMutex;
+
+struct MutexMailbox
+{
+	std::mutex mutex;
+	std::shared_ptr<int> frame;
+	double time = 0;
+
+	void Publish(const std::shared_ptr<int>& value, double t) {
+		std::scoped_lock global(globalMutex);
+		std::scoped_lock lock(mutex);
+		frame = value;
+		time = t;
+	}
+
+	void Read(std::shared_ptr<int>& value, double& t) {
+		std::scoped_lock lock(mutex);
+		value = frame;
+		t = time;
+	}
+};
+
+struct LockFreeMailbox
+{
+	Mailbox<std::shared_ptr<int>> mailbox;
+
+	void Publish(const std::shared_ptr<int>& value, double t) {
+		mailbox.Publish(value, t);
+	}
+
+	void Read(std::shared_ptr<int>& value, double& t) {
+		uint64_t sequence;
+		mailbox.Read(value, t, sequence);
+	}
+};
+
+// Runs a producer and a reader per capture for the given time and returns publishes per second.
+template <typename Box>
+static double RunMailboxContention(int captures, double seconds)
+{
+	std::vector<std::unique_ptr<Box>> boxes;
+	for (int i = 0; i < captures; i++) {
+		boxes.push_back(std::make_unique<Box>());
+	}
+	std::atomic<bool> done{ false };
+	std::atomic<uint64_t> publishes{ 0 };
+	std::vector<std::thread> threads;
+	for (int i = 0; i < captures; i++) {
+		Box* box = boxes[i].get();
+		threads.emplace_back([&, box]() {
+			auto frame = std::make_shared<int>(0);
+			uint64_t n = 0;
+			while (!done) {
+				box->Publish(frame, static_cast<double>(n++));
+			}
+			publishes += n;
+		});
+		threads.emplace_back([&, box]() {
+			std::shared_ptr<int> frame;
+			double time;
+			while (!done) {
+				box->Read(frame, time);
+			}
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	done = true;
+	for (auto& t : threads) {
+		t.join();
+	}
+	return publishes / seconds;
+}
+
+void BenchmarkMailbox()
+{
+	std::cout << "Benchmarking Mailbox against the global + per capture mutex..." << std::endl;
+	for (int captures : { 1, 2, 4 }) {
+		double locked = RunMailboxContention<MutexMailbox>(captures, 1.0);
+		double lockFree = RunMailboxContention<LockFreeMailbox>(captures, 1.0);
+		std::cout << captures << " captures: mutex " << std::fixed << std::setprecision(0) << locked
+			<< " publishes/sec, mailbox " << lockFree << " publishes/sec (" << std::setprecision(2)
+			<< lockFree / locked << "x)" << std::endl;
+	}
+}
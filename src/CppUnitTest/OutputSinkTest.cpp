@@ -0,0 +1,290 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include "OutputSink.h"
+#include "Tests.h"
+
+using namespace util;
+
+// Keeps the file in memory, optionally slow or failing, so the tests can see what the sink did.
+class MemoryFile : public OutputFile
+{
+public:
+	std::vector<uint8_t>& data;
+	std::chrono::microseconds delay{ 0 };
+	int64_t failAt = -1; // writes that reach this offset throw.
+
+	explicit MemoryFile(std::vector<uint8_t>& target) : data(target) {
+	}
+
+	void WriteAt(int64_t offset, const uint8_t* buffer, size_t size) override {
+		if (delay.count() > 0) {
+			std::this_thread::sleep_for(delay);
+		}
+		if (failAt >= 0 && offset + static_cast<int64_t>(size) > failAt) {
+			throw std::runtime_error("disk on fire");
+		}
+		if (offset + size > data.size()) {
+			data.resize(static_cast<size_t>(offset) + size);
+		}
+		::memcpy(data.data() + offset, buffer, size);
+	}
+
+	void Close() override {
+	}
+};
+
+// Writes like the mp4 muxer does: a header, lots of small writes, then seeks back to patch the
+// header and goes back to the end. Every sink has to produce exactly what the model says.
+static void WriteLikeMuxer(OutputSink& sink, std::vector<uint8_t>& model, unsigned int seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> chunk;
+	int64_t position = 0;
+	auto write = [&](size_t size) {
+		chunk.resize(size);
+		for (auto& b : chunk) {
+			b = static_cast<uint8_t>(random());
+		}
+		Check(sink.Write(chunk.data(), static_cast<int>(size)) == static_cast<int>(size), "write failed");
+		if (position + size > model.size()) {
+			model.resize(static_cast<size_t>(position) + size);
+		}
+		::memcpy(model.data() + position, chunk.data(), size);
+		position += size;
+	};
+	write(40);
+	for (int i = 0; i < 500; i++) {
+		write(1 + random() % 9000);
+		if (random() % 50 == 0) {
+			// patch something already written.
+			int64_t back = random() % (position + 1);
+			Check(sink.Seek(back, SEEK_SET) == back, "seek back");
+			position = back;
+			write(1 + random() % 64);
+			Check(sink.Seek(0, SEEK_END) == static_cast<int64_t>(model.size()), "seek to the end");
+			position = static_cast<int64_t>(model.size());
+		}
+	}
+	Check(sink.Seek(0, OutputSink::SeekSize) == static_cast<int64_t>(model.size()), "AVSEEK_SIZE should return the size");
+	Check(sink.Seek(8, SEEK_SET | OutputSink::SeekForce) == 8, "AVSEEK_FORCE should be ignored");
+	position = 8;
+	write(8);
+	Check(sink.Seek(-4, SEEK_CUR) == 12, "seek relative to the position");
+	Check(sink.Seek(-1, SEEK_SET) == -1, "negative positions are an error");
+}
+
+static void TestSinkContents()
+{
+	for (unsigned int seed = 0; seed < 10; seed++) {
+		std::vector<uint8_t> model;
+		std::vector<uint8_t> data;
+		{
+			// tiny blocks so the writer thread falls behind and the seeks land in every state.
+			AsyncFileSink sink(std::make_unique<MemoryFile>(data), 4096, 3);
+			WriteLikeMuxer(sink, model, seed);
+			sink.Close();
+			Check(sink.PendingBytes() == 0, "close should write everything");
+		}
+		Check(data == model, "async sink wrote the wrong bytes with seed " + std::to_string(seed));
+
+		std::vector<uint8_t> expected = model;
+		model.clear();
+		data.clear();
+		SyncFileSink sink(std::make_unique<MemoryFile>(data));
+		WriteLikeMuxer(sink, model, seed);
+		sink.Close();
+		Check(data == model && data == expected, "sync sink wrote the wrong bytes");
+	}
+}
+
+static void TestSinkBackpressure()
+{
+	std::vector<uint8_t> data;
+	auto file = std::make_unique<MemoryFile>(data);
+	file->delay = std::chrono::milliseconds(2);
+	AsyncFileSink sink(std::move(file), 4096, 4);
+	std::vector<uint8_t> chunk(1000, 7);
+	size_t peak = 0;
+	for (int i = 0; i < 200; i++) {
+		Check(sink.Write(chunk.data(), static_cast<int>(chunk.size())) == 1000, "write failed");
+		peak = std::max(peak, sink.PendingBytes());
+	}
+	Check(peak <= sink.MaxPendingBytes(), "pending bytes went over the limit");
+	Check(sink.Stalls() > 0, "a slow disk should make the writer wait");
+	sink.Close();
+	Check(data.size() == 200000, "everything should be written in the end");
+}
+
+static void TestSinkErrors()
+{
+	std::vector<uint8_t> data;
+	auto file = std::make_unique<MemoryFile>(data);
+	file->failAt = 10000;
+	AsyncFileSink sink(std::move(file), 4096, 2);
+	std::vector<uint8_t> chunk(1000, 1);
+	int result = 0;
+	for (int i = 0; i < 1000 && result >= 0; i++) {
+		result = sink.Write(chunk.data(), static_cast<int>(chunk.size()));
+		std::this_thread::yield();
+	}
+	Check(result == -EIO, "writes should fail once the file failed");
+	Check(sink.Error() == "disk on fire", "the sink should keep the first error");
+	bool threw = false;
+	try {
+		sink.Close();
+	}
+	catch (const std::exception& e) {
+		threw = std::string(e.what()) == "disk on fire";
+	}
+	Check(threw, "close should throw the write error");
+}
+
+static void TestDiskFile()
+{
+	auto path = std::filesystem::temp_directory_path() / "OutputSinkTest.bin";
+	std::vector<uint8_t> model;
+	{
+		AsyncFileSink sink(std::make_unique<DiskFile>(path), 64 * 1024, 4);
+		WriteLikeMuxer(sink, model, 99);
+		sink.Close();
+	}
+	std::ifstream in(path, std::ios::binary);
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::filesystem::remove(path);
+	Check(data == model, "file on disk does not match what was written");
+
+	bool threw = false;
+	try {
+		DiskFile missing(std::filesystem::temp_directory_path() / "no such folder" / "file.bin");
+	}
+	catch (const std::runtime_error&) {
+		threw = true;
+	}
+	Check(threw, "opening a file in a missing folder should throw");
+}
+
+static std::string ReadFile(const std::filesystem::path& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static void TestSegmentFiles()
+{
+	auto folder = std::filesystem::temp_directory_path();
+	SegmentFiles files(folder / "segments.mp4");
+	Check(files.SegmentPath(0) == folder / "segments.mp4", "the first segment keeps the name");
+	Check(files.SegmentPath(2) == folder / "segments_2.mp4", "the next ones are numbered like examples/video.py does");
+
+	for (int i = 0; i < 3; i++) {
+		OutputCallbacks callbacks = files.Open(i);
+		std::string text = "segment " + std::to_string(i);
+		Check(callbacks.write(callbacks.opaque, reinterpret_cast<const uint8_t*>(text.data()), static_cast<int>(text.size())) == static_cast<int>(text.size()), "write failed");
+		if (i < 2) {
+			files.Close(i);
+		}
+	}
+	files.CloseFile(); // the last one is left open when encoding fails.
+	files.CloseFile();
+	for (int i = 0; i < 3; i++) {
+		Check(ReadFile(files.SegmentPath(i)) == "segment " + std::to_string(i), "segment " + std::to_string(i) + " has the wrong contents");
+		std::filesystem::remove(files.SegmentPath(i));
+	}
+}
+
+void TestOutputSink()
+{
+	std::cout << "Testing output sinks..." << std::endl;
+	TestSinkContents();
+	TestSinkBackpressure();
+	TestSinkErrors();
+	TestDiskFile();
+	TestSegmentFiles();
+	std::cout << "ok" << std::endl;
+}
+
+// Stalls now and then the way a disk does when the cache flushes or an antivirus scan kicks in.
+class StallingFile : public OutputFile
+{
+	DiskFile _file;
+	int64_t _written = 0;
+
+public:
+	explicit StallingFile(const std::filesystem::path& path) : _file(path) {
+	}
+
+	void WriteAt(int64_t offset, const uint8_t* data, size_t size) override {
+		int64_t before = _written / (16 * 1024 * 1024);
+		_written += size;
+		if (_written / (16 * 1024 * 1024) != before) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		_file.WriteAt(offset, data, size);
+	}
+
+	void Close() override {
+		_file.Close();
+	}
+};
+
+static std::unique_ptr<OutputSink> CreateSink(bool async, std::unique_ptr<OutputFile> file)
+{
+	if (async) {
+		return std::make_unique<AsyncFileSink>(std::move(file));
+	}
+	return std::make_unique<SyncFileSink>(std::move(file));
+}
+
+void BenchmarkOutputSink()
+{
+	const int chunk = 64 * 1024; // the AVIO buffer size FFmpegPipeline uses.
+	std::cout << "Benchmarking output sinks with " << chunk / 1024 << " KB writes..." << std::endl;
+	auto path = std::filesystem::temp_directory_path() / "BenchmarkOutputSink.bin";
+	std::vector<uint8_t> data(chunk, 0x5a);
+
+	// how fast each can go flat out, which mostly measures the disk.
+	const size_t total = 256 * 1024 * 1024;
+	for (bool async : { false, true }) {
+		auto sink = CreateSink(async, std::make_unique<DiskFile>(path));
+		auto start = std::chrono::steady_clock::now();
+		for (size_t written = 0; written < total; written += chunk) {
+			sink->Write(data.data(), chunk);
+		}
+		sink->Close();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << (async ? "async" : "sync ") << " flat out: " << std::fixed << std::setprecision(1)
+			<< total / seconds / (1024 * 1024) << " MB/s" << std::endl;
+	}
+
+	// what the muxer sees at a steady 128 MB/s (a lot more than any screen recording) when the disk
+	// stops for 100 ms every 16 MB: each slow write is a frame that is late or dropped.
+	const size_t paced = 128 * 1024 * 1024;
+	const auto interval = std::chrono::nanoseconds(1000000000LL * chunk / paced);
+	for (bool async : { false, true }) {
+		auto sink = CreateSink(async, std::make_unique<StallingFile>(path));
+		double worst = 0;
+		int slow = 0;
+		auto next = std::chrono::steady_clock::now();
+		for (size_t written = 0; written < paced; written += chunk) {
+			std::this_thread::sleep_until(next);
+			next += interval;
+			auto before = std::chrono::steady_clock::now();
+			sink->Write(data.data(), chunk);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count();
+			worst = std::max(worst, ms);
+			slow += ms > 5 ? 1 : 0;
+		}
+		sink->Close();
+		std::cout << (async ? "async" : "sync ") << " stalling disk at 128 MB/s: slowest write " << std::fixed << std::setprecision(3)
+			<< worst << " ms, " << slow << " writes over 5 ms" << std::endl;
+	}
+	std::filesystem::remove(path);
+}
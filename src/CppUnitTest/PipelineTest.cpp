@@ -0,0 +1,589 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include "FrameSource.h"
+#include "FFmpegPipeline.h"
+#include "Tests.h"
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+using namespace util;
+
+// Collects the encoded file in memory so tests can look at it.
+struct MemoryOutput
+{
+	std::vector<uint8_t> data;
+	int64_t position = 0;
+	std::vector<size_t> flushes; // the size of the file at each flush.
+
+	static int Write(void* opaque, const uint8_t* buf, int size)
+	{
+		auto output = static_cast<MemoryOutput*>(opaque);
+		size_t end = static_cast<size_t>(output->position) + size;
+		if (end > output->data.size()) {
+			output->data.resize(end);
+		}
+		::memcpy(output->data.data() + output->position, buf, size);
+		output->position = end;
+		return size;
+	}
+
+	static int64_t Seek(void* opaque, int64_t offset, int whence)
+	{
+		auto output = static_cast<MemoryOutput*>(opaque);
+		int64_t size = static_cast<int64_t>(output->data.size());
+		switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE: return size;
+		case SEEK_SET: output->position = offset; break;
+		case SEEK_CUR: output->position += offset; break;
+		case SEEK_END: output->position = size + offset; break;
+		default: return -1;
+		}
+		return output->position;
+	}
+
+	static void Flush(void* opaque)
+	{
+		auto output = static_cast<MemoryOutput*>(opaque);
+		output->flushes.push_back(output->data.size());
+	}
+
+	OutputCallbacks Callbacks()
+	{
+		OutputCallbacks callbacks;
+		callbacks.opaque = this;
+		callbacks.write = Write;
+		callbacks.seek = Seek;
+		callbacks.flush = Flush;
+		return callbacks;
+	}
+};
+
+void TestFFmpegPipeline()
+{
+	std::cout << "Testing FFmpegPipeline with a synthetic source..." << std::endl;
+	SyntheticFrameSource source(321, 241, 0, 60); // odd sizes get cropped to even.
+	EncoderSettings settings;
+	settings.frameRate = 30;
+	MemoryOutput output;
+	FFmpegPipeline encoder;
+	encoder.Encode(source, settings, output.Callbacks());
+
+	Check(encoder.GetSampleTimes(nullptr, 0) == 60, "expected 60 sample times");
+	Check(encoder.FramesDropped() == 0, "no frames should be dropped with the Block policy");
+	Check(output.data.size() > 1000, "output is too small");
+	Check(::memcmp(output.data.data() + 4, "ftyp", 4) == 0, "output is not an mp4 file");
+	auto stats = encoder.GetStageStats();
+	Check(stats.size() == 5, "expected capture, readback, convert, encode and mux stages");
+	for (auto& stage : stats) {
+		Check(stage.frames == 60, stage.name + " did not see every frame");
+	}
+}
+
+// A packet of the first stream as DecodeFrames read it.
+struct DemuxedPacket
+{
+	double seconds; // presentation time.
+	bool key;
+};
+
+// Demuxes and decodes a file from memory, returns how many frames decode or -1 if FFmpeg can't
+// even open it. Adds the packets of the first stream to packets when it is given.
+static int DecodeFrames(const std::vector<uint8_t>& file, std::vector<DemuxedPacket>* packets = nullptr)
+{
+	struct Input
+	{
+		const std::vector<uint8_t>* data;
+		int64_t position;
+
+		static int Read(void* opaque, uint8_t* buf, int size)
+		{
+			auto input = static_cast<Input*>(opaque);
+			int count = static_cast<int>(std::min<int64_t>(size, input->data->size() - input->position));
+			if (count <= 0) {
+				return AVERROR_EOF;
+			}
+			::memcpy(buf, input->data->data() + input->position, count);
+			input->position += count;
+			return count;
+		}
+
+		static int64_t Seek(void* opaque, int64_t offset, int whence)
+		{
+			auto input = static_cast<Input*>(opaque);
+			int64_t size = static_cast<int64_t>(input->data->size());
+			switch (whence & ~AVSEEK_FORCE) {
+			case AVSEEK_SIZE: return size;
+			case SEEK_SET: input->position = offset; break;
+			case SEEK_CUR: input->position += offset; break;
+			case SEEK_END: input->position = size + offset; break;
+			default: return -1;
+			}
+			input->position = std::max<int64_t>(0, std::min(input->position, size));
+			return input->position;
+		}
+	};
+
+	Input input{ &file, 0 };
+	int bufferSize = 65536;
+	AVIOContext* avio = avio_alloc_context((uint8_t*)av_malloc(bufferSize), bufferSize, 0, &input, Input::Read, nullptr, Input::Seek);
+	AVFormatContext* format = avformat_alloc_context();
+	format->pb = avio;
+	int frames = -1;
+	// this frees the format context when it fails.
+	if (avformat_open_input(&format, nullptr, nullptr, nullptr) >= 0) {
+		frames = 0;
+		if (avformat_find_stream_info(format, nullptr) >= 0 && format->nb_streams > 0) {
+			const AVCodec* codec = avcodec_find_decoder(format->streams[0]->codecpar->codec_id);
+			AVCodecContext* decoder = avcodec_alloc_context3(codec);
+			avcodec_parameters_to_context(decoder, format->streams[0]->codecpar);
+			if (avcodec_open2(decoder, codec, nullptr) >= 0) {
+				AVPacket* packet = av_packet_alloc();
+				AVFrame* frame = av_frame_alloc();
+				auto receive = [&]() {
+					while (avcodec_receive_frame(decoder, frame) >= 0) {
+						frames++;
+					}
+				};
+				while (av_read_frame(format, packet) >= 0) {
+					// the last packet of a cut file can be broken, that is fine.
+					if (packet->stream_index == 0 && packets != nullptr) {
+						packets->push_back({ packet->pts * av_q2d(format->streams[0]->time_base), (packet->flags & AV_PKT_FLAG_KEY) != 0 });
+					}
+					if (packet->stream_index == 0 && avcodec_send_packet(decoder, packet) >= 0) {
+						receive();
+					}
+					av_packet_unref(packet);
+				}
+				avcodec_send_packet(decoder, nullptr);
+				receive();
+				av_frame_free(&frame);
+				av_packet_free(&packet);
+			}
+			avcodec_free_context(&decoder);
+		}
+		avformat_close_input(&format);
+	}
+	av_freep(&avio->buffer);
+	avio_context_free(&avio);
+	return frames;
+}
+
+// The streaming containers have to reach the output while they are recorded and survive being cut
+// off at any point, which is what a crash or a kill does to them.
+void TestStreamingContainers()
+{
+	std::cout << "Testing fragmented mp4 and mpeg-ts output..." << std::endl;
+	const int frames = 90;
+	for (Container container : { Container::Mp4, Container::FragmentedMp4, Container::MpegTs }) {
+		std::string name = container == Container::Mp4 ? "mp4" : container == Container::FragmentedMp4 ? "fragmented mp4" : "mpeg-ts";
+		// real time 30 fps so the 3 seconds make several fragments.
+		SyntheticFrameSource source(320, 240, 30, frames);
+		EncoderSettings settings;
+		settings.frameRate = 30;
+		settings.container = container;
+		settings.fragmentSeconds = 0.5;
+		MemoryOutput output;
+		FFmpegPipeline encoder;
+		encoder.Encode(source, settings, output.Callbacks());
+
+		Check(DecodeFrames(output.data) == frames, name + " should decode every frame");
+		std::vector<uint8_t> truncated(output.data.begin(), output.data.begin() + output.data.size() * 6 / 10);
+		int survived = DecodeFrames(truncated);
+		std::cout << name << ": " << output.data.size() << " bytes, " << output.flushes.size() << " flushes, "
+			<< survived << " frames survive losing the last 40%" << std::endl;
+		if (container == Container::Mp4) {
+			// the reason for the other two: without the index at the end nothing can be read.
+			Check(output.flushes.empty(), "mp4 is not flushed while it is written");
+			Check(survived <= 0, "a cut off mp4 should not be readable");
+		}
+		else {
+			Check(output.flushes.size() >= 3, name + " should be flushed as it is written");
+			Check(output.flushes.front() < output.data.size() / 2, name + " should reach the output long before it ends");
+			Check(survived > 0 && survived < frames, name + " should still play up to where it was cut");
+		}
+	}
+}
+
+// Keeps every segment in memory.
+class MemorySegments : public SegmentOutput
+{
+public:
+	std::vector<std::unique_ptr<MemoryOutput>> segments;
+	int closed = 0;
+
+	OutputCallbacks Open(int index) override
+	{
+		Check(index == static_cast<int>(segments.size()), "segments should be opened in order");
+		segments.push_back(std::make_unique<MemoryOutput>());
+		return segments.back()->Callbacks();
+	}
+
+	void Close(int index) override
+	{
+		Check(index == closed, "segments should be closed in order");
+		closed++;
+	}
+};
+
+// Encodes the source into segments and checks that together they hold exactly the frames a single
+// file would, on the same timeline: every segment starts on a key frame, and each frame shows at
+// its capture time measured from the first frame of its segment.
+static void CheckSegments(FrameSource& source, const EncoderSettings& settings, int frames, const std::string& name)
+{
+	MemorySegments output;
+	FFmpegPipeline encoder;
+	encoder.Encode(source, settings, output);
+	Check(encoder.SegmentCount() == static_cast<int>(output.segments.size()) && output.closed == encoder.SegmentCount(),
+		name + ": every segment should be opened and closed");
+	Check(output.segments.size() >= 3, name + ": expected at least 3 segments, got " + std::to_string(output.segments.size()));
+
+	std::vector<double> captured(encoder.GetSampleTimes(nullptr, 0));
+	encoder.GetSampleTimes(captured.data(), static_cast<unsigned int>(captured.size()));
+	Check(static_cast<int>(captured.size()) == frames, name + ": every frame should be captured");
+
+	size_t index = 0;
+	double tolerance = 2.0 / (settings.frameRate * 1000); // pts are rounded to the time base.
+	for (size_t i = 0; i < output.segments.size(); i++) {
+		std::vector<DemuxedPacket> packets;
+		int decoded = DecodeFrames(output.segments[i]->data, &packets);
+		std::string segment = name + " segment " + std::to_string(i);
+		Check(decoded == static_cast<int>(packets.size()) && decoded > 0, segment + " should decode every frame");
+		Check(packets.front().key, segment + " has to start on a key frame");
+		std::vector<double> times;
+		for (auto& packet : packets) {
+			times.push_back(packet.seconds);
+		}
+		std::sort(times.begin(), times.end());
+		Check(index + times.size() <= captured.size(), segment + " has more frames than were captured");
+		size_t first = index;
+		for (double time : times) {
+			double expected = captured[index] - captured[first];
+			Check(std::abs((time - times.front()) - expected) <= tolerance,
+				segment + " frame " + std::to_string(index) + " is at " + std::to_string(time - times.front()) + " instead of " + std::to_string(expected));
+			index++;
+		}
+	}
+	Check(static_cast<int>(index) == frames, name + ": the segments hold " + std::to_string(index) + " of " + std::to_string(frames) + " frames");
+	std::cout << name << ": " << frames << " frames in " << output.segments.size() << " segments" << std::endl;
+}
+
+void TestSegments()
+{
+	std::cout << "Testing segmented recording..." << std::endl;
+	for (Container container : { Container::Mp4, Container::MpegTs }) {
+		std::string name = container == Container::Mp4 ? "mp4" : "mpeg-ts";
+		// real time so the 3.5 seconds make 4 segments, cut on frames the encoder was not going to make key frames.
+		const int frames = 105;
+		SyntheticFrameSource timed(320, 240, 30, frames);
+		EncoderSettings settings;
+		settings.frameRate = 30;
+		settings.container = container;
+		settings.segmentSeconds = 0.9;
+		CheckSegments(timed, settings, frames, name + " by time");
+
+		// as fast as it goes, cut at about a quarter of what the whole file takes.
+		SyntheticFrameSource fast(320, 240, 0, frames);
+		settings.segmentSeconds = 0;
+		MemoryOutput whole;
+		FFmpegPipeline encoder;
+		encoder.Encode(fast, settings, whole.Callbacks());
+		Check(DecodeFrames(whole.data) == frames, name + " should decode every frame of a single file");
+		SyntheticFrameSource sized(320, 240, 0, frames);
+		settings.segmentBytes = whole.data.size() / 4;
+		CheckSegments(sized, settings, frames, name + " by size");
+	}
+
+	bool threw = false;
+	try {
+		SyntheticFrameSource source(320, 240, 0, 10);
+		EncoderSettings settings;
+		settings.segmentSeconds = 1;
+		MemoryOutput output;
+		FFmpegPipeline encoder;
+		encoder.Encode(source, settings, output.Callbacks());
+	}
+	catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	Check(threw, "segments need somewhere to go");
+}
+
+// Saves the replay while the encoder keeps going and again after it is done, each clip has to be
+// playable on its own, start on a key frame and hold the last replaySeconds.
+void TestReplay()
+{
+	std::cout << "Testing instant replay..." << std::endl;
+	FFmpegPipeline encoder;
+	bool threw = false;
+	try {
+		MemoryOutput output;
+		encoder.SaveReplay(output.Callbacks());
+	}
+	catch (const std::exception&) {
+		threw = true;
+	}
+	Check(threw, "there is nothing to save before encoding");
+
+	const int frameRate = 30;
+	const int gop = EncoderSettings().tuning.gopSize; // what FFmpegPipeline asks the encoder for.
+	SyntheticFrameSource source(320, 240, frameRate, frameRate * 5);
+	EncoderSettings settings;
+	settings.frameRate = frameRate;
+	settings.replaySeconds = 2;
+	MemoryOutput ignored;
+	std::thread thread([&]() {
+		encoder.Encode(source, settings, ignored.Callbacks());
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+	Check(encoder.IsRunning(), "the synthetic source should still be running");
+	MemoryOutput during;
+	encoder.SaveReplay(during.Callbacks());
+	thread.join();
+	Check(ignored.data.empty(), "nothing should be written while only replaying");
+	MemoryOutput after;
+	encoder.SaveReplay(after.Callbacks());
+
+	for (auto* clip : { &during, &after }) {
+		std::string name = clip == &during ? "replay while encoding" : "replay after encoding";
+		Check(::memcmp(clip->data.data() + 4, "ftyp", 4) == 0, name + " is not an mp4 file");
+		std::vector<DemuxedPacket> packets;
+		int frames = DecodeFrames(clip->data, &packets);
+		Check(!packets.empty() && packets.front().key, name + " has to start on a key frame");
+		double first = packets.front().seconds;
+		double last = first;
+		for (auto& packet : packets) {
+			first = std::min(first, packet.seconds);
+			last = std::max(last, packet.seconds);
+		}
+		double seconds = last - first + 1.0 / frameRate;
+		std::cout << name << ": " << clip->data.size() << " bytes, " << frames << " frames, " << seconds << " seconds" << std::endl;
+		Check(frames == static_cast<int>(packets.size()), name + " should decode every frame");
+		// at least replaySeconds and at most one more group of pictures, give or take a frame of timing.
+		Check(seconds >= settings.replaySeconds - 1.0 / frameRate && seconds <= settings.replaySeconds + (gop + 2.0) / frameRate,
+			name + " is " + std::to_string(seconds) + " seconds long");
+	}
+}
+
+// The synthetic pattern scrolled one step at each of the given frames, and still in between.
+class SteppedFrameSource : public SyntheticFrameSource
+{
+	std::vector<uint64_t> _changes;
+
+public:
+	SteppedFrameSource(int width, int height, int frameRate, uint64_t frameCount, std::vector<uint64_t> changes)
+		: SyntheticFrameSource(width, height, frameRate, frameCount), _changes(changes) {
+	}
+
+	void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) override {
+		uint64_t index = *static_cast<uint64_t*>(frame.get());
+		auto step = std::make_shared<uint64_t>(std::upper_bound(_changes.begin(), _changes.end(), index) - _changes.begin());
+		SyntheticFrameSource::ReadFrame(step, buffer, size);
+	}
+};
+
+// Only the frames that changed may be encoded, at the time they were captured, and the video has
+// to last as long as the recording even when it ends on a still screen.
+void TestVariableFrameRate()
+{
+	std::cout << "Testing variable frame rate encoding..." << std::endl;
+	const int frameRate = 30;
+	const int frames = 90;
+	const std::vector<uint64_t> changes = { 10, 11, 12, 40, 70 };
+	SteppedFrameSource source(320, 240, frameRate, frames, changes);
+	EncoderSettings settings;
+	settings.frameRate = frameRate;
+	settings.variableFrameRate = true;
+	settings.maxFrameGap = 60;
+	MemoryOutput output;
+	FFmpegPipeline encoder;
+	encoder.Encode(source, settings, output.Callbacks());
+	uint64_t kept = 1 + changes.size();
+	Check(encoder.FramesSkipped() == frames - kept, "expected " + std::to_string(frames - kept) + " skipped frames, got " +
+		std::to_string(encoder.FramesSkipped()));
+
+	std::vector<DemuxedPacket> packets;
+	int decoded = DecodeFrames(output.data, &packets);
+	// the kept frames and the last one repeated at the end.
+	Check(decoded == static_cast<int>(kept) + 1 && packets.size() == kept + 1, "expected " + std::to_string(kept + 1) +
+		" frames in the video, got " + std::to_string(decoded));
+	std::vector<double> times;
+	for (auto& packet : packets) {
+		times.push_back(packet.seconds);
+	}
+	std::sort(times.begin(), times.end());
+	std::vector<uint64_t> expected = { 0 };
+	expected.insert(expected.end(), changes.begin(), changes.end());
+	expected.push_back(frames - 1);
+	for (size_t i = 0; i < times.size() && i < expected.size(); i++) {
+		double want = times[0] + static_cast<double>(expected[i]) / frameRate;
+		Check(std::abs(times[i] - want) < 0.025, "frame " + std::to_string(expected[i]) + " is at " + std::to_string(times[i]) +
+			" seconds instead of " + std::to_string(want));
+	}
+
+	// a still screen still gets a frame every maxFrameGap.
+	SteppedFrameSource still(320, 240, frameRate, 60, {});
+	settings.maxFrameGap = 0.5;
+	MemoryOutput stillOutput;
+	encoder.Encode(still, settings, stillOutput.Callbacks());
+	uint64_t encoded = 60 - encoder.FramesSkipped();
+	Check(encoded >= 4 && encoded <= 5, "expected a frame every half second, got " + std::to_string(encoded) + " in 2 seconds");
+}
+
+// The options string goes straight to the encoder, a key frame interval set there has to show up
+// in the file and a misspelled option has to fail instead of being ignored.
+void TestEncoderOptions()
+{
+	std::cout << "Testing encoder options..." << std::endl;
+	for (auto profile : { EncoderProfile::Default, EncoderProfile::LowLatency, EncoderProfile::HighThroughput }) {
+		SyntheticFrameSource source(320, 240, 0, 30);
+		EncoderSettings settings;
+		settings.frameRate = 30;
+		settings.tuning = EncoderTuning::ForProfile(profile);
+		settings.tuning.options = "g=7:bf=0";
+		MemoryOutput output;
+		FFmpegPipeline encoder;
+		encoder.Encode(source, settings, output.Callbacks());
+		std::vector<DemuxedPacket> packets;
+		int frames = DecodeFrames(output.data, &packets);
+		Check(frames == 30, "expected 30 frames");
+		// with no b-frames decode order is display order, x264 may add a key frame at a scene cut.
+		for (size_t i = 0; i < packets.size(); i += 7) {
+			Check(packets[i].key, "the g option was not applied");
+		}
+	}
+
+	SyntheticFrameSource source(320, 240, 0, 30);
+	EncoderSettings settings;
+	settings.frameRate = 30;
+	settings.tuning.options = "preset=veryfast:no_such_option=1";
+	MemoryOutput output;
+	FFmpegPipeline encoder;
+	std::string error;
+	try {
+		encoder.Encode(source, settings, output.Callbacks());
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+	}
+	Check(error.find("no_such_option") != std::string::npos, "an unknown option should fail, got '" + error + "'");
+}
+
+void BenchmarkPipeline()
+{
+	std::cout << "Benchmarking FFmpegPipeline at 1920x1080, 300 frames..." << std::endl;
+	for (size_t depth : { 1, 2, 4 }) {
+		for (DropPolicy policy : { DropPolicy::Block, DropPolicy::DropNewest }) {
+			SyntheticFrameSource frames(1920, 1080, 0, 300);
+			EncoderSettings settings;
+			settings.frameRate = 60;
+			settings.queueDepth = depth;
+			settings.dropPolicy = policy;
+			MemoryOutput output;
+			output.data.reserve(64 * 1024 * 1024);
+			FFmpegPipeline encoder;
+			auto start = std::chrono::steady_clock::now();
+			encoder.Encode(frames, settings, output.Callbacks());
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			auto encoded = encoder.GetSampleTimes(nullptr, 0);
+
+			std::cout << "depth " << depth << (policy == DropPolicy::Block ? " block" : " drop ")
+				<< std::fixed << std::setprecision(1) << ": " << encoded / seconds << " fps, dropped "
+				<< encoder.FramesDropped() << std::endl;
+			for (auto& stage : encoder.GetStageStats()) {
+				double average = stage.frames > 0 ? stage.busySeconds * 1000 / stage.frames : 0;
+				std::cout << "    " << std::setw(8) << stage.name << std::setprecision(3) << " " << average << " ms/frame, p95 "
+					<< stage.p95 * 1000 << " ms" << std::endl;
+			}
+		}
+	}
+}
+
+// Several recordings at once, each with its own FFmpegPipeline and threads the way EncodeVideo
+// runs them now, to see how the total frame rate scales with the number of streams.
+void BenchmarkMultiStream()
+{
+	const int frames = 300;
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::cout << "Benchmarking concurrent FFmpegPipelines at 1280x720, " << frames << " frames each, " << cores << " cores..." << std::endl;
+	for (unsigned int streams = 1; ; streams = std::min(streams * 2, cores)) {
+		std::vector<std::thread> threads;
+		std::vector<double> rates(streams, 0);
+		std::atomic<int> failures{ 0 };
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < streams; i++) {
+			threads.emplace_back([&, i]() {
+				try {
+					SyntheticFrameSource source(1280, 720, 0, frames);
+					EncoderSettings settings;
+					settings.frameRate = 60;
+					MemoryOutput output;
+					output.data.reserve(32 * 1024 * 1024);
+					FFmpegPipeline encoder;
+					auto streamStart = std::chrono::steady_clock::now();
+					encoder.Encode(source, settings, output.Callbacks());
+					double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - streamStart).count();
+					rates[i] = encoder.GetSampleTimes(nullptr, 0) / seconds;
+				}
+				catch (const std::exception& e) {
+					std::cout << "stream " << i << " failed: " << e.what() << std::endl;
+					failures++;
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		Check(failures == 0, "concurrent encoders failed");
+		double slowest = *std::min_element(rates.begin(), rates.end());
+		std::cout << std::setw(3) << streams << " streams: " << std::fixed << std::setprecision(1)
+			<< streams * frames / seconds << " fps total, slowest stream " << slowest << " fps" << std::endl;
+		if (streams == cores) {
+			break;
+		}
+	}
+}
+
+// What each encoder profile costs and what it gives: frames per second with the source as fast as
+// it can go, the time the encode stage spends per frame and the bitrate it ends up using.
+void BenchmarkProfiles()
+{
+	const int frames = 300;
+	const int frameRate = 60;
+	std::cout << "Benchmarking encoder profiles at 1280x720, " << frames << " frames..." << std::endl;
+	const char* names[] = { "default", "low latency", "high throughput" };
+	for (auto profile : { EncoderProfile::Default, EncoderProfile::LowLatency, EncoderProfile::HighThroughput }) {
+		SyntheticFrameSource source(1280, 720, 0, frames);
+		EncoderSettings settings;
+		settings.frameRate = frameRate;
+		settings.tuning = EncoderTuning::ForProfile(profile);
+		MemoryOutput output;
+		output.data.reserve(32 * 1024 * 1024);
+		FFmpegPipeline encoder;
+		auto start = std::chrono::steady_clock::now();
+		encoder.Encode(source, settings, output.Callbacks());
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double encodeMs = 0;
+		for (auto& stage : encoder.GetStageStats()) {
+			if (stage.name == "encode" && stage.frames > 0) {
+				encodeMs = stage.busySeconds * 1000 / stage.frames;
+			}
+		}
+		double mbps = output.data.size() * 8.0 / (static_cast<double>(frames) / frameRate) / 1000000;
+		std::cout << std::setw(16) << names[static_cast<int>(profile)] << std::fixed << std::setprecision(1)
+			<< ": " << frames / seconds << " fps, encode " << std::setprecision(2) << encodeMs << " ms/frame, "
+			<< mbps << " Mbps" << std::endl;
+	}
+}
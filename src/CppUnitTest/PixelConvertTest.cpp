@@ -0,0 +1,161 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include "PixelConvert.h"
+#include "Tests.h"
+
+using namespace util;
+
+static const PixelFormat allFormats[] = { PixelFormat::Bgra, PixelFormat::Bgr, PixelFormat::Rgb, PixelFormat::Gray8 };
+
+static const char* FormatName(PixelFormat format)
+{
+	switch (format) {
+	case PixelFormat::Bgra:
+		return "bgra";
+	case PixelFormat::Bgr:
+		return "bgr";
+	case PixelFormat::Rgb:
+		return "rgb";
+	default:
+		return "gray8";
+	}
+}
+
+// Straightforward per pixel version to check the kernels against.
+static void ReferenceConvert(const uint8_t* src, int srcPitch, int width, int height, uint8_t* dst, int dstStride, PixelFormat format)
+{
+	for (int y = 0; y < height; y++) {
+		const uint8_t* s = src + y * srcPitch;
+		uint8_t* d = dst + y * dstStride;
+		for (int x = 0; x < width; x++) {
+			int b = s[x * 4], g = s[x * 4 + 1], r = s[x * 4 + 2], a = s[x * 4 + 3];
+			switch (format) {
+			case PixelFormat::Bgra:
+				d[x * 4] = b; d[x * 4 + 1] = g; d[x * 4 + 2] = r; d[x * 4 + 3] = a;
+				break;
+			case PixelFormat::Bgr:
+				d[x * 3] = b; d[x * 3 + 1] = g; d[x * 3 + 2] = r;
+				break;
+			case PixelFormat::Rgb:
+				d[x * 3] = r; d[x * 3 + 1] = g; d[x * 3 + 2] = b;
+				break;
+			case PixelFormat::Gray8:
+				d[x] = static_cast<uint8_t>((1868 * b + 9617 * g + 4899 * r + 8192) >> 14);
+				break;
+			}
+		}
+	}
+}
+
+static std::vector<uint8_t> RandomBgra(int pitch, int height, unsigned int seed)
+{
+	std::vector<uint8_t> pixels(static_cast<size_t>(pitch) * height);
+	std::mt19937 random(seed);
+	for (auto& p : pixels) {
+		p = static_cast<uint8_t>(random());
+	}
+	return pixels;
+}
+
+void TestPixelConvert()
+{
+	std::cout << "Testing BGRA to BGR/RGB/GRAY8 conversion..." << std::endl;
+	const uint8_t guard = 0xCD;
+	// odd sizes cover the scalar tails and the overlapping stores near the end of each row.
+	const int sizes[][2] = { { 1, 1 }, { 5, 3 }, { 11, 2 }, { 17, 5 }, { 33, 7 }, { 1278, 31 }, { 1920, 8 } };
+	for (auto& size : sizes) {
+		int width = size[0];
+		int height = size[1];
+		int pitch = ((width * 4 + 63) / 64) * 64;
+		std::vector<uint8_t> src = RandomBgra(pitch, height, width);
+		for (PixelFormat format : allFormats) {
+			int bpp = BytesPerPixel(format);
+			for (int padding : { 0, 5 }) {
+				int stride = width * bpp + padding;
+				std::vector<uint8_t> expected(static_cast<size_t>(stride) * height, guard);
+				ReferenceConvert(src.data(), pitch, width, height, expected.data(), stride, format);
+				for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+					// one extra row of guard bytes catches writes past the end of the image.
+					std::vector<uint8_t> actual(static_cast<size_t>(stride) * (height + 1), guard);
+					ConvertBgra(src.data(), pitch, width, height, actual.data(), stride, format, static_cast<CpuLevel>(level));
+					std::string name = std::string(CpuLevelName(static_cast<CpuLevel>(level))) + " " + FormatName(format) + " " +
+						std::to_string(width) + "x" + std::to_string(height) + " stride " + std::to_string(stride);
+					Check(::memcmp(expected.data(), actual.data(), expected.size()) == 0, name + " does not match the reference");
+					for (int i = 0; i < stride; i++) {
+						Check(actual[expected.size() + i] == guard, name + " wrote past the end of the image");
+					}
+				}
+			}
+		}
+	}
+	std::cout << "ok" << std::endl;
+}
+
+// What DXCamera did in python: copy the pitched buffer, slice off the padding and alpha into a new
+// array, then swap channels for RGB.
+static void ThreePassConvert(const uint8_t* src, int pitch, int width, int height, std::vector<uint8_t>& copy,
+	std::vector<uint8_t>& bgr, std::vector<uint8_t>& rgb, bool swap)
+{
+	::memcpy(copy.data(), src, copy.size());
+	for (int y = 0; y < height; y++) {
+		const uint8_t* s = copy.data() + y * pitch;
+		uint8_t* d = bgr.data() + y * width * 3;
+		for (int x = 0; x < width; x++) {
+			d[x * 3] = s[x * 4];
+			d[x * 3 + 1] = s[x * 4 + 1];
+			d[x * 3 + 2] = s[x * 4 + 2];
+		}
+	}
+	if (swap) {
+		for (size_t i = 0; i < bgr.size(); i += 3) {
+			rgb[i] = bgr[i + 2];
+			rgb[i + 1] = bgr[i + 1];
+			rgb[i + 2] = bgr[i];
+		}
+	}
+}
+
+void BenchmarkPixelConvert()
+{
+	std::cout << "Benchmarking BGRA to packed pixel conversion..." << std::endl;
+	const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const int iterations = 100;
+	for (auto& size : sizes) {
+		int width = size[0];
+		int height = size[1];
+		int pitch = ((width * 4 + 63) / 64) * 64;
+		std::vector<uint8_t> src = RandomBgra(pitch, height, 1);
+		std::vector<uint8_t> copy(src.size());
+		std::vector<uint8_t> bgr(static_cast<size_t>(width) * height * 3);
+		std::vector<uint8_t> rgb(bgr.size());
+		std::vector<uint8_t> dst(static_cast<size_t>(width) * height * 4);
+
+		auto report = [&](const std::string& name, auto convert) {
+			convert(); // warmup
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) {
+				convert();
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			double ms = elapsed.count() / iterations;
+			std::cout << std::fixed << std::setprecision(3) << width << "x" << height << " " << std::setw(16) << name
+				<< " " << ms << " ms/frame " << std::setprecision(0) << (1000.0 / ms) << " fps" << std::endl;
+		};
+
+		report("three pass bgr", [&]() { ThreePassConvert(src.data(), pitch, width, height, copy, bgr, rgb, false); });
+		report("three pass rgb", [&]() { ThreePassConvert(src.data(), pitch, width, height, copy, bgr, rgb, true); });
+		for (PixelFormat format : allFormats) {
+			for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+				std::string name = std::string(FormatName(format)) + " " + CpuLevelName(static_cast<CpuLevel>(level));
+				report(name, [&]() {
+					ConvertBgra(src.data(), pitch, width, height, dst.data(), width * BytesPerPixel(format), format, static_cast<CpuLevel>(level));
+				});
+			}
+		}
+	}
+}
@@ -0,0 +1,38 @@
+// PortableTests.cpp : The tests that need no Windows, FFmpeg or GPU, for the CMake build on Linux.
+// CppUnitTest.cpp runs these and the rest on Windows.
+
+#include "Tests.h"
+#include "TestRunner.h"
+
+const TestCase tests[] = {
+	{ "SpscQueue", TestSpscQueue, false },
+	{ "FramePipeline", TestFramePipeline, false },
+	{ "PixelConvert", TestPixelConvert, false },
+	{ "BenchmarkPixelConvert", BenchmarkPixelConvert, true },
+	{ "Resize", TestResize, false },
+	{ "BenchmarkResize", BenchmarkResize, true },
+	{ "RegionPlan", TestRegionPlan, false },
+	{ "Mailbox", TestMailbox, false },
+	{ "BenchmarkMailbox", BenchmarkMailbox, true },
+	{ "ResourcePool", TestResourcePool, false },
+	{ "ReadbackRing", TestReadbackRing, false },
+	{ "TimingLog", TestTimingLog, false },
+	{ "Trace", TestTrace, false },
+	{ "BenchmarkTrace", BenchmarkTrace, true },
+	{ "OutputSink", TestOutputSink, false },
+	{ "BenchmarkOutputSink", BenchmarkOutputSink, true },
+	{ "ReplayBuffer", TestReplayBuffer, false },
+	{ "ChangeDetector", TestChangeDetector, false },
+	{ "BenchmarkChangeDetector", BenchmarkChangeDetector, true },
+	{ "HoldLastFrame", TestHoldLastFrame, false },
+	{ "LoadController", TestLoadController, false },
+	{ "Clock", TestClock, false },
+	{ "BenchmarkClock", BenchmarkClock, true },
+	{ "FpsThrottleSchedule", TestFpsThrottleSchedule, false },
+	{ "FrameBuffers", TestFrameBuffers, false },
+};
+
+int main(int argc, char* argv[])
+{
+	return RunTests(tests, argc, argv);
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include "ReadbackRing.h"
+#include "Tests.h"
+
+using namespace util;
+
+// Pretends to be a set of staging textures, a frame is just an int that gets "copied" into the slot
+// and written to the buffer when the slot is read.
+class FakeReadbackBackend : public ReadbackBackend
+{
+public:
+	std::vector<int> slots;
+	std::vector<int> copies; // slot index of each BeginCopy.
+	std::vector<int> reads;  // slot index of each ReadSlot.
+
+	void BeginCopy(size_t slot, void* frame) override {
+		if (slot >= slots.size()) {
+			slots.resize(slot + 1, -1);
+		}
+		slots[slot] = *static_cast<int*>(frame);
+		copies.push_back(static_cast<int>(slot));
+	}
+
+	void ReadSlot(size_t slot, uint8_t* buffer, unsigned int size) override {
+		Check(slot < slots.size() && slots[slot] >= 0, "read a slot that was never copied");
+		if (buffer && size >= sizeof(int)) {
+			::memcpy(buffer, &slots[slot], sizeof(int));
+		}
+		slots[slot] = -1;
+		reads.push_back(static_cast<int>(slot));
+	}
+};
+
+static int ReadFrame(ReadbackRing& ring, uint64_t& sequence, double& time)
+{
+	int value = -1;
+	Check(ring.Read(reinterpret_cast<uint8_t*>(&value), sizeof(value), sequence, time), "nothing to read");
+	return value;
+}
+
+void TestReadbackRing()
+{
+	std::cout << "Testing ReadbackRing..." << std::endl;
+	uint64_t sequence = 0;
+	double time = 0;
+	{
+		// latency 0 reads each frame right after submitting it.
+		FakeReadbackBackend backend;
+		ReadbackRing ring(backend, 0);
+		Check(ring.Slots() == 1 && !ring.Ready(), "wrong initial state");
+		Check(!ring.Read(nullptr, 0, sequence, time), "empty ring should have nothing to read");
+		for (int i = 1; i <= 3; i++) {
+			Check(ring.Submit(&i, i, i * 0.5) && ring.Ready(), "submit failed");
+			Check(ReadFrame(ring, sequence, time) == i && sequence == static_cast<uint64_t>(i) && time == i * 0.5, "read the wrong frame");
+		}
+		Check(backend.copies == std::vector<int>({ 0, 0, 0 }), "latency 0 should reuse one slot");
+	}
+	{
+		// latency 2: frame k is read while k+1 and k+2 are in flight, in submission order.
+		FakeReadbackBackend backend;
+		ReadbackRing ring(backend, 2);
+		Check(ring.Slots() == 3, "need latency + 1 slots");
+		int frames[10];
+		int expected = 0;
+		for (int i = 0; i < 10; i++) {
+			frames[i] = i;
+			Check(ring.Submit(&frames[i], i + 1, i), "submit failed");
+			Check(ring.Ready() == (i >= 2), "ready before latency frames were in flight");
+			if (ring.Ready()) {
+				Check(ReadFrame(ring, sequence, time) == expected && sequence == static_cast<uint64_t>(expected + 1), "frames out of order");
+				Check(ring.Pending() == 2, "should keep latency frames in flight");
+				expected++;
+			}
+		}
+		Check(expected == 8 && ring.LastSequence() == 10, "wrong frame count");
+
+		// each slot reports the sequence of the frame it holds.
+		for (size_t s = 0; s < ring.Slots(); s++) {
+			const ReadbackSlot& slot = ring.GetSlot(s);
+			Check(slot.sequence >= 8 && slot.sequence <= 10, "slot holds the wrong sequence");
+			Check(slot.pending == (slot.sequence != 8), "only the read slot should be done");
+		}
+
+		// a full ring rejects instead of overwriting a frame that wasn't read.
+		int extra = 99;
+		Check(ring.Submit(&extra, 11, 0), "there is a free slot");
+		Check(!ring.Submit(&extra, 12, 0), "full ring should reject");
+		Check(ring.LastSequence() == 11, "rejected frame should not count");
+
+		// draining returns the remaining frames in order.
+		Check(ReadFrame(ring, sequence, time) == 8 && ReadFrame(ring, sequence, time) == 9 && ReadFrame(ring, sequence, time) == 99, "drain out of order");
+		Check(!ring.Read(nullptr, 0, sequence, time) && ring.Pending() == 0, "ring should be empty");
+	}
+	{
+		FakeReadbackBackend backend;
+		ReadbackRing ring(backend, 1);
+		int a = 1, b = 2;
+		ring.Submit(&a, 1, 0);
+		ring.Reset();
+		Check(ring.Pending() == 0 && !ring.Ready(), "Reset should drop pending frames");
+		ring.Submit(&b, 2, 0);
+		ring.Submit(&a, 3, 0);
+		Check(ReadFrame(ring, sequence, time) == 2 && sequence == 2, "read the wrong frame after Reset");
+
+		ring.SetLatency(3);
+		Check(ring.Slots() == 4 && ring.Latency() == 3 && ring.Pending() == 0, "SetLatency failed");
+		int frames[4] = { 10, 11, 12, 13 };
+		for (int i = 0; i < 4; i++) {
+			ring.Submit(&frames[i], 20 + i, 0);
+		}
+		Check(ring.Ready() && ReadFrame(ring, sequence, time) == 10 && sequence == 20, "wrong frame after SetLatency");
+	}
+}
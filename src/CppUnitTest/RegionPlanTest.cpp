@@ -0,0 +1,161 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <string>
+#include "RegionPlan.h"
+#include "Tests.h"
+
+using namespace util;
+
+// A synthetic captured frame with the same row padding ReadPixels gives us.
+struct SyntheticFrame
+{
+	int width;
+	int height;
+	int pitch;
+	std::vector<uint8_t> pixels;
+
+	SyntheticFrame(int w, int h, unsigned int seed) : width(w), height(h)
+	{
+		pitch = ((w * 4 + 63) / 64) * 64;
+		pixels.resize(static_cast<size_t>(pitch) * h);
+		std::mt19937 random(seed);
+		for (auto& p : pixels) {
+			p = static_cast<uint8_t>(random());
+		}
+	}
+};
+
+// Does on the CPU what OnFrameArrived does with CopySubresourceRegion for each copy in the plan.
+static std::vector<uint8_t> BuildAtlas(const SyntheticFrame& frame, const RegionPlan& plan, int& pitch)
+{
+	pitch = plan.width * 4 + 32; // staging textures are pitched too.
+	std::vector<uint8_t> atlas(static_cast<size_t>(pitch) * plan.height, 0);
+	for (auto& copy : plan.copies) {
+		for (int y = 0; y < copy.source.Height(); y++) {
+			::memcpy(atlas.data() + (copy.y + y) * pitch + copy.x * 4,
+				frame.pixels.data() + (copy.source.top + y) * frame.pitch + copy.source.left * 4,
+				static_cast<size_t>(copy.source.Width()) * 4);
+		}
+	}
+	return atlas;
+}
+
+static void CheckPlan(const RegionPlan& plan, const std::map<int, RegionSpec>& specs, const std::string& name)
+{
+	Check(plan.regions.size() == specs.size(), name + ": every region must be placed");
+	for (auto& region : plan.regions) {
+		const RegionCopy* owner = nullptr;
+		for (auto& copy : plan.copies) {
+			if (copy.source.Contains(region.spec.bounds) &&
+				region.x == copy.x + region.spec.bounds.left - copy.source.left &&
+				region.y == copy.y + region.spec.bounds.top - copy.source.top) {
+				owner = &copy;
+			}
+		}
+		Check(owner != nullptr, name + ": region is not inside the copy it was placed in");
+	}
+	// the copies must not overlap in the atlas and must fit in it.
+	for (size_t a = 0; a < plan.copies.size(); a++) {
+		auto& ca = plan.copies[a];
+		RegionRect ra = { ca.x, ca.y, ca.x + ca.source.Width(), ca.y + ca.source.Height() };
+		Check(ra.right <= plan.width && ra.bottom <= plan.height, name + ": copy outside the atlas");
+		for (size_t b = a + 1; b < plan.copies.size(); b++) {
+			auto& cb = plan.copies[b];
+			RegionRect rb = { cb.x, cb.y, cb.x + cb.source.Width(), cb.y + cb.source.Height() };
+			Check(ra.Intersect(rb).Empty(), name + ": copies overlap in the atlas");
+		}
+	}
+}
+
+void TestRegionPlan()
+{
+	std::cout << "Testing region planning..." << std::endl;
+	RegionRect screen = { 0, 0, 1920, 1080 };
+	{
+		// overlapping and touching regions share a copy, far apart ones don't.
+		std::map<int, RegionSpec> specs;
+		specs[1].bounds = { 100, 100, 300, 200 };
+		specs[2].bounds = { 120, 110, 320, 210 };
+		specs[3].bounds = { 1500, 800, 1600, 900 };
+		specs[4].bounds = { 1600, 800, 1700, 900 };
+		specs[5].bounds = { 100, 900, 200, 1000 };
+		auto plan = RegionPlan::Build(specs);
+		CheckPlan(*plan, specs, "overlap");
+		Check(plan->copies.size() == 3, "overlapping and touching regions should share a copy");
+		Check(plan->CopiedPixels() < screen.Area() / 10, "should copy far less than the whole screen");
+	}
+	{
+		// a region inside another costs nothing extra.
+		std::map<int, RegionSpec> specs;
+		specs[1].bounds = { 0, 0, 500, 500 };
+		specs[2].bounds = { 10, 10, 20, 20 };
+		auto plan = RegionPlan::Build(specs);
+		CheckPlan(*plan, specs, "nested");
+		Check(plan->copies.size() == 1 && plan->CopiedPixels() == 500 * 500, "nested region should not be copied twice");
+	}
+	{
+		std::map<int, RegionSpec> none;
+		auto plan = RegionPlan::Build(none);
+		Check(plan->copies.empty() && plan->width == 0 && plan->height == 0, "empty plan");
+	}
+
+	// random widget layouts: extracting each region from the atlas must give exactly what converting
+	// it straight out of the frame gives.
+	SyntheticFrame frame(screen.right, screen.bottom, 7);
+	std::mt19937 random(42);
+	const PixelFormat formats[] = { PixelFormat::Bgra, PixelFormat::Bgr, PixelFormat::Rgb, PixelFormat::Gray8 };
+	for (int layout = 0; layout < 20; layout++) {
+		RegionSet set;
+		std::map<int, RegionSpec> specs;
+		int count = 1 + random() % 8;
+		for (int i = 0; i < count; i++) {
+			RegionSpec spec;
+			int w = 8 + random() % 400;
+			int h = 8 + random() % 300;
+			int x = static_cast<int>(random() % screen.right) - 50; // some hang off the edge.
+			int y = static_cast<int>(random() % screen.bottom) - 50;
+			spec.bounds = { x, y, x + w, y + h };
+			spec.format = formats[random() % 4];
+			if (random() % 2) {
+				spec.outputWidth = 1 + random() % 128;
+				spec.outputHeight = 1 + random() % 128;
+				spec.filter = static_cast<ResizeFilter>(random() % 3);
+			}
+			int id = set.Add(spec, screen);
+			if (id != 0) {
+				spec.bounds = spec.bounds.Intersect(screen);
+				specs[id] = spec;
+			}
+		}
+		auto plan = set.Plan();
+		std::string name = "layout " + std::to_string(layout);
+		CheckPlan(*plan, specs, name);
+
+		int pitch = 0;
+		std::vector<uint8_t> atlas = BuildAtlas(frame, *plan, pitch);
+		for (auto& region : plan->regions) {
+			const RegionSpec& spec = region.spec;
+			int stride = spec.OutputWidth() * BytesPerPixel(spec.format) + 1;
+			size_t size = static_cast<size_t>(RegionBufferSize(spec, stride));
+			std::vector<uint8_t> expected(size, 0);
+			const uint8_t* src = frame.pixels.data() + spec.bounds.top * frame.pitch + spec.bounds.left * 4;
+			ResizeBgra(src, frame.pitch, spec.bounds.Width(), spec.bounds.Height(), expected.data(), stride,
+				spec.OutputWidth(), spec.OutputHeight(), spec.format, spec.filter);
+			std::vector<uint8_t> actual(size, 0);
+			ExtractRegion(atlas.data(), pitch, region, actual.data(), stride);
+			Check(actual == expected, name + ": region " + std::to_string(region.id) + " does not match the frame");
+		}
+
+		// removing a region rebuilds the plan without it.
+		if (!specs.empty()) {
+			int id = specs.begin()->first;
+			Check(set.Remove(id) && set.Plan()->Find(id) == nullptr, "removed region is still planned");
+			Check(!set.Remove(id), "region removed twice");
+		}
+	}
+	RegionSet set;
+	Check(set.Add(RegionSpec{ { 2000, 0, 2100, 10 } }, screen) == 0, "region outside the capture should be rejected");
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "ReplayBuffer.h"
+#include "Tests.h"
+
+using namespace util;
+
+// 30 fps in a 1/1000 time base with a key frame every gop frames, the way the encoder emits them.
+static std::shared_ptr<ReplayPacket> MakePacket(int64_t index, int gop, size_t size = 100)
+{
+	auto packet = std::make_shared<ReplayPacket>();
+	packet->data.resize(size, static_cast<uint8_t>(index));
+	packet->dts = index * 1000 / 30;
+	packet->pts = packet->dts + 33;
+	packet->duration = 33;
+	packet->key = index % gop == 0;
+	return packet;
+}
+
+static void TestReplayWindow()
+{
+	ReplayBuffer replay;
+	replay.Configure(2.0, 1 << 30, 1, 1000);
+	Check(replay.Snapshot().empty() && replay.Seconds() == 0, "a new buffer should be empty");
+
+	// packets before the first key frame can't be decoded so they are not kept.
+	for (int64_t i = 5; i < 10; i++) {
+		replay.Add(MakePacket(i, 10));
+	}
+	Check(replay.Snapshot().empty(), "the buffer has to start on a key frame");
+
+	const int gop = 10;
+	for (int64_t i = 10; i < 10 + 30 * 10; i++) {
+		replay.Add(MakePacket(i, gop));
+		auto packets = replay.Snapshot();
+		Check(packets.front()->key, "the buffer has to start on a key frame");
+		double seconds = replay.Seconds();
+		if (i >= 10 + 60) {
+			// at least the window, at most the window plus one group of pictures.
+			Check(seconds >= 2.0 && seconds < 2.0 + gop / 30.0 + 0.01, "replay is " + std::to_string(seconds) + " seconds");
+		}
+	}
+	size_t bytes = 0;
+	for (auto& packet : replay.Snapshot()) {
+		bytes += packet->data.size();
+	}
+	Check(bytes == replay.Bytes(), "byte count is off");
+
+	replay.Clear();
+	Check(replay.Snapshot().empty() && replay.Bytes() == 0, "clear should drop everything");
+}
+
+static void TestReplayMemoryCap()
+{
+	ReplayBuffer replay;
+	const size_t cap = 100000;
+	replay.Configure(60.0, cap, 1, 1000);
+	for (int64_t i = 0; i < 1000; i++) {
+		// big key frames and small deltas, like screen content.
+		replay.Add(MakePacket(i, 30, i % 30 == 0 ? 20000 : 1000));
+		Check(replay.Bytes() <= cap, "the buffer went over its memory cap");
+		Check(replay.Snapshot().front()->key, "the buffer has to start on a key frame");
+	}
+	Check(replay.Seconds() < 60.0 && replay.Seconds() >= 1.0, "the memory cap should shorten the replay");
+
+	// one group of pictures bigger than the cap is still kept whole.
+	replay.Configure(60.0, 1000, 1, 1000);
+	for (int64_t i = 0; i < 30; i++) {
+		replay.Add(MakePacket(i, 30, 500));
+	}
+	Check(replay.Snapshot().size() == 30, "the newest group of pictures should always be kept");
+}
+
+// Snapshots taken while the encoder keeps adding must stay valid and start on a key frame.
+static void TestReplaySnapshotWhileAdding()
+{
+	ReplayBuffer replay;
+	replay.Configure(0.5, 1 << 30, 1, 1000);
+	std::atomic<bool> done{ false };
+	std::atomic<int> failures{ 0 };
+	std::thread reader([&]() {
+		while (!done) {
+			auto packets = replay.Snapshot();
+			if (!packets.empty() && !packets.front()->key) {
+				failures++;
+			}
+			for (size_t i = 1; i < packets.size(); i++) {
+				// MakePacket fills each packet with its index, none may be missing.
+				if (packets[i]->dts <= packets[i - 1]->dts || packets[i]->data[0] != static_cast<uint8_t>(packets[i - 1]->data[0] + 1)) {
+					failures++;
+				}
+			}
+			std::this_thread::yield();
+		}
+	});
+	for (int64_t i = 0; i < 20000; i++) {
+		replay.Add(MakePacket(i, 10));
+	}
+	done = true;
+	reader.join();
+	Check(failures == 0, std::to_string(failures) + " bad replay snapshots");
+}
+
+void TestReplayBuffer()
+{
+	std::cout << "Testing the replay buffer..." << std::endl;
+	TestReplayWindow();
+	TestReplayMemoryCap();
+	TestReplaySnapshotWhileAdding();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,201 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include "Resize.h"
+#include "Tests.h"
+
+using namespace util;
+
+static const char* FilterName(ResizeFilter filter)
+{
+	switch (filter) {
+	case ResizeFilter::Nearest:
+		return "nearest";
+	case ResizeFilter::Box:
+		return "box";
+	default:
+		return "bilinear";
+	}
+}
+
+// A BGRA image with the same row padding ReadPixels gives us. Smooth gradients plus noise so the
+// filters have something to average.
+struct ResizeSource
+{
+	int width;
+	int height;
+	int pitch;
+	std::vector<uint8_t> pixels;
+
+	ResizeSource(int w, int h, unsigned int seed) : width(w), height(h)
+	{
+		pitch = ((w * 4 + 63) / 64) * 64;
+		pixels.resize(static_cast<size_t>(pitch) * h);
+		std::mt19937 random(seed);
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				uint8_t* p = pixels.data() + y * pitch + x * 4;
+				p[0] = static_cast<uint8_t>(x * 255 / std::max(1, w - 1));
+				p[1] = static_cast<uint8_t>(y * 255 / std::max(1, h - 1));
+				p[2] = static_cast<uint8_t>(random());
+				p[3] = static_cast<uint8_t>(255 - (random() & 15));
+			}
+		}
+	}
+
+	double At(int x, int y, int c) const
+	{
+		return pixels[y * pitch + x * 4 + c];
+	}
+};
+
+// Straightforward floating point versions of each filter.
+static std::vector<uint8_t> ReferenceResize(const ResizeSource& src, int dstWidth, int dstHeight, ResizeFilter filter)
+{
+	std::vector<uint8_t> result(static_cast<size_t>(dstWidth) * dstHeight * 4);
+	double sx = static_cast<double>(src.width) / dstWidth;
+	double sy = static_cast<double>(src.height) / dstHeight;
+	for (int y = 0; y < dstHeight; y++) {
+		for (int x = 0; x < dstWidth; x++) {
+			for (int c = 0; c < 4; c++) {
+				double value = 0;
+				if (filter == ResizeFilter::Nearest) {
+					int px = std::min(src.width - 1, static_cast<int>(std::floor((x + 0.5) * sx)));
+					int py = std::min(src.height - 1, static_cast<int>(std::floor((y + 0.5) * sy)));
+					value = src.At(px, py, c);
+				}
+				else if (filter == ResizeFilter::Box) {
+					int x0 = static_cast<int>(std::floor(x * sx));
+					int x1 = std::max(x0 + 1, static_cast<int>(std::floor((x + 1) * sx)));
+					int y0 = static_cast<int>(std::floor(y * sy));
+					int y1 = std::max(y0 + 1, static_cast<int>(std::floor((y + 1) * sy)));
+					for (int j = y0; j < y1; j++) {
+						for (int i = x0; i < x1; i++) {
+							value += src.At(i, j, c);
+						}
+					}
+					value /= (x1 - x0) * (y1 - y0);
+				}
+				else {
+					double cx = std::min(std::max(0.0, (x + 0.5) * sx - 0.5), src.width - 1.0);
+					double cy = std::min(std::max(0.0, (y + 0.5) * sy - 0.5), src.height - 1.0);
+					int x0 = static_cast<int>(cx);
+					int y0 = static_cast<int>(cy);
+					int x1 = std::min(x0 + 1, src.width - 1);
+					int y1 = std::min(y0 + 1, src.height - 1);
+					double fx = cx - x0;
+					double fy = cy - y0;
+					value = (src.At(x0, y0, c) * (1 - fx) + src.At(x1, y0, c) * fx) * (1 - fy) +
+						(src.At(x0, y1, c) * (1 - fx) + src.At(x1, y1, c) * fx) * fy;
+				}
+				result[(y * dstWidth + x) * 4 + c] = static_cast<uint8_t>(std::lround(value));
+			}
+		}
+	}
+	return result;
+}
+
+void TestResize()
+{
+	std::cout << "Testing resize against a floating point reference..." << std::endl;
+	// downscales, upscales, odd ratios and 1 pixel edges.
+	const int cases[][4] = {
+		{ 64, 48, 16, 12 }, { 101, 67, 23, 9 }, { 640, 360, 224, 224 }, { 1278, 720, 512, 288 },
+		{ 17, 5, 40, 11 }, { 1, 1, 3, 2 }, { 9, 1, 4, 1 }, { 33, 21, 33, 21 },
+	};
+	const ResizeFilter filters[] = { ResizeFilter::Nearest, ResizeFilter::Box, ResizeFilter::Bilinear };
+	const PixelFormat formats[] = { PixelFormat::Bgr, PixelFormat::Rgb, PixelFormat::Gray8 };
+	for (auto& c : cases) {
+		ResizeSource src(c[0], c[1], c[0] * 7 + c[1]);
+		int dstWidth = c[2];
+		int dstHeight = c[3];
+		for (ResizeFilter filter : filters) {
+			std::string name = std::string(FilterName(filter)) + " " + std::to_string(src.width) + "x" + std::to_string(src.height) +
+				" to " + std::to_string(dstWidth) + "x" + std::to_string(dstHeight);
+			std::vector<uint8_t> expected = ReferenceResize(src, dstWidth, dstHeight, filter);
+
+			std::vector<uint8_t> scalar(expected.size());
+			ResizeBgra(src.pixels.data(), src.pitch, src.width, src.height, scalar.data(), dstWidth * 4, dstWidth, dstHeight,
+				PixelFormat::Bgra, filter, 1, CpuLevel::Scalar);
+			int maxDiff = 0;
+			for (size_t i = 0; i < expected.size(); i++) {
+				maxDiff = std::max(maxDiff, std::abs(expected[i] - scalar[i]));
+			}
+			// nearest is exact, the others can round differently with fixed point weights.
+			Check(maxDiff <= (filter == ResizeFilter::Nearest ? 0 : 1), name + " differs from the reference by " + std::to_string(maxDiff));
+
+			for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+				for (int threads : { 1, 3 }) {
+					std::string variant = name + " " + CpuLevelName(static_cast<CpuLevel>(level)) + " threads " + std::to_string(threads);
+					std::vector<uint8_t> bgra(expected.size());
+					ResizeBgra(src.pixels.data(), src.pitch, src.width, src.height, bgra.data(), dstWidth * 4, dstWidth, dstHeight,
+						PixelFormat::Bgra, filter, threads, static_cast<CpuLevel>(level));
+					Check(bgra == scalar, variant + " does not match scalar");
+
+					// the fused conversion must match converting the resized BGRA image.
+					for (PixelFormat format : formats) {
+						int stride = dstWidth * BytesPerPixel(format) + 3;
+						std::vector<uint8_t> converted(static_cast<size_t>(stride) * dstHeight, 0);
+						ConvertBgra(scalar.data(), dstWidth * 4, dstWidth, dstHeight, converted.data(), stride, format, CpuLevel::Scalar);
+						std::vector<uint8_t> fused(converted.size(), 0);
+						ResizeBgra(src.pixels.data(), src.pitch, src.width, src.height, fused.data(), stride, dstWidth, dstHeight,
+							format, filter, threads, static_cast<CpuLevel>(level));
+						Check(fused == converted, variant + " fused conversion mismatch");
+					}
+				}
+			}
+		}
+	}
+	std::cout << "ok" << std::endl;
+}
+
+void BenchmarkResize()
+{
+	std::cout << "Benchmarking 4K resize and conversion..." << std::endl;
+	ResizeSource src(3840, 2160, 1);
+	const int sizes[][2] = { { 224, 224 }, { 512, 512 } };
+	const int iterations = 20;
+	std::vector<uint8_t> dst(static_cast<size_t>(src.width) * src.height * 3);
+
+	auto report = [&](const std::string& name, auto run) {
+		run(); // warmup
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			run();
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		double ms = elapsed.count() / iterations;
+		std::cout << std::fixed << std::setprecision(3) << std::setw(36) << name << " " << ms << " ms/frame "
+			<< std::setprecision(0) << (1000.0 / ms) << " fps" << std::endl;
+	};
+
+	// what we did before: ship the full frame and let the caller resize it.
+	report("full 3840x2160 bgr", [&]() {
+		ConvertBgra(src.pixels.data(), src.pitch, src.width, src.height, dst.data(), src.width * 3, PixelFormat::Bgr);
+	});
+	int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	for (auto& size : sizes) {
+		for (ResizeFilter filter : { ResizeFilter::Nearest, ResizeFilter::Box, ResizeFilter::Bilinear }) {
+			auto run = [&](CpuLevel level, int threads) {
+				std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]) + " bgr " + FilterName(filter) + " " +
+					CpuLevelName(level) + " x" + std::to_string(threads);
+				report(name, [&]() {
+					ResizeBgra(src.pixels.data(), src.pitch, src.width, src.height, dst.data(), size[0] * 3, size[0], size[1],
+						PixelFormat::Bgr, filter, threads, level);
+				});
+			};
+			for (int level = 0; level <= static_cast<int>(GetCpuLevel()); level++) {
+				run(static_cast<CpuLevel>(level), 1);
+			}
+			if (cores > 1) {
+				run(GetCpuLevel(), std::min(4, cores));
+			}
+		}
+	}
+}
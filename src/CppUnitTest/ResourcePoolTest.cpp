@@ -0,0 +1,161 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include "ResourcePool.h"
+#include "Tests.h"
+
+using namespace util;
+
+struct MockKey
+{
+	int width;
+	int height;
+
+	bool operator==(const MockKey& other) const {
+		return width == other.width && height == other.height;
+	}
+};
+
+struct MockTexture
+{
+	MockKey key;
+	int id;
+};
+
+// Keeps track of what the pool creates and destroys.
+class MockAllocator : public ResourceAllocator<MockKey, MockTexture>
+{
+public:
+	std::atomic<int> live{ 0 };
+	std::atomic<int> nextId{ 0 };
+	bool fail = false;
+
+	MockTexture* Create(const MockKey& key) override {
+		if (fail) {
+			return nullptr;
+		}
+		live++;
+		return new MockTexture{ key, nextId++ };
+	}
+
+	void Destroy(MockTexture* texture) override {
+		live--;
+		delete texture;
+	}
+};
+
+void TestResourcePool()
+{
+	std::cout << "Testing ResourcePool..." << std::endl;
+	auto allocator = std::make_shared<MockAllocator>();
+	{
+		ResourcePool<MockKey, MockTexture> pool(allocator, 3, 2);
+		MockKey small = { 640, 480 };
+		MockKey large = { 1920, 1080 };
+
+		// released resources are reused for the same key.
+		int id = 0;
+		{
+			auto a = pool.Acquire(small);
+			Check(a != nullptr && a->key == small, "acquire failed");
+			id = a->id;
+		}
+		{
+			auto b = pool.Acquire(small);
+			Check(b->id == id, "released texture was not reused");
+			auto c = pool.Acquire(large);
+			Check(c->id != id && c->key == large, "a different key must not reuse the texture");
+		}
+		auto stats = pool.GetStats();
+		Check(stats.created == 2 && stats.reused == 1 && stats.outstanding == 0 && stats.available == 2, "wrong stats after reuse");
+
+		// the outstanding limit rejects rather than allocates.
+		{
+			auto a = pool.Acquire(small);
+			auto b = pool.Acquire(small);
+			auto c = pool.Acquire(small);
+			Check(a && b && c, "acquire within the limit failed");
+			Check(pool.Acquire(small) == nullptr, "acquire over the limit should fail");
+			Check(pool.GetStats().rejected == 1, "rejected count is wrong");
+			c = nullptr;
+			Check(pool.Acquire(small) != nullptr, "acquire after a release should succeed");
+		}
+
+		// only maxAvailable are kept, the least recently returned go first.
+		stats = pool.GetStats();
+		Check(stats.available == 2 && allocator->live == 2, "pool should keep 2 textures");
+		{
+			auto a = pool.Acquire(large); // was evicted, so this creates a new one.
+			auto b = pool.Acquire(large);
+			Check(a->key == large && b->key == large, "wrong key");
+		}
+		Check(allocator->live == 2, "eviction did not destroy the extra textures");
+
+		// a failed allocation doesn't leak an outstanding slot.
+		allocator->fail = true;
+		for (int i = 0; i < 5; i++) {
+			Check(pool.Acquire({ 1, 1 }) == nullptr, "failed allocation should return null");
+		}
+		allocator->fail = false;
+		Check(pool.GetStats().outstanding == 0, "failed allocations left outstanding resources");
+
+		// shrinking the limits trims the available list right away.
+		pool.SetLimits(3, 0);
+		Check(allocator->live == 0 && pool.GetStats().available == 0, "SetLimits did not trim");
+	}
+
+	// resources can outlive the pool and are destroyed when released.
+	std::shared_ptr<MockTexture> survivor;
+	{
+		ResourcePool<MockKey, MockTexture> pool(allocator, 3, 2);
+		survivor = pool.Acquire({ 8, 8 });
+		auto returned = pool.Acquire({ 8, 8 });
+	}
+	Check(allocator->live == 1, "pool destructor should only destroy the available textures");
+	survivor = nullptr;
+	Check(allocator->live == 0, "texture released after the pool was not destroyed");
+
+	// acquire on one thread and release on others, like the capture callback and its readers.
+	{
+		ResourcePool<MockKey, MockTexture> pool(allocator, 8, 4);
+		std::atomic<bool> done{ false };
+		std::vector<std::shared_ptr<MockTexture>> inbox(4);
+		std::vector<std::thread> readers;
+		std::atomic<int> failures{ 0 };
+		for (int r = 0; r < 4; r++) {
+			readers.emplace_back([&, r]() {
+				while (!done) {
+					auto texture = std::atomic_exchange(&inbox[r], std::shared_ptr<MockTexture>());
+					if (texture && !(texture->key == MockKey{ 64, 64 })) {
+						failures++;
+					}
+					std::this_thread::yield();
+				}
+			});
+		}
+		for (int i = 0; i < 20000; i++) {
+			auto texture = pool.Acquire({ 64, 64 });
+			if (texture) {
+				std::atomic_store(&inbox[i % 4], texture);
+			}
+			if (i % 16 == 0) {
+				std::this_thread::yield();
+			}
+		}
+		done = true;
+		for (auto& t : readers) {
+			t.join();
+		}
+		for (auto& texture : inbox) {
+			texture = nullptr;
+		}
+		auto stats = pool.GetStats();
+		std::cout << "created " << stats.created << " reused " << stats.reused << " rejected " << stats.rejected << std::endl;
+		Check(failures == 0, "reader got the wrong texture");
+		Check(stats.outstanding == 0, "textures leaked");
+		Check(stats.created <= 8 + stats.destroyed, "pool created more than the limit");
+	}
+	Check(allocator->live == 0, "textures leaked after the threaded test");
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// The test tables of the CMake builds, see PortableTests.cpp and FFmpegTests.cpp.
+struct TestCase
+{
+	const char* name;
+	void (*run)();
+	bool benchmark; // only run when named on the command line.
+};
+
+// Runs all tests, or just the tests and benchmarks named on the command line, and returns how
+// many failed.
+template <size_t Count>
+int RunTests(const TestCase (&tests)[Count], int argc, char* argv[])
+{
+	int failed = 0;
+	for (auto& test : tests) {
+		bool selected = (argc < 2 && !test.benchmark);
+		for (int i = 1; i < argc; i++) {
+			if (std::string(argv[i]) == test.name) {
+				selected = true;
+			}
+		}
+		if (!selected) {
+			continue;
+		}
+		try {
+			test.run();
+		}
+		catch (const std::exception& e) {
+			std::cout << test.name << " failed: " << e.what() << std::endl;
+			failed++;
+		}
+	}
+	return failed;
+}
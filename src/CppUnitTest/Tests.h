@@ -0,0 +1,49 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+// Each test is a plain function registered in the table in CppUnitTest.cpp.
+// Tests throw on failure, benchmarks just print their results.
+inline void Check(bool condition, const std::string& message)
+{
+	if (!condition) {
+		throw std::runtime_error(message);
+	}
+}
+
+void TestColorConvert();
+void BenchmarkColorConvert();
+void TestSpscQueue();
+void TestFramePipeline();
+void TestFFmpegPipeline();
+void TestStreamingContainers();
+void TestSegments();
+void TestReplay();
+void BenchmarkPipeline();
+void BenchmarkMultiStream();
+void TestEncoderOptions();
+void TestVariableFrameRate();
+void BenchmarkProfiles();
+void TestMailbox();
+void BenchmarkMailbox();
+void TestResourcePool();
+void TestReadbackRing();
+void TestPixelConvert();
+void BenchmarkPixelConvert();
+void TestResize();
+void BenchmarkResize();
+void TestRegionPlan();
+void TestTimingLog();
+void TestTrace();
+void BenchmarkTrace();
+void TestOutputSink();
+void BenchmarkOutputSink();
+void TestReplayBuffer();
+void TestChangeDetector();
+void BenchmarkChangeDetector();
+void TestHoldLastFrame();
+void TestLoadController();
+void TestClock();
+void BenchmarkClock();
+void TestFpsThrottleSchedule();
+void TestFrameBuffers();
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "TimingLog.h"
+#include "Tests.h"
+
+using namespace util;
+
+static void TestTimingRingCursor()
+{
+	TimingRing ring(100); // rounds up to 128
+	Check(ring.Capacity() == 128, "capacity should round up to a power of 2");
+	double buffer[256];
+	uint64_t cursor = 0;
+	Check(ring.Read(cursor, buffer, 256) == 0 && cursor == 0, "empty ring should read nothing");
+
+	for (int i = 0; i < 50; i++) {
+		ring.Add(i);
+	}
+	Check(ring.Read(cursor, buffer, 20) == 20 && cursor == 20 && buffer[0] == 0 && buffer[19] == 19, "partial read");
+	Check(ring.Read(cursor, buffer, 256) == 30 && cursor == 50 && buffer[0] == 20 && buffer[29] == 49, "read the rest");
+	Check(ring.Read(cursor, buffer, 256) == 0, "nothing new");
+
+	// the reader falls behind by more than the capacity, it gets the newest 128.
+	for (int i = 50; i < 400; i++) {
+		ring.Add(i);
+	}
+	Check(ring.Count() == 400 && ring.Available() == 128, "count keeps going, available is capped");
+	size_t count = ring.Read(cursor, buffer, 256);
+	Check(count == 128 && buffer[0] == 272 && buffer[127] == 399 && cursor == 400, "lapped reader should skip ahead");
+
+	// a reset starts the count over, old cursors skip to the new times.
+	ring.Reset();
+	Check(ring.Count() == 0 && ring.Available() == 0, "reset should forget everything");
+	ring.Add(1000);
+	ring.Add(1001);
+	uint64_t old = 10;
+	Check(ring.Read(old, buffer, 256) == 2 && buffer[0] == 1000, "cursor from before the reset");
+	Check(ring.Read(cursor, buffer, 256) == 2 && buffer[1] == 1001, "cursor at the reset");
+}
+
+// One writer adds the sequence 0, 1, 2... as fast as it can while readers poll, every read has
+// to be a gap free run of that sequence continuing after what the reader saw last.
+static void TestTimingRingThreads()
+{
+	TimingRing ring(64);
+	const int total = 200000;
+	std::atomic<bool> done{ false };
+	std::atomic<int> failures{ 0 };
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 2; r++) {
+		readers.emplace_back([&]() {
+			std::vector<double> buffer(ring.Capacity());
+			uint64_t cursor = 0;
+			double last = -1;
+			while (!done) {
+				size_t count = ring.Read(cursor, buffer.data(), buffer.size());
+				for (size_t i = 0; i < count; i++) {
+					bool contiguous = i == 0 ? buffer[i] > last : buffer[i] == buffer[i - 1] + 1;
+					if (!contiguous || buffer[i] != static_cast<double>(cursor - count + i)) {
+						failures++;
+					}
+				}
+				if (count > 0) {
+					last = buffer[count - 1];
+				}
+				std::this_thread::yield();
+			}
+		});
+	}
+	for (int i = 0; i < total; i++) {
+		ring.Add(i);
+		if (i % 1000 == 0) {
+			std::this_thread::yield();
+		}
+	}
+	done = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	Check(failures == 0, std::to_string(failures) + " reads returned overwritten or out of order times");
+}
+
+static void TestTimingStatsAccuracy()
+{
+	// 60 fps with jitter and an occasional long stall, like a real capture.
+	std::mt19937 random(3);
+	std::normal_distribution<double> jitter(0, 0.0015);
+	TimingStats stats;
+	std::vector<double> gaps;
+	double time = 5;
+	stats.Add(time);
+	for (int i = 0; i < 100000; i++) {
+		double gap = std::max(0.0, 1.0 / 60 + jitter(random));
+		if (i % 500 == 0) {
+			gap += 0.1;
+		}
+		time += gap;
+		gaps.push_back(gap);
+		stats.Add(time);
+	}
+	TimingSummary summary = stats.Summary();
+	std::sort(gaps.begin(), gaps.end());
+	auto exact = [&](double p) {
+		return gaps[static_cast<size_t>(std::ceil(p * gaps.size())) - 1];
+	};
+	auto close = [](double actual, double expected) {
+		return std::abs(actual - expected) <= expected * 0.02 + 1e-6;
+	};
+	Check(summary.count == 100001, "count");
+	Check(summary.first == 5 && summary.last == time, "first and last time");
+	Check(close(summary.meanGap, (time - 5) / 100000), "mean gap");
+	Check(std::abs(summary.maxGap - gaps.back()) < 1e-9, "max gap should be exact");
+	Check(close(summary.p50Gap, exact(0.50)), "p50 gap is " + std::to_string(summary.p50Gap) + " expected " + std::to_string(exact(0.50)));
+	Check(close(summary.p95Gap, exact(0.95)), "p95 gap is " + std::to_string(summary.p95Gap) + " expected " + std::to_string(exact(0.95)));
+	Check(close(summary.p99Gap, exact(0.99)), "p99 gap is " + std::to_string(summary.p99Gap) + " expected " + std::to_string(exact(0.99)));
+
+	stats.Reset();
+	summary = stats.Summary();
+	Check(summary.count == 0 && summary.maxGap == 0 && summary.p99Gap == 0, "reset stats");
+	stats.Add(1);
+	stats.Add(1); // duplicate times are a 0 gap, not a crash.
+	summary = stats.Summary();
+	Check(summary.count == 2 && summary.p50Gap == 0 && summary.maxGap == 0, "zero gap");
+}
+
+void TestTimingLog()
+{
+	std::cout << "Testing timing ring and statistics..." << std::endl;
+	TestTimingRingCursor();
+	TestTimingRingThreads();
+	TestTimingStatsAccuracy();
+
+	TimingLog log(16);
+	for (int i = 0; i < 40; i++) {
+		log.Add(i / 30.0);
+	}
+	double buffer[64];
+	Check(log.Copy(nullptr, 0) == 16, "copy should report what is in the ring");
+	Check(log.Copy(buffer, 4) == 4 && buffer[0] == 24 / 30.0 && buffer[3] == 27 / 30.0, "copy the oldest");
+	Check(log.Copy(buffer, 64) == 16 && buffer[15] == 39 / 30.0, "copy no more than the ring has");
+	Check(log.Count() == 40 && log.Summary().count == 40, "log count");
+	std::cout << "ok" << std::endl;
+}
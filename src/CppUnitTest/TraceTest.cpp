@@ -0,0 +1,175 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include "Trace.h"
+#include "Tests.h"
+
+using namespace util;
+
+static size_t CountOf(const std::string& text, const std::string& pattern)
+{
+	size_t count = 0;
+	for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+		count++;
+	}
+	return count;
+}
+
+// A reader copying a buffer while its thread keeps overwriting it must only ever see whole events.
+static void TestTraceBufferOverwrite()
+{
+	TraceBuffer buffer(32);
+	static const char* name = "event";
+	std::atomic<bool> done{ false };
+	std::atomic<int> failures{ 0 };
+	std::thread reader([&]() {
+		std::vector<TraceEvent> events;
+		while (!done) {
+			events.clear();
+			buffer.Read(events);
+			if (events.size() > buffer.Capacity()) {
+				failures++;
+			}
+			for (size_t i = 0; i < events.size(); i++) {
+				// each event is written with duration = start + 1 and consecutive starts.
+				if (events[i].name != name || events[i].duration != events[i].start + 1 ||
+					(i > 0 && events[i].start != events[i - 1].start + 1)) {
+					failures++;
+				}
+			}
+			std::this_thread::yield();
+		}
+	});
+	for (uint64_t i = 0; i < 200000; i++) {
+		buffer.Add(name, i, i + 1);
+		if (i % 1000 == 0) {
+			std::this_thread::yield();
+		}
+	}
+	done = true;
+	reader.join();
+	Check(failures == 0, std::to_string(failures) + " torn or out of order trace events");
+
+	std::vector<TraceEvent> events;
+	buffer.Read(events);
+	Check(events.size() == 32 && events.back().start == 199999, "full buffer keeps the newest events");
+	buffer.Clear();
+	events.clear();
+	buffer.Read(events);
+	Check(events.empty(), "cleared buffer should be empty");
+}
+
+void TestTrace()
+{
+	std::cout << "Testing the tracer..." << std::endl;
+	TestTraceBufferOverwrite();
+
+	Tracer& tracer = Tracer::Instance();
+	tracer.Enable(false);
+	tracer.Clear();
+	{
+		UTIL_TRACE_SCOPE("disabled");
+	}
+	Check(tracer.Events().empty(), "a disabled tracer should not record");
+
+	tracer.Enable(true);
+	const int perThread = 1000;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 3; t++) {
+		threads.emplace_back([t]() {
+			Tracer::Instance().SetThreadName("worker \"" + std::to_string(t) + "\"");
+			for (int i = 0; i < perThread; i++) {
+				UTIL_TRACE_SCOPE("outer");
+				UTIL_TRACE_SCOPE("inner");
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	tracer.Enable(false);
+
+	auto events = tracer.Events();
+	std::map<int, int> perLane;
+	for (auto& e : events) {
+		perLane[e.first]++;
+		Check(e.second.name == std::string("outer") || e.second.name == std::string("inner"), "unexpected event name");
+	}
+	// the threads may have run one after the other and shared a lane.
+	Check(events.size() == 3 * 2 * perThread, "expected " + std::to_string(3 * 2 * perThread) + " events, got " + std::to_string(events.size()));
+	for (auto& lane : perLane) {
+		Check(lane.second % (2 * perThread) == 0, "a thread's events were split across lanes");
+	}
+
+	std::ostringstream json;
+	tracer.WriteChromeJson(json);
+	std::string text = json.str();
+	Check(text.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0, "not a chrome trace");
+	Check(CountOf(text, "\"ph\":\"X\"") == events.size(), "every event should be in the json");
+	Check(CountOf(text, "\"name\":\"outer\"") == 3 * perThread, "outer events");
+	Check(text.find("worker \\\"") != std::string::npos, "thread names should be escaped");
+	Check(CountOf(text, "{") == CountOf(text, "}") && CountOf(text, "[") == CountOf(text, "]"), "unbalanced json");
+
+	tracer.Clear();
+	Check(tracer.Events().empty(), "clear should drop every event");
+
+	// trace ticks have to convert back to the real time.
+	auto wallStart = std::chrono::steady_clock::now();
+	uint64_t ticks = Tracer::Now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	ticks = Tracer::Now() - ticks;
+	std::chrono::duration<double, std::nano> wall = std::chrono::steady_clock::now() - wallStart;
+	double traced = ticks * tracer.NanosecondsPerTick();
+	Check(traced > wall.count() * 0.9 && traced < wall.count() * 1.1, "trace clock is off by " + std::to_string(traced / wall.count()));
+	std::cout << "ok" << std::endl;
+}
+
+void BenchmarkTrace()
+{
+	std::cout << "Benchmarking trace points..." << std::endl;
+	Tracer& tracer = Tracer::Instance();
+	const int iterations = 10000000;
+	auto run = [&](bool enabled) {
+		tracer.Enable(enabled);
+		{
+			UTIL_TRACE_SCOPE("warmup"); // allocates this thread's buffer.
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			UTIL_TRACE_SCOPE("benchmark");
+		}
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		tracer.Enable(false);
+		return elapsed.count() / iterations;
+	};
+	double disabled = run(false);
+	double enabled = run(true);
+
+	// what the two clock reads in every enabled event cost on their own, compared to steady_clock.
+	auto start = std::chrono::steady_clock::now();
+	uint64_t sum = 0;
+	for (int i = 0; i < iterations; i++) {
+		sum += Tracer::Now();
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	double clock = elapsed.count() / iterations;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		sum += std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+	elapsed = std::chrono::steady_clock::now() - start;
+	double steady = elapsed.count() / iterations;
+	tracer.Clear();
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "disabled: " << disabled << " ns per event" << std::endl;
+	std::cout << "enabled:  " << enabled << " ns per event (target < 50)" << std::endl;
+	std::cout << "trace clock:  " << clock << " ns per read" << std::endl;
+	std::cout << "steady_clock: " << steady << " ns per read" << (sum == 0 ? " " : "") << std::endl;
+}
@@ -0,0 +1,666 @@
+// EncoderBenchmark.cpp : Runs the FFmpeg encode pipeline over made up or recorded frames and reports
+// how it did as JSON, so encoder changes can be compared from one build to the next. Needs no GPU
+// or screen, it builds on Windows with the solution and on Linux with the CMakeLists.txt here.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include "FFmpegPipeline.h"
+#include "FrameSource.h"
+extern "C" {
+#include <libavformat/avio.h>
+}
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace util;
+
+static int Pitch(int width)
+{
+	return ((width * 4 + 63) / 64) * 64; // same alignment ReadPixels gives us.
+}
+
+// The pixels of every frame of a benchmark run. Render is only called from the readback stage.
+class FrameContent
+{
+public:
+	FrameFormat format;
+
+	virtual ~FrameContent() {}
+	virtual void Render(uint64_t index, uint8_t* buffer, size_t size) const = 0;
+};
+
+// Lines of made up words in dark ink on a light background, something like a page of text.
+static void DrawText(uint8_t* pixels, int pitch, int width, int top, int bottom, uint32_t seed, uint8_t ink)
+{
+	const int lineHeight = 18, glyphWidth = 8, glyphHeight = 12;
+	for (int line = top; line + glyphHeight <= bottom; line += lineHeight) {
+		seed = seed * 1103515245 + 12345;
+		int length = static_cast<int>((seed >> 16) % (width / glyphWidth));
+		for (int column = 1; column < length; column++) {
+			seed = seed * 1103515245 + 12345;
+			uint32_t glyph = seed >> 8;
+			if ((glyph & 7) == 0) {
+				continue; // a space between words.
+			}
+			for (int y = 0; y < glyphHeight - 1; y++) {
+				uint8_t* row = pixels + static_cast<size_t>(line + y) * pitch + column * glyphWidth * 4;
+				for (int x = 0; x < glyphWidth - 1; x++) {
+					if ((glyph >> ((x + y * 3) % 24)) & 1) {
+						::memset(row + x * 4, ink, 3);
+					}
+				}
+			}
+		}
+	}
+}
+
+// A page of text scrolling up 3 lines of pixels a frame, the most common thing on a screen that moves.
+class ScrollingText : public FrameContent
+{
+	std::vector<uint8_t> _page; // twice the frame height so scrolling is a single copy.
+
+public:
+	ScrollingText(int width, int height) {
+		format = { width, height, Pitch(width) };
+		size_t frameSize = static_cast<size_t>(format.pitch) * height;
+		_page.assign(frameSize * 2, 0xF0);
+		DrawText(_page.data(), format.pitch, width, 0, height, 1, 0x20);
+		::memcpy(_page.data() + frameSize, _page.data(), frameSize);
+	}
+
+	void Render(uint64_t index, uint8_t* buffer, size_t size) const override {
+		size_t frameSize = static_cast<size_t>(format.pitch) * format.height;
+		size_t offset = static_cast<size_t>(index * 3 % format.height) * format.pitch;
+		::memcpy(buffer, _page.data() + offset, std::min(frameSize, size));
+	}
+};
+
+// Moving gradients with grain on top like a camera picture, every pixel changes every frame which is
+// the worst case for the encoder. A few frames are made up front and played in a loop.
+class VideoNoise : public FrameContent
+{
+	std::vector<std::vector<uint8_t>> _frames;
+
+public:
+	VideoNoise(int width, int height) {
+		format = { width, height, Pitch(width) };
+		uint32_t seed = 12345;
+		for (int i = 0; i < 8; i++) {
+			std::vector<uint8_t> frame(static_cast<size_t>(format.pitch) * height);
+			for (int y = 0; y < height; y++) {
+				uint8_t* row = frame.data() + static_cast<size_t>(y) * format.pitch;
+				for (int x = 0; x < width; x++) {
+					seed = seed * 1103515245 + 12345;
+					int grain = static_cast<int>((seed >> 24) & 0x1f) - 16;
+					int base = (x + y + i * 12) * 255 / (width + height);
+					row[x * 4] = static_cast<uint8_t>(std::clamp(base + grain, 0, 255));
+					row[x * 4 + 1] = static_cast<uint8_t>(std::clamp(255 - base + grain, 0, 255));
+					row[x * 4 + 2] = static_cast<uint8_t>(std::clamp((x * 255 / width + i * 8) % 256 + grain, 0, 255));
+					row[x * 4 + 3] = 0xFF;
+				}
+			}
+			_frames.push_back(std::move(frame));
+		}
+	}
+
+	void Render(uint64_t index, uint8_t* buffer, size_t size) const override {
+		auto& frame = _frames[index % _frames.size()];
+		::memcpy(buffer, frame.data(), std::min(frame.size(), size));
+	}
+};
+
+// A desktop where nothing happens but a blinking text cursor, what most of a recording looks like.
+class StaticDesktop : public FrameContent
+{
+	std::vector<uint8_t> _desktop;
+
+public:
+	StaticDesktop(int width, int height) {
+		format = { width, height, Pitch(width) };
+		_desktop.resize(static_cast<size_t>(format.pitch) * height);
+		for (int y = 0; y < height; y++) {
+			uint8_t* row = _desktop.data() + static_cast<size_t>(y) * format.pitch;
+			for (int x = 0; x < width; x++) {
+				bool taskbar = y >= height - 40;
+				bool window = x > width / 8 && x < width * 7 / 8 && y > height / 8 && y < height * 3 / 4;
+				uint8_t shade = taskbar ? 0x30 : window ? 0xFF : static_cast<uint8_t>(0x40 + y * 0x60 / height);
+				row[x * 4] = shade;
+				row[x * 4 + 1] = taskbar || window ? shade : static_cast<uint8_t>(shade / 2);
+				row[x * 4 + 2] = taskbar || window ? shade : static_cast<uint8_t>(shade / 4);
+				row[x * 4 + 3] = 0xFF;
+			}
+		}
+		int left = width / 8 + 8;
+		DrawText(_desktop.data() + left * 4, format.pitch, width * 3 / 4 - 16, height / 8 + 8, height * 3 / 4, 7, 0x10);
+	}
+
+	void Render(uint64_t index, uint8_t* buffer, size_t size) const override {
+		::memcpy(buffer, _desktop.data(), std::min(_desktop.size(), size));
+		if ((index / 15) % 2 == 1 && format.width > 200 && format.height > 200) {
+			for (int y = format.height / 4; y < format.height / 4 + 16; y++) {
+				size_t offset = static_cast<size_t>(y) * format.pitch + (format.width / 2) * 4;
+				if (offset + 8 <= size) {
+					::memset(buffer + offset, 0, 8);
+				}
+			}
+		}
+	}
+};
+
+// Frames from a file, a .y4m with 8 bit 4:2:0 video or headerless BGRA frames of a given size. They
+// are read into memory up front, at most maxBytes of them, and played in a loop so the speed of the
+// disk doesn't show up in the results.
+class FileFrames : public FrameContent
+{
+	std::vector<std::vector<uint8_t>> _frames;
+
+	static uint8_t Clamp(int value) {
+		return static_cast<uint8_t>(std::clamp(value, 0, 255));
+	}
+
+	// BT.601 limited range, what y4m files from FFmpeg have unless told otherwise.
+	void AddYuvFrame(const uint8_t* yPlane, const uint8_t* uPlane, const uint8_t* vPlane) {
+		int width = format.width;
+		int chromaWidth = (width + 1) / 2;
+		std::vector<uint8_t> frame(static_cast<size_t>(format.pitch) * format.height);
+		for (int y = 0; y < format.height; y++) {
+			uint8_t* row = frame.data() + static_cast<size_t>(y) * format.pitch;
+			const uint8_t* luma = yPlane + static_cast<size_t>(y) * width;
+			const uint8_t* u = uPlane + static_cast<size_t>(y / 2) * chromaWidth;
+			const uint8_t* v = vPlane + static_cast<size_t>(y / 2) * chromaWidth;
+			for (int x = 0; x < width; x++) {
+				int c = 298 * (luma[x] - 16);
+				int d = u[x / 2] - 128;
+				int e = v[x / 2] - 128;
+				row[x * 4] = Clamp((c + 516 * d + 128) >> 8);
+				row[x * 4 + 1] = Clamp((c - 100 * d - 208 * e + 128) >> 8);
+				row[x * 4 + 2] = Clamp((c + 409 * e + 128) >> 8);
+				row[x * 4 + 3] = 0xFF;
+			}
+		}
+		_frames.push_back(std::move(frame));
+	}
+
+	void ReadY4m(std::ifstream& file, size_t maxBytes) {
+		std::string header;
+		std::getline(file, header);
+		std::istringstream tokens(header);
+		std::string token;
+		tokens >> token;
+		if (token != "YUV4MPEG2") {
+			throw std::runtime_error("not a y4m file");
+		}
+		std::string colorspace = "420";
+		while (tokens >> token) {
+			switch (token[0]) {
+			case 'W': format.width = std::stoi(token.substr(1)); break;
+			case 'H': format.height = std::stoi(token.substr(1)); break;
+			case 'C': colorspace = token.substr(1); break;
+			}
+		}
+		if (colorspace != "420" && colorspace != "420jpeg" && colorspace != "420paldv" && colorspace != "420mpeg2") {
+			throw std::runtime_error("only 8 bit 4:2:0 y4m files are supported, this one is C" + colorspace);
+		}
+		if (format.width <= 0 || format.height <= 0) {
+			throw std::runtime_error("the y4m header has no frame size");
+		}
+		format.pitch = Pitch(format.width);
+		size_t lumaSize = static_cast<size_t>(format.width) * format.height;
+		size_t chromaSize = static_cast<size_t>((format.width + 1) / 2) * ((format.height + 1) / 2);
+		std::vector<uint8_t> yuv(lumaSize + chromaSize * 2);
+		std::string frameHeader;
+		while (_frames.size() * format.pitch * format.height < maxBytes && std::getline(file, frameHeader)) {
+			if (frameHeader.compare(0, 5, "FRAME") != 0) {
+				throw std::runtime_error("bad frame header in the y4m file");
+			}
+			if (!file.read(reinterpret_cast<char*>(yuv.data()), yuv.size())) {
+				break; // a truncated last frame.
+			}
+			AddYuvFrame(yuv.data(), yuv.data() + lumaSize, yuv.data() + lumaSize + chromaSize);
+		}
+	}
+
+	void ReadBgra(std::ifstream& file, int width, int height, size_t maxBytes) {
+		if (width <= 0 || height <= 0) {
+			throw std::runtime_error("raw BGRA input needs --width and --height");
+		}
+		format = { width, height, Pitch(width) };
+		std::vector<uint8_t> frame(static_cast<size_t>(format.pitch) * height);
+		while (_frames.size() * frame.size() < maxBytes) {
+			for (int y = 0; y < height; y++) {
+				file.read(reinterpret_cast<char*>(frame.data() + static_cast<size_t>(y) * format.pitch), static_cast<size_t>(width) * 4);
+			}
+			if (!file) {
+				break;
+			}
+			_frames.push_back(frame);
+		}
+	}
+
+public:
+	FileFrames(const std::string& path, int width, int height, size_t maxBytes) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("cannot open " + path);
+		}
+		bool y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+		if (y4m) {
+			ReadY4m(file, maxBytes);
+		}
+		else {
+			ReadBgra(file, width, height, maxBytes);
+		}
+		if (_frames.empty()) {
+			throw std::runtime_error("no frames in " + path);
+		}
+	}
+
+	size_t FrameCount() const {
+		return _frames.size();
+	}
+
+	void Render(uint64_t index, uint8_t* buffer, size_t size) const override {
+		auto& frame = _frames[index % _frames.size()];
+		::memcpy(buffer, frame.data(), std::min(frame.size(), size));
+	}
+};
+
+// Hands frameCount frames of the content to the encoder, timestamped at exactly frameRate so the
+// video and its bitrate are the same on every run. It goes as fast as the encoder takes them unless
+// realtime, then each frame waits for its time like a capture does.
+class ContentFrameSource : public FrameSource
+{
+	const FrameContent& _content;
+	int _frameRate;
+	uint64_t _frameCount;
+	bool _realtime;
+	uint64_t _index = 0;
+	std::chrono::steady_clock::time_point _start;
+
+public:
+	ContentFrameSource(const FrameContent& content, int frameRate, uint64_t frameCount, bool realtime)
+		: _content(content), _frameRate(frameRate), _frameCount(frameCount), _realtime(realtime) {
+	}
+
+	FrameFormat GetFormat() override {
+		return _content.format;
+	}
+
+	double AcquireFrame(std::shared_ptr<void>& frame) override {
+		if (_index >= _frameCount) {
+			return -1;
+		}
+		if (_index == 0) {
+			_start = std::chrono::steady_clock::now();
+		}
+		double time = static_cast<double>(_index) / _frameRate;
+		if (_realtime) {
+			std::this_thread::sleep_until(_start + std::chrono::microseconds(_index * 1000000 / _frameRate));
+		}
+		frame = std::make_shared<uint64_t>(_index++);
+		return time;
+	}
+
+	void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) override {
+		_content.Render(*static_cast<uint64_t*>(frame.get()), buffer, size);
+	}
+};
+
+// Throws the encoded file away and only keeps track of how big it got.
+struct CountingOutput
+{
+	int64_t position = 0;
+	int64_t size = 0;
+
+	static int Write(void* opaque, const uint8_t* buf, int size)
+	{
+		auto output = static_cast<CountingOutput*>(opaque);
+		output->position += size;
+		output->size = std::max(output->size, output->position);
+		return size;
+	}
+
+	static int64_t Seek(void* opaque, int64_t offset, int whence)
+	{
+		auto output = static_cast<CountingOutput*>(opaque);
+		switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE: return output->size;
+		case SEEK_SET: output->position = offset; break;
+		case SEEK_CUR: output->position += offset; break;
+		case SEEK_END: output->position = output->size + offset; break;
+		default: return -1;
+		}
+		return output->position;
+	}
+
+	OutputCallbacks Callbacks()
+	{
+		OutputCallbacks callbacks;
+		callbacks.opaque = this;
+		callbacks.write = Write;
+		callbacks.seek = Seek;
+		return callbacks;
+	}
+};
+
+// User plus kernel time of all the threads of this process.
+static double CpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!::GetProcessTimes(::GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	auto seconds = [](const FILETIME& time) {
+		return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+	};
+	return seconds(kernel) + seconds(user);
+#else
+	rusage usage{};
+	::getrusage(RUSAGE_SELF, &usage);
+	auto seconds = [](const timeval& time) {
+		return time.tv_sec + time.tv_usec / 1e6;
+	};
+	return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+struct RunResult
+{
+	int width = 0;
+	int height = 0;
+	int frameRate = 0;
+	std::string preset;
+	int threads = 0;
+	uint64_t frames = 0;
+	uint64_t encoded = 0;
+	uint64_t dropped = 0;
+	double seconds = 0;
+	double cpuSeconds = 0;
+	int64_t bytes = 0;
+	std::vector<StageStats> stages;
+	std::string error;
+};
+
+static RunResult Run(const FrameContent& content, EncoderSettings settings, uint64_t frames, bool realtime)
+{
+	RunResult result;
+	result.width = content.format.width;
+	result.height = content.format.height;
+	result.frameRate = static_cast<int>(settings.frameRate);
+	result.preset = settings.tuning.preset;
+	result.threads = settings.tuning.threads;
+	result.frames = frames;
+	ContentFrameSource source(content, settings.frameRate, frames, realtime);
+	CountingOutput output;
+	FFmpegPipeline encoder;
+	double cpuStart = CpuSeconds();
+	auto start = std::chrono::steady_clock::now();
+	try {
+		encoder.Encode(source, settings, output.Callbacks());
+	}
+	catch (const std::exception& e) {
+		result.error = e.what();
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.cpuSeconds = CpuSeconds() - cpuStart;
+	result.encoded = encoder.SampleTimes().Count();
+	result.dropped = encoder.FramesDropped();
+	result.bytes = output.size;
+	result.stages = encoder.GetStageStats();
+	return result;
+}
+
+static std::string JsonString(const std::string& value)
+{
+	std::string result = "\"";
+	for (char c : value) {
+		switch (c) {
+		case '"': result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char escaped[8];
+				::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				result += escaped;
+			}
+			else {
+				result += c;
+			}
+		}
+	}
+	return result + "\"";
+}
+
+static void WriteJson(std::ostream& out, const std::string& source, bool realtime, const std::vector<RunResult>& runs)
+{
+	out << std::fixed;
+	out << "{\n";
+	out << "  \"source\": " << JsonString(source) << ",\n";
+	out << "  \"realtime\": " << (realtime ? "true" : "false") << ",\n";
+	out << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "  \"runs\": [";
+	for (size_t i = 0; i < runs.size(); i++) {
+		auto& run = runs[i];
+		// the timestamps are exactly frameRate apart, so this is the bitrate of the video when played.
+		double videoSeconds = static_cast<double>(run.encoded) / run.frameRate;
+		out << (i > 0 ? "," : "") << "\n    {\n";
+		out << "      \"width\": " << run.width << ", \"height\": " << run.height << ", \"fps\": " << run.frameRate
+			<< ", \"preset\": " << JsonString(run.preset) << ", \"threads\": " << run.threads << ",\n";
+		out << std::setprecision(3);
+		out << "      \"frames\": " << run.frames << ", \"encoded\": " << run.encoded << ", \"dropped\": " << run.dropped
+			<< ", \"seconds\": " << run.seconds << ", \"achievedFps\": " << (run.seconds > 0 ? run.encoded / run.seconds : 0) << ",\n";
+		out << "      \"cpuSeconds\": " << run.cpuSeconds << ", \"cpuCores\": " << (run.seconds > 0 ? run.cpuSeconds / run.seconds : 0)
+			<< ", \"bytes\": " << run.bytes << ", \"bitrateKbps\": " << (videoSeconds > 0 ? run.bytes * 8 / videoSeconds / 1000 : 0) << ",\n";
+		if (!run.error.empty()) {
+			out << "      \"error\": " << JsonString(run.error) << ",\n";
+		}
+		out << "      \"stages\": [";
+		for (size_t s = 0; s < run.stages.size(); s++) {
+			auto& stage = run.stages[s];
+			double mean = stage.frames > 0 ? stage.busySeconds * 1000 / stage.frames : 0;
+			out << (s > 0 ? "," : "") << "\n        { \"name\": " << JsonString(stage.name) << ", \"frames\": " << stage.frames
+				<< ", \"meanMs\": " << mean << ", \"p50Ms\": " << stage.p50 * 1000 << ", \"p95Ms\": " << stage.p95 * 1000
+				<< ", \"p99Ms\": " << stage.p99 * 1000 << " }";
+		}
+		out << "\n      ]\n    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+static std::vector<std::string> Split(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static std::vector<int> SplitNumbers(const std::string& list, int minimum)
+{
+	std::vector<int> numbers;
+	for (auto& item : Split(list)) {
+		int number = std::stoi(item);
+		if (number < minimum) {
+			throw std::invalid_argument("expected numbers of at least " + std::to_string(minimum) + ", got " + item);
+		}
+		numbers.push_back(number);
+	}
+	return numbers;
+}
+
+static void PrintUsage()
+{
+	std::cerr << "Usage: EncoderBenchmark [options]\n"
+		"  --source text|noise|static  made up frames to encode (default text)\n"
+		"  --input file                encode frames from a .y4m file or raw BGRA frames instead\n"
+		"  --width n --height n        the frame size of a raw BGRA input\n"
+		"  --sizes WxH,...             frame sizes of the made up frames (default 1280x720,1920x1080)\n"
+		"  --fps n,...                 frame rates (default 30,60)\n"
+		"  --presets name,...          x264 presets (default veryfast,fast)\n"
+		"  --threads n,...             encoder threads, 0 lets FFmpeg pick (default 0)\n"
+		"  --frames n                  frames per run (default 300)\n"
+		"  --profile default|lowlatency|throughput  the tuning the presets and threads change\n"
+		"  --options key=value:...     more FFmpeg encoder options for every run\n"
+		"  --queue-depth n             frames in flight between the pipeline stages (default 3)\n"
+		"  --realtime                  send frames at the frame rate instead of as fast as possible\n"
+		"  --output file.json          where the results go (default stdout)\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::string sourceName = "text";
+	std::string input;
+	int inputWidth = 0, inputHeight = 0;
+	std::vector<std::string> sizes = { "1280x720", "1920x1080" };
+	std::vector<int> rates = { 30, 60 };
+	std::vector<std::string> presets = { "veryfast", "fast" };
+	std::vector<int> threadCounts = { 0 };
+	uint64_t frames = 300;
+	EncoderProfile profile = EncoderProfile::Default;
+	std::string options;
+	size_t queueDepth = 3;
+	bool realtime = false;
+	std::string outputPath;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> std::string {
+				if (i + 1 >= argc) {
+					throw std::invalid_argument(arg + " needs a value");
+				}
+				return argv[++i];
+			};
+			if (arg == "--source") sourceName = value();
+			else if (arg == "--input") input = value();
+			else if (arg == "--width") inputWidth = std::stoi(value());
+			else if (arg == "--height") inputHeight = std::stoi(value());
+			else if (arg == "--sizes") sizes = Split(value());
+			else if (arg == "--fps") rates = SplitNumbers(value(), 1);
+			else if (arg == "--presets") presets = Split(value());
+			else if (arg == "--threads") threadCounts = SplitNumbers(value(), 0);
+			else if (arg == "--frames") frames = std::stoull(value());
+			else if (arg == "--options") options = value();
+			else if (arg == "--queue-depth") queueDepth = std::stoul(value());
+			else if (arg == "--realtime") realtime = true;
+			else if (arg == "--output") outputPath = value();
+			else if (arg == "--profile") {
+				std::string name = value();
+				if (name == "default") profile = EncoderProfile::Default;
+				else if (name == "lowlatency") profile = EncoderProfile::LowLatency;
+				else if (name == "throughput") profile = EncoderProfile::HighThroughput;
+				else throw std::invalid_argument("unknown profile " + name);
+			}
+			else if (arg == "--help" || arg == "-h") {
+				PrintUsage();
+				return 0;
+			}
+			else {
+				throw std::invalid_argument("unknown argument " + arg);
+			}
+		}
+		if (sourceName != "text" && sourceName != "noise" && sourceName != "static") {
+			throw std::invalid_argument("unknown source " + sourceName);
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		PrintUsage();
+		return 1;
+	}
+
+	// a file has the one frame size it was recorded at.
+	std::vector<std::unique_ptr<FrameContent>> contents;
+	try {
+		if (!input.empty()) {
+			auto file = std::make_unique<FileFrames>(input, inputWidth, inputHeight, static_cast<size_t>(512) * 1024 * 1024);
+			std::cerr << "read " << file->FrameCount() << " frames of " << file->format.width << "x" << file->format.height
+				<< " from " << input << std::endl;
+			sourceName = input;
+			contents.push_back(std::move(file));
+		}
+		else {
+			for (auto& size : sizes) {
+				int width = 0, height = 0;
+				if (::sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width < 16 || height < 16) {
+					throw std::invalid_argument("bad frame size " + size);
+				}
+				// the encoder wants even sizes.
+				width &= ~1;
+				height &= ~1;
+				if (sourceName == "noise") contents.push_back(std::make_unique<VideoNoise>(width, height));
+				else if (sourceName == "static") contents.push_back(std::make_unique<StaticDesktop>(width, height));
+				else contents.push_back(std::make_unique<ScrollingText>(width, height));
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::vector<RunResult> runs;
+	bool failed = false;
+	for (auto& content : contents) {
+		for (auto& rate : rates) {
+			for (auto& preset : presets) {
+				for (auto& threads : threadCounts) {
+					EncoderSettings settings;
+					settings.frameRate = rate;
+					settings.queueDepth = queueDepth;
+					settings.tuning = EncoderTuning::ForProfile(profile);
+					settings.tuning.preset = preset;
+					settings.tuning.threads = threads;
+					settings.tuning.options = options;
+					std::cerr << content->format.width << "x" << content->format.height << " " << settings.frameRate
+						<< " fps, preset " << preset << ", threads " << threads << ": " << std::flush;
+					RunResult run = Run(*content, settings, frames, realtime);
+					if (run.error.empty()) {
+						std::cerr << std::fixed << std::setprecision(1) << run.encoded / run.seconds << " fps" << std::endl;
+					}
+					else {
+						std::cerr << "failed, " << run.error << std::endl;
+						failed = true;
+					}
+					runs.push_back(std::move(run));
+				}
+			}
+		}
+	}
+
+	if (outputPath.empty()) {
+		WriteJson(std::cout, sourceName, realtime, runs);
+	}
+	else {
+		std::ofstream file(outputPath);
+		WriteJson(file, sourceName, realtime, runs);
+		if (!file) {
+			std::cerr << "cannot write " << outputPath << std::endl;
+			return 1;
+		}
+	}
+	return failed ? 1 : 0;
+}
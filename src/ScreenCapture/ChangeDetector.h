@@ -0,0 +1,185 @@
+#pragma once
+#include "Simd.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace util
+{
+    namespace detail
+    {
+        // Each tile is hashed in 8 lanes, lane j takes the pixels at x % 8 == j of every row of the
+        // tile, so the scalar, SSE and AVX2 versions give the same hash. Every step of
+        // h = (h + pixel) * prime is a bijection of both h and the pixel, so a tile with a single
+        // changed pixel always gets a different hash, only several changes can collide.
+        const uint32_t TileHashPrime = 0x9E3779B1;
+        const int TileHashLanes = 8;
+
+        inline void HashTileRowScalar(const uint8_t* row, int x, int count, uint32_t mask, uint32_t* lanes)
+        {
+            for (; x < count; x++) {
+                uint32_t pixel;
+                ::memcpy(&pixel, row + x * 4, 4);
+                uint32_t& h = lanes[x % TileHashLanes];
+                h = (h + (pixel & mask)) * TileHashPrime;
+            }
+        }
+
+#if UTIL_X86
+        UTIL_TARGET_SSE41 inline void HashTileRowSse41(const uint8_t* row, int count, uint32_t mask, uint32_t* lanes)
+        {
+            __m128i m = _mm_set1_epi32(static_cast<int>(mask));
+            __m128i p = _mm_set1_epi32(static_cast<int>(TileHashPrime));
+            __m128i h0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes));
+            __m128i h1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + 4));
+            int x = 0;
+            for (; x + 8 <= count; x += 8) {
+                __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4)), m);
+                __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4 + 16)), m);
+                h0 = _mm_mullo_epi32(_mm_add_epi32(h0, a), p);
+                h1 = _mm_mullo_epi32(_mm_add_epi32(h1, b), p);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), h0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), h1);
+            HashTileRowScalar(row, x, count, mask, lanes);
+        }
+
+        UTIL_TARGET_AVX2 inline void HashTileRowAvx2(const uint8_t* row, int count, uint32_t mask, uint32_t* lanes)
+        {
+            __m256i m = _mm256_set1_epi32(static_cast<int>(mask));
+            __m256i p = _mm256_set1_epi32(static_cast<int>(TileHashPrime));
+            __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+            int x = 0;
+            for (; x + 8 <= count; x += 8) {
+                __m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x * 4)), m);
+                h = _mm256_mullo_epi32(_mm256_add_epi32(h, a), p);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), h);
+            HashTileRowScalar(row, x, count, mask, lanes);
+        }
+#endif
+
+        inline void HashTileRow(const uint8_t* row, int count, uint32_t mask, uint32_t* lanes, CpuLevel level)
+        {
+            switch (level) {
+#if UTIL_X86
+            case CpuLevel::Avx2:
+                HashTileRowAvx2(row, count, mask, lanes);
+                break;
+            case CpuLevel::Sse41:
+                HashTileRowSse41(row, count, mask, lanes);
+                break;
+#endif
+            default:
+                HashTileRowScalar(row, 0, count, mask, lanes);
+                break;
+            }
+        }
+
+        inline uint64_t FoldTileLanes(const uint32_t* lanes)
+        {
+            uint64_t h = 0xCBF29CE484222325ull;
+            for (int j = 0; j < TileHashLanes; j++) {
+                h = (h ^ lanes[j]) * 0x100000001B3ull;
+            }
+            return h;
+        }
+    }
+
+    // Finds what changed between consecutive BGRA frames by hashing them in tiles of tileSize x
+    // tileSize pixels, so static screen content can be skipped without keeping a copy of the last
+    // frame. The alpha channel is ignored, and so are the lowest ignoreBits bits of each color so
+    // that near identical frames, e.g. with dithering noise, count as unchanged. Reads each pixel
+    // once in row order, about as fast as a memcpy of the frame.
+    class ChangeDetector
+    {
+        int _tileSize;
+        uint32_t _mask;
+        CpuLevel _level;
+        int _width = 0;
+        int _height = 0;
+        int _columns = 0;
+        int _rows = 0;
+        std::vector<uint64_t> _hashes;
+        std::vector<uint8_t> _changed;
+        std::vector<uint32_t> _lanes; // one set per tile column of the tile row being hashed.
+
+    public:
+        explicit ChangeDetector(int tileSize = 32, int ignoreBits = 0, CpuLevel level = GetCpuLevel())
+            : _tileSize(tileSize), _level(level) {
+            if (tileSize <= 0 || tileSize % detail::TileHashLanes != 0) {
+                throw std::invalid_argument("tile size must be a multiple of 8");
+            }
+            if (ignoreBits < 0 || ignoreBits > 7) {
+                throw std::invalid_argument("ignoreBits must be between 0 and 7");
+            }
+            uint32_t channel = (0xFFu << ignoreBits) & 0xFFu;
+            _mask = channel * 0x010101u;
+        }
+
+        // Hashes the frame and compares it with the one before, returns how many tiles changed.
+        // The first frame, and a frame of a different size, count as all tiles changed.
+        size_t Update(const uint8_t* bgra, int pitch, int width, int height) {
+            bool resized = width != _width || height != _height;
+            if (resized) {
+                _width = width;
+                _height = height;
+                _columns = (width + _tileSize - 1) / _tileSize;
+                _rows = (height + _tileSize - 1) / _tileSize;
+                _hashes.assign(static_cast<size_t>(_columns) * _rows, 0);
+                _changed.assign(_hashes.size(), 1);
+                _lanes.resize(static_cast<size_t>(_columns) * detail::TileHashLanes);
+            }
+            size_t changed = 0;
+            for (int tileRow = 0; tileRow < _rows; tileRow++) {
+                std::fill(_lanes.begin(), _lanes.end(), 0);
+                int top = tileRow * _tileSize;
+                int bottom = std::min(top + _tileSize, height);
+                for (int y = top; y < bottom; y++) {
+                    // a row at a time across all tiles, so the multiply chains of different tiles overlap.
+                    const uint8_t* row = bgra + static_cast<int64_t>(y) * pitch;
+                    for (int column = 0; column < _columns; column++) {
+                        int left = column * _tileSize;
+                        detail::HashTileRow(row + left * 4, std::min(_tileSize, width - left), _mask,
+                            &_lanes[static_cast<size_t>(column) * detail::TileHashLanes], _level);
+                    }
+                }
+                for (int column = 0; column < _columns; column++) {
+                    size_t index = static_cast<size_t>(tileRow) * _columns + column;
+                    uint64_t hash = detail::FoldTileLanes(&_lanes[static_cast<size_t>(column) * detail::TileHashLanes]);
+                    bool different = resized || hash != _hashes[index];
+                    _hashes[index] = hash;
+                    _changed[index] = different ? 1 : 0;
+                    changed += different ? 1 : 0;
+                }
+            }
+            return changed;
+        }
+
+        // Forgets the last frame so the next one counts as all new.
+        void Reset() {
+            _width = 0;
+            _height = 0;
+        }
+
+        int Columns() const {
+            return _columns;
+        }
+
+        int Rows() const {
+            return _rows;
+        }
+
+        // Whether the tile changed in the last Update.
+        bool TileChanged(int column, int row) const {
+            return _changed[static_cast<size_t>(row) * _columns + column] != 0;
+        }
+
+        // The tile hashes of the last frame, row by row.
+        const std::vector<uint64_t>& Hashes() const {
+            return _hashes;
+        }
+    };
+}
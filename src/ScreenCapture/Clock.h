@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Simd.h"
+#if UTIL_X86 && !defined(_MSC_VER)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace util
+{
+    enum class ClockSource
+    {
+        Steady = 0, // steady_clock, which is QueryPerformanceCounter on Windows and CLOCK_MONOTONIC on Linux.
+        Tsc = 1     // the invariant time stamp counter, calibrated against steady_clock.
+    };
+
+    // Turns time stamp counter ticks into steady_clock nanoseconds: a tick count read at the same
+    // moment as a steady_clock time, and the rate between two such readings some time apart.
+    struct ClockCalibration
+    {
+        uint64_t ticks = 0;
+        int64_t nanoseconds = 0;
+        double nanosecondsPerTick = 1;
+
+        int64_t ToNanoseconds(uint64_t t) const {
+            return nanoseconds + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(t - ticks)) * nanosecondsPerTick);
+        }
+
+        uint64_t ToTicks(int64_t ns) const {
+            return ticks + static_cast<uint64_t>(static_cast<int64_t>(static_cast<double>(ns - nanoseconds) / nanosecondsPerTick));
+        }
+
+        double TicksPerSecond() const {
+            return 1e9 / nanosecondsPerTick;
+        }
+    };
+
+    // The monotonic clock behind Timer, FramePipeline and the tracer. It reads steady_clock unless
+    // the process switches it to the time stamp counter with UseTsc, which reads in a few cycles
+    // instead of a QueryPerformanceCounter or vDSO call and still counts steady_clock nanoseconds,
+    // give or take the calibration error (well under a microsecond per second, BenchmarkClock
+    // measures it). Switch at startup: times read before and after a switch may be off by the read
+    // cost of the two clocks. Times are process local nanoseconds, only differences mean anything.
+    class Clock
+    {
+        // Published once and kept until the process exits, so readers can use one without a lock
+        // while a later calibration replaces it. There are only as many as UseTsc calls.
+        static std::atomic<const ClockCalibration*>& Calibration() {
+            static std::atomic<const ClockCalibration*> calibration{ nullptr };
+            return calibration;
+        }
+
+        static const ClockCalibration* Keep(const ClockCalibration& calibration) {
+            static std::mutex mutex;
+            static std::vector<std::unique_ptr<ClockCalibration>> calibrations;
+            std::scoped_lock lock(mutex);
+            calibrations.push_back(std::make_unique<ClockCalibration>(calibration));
+            return calibrations.back().get();
+        }
+
+        // The closest pair of readings out of a few, a context switch between the two reads
+        // would throw the calibration off by a whole time slice.
+        static void ReadPair(uint64_t& ticks, int64_t& nanoseconds) {
+            uint64_t best = UINT64_MAX;
+            for (int i = 0; i < 8; i++) {
+                uint64_t before = Ticks();
+                int64_t steady = SteadyNanoseconds();
+                uint64_t after = Ticks();
+                if (after - before < best) {
+                    best = after - before;
+                    ticks = before + (after - before) / 2;
+                    nanoseconds = steady;
+                }
+            }
+        }
+
+    public:
+        static int64_t SteadyNanoseconds() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Raw timestamps, the time stamp counter on x86 and steady clock nanoseconds elsewhere.
+        static uint64_t Ticks() {
+#if UTIL_X86
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(SteadyNanoseconds());
+#endif
+        }
+
+        // Whether the time stamp counter runs at a constant rate through frequency changes and sleep
+        // states, which every cpu that runs Windows 10 capture has but virtual machines can hide.
+        static bool HasInvariantTsc() {
+#if UTIL_X86
+#if defined(_MSC_VER)
+            int info[4] = { 0 };
+            __cpuid(info, 0x80000000);
+            if (static_cast<unsigned int>(info[0]) < 0x80000007) {
+                return false;
+            }
+            __cpuid(info, 0x80000007);
+            return (info[3] & (1 << 8)) != 0;
+#else
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8)) != 0;
+#endif
+#else
+            return false;
+#endif
+        }
+
+        // Measures the tick rate against steady_clock over the given time, sleeping through it.
+        static ClockCalibration Calibrate(std::chrono::duration<double> period = std::chrono::milliseconds(100)) {
+            ClockCalibration calibration;
+            ReadPair(calibration.ticks, calibration.nanoseconds);
+            std::this_thread::sleep_for(period);
+            uint64_t ticks = 0;
+            int64_t nanoseconds = 0;
+            ReadPair(ticks, nanoseconds);
+            if (ticks > calibration.ticks && nanoseconds > calibration.nanoseconds) {
+                calibration.nanosecondsPerTick = static_cast<double>(nanoseconds - calibration.nanoseconds) / (ticks - calibration.ticks);
+            }
+            return calibration;
+        }
+
+        // Reads the time stamp counter from now on, false if it isn't invariant. Called again with a
+        // longer calibration it picks up the new rate from the current time, so time never jumps back.
+        static bool UseTsc(const ClockCalibration& calibration) {
+            if (!HasInvariantTsc() || calibration.nanosecondsPerTick <= 0) {
+                return false;
+            }
+            ClockCalibration next = calibration;
+            const ClockCalibration* current = Calibration().load(std::memory_order_acquire);
+            if (current != nullptr) {
+                next.ticks = Ticks();
+                next.nanoseconds = std::max(current->ToNanoseconds(next.ticks), Nanoseconds());
+            }
+            Calibration().store(Keep(next), std::memory_order_release);
+            return true;
+        }
+
+        static bool UseTsc() {
+            return HasInvariantTsc() && UseTsc(Calibrate());
+        }
+
+        // Back to steady_clock.
+        static void UseSteady() {
+            Calibration().store(nullptr, std::memory_order_release);
+        }
+
+        static ClockSource Source() {
+            return Calibration().load(std::memory_order_relaxed) != nullptr ? ClockSource::Tsc : ClockSource::Steady;
+        }
+
+        // The calibration in use, the default one (1 nanosecond per tick) with steady_clock.
+        static ClockCalibration CurrentCalibration() {
+            const ClockCalibration* calibration = Calibration().load(std::memory_order_acquire);
+            return calibration != nullptr ? *calibration : ClockCalibration();
+        }
+
+        static int64_t Nanoseconds() {
+            const ClockCalibration* calibration = Calibration().load(std::memory_order_acquire);
+            if (calibration != nullptr) {
+                return calibration->ToNanoseconds(Ticks());
+            }
+            return SteadyNanoseconds();
+        }
+
+        static double Seconds() {
+            return ToSeconds(Nanoseconds());
+        }
+
+        static double ToSeconds(int64_t nanoseconds) {
+            return static_cast<double>(nanoseconds) / 1e9;
+        }
+
+        static double ToMilliseconds(int64_t nanoseconds) {
+            return static_cast<double>(nanoseconds) / 1e6;
+        }
+
+        static double ToMicroseconds(int64_t nanoseconds) {
+            return static_cast<double>(nanoseconds) / 1e3;
+        }
+
+        static int64_t FromSeconds(double seconds) {
+            return static_cast<int64_t>(seconds * 1e9);
+        }
+
+        static int64_t FromMicroseconds(int64_t microseconds) {
+            return microseconds * 1000;
+        }
+    };
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include "Simd.h"
+#include <cstring>
+
+namespace util
+{
+    // Converts the pitched BGRA buffer we read back from DXGI_FORMAT_B8G8R8A8_UNORM textures into
+    // BT.601 limited range YUV 4:2:0. Each pixel's color matches what sws_scale produces for
+    // AV_PIX_FMT_BGRA (within 1 LSB), and the chroma of each 2x2 block is their average, where the
+    // bilinear sws_scale to AV_PIX_FMT_YUV420P uses a wider filter. It writes straight into the
+    // encoder's AVFrame planes so we skip the intermediate BGRA frame copy.
+    enum class YuvFormat
+    {
+        I420, // 3 planes: Y, U, V (AV_PIX_FMT_YUV420P)
+        NV12  // 2 planes: Y, interleaved UV (AV_PIX_FMT_NV12)
+    };
+
+    namespace detail
+    {
+        // 8 bit fixed point BT.601 coefficients in B, G, R, A order.
+        const int YB = 25, YG = 129, YR = 66;
+        const int UB = 112, UG = -74, UR = -38;
+        const int VB = -18, VG = -94, VR = 112;
+
+        inline uint8_t Luma(const uint8_t* p)
+        {
+            return static_cast<uint8_t>(((YB * p[0] + YG * p[1] + YR * p[2] + 128) >> 8) + 16);
+        }
+
+        // Converts one pair of source rows into two luma rows and one chroma row, starting at
+        // column x which must be even. uvStep is 1 for I420 and 2 for NV12.
+        inline void RowPairScalar(const uint8_t* s0, const uint8_t* s1, uint8_t* y0, uint8_t* y1,
+            uint8_t* u, uint8_t* v, int uvStep, int x, int width)
+        {
+            for (; x < width; x += 2) {
+                const uint8_t* a = s0 + x * 4;
+                const uint8_t* b = s1 + x * 4;
+                y0[x] = Luma(a);
+                y0[x + 1] = Luma(a + 4);
+                y1[x] = Luma(b);
+                y1[x + 1] = Luma(b + 4);
+                // chroma is computed from the average of the 2x2 block.
+                int blue = (a[0] + a[4] + b[0] + b[4] + 2) >> 2;
+                int green = (a[1] + a[5] + b[1] + b[5] + 2) >> 2;
+                int red = (a[2] + a[6] + b[2] + b[6] + 2) >> 2;
+                int i = (x / 2) * uvStep;
+                u[i] = static_cast<uint8_t>(((UB * blue + UG * green + UR * red + 128) >> 8) + 128);
+                v[i] = static_cast<uint8_t>(((VB * blue + VG * green + VR * red + 128) >> 8) + 128);
+            }
+        }
+
+#if UTIL_X86
+        // Weighted sum of 4 BGRA pixels (16 bit lanes) against 16 bit coefficients, giving 4 int32.
+        UTIL_TARGET_SSE41 inline __m128i Dot4Sse41(__m128i lo, __m128i hi, __m128i coeff)
+        {
+            return _mm_hadd_epi32(_mm_madd_epi16(lo, coeff), _mm_madd_epi16(hi, coeff));
+        }
+
+        // 8 BGRA pixels to 8 luma bytes in the low half of the result.
+        UTIL_TARGET_SSE41 inline __m128i Luma8Sse41(__m128i a, __m128i b, __m128i coeff)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi32(128);
+            __m128i ya = Dot4Sse41(_mm_cvtepu8_epi16(a), _mm_unpackhi_epi8(a, zero), coeff);
+            __m128i yb = Dot4Sse41(_mm_cvtepu8_epi16(b), _mm_unpackhi_epi8(b, zero), coeff);
+            ya = _mm_srli_epi32(_mm_add_epi32(ya, round), 8);
+            yb = _mm_srli_epi32(_mm_add_epi32(yb, round), 8);
+            __m128i y = _mm_add_epi16(_mm_packs_epi32(ya, yb), _mm_set1_epi16(16));
+            return _mm_packus_epi16(y, y);
+        }
+
+        // Averages the 2x2 blocks of 4 pixels from each of two rows, giving 2 averaged BGRA pixels
+        // in 16 bit lanes.
+        UTIL_TARGET_SSE41 inline __m128i Average2x2Sse41(__m128i r0, __m128i r1)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i lo = _mm_add_epi16(_mm_cvtepu8_epi16(r0), _mm_cvtepu8_epi16(r1));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+        }
+
+        UTIL_TARGET_SSE41 inline __m128i Chroma4Sse41(__m128i avgA, __m128i avgB, __m128i coeff)
+        {
+            __m128i c = Dot4Sse41(avgA, avgB, coeff);
+            c = _mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(128)), 8);
+            return _mm_add_epi32(c, _mm_set1_epi32(128));
+        }
+
+        // 8 pixels per iteration, 16 bytes of BGRA at a time.
+        UTIL_TARGET_SSE41 inline void RowPairSse41(const uint8_t* s0, const uint8_t* s1, uint8_t* y0, uint8_t* y1,
+            uint8_t* u, uint8_t* v, int uvStep, int width)
+        {
+            const __m128i yCoeff = _mm_setr_epi16(YB, YG, YR, 0, YB, YG, YR, 0);
+            const __m128i uCoeff = _mm_setr_epi16(UB, UG, UR, 0, UB, UG, UR, 0);
+            const __m128i vCoeff = _mm_setr_epi16(VB, VG, VR, 0, VB, VG, VR, 0);
+            // [u0 u1 u2 u3 v0 v1 v2 v3] -> [u0 v0 u1 v1 u2 v2 u3 v3]
+            const __m128i interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            int x = 0;
+            for (; x + 8 <= width; x += 8) {
+                __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0 + x * 4));
+                __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0 + x * 4 + 16));
+                __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1 + x * 4));
+                __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1 + x * 4 + 16));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), Luma8Sse41(a0, b0, yCoeff));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), Luma8Sse41(a1, b1, yCoeff));
+
+                __m128i avgA = Average2x2Sse41(a0, a1);
+                __m128i avgB = Average2x2Sse41(b0, b1);
+                __m128i cu = Chroma4Sse41(avgA, avgB, uCoeff);
+                __m128i cv = Chroma4Sse41(avgA, avgB, vCoeff);
+                __m128i uv = _mm_packus_epi16(_mm_packs_epi32(cu, cv), _mm_setzero_si128());
+                int i = x / 2;
+                if (uvStep == 1) {
+                    int32_t uBytes = _mm_cvtsi128_si32(uv);
+                    int32_t vBytes = _mm_extract_epi32(uv, 1);
+                    ::memcpy(u + i, &uBytes, 4);
+                    ::memcpy(v + i, &vBytes, 4);
+                }
+                else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i * 2), _mm_shuffle_epi8(uv, interleave));
+                }
+            }
+            RowPairScalar(s0, s1, y0, y1, u, v, uvStep, x, width);
+        }
+
+        UTIL_TARGET_AVX2 inline __m256i Dot8Avx2(__m256i lo, __m256i hi, __m256i coeff)
+        {
+            return _mm256_hadd_epi32(_mm256_madd_epi16(lo, coeff), _mm256_madd_epi16(hi, coeff));
+        }
+
+        // 16 BGRA pixels to 16 luma bytes. The unpack and hadd steps work within each 128 bit lane
+        // so the permutes put the pixels back in order.
+        UTIL_TARGET_AVX2 inline __m128i Luma16Avx2(__m256i a, __m256i b, __m256i coeff)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i round = _mm256_set1_epi32(128);
+            __m256i ya = Dot8Avx2(_mm256_unpacklo_epi8(a, zero), _mm256_unpackhi_epi8(a, zero), coeff);
+            __m256i yb = Dot8Avx2(_mm256_unpacklo_epi8(b, zero), _mm256_unpackhi_epi8(b, zero), coeff);
+            ya = _mm256_srli_epi32(_mm256_add_epi32(ya, round), 8);
+            yb = _mm256_srli_epi32(_mm256_add_epi32(yb, round), 8);
+            __m256i y = _mm256_permute4x64_epi64(_mm256_packs_epi32(ya, yb), 0xD8);
+            y = _mm256_add_epi16(y, _mm256_set1_epi16(16));
+            y = _mm256_permute4x64_epi64(_mm256_packus_epi16(y, y), 0x08);
+            return _mm256_castsi256_si128(y);
+        }
+
+        UTIL_TARGET_AVX2 inline __m256i Average2x2Avx2(__m256i r0, __m256i r1)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, zero), _mm256_unpacklo_epi8(r1, zero));
+            __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, zero), _mm256_unpackhi_epi8(r1, zero));
+            __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+            return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+        }
+
+        UTIL_TARGET_AVX2 inline __m256i Chroma8Avx2(__m256i avgA, __m256i avgB, __m256i coeff)
+        {
+            __m256i c = Dot8Avx2(avgA, avgB, coeff);
+            c = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(128)), 8);
+            return _mm256_add_epi32(c, _mm256_set1_epi32(128));
+        }
+
+        // 16 pixels per iteration, 32 bytes of BGRA at a time.
+        UTIL_TARGET_AVX2 inline void RowPairAvx2(const uint8_t* s0, const uint8_t* s1, uint8_t* y0, uint8_t* y1,
+            uint8_t* u, uint8_t* v, int uvStep, int width)
+        {
+            const __m256i yCoeff = _mm256_setr_epi16(YB, YG, YR, 0, YB, YG, YR, 0, YB, YG, YR, 0, YB, YG, YR, 0);
+            const __m256i uCoeff = _mm256_setr_epi16(UB, UG, UR, 0, UB, UG, UR, 0, UB, UG, UR, 0, UB, UG, UR, 0);
+            const __m256i vCoeff = _mm256_setr_epi16(VB, VG, VR, 0, VB, VG, VR, 0, VB, VG, VR, 0, VB, VG, VR, 0);
+            // chroma arrives as [u0 u1 u4 u5 v0 v1 v4 v5 u2 u3 u6 u7 v2 v3 v6 v7]
+            const __m128i planar = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+            const __m128i interleave = _mm_setr_epi8(0, 4, 1, 5, 8, 12, 9, 13, 2, 6, 3, 7, 10, 14, 11, 15);
+            int x = 0;
+            for (; x + 16 <= width; x += 16) {
+                __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s0 + x * 4));
+                __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s0 + x * 4 + 32));
+                __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s1 + x * 4));
+                __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s1 + x * 4 + 32));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), Luma16Avx2(a0, b0, yCoeff));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), Luma16Avx2(a1, b1, yCoeff));
+
+                __m256i avgA = Average2x2Avx2(a0, a1);
+                __m256i avgB = Average2x2Avx2(b0, b1);
+                __m256i cu = Chroma8Avx2(avgA, avgB, uCoeff);
+                __m256i cv = Chroma8Avx2(avgA, avgB, vCoeff);
+                __m256i packed = _mm256_packs_epi32(cu, cv);
+                packed = _mm256_packus_epi16(packed, packed);
+                __m128i uv = _mm_unpacklo_epi64(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+                int i = x / 2;
+                if (uvStep == 1) {
+                    uv = _mm_shuffle_epi8(uv, planar);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i), uv);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i), _mm_unpackhi_epi64(uv, uv));
+                }
+                else {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i * 2), _mm_shuffle_epi8(uv, interleave));
+                }
+            }
+            RowPairScalar(s0, s1, y0, y1, u, v, uvStep, x, width);
+        }
+#endif
+    }
+
+    // Converts width x height BGRA pixels with the given source row pitch (in bytes) into the
+    // planes described by dst and dstStride, which can be AVFrame::data and AVFrame::linesize.
+    // Width and height must be even.  Uses the given instruction set, see GetCpuLevel().
+    inline void ConvertBgraToYuv420(const uint8_t* src, int srcPitch, int width, int height,
+        uint8_t* const* dst, const int* dstStride, YuvFormat format, CpuLevel level)
+    {
+        int uvStep = (format == YuvFormat::NV12) ? 2 : 1;
+        for (int y = 0; y + 1 < height; y += 2) {
+            const uint8_t* s0 = src + static_cast<int64_t>(y) * srcPitch;
+            const uint8_t* s1 = s0 + srcPitch;
+            uint8_t* y0 = dst[0] + static_cast<int64_t>(y) * dstStride[0];
+            uint8_t* y1 = y0 + dstStride[0];
+            uint8_t* u = dst[1] + static_cast<int64_t>(y / 2) * dstStride[1];
+            uint8_t* v = (format == YuvFormat::NV12) ? u + 1 : dst[2] + static_cast<int64_t>(y / 2) * dstStride[2];
+            switch (level) {
+#if UTIL_X86
+            case CpuLevel::Avx2:
+                detail::RowPairAvx2(s0, s1, y0, y1, u, v, uvStep, width);
+                break;
+            case CpuLevel::Sse41:
+                detail::RowPairSse41(s0, s1, y0, y1, u, v, uvStep, width);
+                break;
+#endif
+            default:
+                detail::RowPairScalar(s0, s1, y0, y1, u, v, uvStep, 0, width);
+                break;
+            }
+        }
+    }
+
+    inline void ConvertBgraToYuv420(const uint8_t* src, int srcPitch, int width, int height,
+        uint8_t* const* dst, const int* dstStride, YuvFormat format)
+    {
+        ConvertBgraToYuv420(src, srcPitch, width, height, dst, dstStride, format, GetCpuLevel());
+    }
+}
@@ -0,0 +1,730 @@
+#include "FFmpegPipeline.h"
+#include "ChangeDetector.h"
+#include "ColorConvert.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/avutil.h>
+}
+
+using namespace util;
+
+static void check_ffmpeg_result(int hr, const char* msg) {
+    if (hr < 0) {
+        char message[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+        av_make_error_string(message, AV_ERROR_MAX_STRING_SIZE, hr);
+        throw std::runtime_error(std::string(msg) + message);
+    }
+}
+
+// One frame on its way through the pipeline, the buffers are allocated once and reused.
+struct EncoderFrame
+{
+    std::shared_ptr<void> source; // the FrameSource handle between capture and readback.
+    double time = 0;
+    bool skip = false;            // nothing changed, with variableFrameRate.
+    std::vector<uint8_t> pixels;  // pitched BGRA.
+    AVFrame* yuv = nullptr;
+    std::vector<AVPacket*> packets;
+    size_t packetCount = 0;
+
+    ~EncoderFrame() {
+        av_frame_free(&yuv);
+        for (auto& packet : packets) {
+            av_packet_free(&packet);
+        }
+    }
+
+    AVPacket* NextPacket() {
+        if (packetCount == packets.size()) {
+            packets.push_back(av_packet_alloc());
+        }
+        return packets[packetCount++];
+    }
+};
+
+EncoderTuning EncoderTuning::ForProfile(EncoderProfile profile)
+{
+    EncoderTuning tuning;
+    switch (profile) {
+    case EncoderProfile::LowLatency:
+        // the usual live streaming setup: a steady bitrate with a one second buffer and frames
+        // split into slices across threads instead of several frames in flight.
+        tuning.preset = "superfast";
+        tuning.tune = "zerolatency";
+        tuning.crf = -1;
+        tuning.gopSize = 0;
+        tuning.maxBFrames = 0;
+        break;
+    case EncoderProfile::HighThroughput:
+        // screen content compresses well with long GOPs, and b-frames are cheap at this preset.
+        tuning.preset = "veryfast";
+        tuning.crf = 23;
+        tuning.gopSize = 0;
+        tuning.maxBFrames = 2;
+        break;
+    default:
+        break;
+    }
+    return tuning;
+}
+
+FFmpegPipeline::FFmpegPipeline()
+{
+}
+
+FFmpegPipeline::~FFmpegPipeline()
+{
+    Cleanup();
+    avcodec_parameters_free(&_replayParameters);
+}
+
+void FFmpegPipeline::Stop()
+{
+    _stopped = true;
+}
+
+bool FFmpegPipeline::Stopped()
+{
+    return _stopped;
+}
+
+bool FFmpegPipeline::IsRunning()
+{
+    return _running;
+}
+
+unsigned int FFmpegPipeline::GetSampleTimes(double* buffer, unsigned int size)
+{
+    return static_cast<unsigned int>(_ticks.Copy(buffer, size));
+}
+
+const TimingLog& FFmpegPipeline::SampleTimes() const
+{
+    return _ticks;
+}
+
+uint64_t FFmpegPipeline::FramesDropped()
+{
+    std::scoped_lock lock(_statsMutex);
+    return _dropped;
+}
+
+uint64_t FFmpegPipeline::FramesSkipped()
+{
+    return _skipped;
+}
+
+std::vector<LoadAdjustment> FFmpegPipeline::GetLoadAdjustments()
+{
+    std::scoped_lock lock(_statsMutex);
+    return _load != nullptr ? _load->Adjustments() : std::vector<LoadAdjustment>();
+}
+
+uint64_t FFmpegPipeline::FramesThinned()
+{
+    std::scoped_lock lock(_statsMutex);
+    return _load != nullptr ? _load->Thinned() : 0;
+}
+
+std::vector<StageStats> FFmpegPipeline::GetStageStats()
+{
+    std::scoped_lock lock(_statsMutex);
+    return _stageStats;
+}
+
+int FFmpegPipeline::SegmentCount()
+{
+    return _segments;
+}
+
+// The one and only segment of a recording that is not segmented.
+class SingleOutput : public SegmentOutput
+{
+    const OutputCallbacks& _callbacks;
+
+public:
+    explicit SingleOutput(const OutputCallbacks& callbacks) : _callbacks(callbacks) {
+    }
+
+    OutputCallbacks Open(int /*index*/) override {
+        return _callbacks;
+    }
+
+    void Close(int /*index*/) override {
+    }
+};
+
+void FFmpegPipeline::Encode(FrameSource& source, const EncoderSettings& settings, const OutputCallbacks& output)
+{
+    if (settings.replaySeconds <= 0 && (settings.segmentSeconds > 0 || settings.segmentBytes > 0)) {
+        throw std::invalid_argument("A segmented recording needs a SegmentOutput");
+    }
+    SingleOutput single(output);
+    Encode(source, settings, single);
+}
+
+void FFmpegPipeline::Encode(FrameSource& source, const EncoderSettings& settings, SegmentOutput& output)
+{
+    if (_stopped) {
+        return;
+    }
+    {
+        std::scoped_lock lock(_statsMutex);
+        _ticks.Reset();
+        _stageStats.clear();
+        _dropped = 0;
+    }
+    _skipped = 0;
+    try {
+        EncodeFrames(source, settings, output);
+    }
+    catch (...) {
+        _running = false;
+        Cleanup();
+        throw;
+    }
+    _running = false;
+    Cleanup();
+}
+
+void FFmpegPipeline::Cleanup()
+{
+    FreeOutput();
+    if (_codecContext) {
+        avcodec_free_context(&_codecContext);
+    }
+}
+
+void FFmpegPipeline::FreeOutput()
+{
+    if (_formatContext) {
+        avformat_free_context(_formatContext);
+        _formatContext = nullptr;
+    }
+    if (_avioContext) {
+        // avio can replace the buffer we gave it, so free whatever it has now.
+        av_freep(&_avioContext->buffer);
+        avio_context_free(&_avioContext);
+    }
+}
+
+// Creates the muxer for the open codec and writes the header of a file or segment to output.
+void FFmpegPipeline::OpenOutput(const EncoderSettings& settings, const OutputCallbacks& output)
+{
+    const char* formatName = settings.container == Container::MpegTs ? "mpegts" : "mp4";
+    int hr = avformat_alloc_output_context2(&_formatContext, nullptr, formatName, nullptr);
+    check_ffmpeg_result(hr, "avformat_alloc_output_context2: ");
+
+    AVStream* out_stream = avformat_new_stream(_formatContext, nullptr);
+    if (!out_stream) {
+        throw std::runtime_error("Output file does not contain any stream");
+    }
+    out_stream->time_base = _codecContext->time_base;
+    out_stream->avg_frame_rate = _codecContext->framerate;
+    out_stream->r_frame_rate = _codecContext->framerate;
+    hr = avcodec_parameters_from_context(out_stream->codecpar, _codecContext);
+    check_ffmpeg_result(hr, "avcodec_parameters_from_context: ");
+
+    int io_buffer_size = 65536;
+    uint8_t* io_buffer = (uint8_t*)av_malloc(io_buffer_size);
+    _avioContext = avio_alloc_context(io_buffer, io_buffer_size, 1, output.opaque, nullptr, output.write, output.seek);
+    _formatContext->pb = _avioContext; // hook up our custom IO context.
+
+    AVDictionary* muxerOptions = nullptr;
+    if (settings.container == Container::FragmentedMp4) {
+        // a fragment starts at the first key frame after fragmentSeconds, and the moov atom up front
+        // has no samples so it never needs to be rewritten.
+        av_dict_set(&muxerOptions, "movflags", "+frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set_int(&muxerOptions, "min_frag_duration", static_cast<int64_t>(settings.fragmentSeconds * 1000000), 0);
+    }
+    hr = avformat_write_header(_formatContext, &muxerOptions);
+    av_dict_free(&muxerOptions);
+    check_ffmpeg_result(hr, "avformat_write_header: ");
+}
+
+// Finishes the file or segment and pushes it all out to the output.
+void FFmpegPipeline::CloseOutput()
+{
+    int hr = av_write_trailer(_formatContext);
+    check_ffmpeg_result(hr, "av_write_trailer: ");
+    avio_flush(_avioContext);
+    FreeOutput();
+}
+
+static void ReceivePackets(AVCodecContext* codecContext, AVRational streamTimeBase, EncoderFrame& frame)
+{
+    while (true) {
+        AVPacket* packet = frame.NextPacket();
+        UTIL_TRACE_SCOPE("avcodec_receive_packet");
+        int hr = avcodec_receive_packet(codecContext, packet);
+        if (hr == AVERROR(EAGAIN) || hr == AVERROR_EOF) {
+            frame.packetCount--;
+            break;
+        }
+        check_ffmpeg_result(hr, "avcodec_receive_packet: ");
+        packet->stream_index = 0;
+        // mp4 keeps our time base, mpeg-ts always uses 90 kHz.
+        av_packet_rescale_ts(packet, codecContext->time_base, streamTimeBase);
+    }
+}
+
+static void WritePacket(AVFormatContext* formatContext, AVPacket* packet)
+{
+    // this takes ownership of the packet data and leaves the packet blank for reuse.
+    UTIL_TRACE_SCOPE("av_interleaved_write_frame");
+    int hr = av_interleaved_write_frame(formatContext, packet);
+    check_ffmpeg_result(hr, "av_interleaved_write_frame: ");
+}
+
+// Copies the packets into the replay buffer instead of muxing them.
+static void KeepFramePackets(ReplayBuffer& replay, EncoderFrame& frame)
+{
+    UTIL_TRACE_SCOPE("KeepFramePackets");
+    for (size_t i = 0; i < frame.packetCount; i++) {
+        AVPacket* packet = frame.packets[i];
+        auto kept = std::make_shared<ReplayPacket>();
+        kept->data.assign(packet->data, packet->data + packet->size);
+        kept->pts = packet->pts;
+        kept->dts = packet->dts;
+        kept->duration = packet->duration;
+        kept->key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+        replay.Add(std::move(kept));
+        av_packet_unref(packet);
+    }
+    frame.packetCount = 0;
+}
+
+// What SaveReplay allocates, freed however it ends.
+struct ReplayMuxer
+{
+    AVFormatContext* formatContext = nullptr;
+    AVIOContext* avioContext = nullptr;
+    AVPacket* packet = nullptr;
+
+    ~ReplayMuxer() {
+        av_packet_free(&packet);
+        avformat_free_context(formatContext);
+        if (avioContext) {
+            av_freep(&avioContext->buffer);
+            avio_context_free(&avioContext);
+        }
+    }
+};
+
+void FFmpegPipeline::SaveReplay(const OutputCallbacks& output)
+{
+    ReplayMuxer muxer;
+    int hr = avformat_alloc_output_context2(&muxer.formatContext, nullptr, "mp4", nullptr);
+    check_ffmpeg_result(hr, "avformat_alloc_output_context2: ");
+    AVStream* stream = avformat_new_stream(muxer.formatContext, nullptr);
+    if (!stream) {
+        throw std::runtime_error("avformat_new_stream failed");
+    }
+
+    std::vector<std::shared_ptr<const ReplayPacket>> packets;
+    AVRational timeBase;
+    {
+        // the parameters and the packets have to come from the same encoding.
+        std::scoped_lock lock(_replayMutex);
+        if (_replayParameters == nullptr) {
+            throw std::runtime_error("There is no replay, encode with replaySeconds first");
+        }
+        hr = avcodec_parameters_copy(stream->codecpar, _replayParameters);
+        check_ffmpeg_result(hr, "avcodec_parameters_copy: ");
+        timeBase = { _replayTimeBaseNum, _replayTimeBaseDen };
+        packets = _replay.Snapshot();
+    }
+    if (packets.empty()) {
+        throw std::runtime_error("The replay buffer is empty");
+    }
+    stream->time_base = timeBase;
+
+    int io_buffer_size = 65536;
+    uint8_t* io_buffer = (uint8_t*)av_malloc(io_buffer_size);
+    muxer.avioContext = avio_alloc_context(io_buffer, io_buffer_size, 1, output.opaque, nullptr, output.write, output.seek);
+    muxer.formatContext->pb = muxer.avioContext;
+    hr = avformat_write_header(muxer.formatContext, nullptr);
+    check_ffmpeg_result(hr, "avformat_write_header: ");
+
+    // the clip starts at 0 whenever in the recording it was taken.
+    int64_t origin = packets.front()->dts;
+    muxer.packet = av_packet_alloc();
+    for (auto& kept : packets) {
+        hr = av_new_packet(muxer.packet, static_cast<int>(kept->data.size()));
+        check_ffmpeg_result(hr, "av_new_packet: ");
+        ::memcpy(muxer.packet->data, kept->data.data(), kept->data.size());
+        muxer.packet->pts = kept->pts - origin;
+        muxer.packet->dts = kept->dts - origin;
+        muxer.packet->duration = kept->duration;
+        muxer.packet->flags = kept->key ? AV_PKT_FLAG_KEY : 0;
+        muxer.packet->stream_index = 0;
+        av_packet_rescale_ts(muxer.packet, timeBase, stream->time_base);
+        hr = av_interleaved_write_frame(muxer.formatContext, muxer.packet);
+        check_ffmpeg_result(hr, "av_interleaved_write_frame: ");
+    }
+    hr = av_write_trailer(muxer.formatContext);
+    check_ffmpeg_result(hr, "av_write_trailer: ");
+    avio_flush(muxer.avioContext);
+    if (output.flush != nullptr) {
+        output.flush(output.opaque);
+    }
+}
+
+void FFmpegPipeline::EncodeFrames(FrameSource& source, const EncoderSettings& settings, SegmentOutput& output)
+{
+    auto format = source.GetFormat();
+    /* resolution must be a multiple of two */
+    int width = format.width & ~1;
+    int height = format.height & ~1;
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("Resolution too small");
+    }
+    int frameRate = static_cast<int>(settings.frameRate);
+
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        throw std::runtime_error("H264 codec not found");
+    }
+
+    bool replay = settings.replaySeconds > 0;
+    bool segmented = !replay && (settings.segmentSeconds > 0 || settings.segmentBytes > 0);
+    _segments = 0;
+    {
+        std::scoped_lock lock(_replayMutex);
+        avcodec_parameters_free(&_replayParameters);
+        _replay.Clear();
+    }
+
+    const char* formatName = settings.container == Container::MpegTs ? "mpegts" : "mp4";
+    const AVOutputFormat* outputFormat = av_guess_format(formatName, nullptr, nullptr);
+    if (!outputFormat) {
+        throw std::runtime_error(std::string("Output format not found: ") + formatName);
+    }
+
+    int hr = 0;
+    _codecContext = avcodec_alloc_context3(codec);
+    AVRational time_base = { 1, frameRate * 1000 }; // in milliseconds.
+    AVRational av_framerate = { frameRate, 1 };
+    const EncoderTuning& tuning = settings.tuning;
+    _codecContext->bit_rate = settings.bitrateInBps;
+    // x264 ignores bit_rate in crf mode but still keeps to the vbv limits, so the bitrate is a cap.
+    _codecContext->rc_max_rate = settings.bitrateInBps;
+    _codecContext->rc_buffer_size = tuning.crf >= 0 ? settings.bitrateInBps * 2 : settings.bitrateInBps;
+    _codecContext->width = width;
+    _codecContext->height = height;
+    _codecContext->time_base = time_base;
+    _codecContext->pkt_timebase = time_base;
+    _codecContext->framerate = av_framerate;
+    _codecContext->gop_size = tuning.gopSize > 0 ? tuning.gopSize : frameRate * 2;
+    _codecContext->max_b_frames = tuning.maxBFrames;
+    _codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+    _codecContext->qmin = tuning.qmin;
+    _codecContext->thread_count = tuning.threads;
+    // the replay is muxed into an mp4 later, which wants the headers up front too.
+    if (replay || (outputFormat->flags & AVFMT_GLOBALHEADER))
+    {
+        _codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    // duration comes out at 1000, or 1 millisecond which means 1000/30000 seconds or 1/30th of a second if we are running at 30 fps
+    // The reason we set time_base to 1/30000 instead of 1/30 is to give the system more floating point precision.
+    int64_t avp_duration = (_codecContext->time_base.den / _codecContext->time_base.num) / av_framerate.num * av_framerate.den;
+
+    if (codec->id == AV_CODEC_ID_H264) {
+        av_opt_set(_codecContext->priv_data, "preset", tuning.preset.c_str(), 0);
+        if (!tuning.tune.empty()) {
+            av_opt_set(_codecContext->priv_data, "tune", tuning.tune.c_str(), 0);
+        }
+        if (tuning.crf >= 0) {
+            av_opt_set(_codecContext->priv_data, "crf", std::to_string(tuning.crf).c_str(), 0);
+        }
+    }
+    AVDictionary* codecOptions = nullptr;
+    hr = av_dict_parse_string(&codecOptions, tuning.options.c_str(), "=", ":", 0);
+    if (hr < 0) {
+        av_dict_free(&codecOptions);
+        check_ffmpeg_result(hr, "encoder options: ");
+    }
+    hr = avcodec_open2(_codecContext, codec, &codecOptions);
+    // avcodec_open2 leaves the options it did not know in the dictionary.
+    const AVDictionaryEntry* unknown = av_dict_get(codecOptions, "", nullptr, AV_DICT_IGNORE_SUFFIX);
+    std::string unknownName = unknown != nullptr ? unknown->key : "";
+    av_dict_free(&codecOptions);
+    check_ffmpeg_result(hr, "avcodec_open2: ");
+    if (!unknownName.empty()) {
+        throw std::runtime_error("Unknown encoder option: " + unknownName);
+    }
+
+    AVRational streamTimeBase = _codecContext->time_base;
+    if (replay) {
+        std::scoped_lock lock(_replayMutex);
+        _replayParameters = avcodec_parameters_alloc();
+        if (!_replayParameters) {
+            throw std::runtime_error("avcodec_parameters_alloc failed");
+        }
+        hr = avcodec_parameters_from_context(_replayParameters, _codecContext);
+        check_ffmpeg_result(hr, "avcodec_parameters_from_context: ");
+        _replayTimeBaseNum = streamTimeBase.num;
+        _replayTimeBaseDen = streamTimeBase.den;
+        _replay.Configure(settings.replaySeconds, settings.replayMaxBytes, streamTimeBase.num, streamTimeBase.den);
+    }
+    OutputCallbacks current;
+    if (!replay) {
+        current = output.Open(0);
+        OpenOutput(settings, current);
+        _segments = 1;
+        // every segment gets the same time base, mp4 keeps ours and mpeg-ts always uses 90 kHz.
+        streamTimeBase = _formatContext->streams[0]->time_base;
+    }
+
+    FramePipeline<EncoderFrame> pipeline(settings.queueDepth, settings.dropPolicy);
+    unsigned int bufferSize = static_cast<unsigned int>(format.pitch) * format.height;
+    for (size_t i = 0; i < pipeline.Depth(); i++) {
+        EncoderFrame& frame = pipeline.GetFrame(i);
+        frame.pixels.resize(bufferSize);
+        frame.yuv = av_frame_alloc();
+        frame.yuv->format = AV_PIX_FMT_YUV420P;
+        frame.yuv->width = width;
+        frame.yuv->height = height;
+        hr = av_frame_get_buffer(frame.yuv, 32);
+        check_ffmpeg_result(hr, "av_frame_get_buffer: ");
+    }
+
+    LoadController* load = nullptr;
+    {
+        std::scoped_lock lock(_statsMutex);
+        _load = settings.adaptiveFrameRate ? std::make_unique<LoadController>(frameRate, settings.minFrameRate) : nullptr;
+        load = _load.get();
+    }
+    std::vector<double> busySeconds;
+
+    std::chrono::steady_clock::time_point start;
+    bool started = false;
+    _running = true;
+
+    pipeline.SetSource("capture", [&](EncoderFrame* frame) {
+        std::shared_ptr<void> handle;
+        double frameTime = 0;
+        do {
+            if (_stopped) {
+                return false;
+            }
+            UTIL_TRACE_SCOPE("AcquireFrame");
+            if (source.AcquireFrame(handle) < 0) {
+                return false;
+            }
+            if (!started) {
+                // we cannot use the time returned from the source because it can be non monotonic
+                // which makes the muxer fail, so we use our own clock starting at the first frame.
+                start = std::chrono::steady_clock::now();
+                started = true;
+            }
+            frameTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (settings.seconds > 0 && frameTime > settings.seconds) {
+                return false;
+            }
+        } while (load != nullptr && !load->Keep(frameTime));
+        if (load != nullptr) {
+            pipeline.GetBusySeconds(busySeconds);
+            load->Update(frameTime, busySeconds, pipeline.Dropped(), pipeline.InFlight() == pipeline.Depth());
+        }
+        if (frame != nullptr) {
+            frame->source = handle;
+            frame->time = frameTime;
+            _ticks.Add(frameTime);
+        }
+        return true;
+    });
+
+    pipeline.AddStage("readback", [&](EncoderFrame& frame) {
+        UTIL_TRACE_SCOPE("ReadFrame");
+        source.ReadFrame(frame.source, frame.pixels.data(), bufferSize);
+        frame.source = nullptr; // let the source recycle its frame as soon as possible.
+    });
+
+    ChangeDetector detector(32, settings.changeIgnoreBits);
+    double lastKept = 0;
+    if (settings.variableFrameRate) {
+        pipeline.AddStage("detect", [&](EncoderFrame& frame) {
+            UTIL_TRACE_SCOPE("ChangeDetector");
+            size_t changed = detector.Update(frame.pixels.data(), format.pitch, width, height);
+            frame.skip = changed == 0 && frame.time - lastKept < settings.maxFrameGap;
+            if (frame.skip) {
+                _skipped++;
+            }
+            else {
+                lastKept = frame.time;
+            }
+        });
+    }
+
+    int64_t lastPts = -1;
+    pipeline.AddStage("convert", [&](EncoderFrame& frame) {
+        if (frame.skip) {
+            return;
+        }
+        // the encoder may still hold a reference to this frame from the last time it was sent.
+        int rc = av_frame_make_writable(frame.yuv);
+        check_ffmpeg_result(rc, "av_frame_make_writable: ");
+        {
+            UTIL_TRACE_SCOPE("ConvertBgraToYuv420");
+            ConvertBgraToYuv420(frame.pixels.data(), format.pitch, width, height,
+                frame.yuv->data, frame.yuv->linesize, YuvFormat::I420);
+        }
+
+        // Sync presentation time to real time frame times, and keep it strictly increasing.
+        int64_t pts = static_cast<int64_t>(frame.time * 1000 * frameRate); // in time_base units.
+        if (pts <= lastPts) {
+            pts = lastPts + 1;
+        }
+        lastPts = pts;
+        frame.yuv->pts = pts;
+        frame.yuv->duration = avp_duration;
+    });
+
+    // Segments are cut at key frames the encode stage asks for, every segmentSeconds or when the mux
+    // stage sees the segment reach segmentBytes. The pts of the last one asked for is passed on in
+    // the stream time base so the mux stage cuts exactly there and not at the regular key frames.
+    std::atomic<bool> keyFrameWanted{ false };
+    std::atomic<int64_t> cutPts{ INT64_MIN };
+    double nextCutTime = settings.segmentSeconds;
+    EncoderFrame* lastEncoded = nullptr;
+    double lastSkipped = -1; // the time of a skipped frame after lastEncoded.
+    pipeline.AddStage("encode", [&](EncoderFrame& frame) {
+        if (frame.skip) {
+            lastSkipped = frame.time;
+            return;
+        }
+        lastEncoded = &frame;
+        lastSkipped = -1;
+        frame.yuv->pict_type = AV_PICTURE_TYPE_NONE; // let the encoder decide.
+        if (segmented) {
+            bool cut = keyFrameWanted.exchange(false);
+            if (settings.segmentSeconds > 0 && frame.time >= nextCutTime) {
+                cut = true;
+                while (nextCutTime <= frame.time) {
+                    nextCutTime += settings.segmentSeconds;
+                }
+            }
+            if (cut) {
+                frame.yuv->pict_type = AV_PICTURE_TYPE_I;
+                cutPts = av_rescale_q(frame.yuv->pts, _codecContext->time_base, streamTimeBase);
+            }
+        }
+        {
+            UTIL_TRACE_SCOPE("avcodec_send_frame");
+            int rc = avcodec_send_frame(_codecContext, frame.yuv);
+            check_ffmpeg_result(rc, "avcodec_send_frame: ");
+        }
+        ReceivePackets(_codecContext, streamTimeBase, frame);
+    });
+
+    int64_t segmentOrigin = 0; // the pts the current segment starts at.
+    int64_t lastCut = INT64_MIN;
+    bool cutRequested = false;
+    auto writePackets = [&](EncoderFrame& frame) {
+        for (size_t i = 0; i < frame.packetCount; i++) {
+            AVPacket* packet = frame.packets[i];
+            int64_t cut = cutPts;
+            if (segmented && cut > lastCut && (packet->flags & AV_PKT_FLAG_KEY) && packet->pts >= cut) {
+                // closed GOPs, so nothing after this in decoding order shows before it.
+                UTIL_TRACE_SCOPE("NextSegment");
+                lastCut = cut;
+                cutRequested = false;
+                CloseOutput();
+                output.Close(_segments - 1);
+                current = output.Open(_segments);
+                OpenOutput(settings, current);
+                _segments++;
+                segmentOrigin = packet->pts;
+            }
+            packet->pts -= segmentOrigin;
+            packet->dts -= segmentOrigin;
+            WritePacket(_formatContext, packet);
+        }
+        frame.packetCount = 0;
+        if (segmented && settings.segmentBytes > 0 && !cutRequested &&
+            static_cast<uint64_t>(avio_tell(_formatContext->pb)) >= settings.segmentBytes) {
+            keyFrameWanted = true;
+            cutRequested = true;
+        }
+    };
+
+    bool streaming = settings.container != Container::Mp4;
+    int64_t flushedPosition = 0;
+    double flushedTime = 0;
+    pipeline.AddStage("mux", [&](EncoderFrame& frame) {
+        if (replay) {
+            KeepFramePackets(_replay, frame);
+            return;
+        }
+        int segments = _segments;
+        writePackets(frame);
+        if (segments != _segments) {
+            flushedPosition = 0;
+            flushedTime = frame.time;
+        }
+        if (streaming) {
+            // fragmented mp4 only writes whole fragments, mpeg-ts writes every frame so it is only
+            // flushed every fragmentSeconds.
+            int64_t position = avio_tell(_formatContext->pb);
+            if (position != flushedPosition &&
+                (settings.container == Container::FragmentedMp4 || frame.time - flushedTime >= settings.fragmentSeconds)) {
+                UTIL_TRACE_SCOPE("avio_flush");
+                avio_flush(_formatContext->pb);
+                if (current.flush != nullptr) {
+                    current.flush(current.opaque);
+                }
+                flushedPosition = position;
+                flushedTime = frame.time;
+            }
+        }
+    });
+
+    try {
+        pipeline.Run();
+    }
+    catch (...) {
+        std::scoped_lock lock(_statsMutex);
+        _stageStats = pipeline.GetStats();
+        _dropped = pipeline.Dropped();
+        throw;
+    }
+    {
+        std::scoped_lock lock(_statsMutex);
+        _stageStats = pipeline.GetStats();
+        _dropped = pipeline.Dropped();
+    }
+
+    // when the screen did not change at the end the last encoded picture is repeated at the time of
+    // the last frame, so the video is as long as the recording was.
+    if (lastEncoded != nullptr && lastSkipped >= 0) {
+        int64_t pts = std::max(static_cast<int64_t>(lastSkipped * 1000 * frameRate), lastPts + 1);
+        lastEncoded->yuv->pts = pts;
+        lastEncoded->yuv->pict_type = AV_PICTURE_TYPE_NONE;
+        hr = avcodec_send_frame(_codecContext, lastEncoded->yuv);
+        check_ffmpeg_result(hr, "avcodec_send_frame: ");
+    }
+
+    // drain the frames the encoder is still holding on to (lookahead and b-frames).
+    EncoderFrame flush;
+    hr = avcodec_send_frame(_codecContext, nullptr);
+    check_ffmpeg_result(hr, "avcodec_send_frame: ");
+    ReceivePackets(_codecContext, streamTimeBase, flush);
+    if (replay) {
+        KeepFramePackets(_replay, flush);
+        return;
+    }
+    writePackets(flush);
+
+    // finish up the video format.
+    CloseOutput();
+    output.Close(_segments - 1);
+}
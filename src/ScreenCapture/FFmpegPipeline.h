@@ -0,0 +1,169 @@
+#pragma once
+#include "FramePipeline.h"
+#include "FrameSource.h"
+#include "LoadController.h"
+#include "TimingLog.h"
+#include "OutputSink.h"
+#include "ReplayBuffer.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVCodecContext;
+struct AVCodecParameters;
+
+namespace util
+{
+    enum class Container
+    {
+        Mp4 = 0,           // the index goes at the end, so nothing can read the file until it is finished.
+        FragmentedMp4 = 1, // an empty index up front and the frames in self contained fragments.
+        MpegTs = 2
+    };
+
+    enum class EncoderProfile
+    {
+        Default = 0,        // what the pipeline always did: good quality at a moderate cost.
+        LowLatency = 1,     // no b-frames or lookahead so each frame comes out as soon as it is sent.
+        HighThroughput = 2  // the most frames per second of CPU, for large or high frame rate captures.
+    };
+
+    // How the H264 encoder is set up. Start from a profile and change what you need, options is
+    // applied last and can set any FFmpeg or x264 encoder option.
+    struct EncoderTuning
+    {
+        std::string preset = "fast";
+        std::string tune;   // e.g. "zerolatency", empty for none.
+        int crf = 20;       // constant quality capped at bitrateInBps, or -1 for bitrateInBps on average.
+        int gopSize = 10;   // frames between key frames at most, 0 for two seconds worth.
+        int maxBFrames = 1;
+        int threads = 0;    // 0 lets FFmpeg pick.
+        int qmin = 3;
+        // "key=value:key=value" FFmpeg encoder options, e.g. "preset=veryfast:g=120:bf=0".
+        std::string options;
+
+        static EncoderTuning ForProfile(EncoderProfile profile);
+    };
+
+    struct EncoderSettings
+    {
+        unsigned int bitrateInBps = 8000000;
+        unsigned int frameRate = 30;
+        double seconds = 0;     // maximum length before encoding finishes or 0 for infinite.
+        size_t queueDepth = 3;  // how many frames can be in flight between the pipeline stages.
+        DropPolicy dropPolicy = DropPolicy::Block;
+        Container container = Container::Mp4;
+        // FragmentedMp4 and MpegTs: how long a fragment is and how often what was muxed is flushed
+        // to the output, so a crash loses at most this much and a reader can follow the file.
+        double fragmentSeconds = 1;
+        // Instant replay: when above 0 nothing is written to the output, the encoded packets are
+        // kept in memory instead, at least this many seconds of them, and SaveReplay writes them
+        // out on demand. replayMaxBytes caps the memory they use, which can make the replay shorter.
+        double replaySeconds = 0;
+        size_t replayMaxBytes = 256 * 1024 * 1024;
+        // Segmented recording: start a new output every segmentSeconds and/or once one holds
+        // segmentBytes. The encoder is asked for a key frame there so each segment plays on its
+        // own, and each starts at time 0 where the last one ended. 0 turns a limit off.
+        double segmentSeconds = 0;
+        uint64_t segmentBytes = 0;
+        EncoderTuning tuning;
+        // Variable frame rate: frames where nothing changed since the one before are not converted
+        // or encoded, the next one that did change keeps its real timestamp so playback timing stays
+        // true. The lowest changeIgnoreBits bits of each color are ignored so near identical frames
+        // count as unchanged. A frame is still encoded every maxFrameGap seconds so segments, the
+        // replay and seeking in a player keep moving while the screen is idle.
+        bool variableFrameRate = false;
+        int changeIgnoreBits = 0;
+        double maxFrameGap = 1;
+        // Adaptive frame rate: while the stages cannot keep up with the source, frames are left out
+        // before the readback so the rest get through on time, in steps down to minFrameRate (0 for a
+        // quarter of frameRate), and the frame rate goes back up once there is room. The output
+        // size and the encoder preset stay as they are, H264 cannot change them within a stream.
+        bool adaptiveFrameRate = false;
+        double minFrameRate = 0;
+    };
+
+    // Encodes frames from a FrameSource into an H264 mp4 file using FFmpeg. Capture, readback,
+    // color conversion, encoding and muxing each run on their own thread with queueDepth frames in
+    // flight between them, so the frame rate is limited by the slowest stage instead of the sum of
+    // all of them. This has no Windows dependencies so it can be tested with a SyntheticFrameSource.
+    class FFmpegPipeline
+    {
+    public:
+        FFmpegPipeline();
+        ~FFmpegPipeline();
+
+        // Blocks until Stop is called, the source ends, or settings.seconds have been encoded.
+        // Returns right away without opening anything if Stop was called before it.
+        // Throws std::exception on failure.
+        void Encode(FrameSource& source, const EncoderSettings& settings, const OutputCallbacks& output);
+
+        // The same for a segmented recording, with settings.segmentSeconds or segmentBytes.
+        void Encode(FrameSource& source, const EncoderSettings& settings, SegmentOutput& output);
+
+        // Ends the Encode in progress, or the next one if it has not started yet, so a Stop that
+        // comes in while the caller is still setting up is not lost. A stopped pipeline stays stopped.
+        void Stop();
+
+        bool Stopped();
+
+        bool IsRunning();
+
+        // Writes the replay buffer to an mp4 without stopping the encoding, it starts on a key frame.
+        // Works while and after encoding with replaySeconds, throws std::exception on failure.
+        void SaveReplay(const OutputCallbacks& output);
+
+        // Timestamps of the oldest encoded frames still in SampleTimes, returns how many were
+        // copied, or with no buffer how many it has.
+        unsigned int GetSampleTimes(double* buffer, unsigned int size);
+
+        // Timestamps of the encoded frames in seconds, safe to read while encoding.
+        const TimingLog& SampleTimes() const;
+
+        uint64_t FramesDropped();
+
+        // Frames the last Encode left out because they did not change, with variableFrameRate.
+        uint64_t FramesSkipped();
+
+        // The frame rate changes of the last Encode with adaptiveFrameRate, safe to read while encoding.
+        std::vector<LoadAdjustment> GetLoadAdjustments();
+
+        // Frames the last Encode left out to keep up, with adaptiveFrameRate.
+        uint64_t FramesThinned();
+
+        // Per stage timings of the last Encode, the source is first.
+        std::vector<StageStats> GetStageStats();
+
+        // How many segments the last Encode started, 1 if it was not segmented.
+        int SegmentCount();
+
+    private:
+        void EncodeFrames(FrameSource& source, const EncoderSettings& settings, SegmentOutput& output);
+        void OpenOutput(const EncoderSettings& settings, const OutputCallbacks& output);
+        void CloseOutput();
+        void FreeOutput();
+        void Cleanup();
+
+        AVFormatContext* _formatContext = nullptr;
+        AVIOContext* _avioContext = nullptr;
+        AVCodecContext* _codecContext = nullptr;
+        std::atomic<bool> _running{ false };
+        std::atomic<bool> _stopped{ false };
+        ReplayBuffer _replay;
+        std::mutex _replayMutex;
+        // the stream the replay buffer holds, from the last Encode with replaySeconds.
+        AVCodecParameters* _replayParameters = nullptr;
+        int _replayTimeBaseNum = 1;
+        int _replayTimeBaseDen = 1;
+        std::mutex _statsMutex;
+        TimingLog _ticks; // written by the capture stage only.
+        std::vector<StageStats> _stageStats;
+        uint64_t _dropped = 0;
+        std::atomic<uint64_t> _skipped{ 0 };
+        std::atomic<int> _segments{ 0 };
+        std::unique_ptr<LoadController> _load; // replaced under _statsMutex.
+    };
+}
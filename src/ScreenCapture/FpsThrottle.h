@@ -1,47 +1,149 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include "Clock.h"
+#include "TimingLog.h"
 #include "Timer.h"
 
 namespace util
 {
+    // What FpsThrottle does when a step comes a whole interval or more after its deadline, after a
+    // stall like a slow frame or the machine being busy.
+    enum class CatchUpPolicy
+    {
+        Burst = 0,      // return right away until it is back on the schedule, the missed steps run back to back.
+        SkipMissed = 1, // drop the missed deadlines, the late step returns right away and the next is back on the schedule.
+        Reanchor = 2    // start a new schedule from now.
+    };
+
+    struct ThrottleStats
+    {
+        uint64_t steps = 0;
+        uint64_t missed = 0; // deadlines skipped by SkipMissed or given up by Reanchor.
+        double p50 = 0;      // seconds steps returned after their deadline.
+        double p90 = 0;
+        double p99 = 0;
+        double p999 = 0;
+        double max = 0;
+    };
+
+    // Paces a loop to a frame rate. Step waits for the next of a fixed schedule of deadlines, one
+    // interval apart from when it started, so however long each step takes there is no drift, and the
+    // catch up policy decides what happens after a stall. AlignTo moves the schedule to just after the
+    // times frames arrive, so a step doesn't land just before a new frame and read the old one. How
+    // late each step returns goes into a histogram. Step and AlignTo are for one thread, Stats and
+    // Histogram for any.
     class FpsThrottle
     {
-    private:
         Timer _timer;
-        double _fps = 0;
+        int64_t _interval;
+        CatchUpPolicy _catchUp;
         bool _started = false;
-        double _start_time = 0;
-        int _step_count = 0;
+        int64_t _anchor = 0;
+        int64_t _step = 0;
+        std::atomic<uint64_t> _steps{ 0 };
+        std::atomic<uint64_t> _missed{ 0 };
+        DurationHistogram _lateness;
 
+        int64_t Deadline() const {
+            return _anchor + _step * _interval;
+        }
 
     public:
-        FpsThrottle(int fps) {
-            _fps = static_cast<double>(fps);
+        explicit FpsThrottle(double fps, CatchUpPolicy catchUp = CatchUpPolicy::SkipMissed)
+            : _interval(static_cast<int64_t>(1e9 / (fps > 0 ? fps : 30))), _catchUp(catchUp) {
         }
 
+        // The next Step starts a new schedule, the statistics are kept.
         void Reset() {
             _started = false;
-            _start_time = 0;
-            _step_count = 0;
-            _timer.Start();
         }
 
+        void SetSleepPolicy(SleepPolicy policy) {
+            _timer.SetPolicy(policy);
+        }
 
-        void Step() {
-            _step_count += 1;
-            double throttle_ms = 0;
+        double Interval() const {
+            return Clock::ToSeconds(_interval);
+        }
+
+        // The deadline the last step waited for in Clock nanoseconds, for measuring how late it was.
+        int64_t LastDeadline() const {
+            return Deadline();
+        }
+
+        // Waits for the next deadline and returns the seconds it waited. The first step after
+        // construction or Reset starts the schedule and returns right away.
+        double Step() {
+            int64_t now = Clock::Nanoseconds();
             if (!_started) {
                 _started = true;
-                _start_time = _timer.Seconds();
+                _anchor = now;
+                _step = 0;
+                _steps++;
+                return 0;
+            }
+            _step++;
+            int64_t late = now - Deadline();
+            if (late >= _interval) {
+                int64_t missed = late / _interval;
+                if (_catchUp == CatchUpPolicy::SkipMissed) {
+                    _step += missed;
+                    _missed += missed;
+                }
+                else if (_catchUp == CatchUpPolicy::Reanchor) {
+                    _anchor = now - _step * _interval;
+                    _missed += missed;
+                }
+            }
+            int64_t wait = Deadline() - now;
+            if (wait > 0) {
+                // rounded up, Sleep takes whole microseconds and must not return before the deadline.
+                _timer.Sleep((wait + 999) / 1000);
+            }
+            _lateness.Add(Clock::ToSeconds(Clock::Nanoseconds() - Deadline()));
+            _steps++;
+            return Clock::ToSeconds(std::max<int64_t>(wait, 0));
+        }
+
+        // Moves the schedule towards deadlines lead nanoseconds after the given arrival time, in
+        // Clock nanoseconds, a quarter of the way each call and never more than an eighth of an
+        // interval, so a late frame here and there doesn't throw it off. Call it with the arrival time
+        // of the newest frame after each step.
+        void AlignTo(int64_t arrival, int64_t lead = 1000000) {
+            if (!_started || arrival <= 0) {
+                return;
             }
-            else {
-                double elapsed = (_timer.Seconds() - _start_time);
-                double expected = ((double)_step_count / _fps);
-                throttle_ms = (expected - elapsed);
+            int64_t error = (Deadline() - arrival - lead) % _interval;
+            if (error > _interval / 2) {
+                error -= _interval;
             }
-            // sync to match the given frame rate.
-            if (throttle_ms > 0) {
-                _timer.Sleep(static_cast<int64_t>(throttle_ms * 1000000.0)); // Sleep expects microseconds
+            else if (error < -_interval / 2) {
+                error += _interval;
             }
+            int64_t limit = _interval / 8;
+            _anchor -= std::clamp<int64_t>(error / 4, -limit, limit);
+        }
+
+        ThrottleStats Stats() const {
+            ThrottleStats stats;
+            stats.steps = _steps;
+            stats.missed = _missed;
+            const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+            double results[4];
+            _lateness.Percentiles(percentiles, results, 4);
+            stats.p50 = results[0];
+            stats.p90 = results[1];
+            stats.p99 = results[2];
+            stats.p999 = results[3];
+            stats.max = _lateness.Max();
+            return stats;
+        }
+
+        // How late the steps returned, see DurationHistogram::Read.
+        const DurationHistogram& Histogram() const {
+            return _lateness;
         }
     };
-}
\ No newline at end of file
+}
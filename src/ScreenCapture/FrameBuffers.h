@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include "ResourcePool.h"
+
+namespace util
+{
+    struct FrameBuffer
+    {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // Frame buffers from the heap, aligned so each frame (and each row, with a stride that is a
+    // multiple of the alignment) starts on a cache line and SIMD conversions can use aligned loads.
+    class AlignedBufferAllocator : public ResourceAllocator<size_t, FrameBuffer>
+    {
+        size_t _alignment;
+
+    public:
+        explicit AlignedBufferAllocator(size_t alignment) : _alignment(alignment) {
+        }
+
+        FrameBuffer* Create(const size_t& size) override {
+            void* data = ::operator new(size, std::align_val_t(_alignment), std::nothrow);
+            if (data == nullptr) {
+                return nullptr;
+            }
+            return new FrameBuffer{ static_cast<uint8_t*>(data), size };
+        }
+
+        void Destroy(FrameBuffer* buffer) override {
+            ::operator delete(buffer->data, std::align_val_t(_alignment));
+            delete buffer;
+        }
+    };
+
+    // Lends pooled frame buffers by address to callers that can only hold on to a pointer, like
+    // python, which wraps each one in a numpy array instead of allocating and copying every frame.
+    // A buffer goes back to the pool when it is returned, and is reused for the next frame of the
+    // same size. At most maxBuffers are lent at once. After Close nothing more is lent, but the
+    // buffers still out stay valid until they are returned. Thread safe.
+    class FrameBufferLender
+    {
+        ResourcePool<size_t, FrameBuffer> _pool;
+        std::mutex _mutex;
+        std::unordered_map<const void*, std::shared_ptr<FrameBuffer>> _lent;
+        bool _closed = false;
+
+    public:
+        FrameBufferLender(size_t alignment, size_t maxBuffers)
+            : _pool(std::make_shared<AlignedBufferAllocator>(alignment), maxBuffers, maxBuffers) {
+        }
+
+        // Returns a buffer of size bytes, or null if maxBuffers are lent already or the
+        // lender is closed.
+        uint8_t* Lend(size_t size) {
+            {
+                std::scoped_lock lock(_mutex);
+                if (_closed) {
+                    return nullptr;
+                }
+            }
+            std::shared_ptr<FrameBuffer> buffer = _pool.Acquire(size);
+            if (buffer == nullptr) {
+                return nullptr;
+            }
+            std::scoped_lock lock(_mutex);
+            _lent[buffer->data] = buffer;
+            return buffer->data;
+        }
+
+        // False if the address is not a buffer lent by this lender.
+        bool Return(const void* data) {
+            std::shared_ptr<FrameBuffer> buffer;
+            {
+                std::scoped_lock lock(_mutex);
+                auto found = _lent.find(data);
+                if (found == _lent.end()) {
+                    return false;
+                }
+                buffer = std::move(found->second);
+                _lent.erase(found);
+            }
+            // back in the pool as this goes out of scope, outside of our lock.
+            return true;
+        }
+
+        // Stops lending, returns true if no buffers are out so the lender can be freed right away.
+        bool Close() {
+            std::scoped_lock lock(_mutex);
+            _closed = true;
+            return _lent.empty();
+        }
+
+        // Whether the lender is closed and every buffer is back, so it can be freed.
+        bool Done() {
+            std::scoped_lock lock(_mutex);
+            return _closed && _lent.empty();
+        }
+
+        size_t Lent() {
+            std::scoped_lock lock(_mutex);
+            return _lent.size();
+        }
+
+        PoolStats GetStats() {
+            return _pool.GetStats();
+        }
+    };
+}
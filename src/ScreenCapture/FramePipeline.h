@@ -0,0 +1,285 @@
+#pragma once
+#include "Clock.h"
+#include "SpscQueue.h"
+#include "TimingLog.h"
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+    // What the source does when every frame is still busy in a later stage.
+    enum class DropPolicy
+    {
+        Block = 0,     // wait for a free frame, so the source falls behind.
+        DropNewest = 1 // drop the frame just captured so the source keeps its pace.
+    };
+
+    struct StageStats
+    {
+        std::string name;
+        uint64_t frames = 0;
+        double busySeconds = 0; // total time spent inside the stage function.
+        // percentiles of the time one frame spent inside it, in seconds.
+        double p50 = 0;
+        double p95 = 0;
+        double p99 = 0;
+    };
+
+    // Spins briefly, then yields, then sleeps so an idle stage doesn't burn a core.
+    class Backoff
+    {
+        int _count = 0;
+    public:
+        void Wait() {
+            if (++_count < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        void Reset() {
+            _count = 0;
+        }
+    };
+
+    // Runs a source and a chain of stages each on their own thread, passing a fixed pool of frames
+    // through bounded SPSC queues. The last stage hands frames back to the source, so there are never
+    // more than depth frames in flight and nothing is allocated per frame.
+    template <typename Frame>
+    class FramePipeline
+    {
+    public:
+        // Fills the given frame and returns false at the end of the stream. The frame is null when
+        // every frame is busy and the policy is DropNewest, the source should then consume its input
+        // and discard it so it keeps its pace.
+        using SourceFunction = std::function<bool(Frame* frame)>;
+        // Stages report errors by throwing, which stops the pipeline.
+        using StageFunction = std::function<void(Frame& frame)>;
+
+    private:
+        struct Stage
+        {
+            std::string name;
+            StageFunction run;
+            std::unique_ptr<SpscQueue<Frame*>> input;
+            std::atomic<bool> finished{ false };
+            std::atomic<uint64_t> frames{ 0 };
+            std::atomic<uint64_t> busyNanoseconds{ 0 };
+            DurationHistogram latency; // the time each frame spent in run.
+        };
+
+        std::vector<std::unique_ptr<Frame>> _frames;
+        SpscQueue<Frame*> _free;
+        std::string _sourceName;
+        SourceFunction _source;
+        std::vector<std::unique_ptr<Stage>> _stages;
+        DropPolicy _policy;
+        std::atomic<bool> _stopping{ false };
+        std::atomic<bool> _failed{ false };
+        std::atomic<bool> _sourceFinished{ false };
+        std::atomic<uint64_t> _sourceFrames{ 0 };
+        std::atomic<uint64_t> _sourceNanoseconds{ 0 };
+        DurationHistogram _sourceLatency;
+        std::atomic<uint64_t> _dropped{ 0 };
+        std::mutex _errorMutex;
+        std::string _error;
+
+    public:
+        FramePipeline(size_t depth, DropPolicy policy) : _free(depth < 1 ? 1 : depth), _policy(policy) {
+            depth = _free.Capacity();
+            for (size_t i = 0; i < depth; i++) {
+                _frames.push_back(std::make_unique<Frame>());
+                _free.TryPush(_frames.back().get());
+            }
+        }
+
+        size_t Depth() const {
+            return _frames.size();
+        }
+
+        // So the caller can allocate the buffers each frame needs up front.
+        Frame& GetFrame(size_t index) {
+            return *_frames[index];
+        }
+
+        void SetSource(const std::string& name, SourceFunction source) {
+            _sourceName = name;
+            _source = source;
+        }
+
+        void AddStage(const std::string& name, StageFunction run) {
+            auto stage = std::make_unique<Stage>();
+            stage->name = name;
+            stage->run = run;
+            stage->input = std::make_unique<SpscQueue<Frame*>>(_frames.size());
+            _stages.push_back(std::move(stage));
+        }
+
+        // Runs the source on the calling thread until it ends or Stop is called, then waits for the
+        // stages to drain. Throws if the source or any stage failed.
+        void Run() {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < _stages.size(); i++) {
+                threads.emplace_back([this, i]() { RunStage(i); });
+            }
+            RunSource();
+            for (auto& t : threads) {
+                t.join();
+            }
+            if (_failed) {
+                throw std::runtime_error(_error);
+            }
+        }
+
+        // Ends the stream, frames already captured still go through the remaining stages.
+        void Stop() {
+            _stopping = true;
+        }
+
+        uint64_t Dropped() const {
+            return _dropped;
+        }
+
+        // How many frames are somewhere in the stages, Depth means the source has to wait or drop.
+        size_t InFlight() const {
+            return _frames.size() - _free.Size();
+        }
+
+        // The running busy seconds of each stage, without the source. Cheap enough to call every frame.
+        void GetBusySeconds(std::vector<double>& seconds) const {
+            seconds.resize(_stages.size());
+            for (size_t i = 0; i < _stages.size(); i++) {
+                seconds[i] = _stages[i]->busyNanoseconds.load(std::memory_order_relaxed) / 1e9;
+            }
+        }
+
+        // The source first followed by each stage.
+        std::vector<StageStats> GetStats() const {
+            std::vector<StageStats> result;
+            result.push_back(MakeStats(_sourceName, _sourceFrames, _sourceNanoseconds, _sourceLatency));
+            for (auto& stage : _stages) {
+                result.push_back(MakeStats(stage->name, stage->frames, stage->busyNanoseconds, stage->latency));
+            }
+            return result;
+        }
+
+    private:
+        static StageStats MakeStats(const std::string& name, uint64_t frames, uint64_t nanoseconds, const DurationHistogram& latency) {
+            StageStats stats{ name, frames, nanoseconds / 1e9 };
+            const double percentiles[] = { 0.5, 0.95, 0.99 };
+            double results[3];
+            latency.Percentiles(percentiles, results, 3);
+            stats.p50 = results[0];
+            stats.p95 = results[1];
+            stats.p99 = results[2];
+            return stats;
+        }
+
+        static uint64_t Now() {
+            return static_cast<uint64_t>(Clock::Nanoseconds());
+        }
+
+        void Fail(const std::string& message) {
+            std::scoped_lock lock(_errorMutex);
+            if (!_failed) {
+                _error = message;
+                _failed = true;
+            }
+            _stopping = true;
+        }
+
+        void Forward(size_t index, Frame* frame) {
+            if (index < _stages.size()) {
+                _stages[index]->input->TryPush(frame);
+            }
+            else {
+                _free.TryPush(frame);
+            }
+        }
+
+        void RunSource() {
+            Tracer::Instance().SetThreadName(_sourceName);
+            Backoff backoff;
+            while (!_stopping) {
+                Frame* frame = nullptr;
+                if (!_free.TryPop(frame) && _policy == DropPolicy::Block) {
+                    while (!_stopping && !_free.TryPop(frame)) {
+                        backoff.Wait();
+                    }
+                    backoff.Reset();
+                    if (frame == nullptr) {
+                        break;
+                    }
+                }
+                bool more = false;
+                uint64_t start = Now();
+                try {
+                    more = _source(frame);
+                }
+                catch (const std::exception& e) {
+                    Fail(e.what());
+                }
+                if (!more) {
+                    break; // an unused frame is simply left out of the pool.
+                }
+                uint64_t elapsed = Now() - start;
+                _sourceNanoseconds += elapsed;
+                _sourceLatency.Add(elapsed / 1e9);
+                if (frame == nullptr) {
+                    _dropped++;
+                }
+                else {
+                    _sourceFrames++;
+                    Forward(0, frame);
+                }
+            }
+            _sourceFinished.store(true, std::memory_order_release);
+        }
+
+        void RunStage(size_t index) {
+            Stage& stage = *_stages[index];
+            Tracer::Instance().SetThreadName(stage.name);
+            std::atomic<bool>& upstreamFinished = (index == 0) ? _sourceFinished : _stages[index - 1]->finished;
+            Backoff backoff;
+            while (true) {
+                bool done = upstreamFinished.load(std::memory_order_acquire);
+                Frame* frame = nullptr;
+                if (stage.input->TryPop(frame)) {
+                    backoff.Reset();
+                    // after a failure frames are passed along unprocessed so everything drains.
+                    if (!_failed) {
+                        uint64_t start = Now();
+                        try {
+                            stage.run(*frame);
+                        }
+                        catch (const std::exception& e) {
+                            Fail(e.what());
+                        }
+                        uint64_t elapsed = Now() - start;
+                        stage.busyNanoseconds += elapsed;
+                        stage.latency.Add(elapsed / 1e9);
+                        stage.frames++;
+                    }
+                    Forward(index + 1, frame);
+                }
+                else if (done) {
+                    break;
+                }
+                else {
+                    backoff.Wait();
+                }
+            }
+            stage.finished.store(true, std::memory_order_release);
+        }
+    };
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+    // Describes the BGRA frames a FrameSource produces, pitch is the row size in bytes which can be
+    // bigger than width * 4.
+    struct FrameFormat
+    {
+        int width = 0;
+        int height = 0;
+        int pitch = 0;
+    };
+
+    // Where the encoder gets its frames from. Getting a frame happens in two steps so the encoder
+    // can run them on different threads: AcquireFrame waits for the next frame (on the GPU for a
+    // screen capture) and ReadFrame copies it into CPU memory.
+    class FrameSource
+    {
+    public:
+        virtual ~FrameSource() {}
+
+        virtual FrameFormat GetFormat() = 0;
+
+        // Waits for the next frame and returns its timestamp in seconds, or a negative number if no
+        // frame arrived. The frame handle is then passed to ReadFrame.
+        virtual double AcquireFrame(std::shared_ptr<void>& frame) = 0;
+
+        // Like AcquireFrame but gives up after timeout seconds, returns false if no frame arrived
+        // by then. Sources that never keep the caller waiting for long don't need to override it.
+        virtual bool TryAcquireFrame(std::shared_ptr<void>& frame, double /*timeout*/, double& time) {
+            time = AcquireFrame(frame);
+            return true;
+        }
+
+        // Copies the acquired frame into a buffer of at least pitch * height bytes.
+        virtual void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) = 0;
+    };
+
+    // Keeps the frame rate of a source that stops delivering frames while nothing changes, the way
+    // Windows Graphics Capture does on a still screen. When no new frame arrives within one frame
+    // interval the last one is handed out again, so the encoder gets a steady frame rate and is
+    // never more than an interval late to notice a stop. The wrapped source does the pacing.
+    class HoldLastFrameSource : public FrameSource
+    {
+        FrameSource& _source;
+        double _interval;
+        std::shared_ptr<void> _last;
+        double _lastTime = 0;
+        std::atomic<uint64_t> _repeated{ 0 };
+
+    public:
+        HoldLastFrameSource(FrameSource& source, int frameRate)
+            : _source(source), _interval(1.0 / (frameRate > 0 ? frameRate : 30)) {
+        }
+
+        FrameFormat GetFormat() override {
+            return _source.GetFormat();
+        }
+
+        double AcquireFrame(std::shared_ptr<void>& frame) override {
+            double time = 0;
+            if (_last == nullptr) {
+                time = _source.AcquireFrame(frame); // there is nothing to repeat yet.
+            }
+            else if (!_source.TryAcquireFrame(frame, _interval, time)) {
+                frame = _last;
+                _repeated++;
+                return _lastTime;
+            }
+            if (time >= 0) {
+                _last = frame;
+                _lastTime = time;
+            }
+            return time;
+        }
+
+        void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) override {
+            _source.ReadFrame(frame, buffer, size);
+        }
+
+        // How many frames were repeats of the one before.
+        uint64_t Repeated() const {
+            return _repeated;
+        }
+    };
+
+    // Generates a scrolling test pattern without needing a GPU, for running the encoder in tests
+    // and benchmarks. It runs as fast as it can unless given a frame rate, and ends after frameCount
+    // frames unless that is zero.
+    class SyntheticFrameSource : public FrameSource
+    {
+    private:
+        FrameFormat _format;
+        int _frameRate;
+        uint64_t _frameCount;
+        uint64_t _index = 0;
+        std::vector<uint8_t> _pattern; // twice the frame height so scrolling is a single copy.
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        SyntheticFrameSource(int width, int height, int frameRate = 0, uint64_t frameCount = 0)
+            : _frameRate(frameRate), _frameCount(frameCount) {
+            _format.width = width;
+            _format.height = height;
+            _format.pitch = ((width * 4 + 63) / 64) * 64; // same alignment ReadPixels gives us.
+            _pattern.resize(static_cast<size_t>(_format.pitch) * height * 2);
+            uint32_t seed = 12345;
+            for (int y = 0; y < height * 2; y++) {
+                uint8_t* row = _pattern.data() + static_cast<size_t>(y) * _format.pitch;
+                for (int x = 0; x < width; x++) {
+                    seed = seed * 1103515245 + 12345;
+                    uint8_t noise = static_cast<uint8_t>(seed >> 24) & 0x1f;
+                    row[x * 4] = static_cast<uint8_t>((x + noise) & 0xff);
+                    row[x * 4 + 1] = static_cast<uint8_t>((y + noise) & 0xff);
+                    row[x * 4 + 2] = static_cast<uint8_t>(((x / 16) ^ (y / 16)) * 32);
+                    row[x * 4 + 3] = 0xff;
+                }
+            }
+        }
+
+        FrameFormat GetFormat() override {
+            return _format;
+        }
+
+        double AcquireFrame(std::shared_ptr<void>& frame) override {
+            if (_frameCount > 0 && _index >= _frameCount) {
+                return -1;
+            }
+            if (_index == 0) {
+                _start = std::chrono::steady_clock::now();
+            }
+            else if (_frameRate > 0) {
+                std::this_thread::sleep_until(_start + std::chrono::microseconds(_index * 1000000 / _frameRate));
+            }
+            frame = std::make_shared<uint64_t>(_index++);
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+        }
+
+        void ReadFrame(const std::shared_ptr<void>& frame, uint8_t* buffer, unsigned int size) override {
+            uint64_t index = *static_cast<uint64_t*>(frame.get());
+            size_t frameSize = static_cast<size_t>(_format.pitch) * _format.height;
+            size_t offset = static_cast<size_t>(index % _format.height) * _format.pitch;
+            ::memcpy(buffer, _pattern.data() + offset, frameSize < size ? frameSize : size);
+        }
+    };
+}
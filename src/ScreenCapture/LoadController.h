@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace util
+{
+    // One change of the frame rate a LoadController keeps.
+    struct LoadAdjustment
+    {
+        double time = 0;      // seconds since the first frame.
+        double frameRate = 0; // the frames per second kept from then on.
+        double load = 0;      // how busy the busiest stage was, 1 is all of the time.
+    };
+
+    struct LoadControllerSettings
+    {
+        double high = 0.9;      // step down when the busiest stage is busier than this.
+        double low = 0.7;       // step up when it would stay below this at the higher frame rate.
+        double window = 1;      // seconds the load is measured over.
+        int recoverWindows = 3; // windows in a row with room to spare before stepping up.
+    };
+
+    // Lowers the frame rate an encoder keeps in steps while it cannot keep up and raises it again once
+    // there is room, instead of letting the capture fall behind or drop frames at random. Every window
+    // it looks at how much of the time the busiest stage was busy, whether the pipeline dropped frames
+    // and how often every frame in it was in use, which is what falling behind looks like with either
+    // drop policy. Stepping up waits for a few calm windows, and twice as many each time a step up had
+    // to be taken back right away, so a load that only fits at the lower rate doesn't flip flop. The
+    // window right after a change is not judged, the queue is still draining what came in before it.
+    // Keep and Update are called from the capture thread, Adjustments from any thread.
+    class LoadController
+    {
+        static constexpr double Steps[] = { 1, 0.75, 0.5, 1.0 / 3, 0.25 };
+        static const int StepCount = sizeof(Steps) / sizeof(Steps[0]);
+
+        double _frameRate;
+        int _maxLevel = 0;
+        LoadControllerSettings _settings;
+        int _level = 0;
+        double _nextFrame = 0;
+        double _windowStart = -1;
+        std::vector<double> _busyAtStart;
+        uint64_t _droppedAtStart = 0;
+        uint64_t _samples = 0;
+        uint64_t _fullSamples = 0;
+        int _calm = 0;
+        bool _settling = false;
+        int _recoverWindows;
+        double _steppedUp = -1;
+        uint64_t _kept = 0;
+        std::atomic<uint64_t> _thinned{ 0 };
+        mutable std::mutex _mutex;
+        std::vector<LoadAdjustment> _adjustments;
+
+        void SetLevel(int level, double time, double load) {
+            _level = level;
+            _calm = 0;
+            _settling = true;
+            std::scoped_lock lock(_mutex);
+            _adjustments.push_back({ time, FrameRate(), load });
+        }
+
+        void EndWindow(double time, const std::vector<double>& busySeconds, uint64_t dropped) {
+            if (_settling) {
+                // the window after a change still has the frames queued at the old rate in it.
+                _settling = false;
+                return;
+            }
+            double elapsed = time - _windowStart;
+            double load = 0;
+            for (size_t i = 0; i < busySeconds.size() && i < _busyAtStart.size(); i++) {
+                load = std::max(load, (busySeconds[i] - _busyAtStart[i]) / elapsed);
+            }
+            bool overloaded = load > _settings.high || dropped > _droppedAtStart || _fullSamples * 2 > _samples;
+            if (overloaded) {
+                if (_steppedUp >= 0 && time - _steppedUp < _settings.window * (_recoverWindows + 1)) {
+                    _recoverWindows = std::min(_recoverWindows * 2, 64); // the last step up did not fit.
+                }
+                _steppedUp = -1;
+                if (_level < _maxLevel) {
+                    SetLevel(_level + 1, time, load);
+                }
+            }
+            else if (_level > 0 && load * Steps[_level - 1] / Steps[_level] < _settings.low) {
+                if (++_calm >= _recoverWindows) {
+                    SetLevel(_level - 1, time, load);
+                    _steppedUp = time;
+                }
+            }
+            else {
+                _calm = 0;
+            }
+            if (_steppedUp >= 0 && time - _steppedUp >= _settings.window * (_recoverWindows + 1)) {
+                _recoverWindows = _settings.recoverWindows; // it held, back to normal.
+                _steppedUp = -1;
+            }
+        }
+
+    public:
+        // Steps down to no less than minFrameRate, which defaults to a quarter of frameRate.
+        LoadController(double frameRate, double minFrameRate = 0, LoadControllerSettings settings = LoadControllerSettings())
+            : _frameRate(frameRate > 0 ? frameRate : 30), _settings(settings), _recoverWindows(settings.recoverWindows) {
+            while (_maxLevel + 1 < StepCount && _frameRate * Steps[_maxLevel + 1] >= minFrameRate - 1e-9) {
+                _maxLevel++;
+            }
+        }
+
+        // Whether the frame the source delivered at this time fits the current frame rate, the rest are
+        // left out before they cost anything. The source's own jitter of up to half a frame is allowed.
+        bool Keep(double time) {
+            double interval = 1 / FrameRate();
+            double slack = 0.5 / _frameRate;
+            if (_level > 0 && _kept > 0 && time + slack < _nextFrame) {
+                _thinned++;
+                return false;
+            }
+            // after a pause start over from this frame instead of catching up.
+            _nextFrame = (_kept == 0 || time - _nextFrame > interval) ? time + interval : _nextFrame + interval;
+            _kept++;
+            return true;
+        }
+
+        // Called for every kept frame with the running busy seconds of each stage worth watching, the
+        // frames dropped so far and whether every frame of the pipeline was in use.
+        void Update(double time, const std::vector<double>& busySeconds, uint64_t dropped, bool queueFull) {
+            if (_windowStart < 0) {
+                _windowStart = time;
+                _busyAtStart = busySeconds;
+                _droppedAtStart = dropped;
+                return;
+            }
+            _samples++;
+            _fullSamples += queueFull ? 1 : 0;
+            if (time - _windowStart >= _settings.window) {
+                EndWindow(time, busySeconds, dropped);
+                _windowStart = time;
+                _busyAtStart = busySeconds;
+                _droppedAtStart = dropped;
+                _samples = 0;
+                _fullSamples = 0;
+            }
+        }
+
+        double FrameRate() const {
+            return _frameRate * Steps[_level];
+        }
+
+        // 0 keeps every frame, each level above keeps fewer.
+        int Level() const {
+            return _level;
+        }
+
+        // Frames Keep left out.
+        uint64_t Thinned() const {
+            return _thinned;
+        }
+
+        std::vector<LoadAdjustment> Adjustments() const {
+            std::scoped_lock lock(_mutex);
+            return _adjustments;
+        }
+    };
+}
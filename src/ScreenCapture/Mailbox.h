@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace util
+{
+    // Lock-free "latest value" mailbox for one producer and any number of readers, used to hand the
+    // newest captured frame from the capture callback to whoever reads it next. Neither side ever
+    // blocks: the producer writes into a slot nobody is reading and then publishes its index, readers
+    // mark the slot they are copying so the producer skips it. With the default 4 slots the producer
+    // always finds a free slot as long as there are at most 2 readers inside Read at the same time,
+    // otherwise Publish returns false and the value is dropped.
+    template <typename T, size_t Slots = 4>
+    class Mailbox
+    {
+        static_assert(Slots >= 3, "need a slot for the latest value, one to write and one to read");
+
+        struct alignas(64) Slot
+        {
+            T value{};
+            double time = 0;
+            uint64_t sequence = 0;
+            std::atomic<uint32_t> readers{ 0 };
+        };
+
+        Slot _slots[Slots];
+        std::atomic<size_t> _latest{ 0 };
+        std::atomic<uint64_t> _sequence{ 0 }; // of the latest value, 0 means nothing published yet.
+        std::atomic<uint64_t> _dropped{ 0 };
+
+    public:
+        // Producer only. Stores the value with its timestamp and gives it the next sequence number.
+        bool Publish(const T& value, double time) {
+            size_t latest = _latest.load(std::memory_order_relaxed);
+            for (size_t i = 1; i < Slots; i++) {
+                size_t index = (latest + i) % Slots;
+                Slot& slot = _slots[index];
+                // seq_cst pairs with the reader incrementing readers and then re-checking _latest:
+                // either we see its mark, or it sees that this slot is no longer the latest.
+                if (slot.readers.load(std::memory_order_seq_cst) == 0) {
+                    uint64_t sequence = _sequence.load(std::memory_order_relaxed) + 1;
+                    slot.value = value;
+                    slot.time = time;
+                    slot.sequence = sequence;
+                    _latest.store(index, std::memory_order_seq_cst);
+                    _sequence.store(sequence, std::memory_order_release);
+                    return true;
+                }
+            }
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Producer only. Publishes an empty value and releases whatever the other free slots still
+        // hold, so a mailbox of COM or shared pointers doesn't keep old frames alive.
+        void Clear() {
+            Publish(T{}, 0);
+            size_t latest = _latest.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < Slots; i++) {
+                if (i != latest && _slots[i].readers.load(std::memory_order_seq_cst) == 0) {
+                    _slots[i].value = T{};
+                }
+            }
+        }
+
+        // Copies the latest value, returns false if nothing has been published yet.
+        bool Read(T& value, double& time, uint64_t& sequence) {
+            while (true) {
+                size_t index = _latest.load(std::memory_order_seq_cst);
+                Slot& slot = _slots[index];
+                slot.readers.fetch_add(1, std::memory_order_seq_cst);
+                if (_latest.load(std::memory_order_seq_cst) == index) {
+                    bool published = slot.sequence != 0;
+                    if (published) {
+                        value = slot.value;
+                        time = slot.time;
+                        sequence = slot.sequence;
+                    }
+                    slot.readers.fetch_sub(1, std::memory_order_release);
+                    return published;
+                }
+                // the producer moved on before we marked the slot, try the new latest one.
+                slot.readers.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        // Sequence number of the latest value, cheap enough to poll for new frames.
+        uint64_t Sequence() const {
+            return _sequence.load(std::memory_order_acquire);
+        }
+
+        // How many values Publish had to drop because every slot was busy.
+        uint64_t Dropped() const {
+            return _dropped.load(std::memory_order_relaxed);
+        }
+    };
+}
@@ -0,0 +1,496 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace util
+{
+    // Where the encoded file goes, these have the same signature as the avio_alloc_context callbacks.
+    struct OutputCallbacks
+    {
+        void* opaque = nullptr;
+        int (*write)(void* opaque, const uint8_t* buf, int size) = nullptr;
+        int64_t (*seek)(void* opaque, int64_t offset, int whence) = nullptr;
+        // optional, called when what was written so far should reach the file soon.
+        void (*flush)(void* opaque) = nullptr;
+    };
+
+    // What a sink writes to. Every write says where it goes, so buffers that were filled before a
+    // seek can still be written after it. Throws std::runtime_error on failure.
+    class OutputFile
+    {
+    public:
+        virtual ~OutputFile() = default;
+        virtual void WriteAt(int64_t offset, const uint8_t* data, size_t size) = 0;
+        virtual void Close() = 0;
+    };
+
+    // A file on disk, WriteFile with an offset on Windows and pwrite elsewhere.
+    class DiskFile : public OutputFile
+    {
+#ifdef _WIN32
+        HANDLE _handle = INVALID_HANDLE_VALUE;
+
+        static std::string LastError(const char* what) {
+            DWORD error = GetLastError();
+            char* buffer = nullptr;
+            size_t size = FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                NULL, error, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&buffer, 0, NULL);
+            std::string message = std::string(what) + std::string(buffer, size);
+            LocalFree(buffer);
+            return message;
+        }
+#else
+        int _fd = -1;
+
+        static std::string LastError(const char* what) {
+            return std::string(what) + strerror(errno);
+        }
+#endif
+
+    public:
+        // Creates the file, or truncates it if it exists.
+        explicit DiskFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+            _handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (_handle == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error(LastError("OpenFile: "));
+            }
+#else
+            _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (_fd < 0) {
+                throw std::runtime_error(LastError("OpenFile: "));
+            }
+#endif
+        }
+
+        ~DiskFile() {
+            Close();
+        }
+
+        void WriteAt(int64_t offset, const uint8_t* data, size_t size) override {
+            while (size > 0) {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                position.Offset = static_cast<DWORD>(offset);
+                position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+                DWORD written = 0;
+                DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+                if (!WriteFile(_handle, data, chunk, &written, &position)) {
+                    throw std::runtime_error(LastError("WriteFile: "));
+                }
+#else
+                ssize_t written = ::pwrite(_fd, data, size, static_cast<off_t>(offset));
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(LastError("pwrite: "));
+                }
+#endif
+                if (written == 0) {
+                    throw std::runtime_error("WriteAt: the disk is full");
+                }
+                data += written;
+                offset += written;
+                size -= static_cast<size_t>(written);
+            }
+        }
+
+        void Close() override {
+#ifdef _WIN32
+            if (_handle != INVALID_HANDLE_VALUE) {
+                CloseHandle(_handle);
+                _handle = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (_fd >= 0) {
+                ::close(_fd);
+                _fd = -1;
+            }
+#endif
+        }
+    };
+
+    // The byte stream FFmpeg muxes into. Writes move a position that Seek can move back, which is
+    // how the mp4 muxer patches the sizes at the start of the file when it finishes.
+    class OutputSink
+    {
+        static int WriteCallback(void* opaque, const uint8_t* buf, int size) {
+            return static_cast<OutputSink*>(opaque)->Write(buf, size);
+        }
+
+        static int64_t SeekCallback(void* opaque, int64_t offset, int whence) {
+            return static_cast<OutputSink*>(opaque)->Seek(offset, whence);
+        }
+
+        static void FlushCallback(void* opaque) {
+            static_cast<OutputSink*>(opaque)->Flush();
+        }
+
+    protected:
+        int64_t _position = 0;
+        int64_t _size = 0;
+
+    public:
+        // AVSEEK_SIZE and AVSEEK_FORCE, which FFmpeg ors into whence.
+        static const int SeekSize = 0x10000;
+        static const int SeekForce = 0x20000;
+
+        virtual ~OutputSink() = default;
+
+        // Returns size, or a negative error once writing has failed, like the AVIO write callback.
+        virtual int Write(const uint8_t* data, int size) = 0;
+
+        // Writes everything still buffered and closes the file, throws the first write error.
+        virtual void Close() = 0;
+
+        // Starts writing whatever is buffered without waiting for it.
+        virtual void Flush() {
+        }
+
+        // Moves the write position, whence is SEEK_SET, SEEK_CUR, SEEK_END or SeekSize which returns
+        // the size of the file instead. Returns the new position or -1.
+        virtual int64_t Seek(int64_t offset, int whence) {
+            int64_t position;
+            switch (whence & ~SeekForce) {
+            case SEEK_SET:
+                position = offset;
+                break;
+            case SEEK_CUR:
+                position = _position + offset;
+                break;
+            case SEEK_END:
+                position = _size + offset;
+                break;
+            case SeekSize:
+                return _size;
+            default:
+                return -1;
+            }
+            if (position < 0) {
+                return -1;
+            }
+            _position = position;
+            return _position;
+        }
+
+        OutputCallbacks Callbacks() {
+            OutputCallbacks callbacks;
+            callbacks.opaque = this;
+            callbacks.write = WriteCallback;
+            callbacks.seek = SeekCallback;
+            callbacks.flush = FlushCallback;
+            return callbacks;
+        }
+    };
+
+    // Writes straight through on the calling thread, so a slow disk stalls the caller.
+    class SyncFileSink : public OutputSink
+    {
+        std::unique_ptr<OutputFile> _file;
+        std::string _error;
+
+    public:
+        explicit SyncFileSink(std::unique_ptr<OutputFile> file) : _file(std::move(file)) {
+        }
+
+        int Write(const uint8_t* data, int size) override {
+            if (!_error.empty()) {
+                return -EIO;
+            }
+            try {
+                _file->WriteAt(_position, data, size);
+            }
+            catch (const std::exception& e) {
+                _error = e.what();
+                return -EIO;
+            }
+            _position += size;
+            _size = std::max(_size, _position);
+            return size;
+        }
+
+        void Close() override {
+            _file->Close();
+            if (!_error.empty()) {
+                throw std::runtime_error(_error);
+            }
+        }
+    };
+
+    // Write behind sink: writes are copied into large blocks that a writer thread of its own
+    // writes to the file, so the muxer only waits for the disk when every block is waiting to be
+    // written. That bounds the memory to blockSize * blockCount. A seek sends off the block being
+    // filled and starts a new one at the new position; blocks are written in the order they were
+    // filled so a later write to the same bytes still wins. One thread writes and seeks,
+    // PendingBytes and Stalls can be read from any thread.
+    class AsyncFileSink : public OutputSink
+    {
+        struct Block
+        {
+            std::vector<uint8_t> storage;
+            uint8_t* data = nullptr; // storage aligned to a page so it can go straight to the disk.
+            size_t size = 0;
+            int64_t offset = 0;
+        };
+
+        std::unique_ptr<OutputFile> _file;
+        size_t _blockSize;
+        std::vector<std::unique_ptr<Block>> _blocks;
+        std::vector<Block*> _free;
+        std::deque<Block*> _pending;
+        Block* _current = nullptr;
+        std::mutex _mutex;
+        std::condition_variable _pendingChanged; // the writer waits for blocks to write.
+        std::condition_variable _freeChanged;    // Write waits for a free block.
+        std::thread _writer;
+        bool _closing = false;
+        bool _closed = false;
+        std::atomic<bool> _failed{ false };
+        std::string _error;
+        std::atomic<size_t> _pendingBytes{ 0 };
+        std::atomic<uint64_t> _stalls{ 0 };
+
+        void Submit() {
+            if (_current == nullptr) {
+                return;
+            }
+            Block* block = _current;
+            _current = nullptr;
+            std::scoped_lock lock(_mutex);
+            if (block->size == 0) {
+                _free.push_back(block);
+                return;
+            }
+            _pendingBytes += block->size;
+            _pending.push_back(block);
+            _pendingChanged.notify_one();
+        }
+
+        Block* Acquire() {
+            std::unique_lock lock(_mutex);
+            if (_free.empty()) {
+                _stalls++;
+                _freeChanged.wait(lock, [this] { return !_free.empty(); });
+            }
+            Block* block = _free.back();
+            _free.pop_back();
+            return block;
+        }
+
+        void WriteBlocks() {
+            std::unique_lock lock(_mutex);
+            while (true) {
+                _pendingChanged.wait(lock, [this] { return _closing || !_pending.empty(); });
+                if (_pending.empty()) {
+                    return;
+                }
+                Block* block = _pending.front();
+                _pending.pop_front();
+                lock.unlock();
+                if (!_failed) {
+                    try {
+                        _file->WriteAt(block->offset, block->data, block->size);
+                    }
+                    catch (const std::exception& e) {
+                        std::scoped_lock errorLock(_mutex);
+                        _error = e.what();
+                        _failed = true;
+                    }
+                }
+                _pendingBytes -= block->size;
+                block->size = 0;
+                lock.lock();
+                _free.push_back(block);
+                _freeChanged.notify_one();
+            }
+        }
+
+    public:
+        static const size_t DefaultBlockSize = 4 * 1024 * 1024;
+        static const size_t DefaultBlockCount = 8;
+
+        AsyncFileSink(std::unique_ptr<OutputFile> file, size_t blockSize = DefaultBlockSize, size_t blockCount = DefaultBlockCount)
+            : _file(std::move(file)), _blockSize(std::max<size_t>(blockSize, 4096)) {
+            const size_t alignment = 4096;
+            for (size_t i = 0; i < std::max<size_t>(blockCount, 2); i++) {
+                auto block = std::make_unique<Block>();
+                block->storage.resize(_blockSize + alignment);
+                uintptr_t address = reinterpret_cast<uintptr_t>(block->storage.data());
+                block->data = block->storage.data() + (alignment - address % alignment) % alignment;
+                _free.push_back(block.get());
+                _blocks.push_back(std::move(block));
+            }
+            _writer = std::thread([this]() { WriteBlocks(); });
+        }
+
+        ~AsyncFileSink() {
+            try {
+                Close();
+            }
+            catch (const std::exception&) {
+                // whoever wanted to know about the error called Close themselves.
+            }
+        }
+
+        AsyncFileSink(const AsyncFileSink&) = delete;
+        AsyncFileSink& operator=(const AsyncFileSink&) = delete;
+
+        int Write(const uint8_t* data, int size) override {
+            if (_failed) {
+                return -EIO;
+            }
+            int written = 0;
+            while (written < size) {
+                if (_current == nullptr) {
+                    _current = Acquire();
+                    _current->offset = _position;
+                }
+                size_t count = std::min(_blockSize - _current->size, static_cast<size_t>(size - written));
+                ::memcpy(_current->data + _current->size, data + written, count);
+                _current->size += count;
+                written += static_cast<int>(count);
+                _position += count;
+                if (_current->size == _blockSize) {
+                    Submit();
+                }
+            }
+            _size = std::max(_size, _position);
+            return size;
+        }
+
+        int64_t Seek(int64_t offset, int whence) override {
+            int64_t result = OutputSink::Seek(offset, whence);
+            if (_current != nullptr && _position != _current->offset + static_cast<int64_t>(_current->size)) {
+                Submit();
+            }
+            return result;
+        }
+
+        // Sends off the block being filled, so streaming formats reach the disk in fragments
+        // instead of every 4 MB.
+        void Flush() override {
+            Submit();
+        }
+
+        void Close() override {
+            if (_closed) {
+                return;
+            }
+            _closed = true;
+            Submit();
+            {
+                std::scoped_lock lock(_mutex);
+                _closing = true;
+                _pendingChanged.notify_one();
+            }
+            _writer.join();
+            _file->Close();
+            if (_failed) {
+                throw std::runtime_error(_error);
+            }
+        }
+
+        // Bytes handed to the writer thread that are not on disk yet. When this gets close to
+        // MaxPendingBytes the next Write is going to wait for the disk.
+        size_t PendingBytes() const {
+            return _pendingBytes.load();
+        }
+
+        size_t MaxPendingBytes() const {
+            return _blockSize * _blocks.size();
+        }
+
+        // How many times Write had to wait for the disk because every block was full.
+        uint64_t Stalls() const {
+            return _stalls.load();
+        }
+
+        // The first write error, empty if there was none.
+        std::string Error() {
+            std::scoped_lock lock(_mutex);
+            return _error;
+        }
+    };
+
+    // Where the segments of a recording go, Open and Close are called on the mux thread.
+    class SegmentOutput
+    {
+    public:
+        virtual ~SegmentOutput() = default;
+
+        // Called before the first packet of segment index, which starts at 0.
+        virtual OutputCallbacks Open(int index) = 0;
+
+        // Called once everything of segment index has been written to its output.
+        virtual void Close(int index) = 0;
+    };
+
+    // Writes segment 0 to path and segment n to name_n.ext next to it, each through an
+    // AsyncFileSink. A recording that is not segmented is just the one file.
+    class SegmentFiles : public SegmentOutput
+    {
+        std::filesystem::path _path;
+        std::unique_ptr<AsyncFileSink> _file;
+        uint64_t _stalls = 0;
+
+    public:
+        explicit SegmentFiles(const std::filesystem::path& path) : _path(path) {
+        }
+
+        std::filesystem::path SegmentPath(int index) const {
+            if (index == 0) {
+                return _path;
+            }
+            std::filesystem::path name = _path.stem();
+            name += "_" + std::to_string(index);
+            name += _path.extension();
+            return _path.parent_path() / name;
+        }
+
+        OutputCallbacks Open(int index) override {
+            _file = std::make_unique<AsyncFileSink>(std::make_unique<DiskFile>(SegmentPath(index)));
+            return _file->Callbacks();
+        }
+
+        void Close(int /*index*/) override {
+            CloseFile();
+        }
+
+        // Closes the segment still open, if any, which throws the write error if one failed.
+        void CloseFile() {
+            if (_file != nullptr) {
+                auto file = std::move(_file);
+                _stalls += file->Stalls();
+                file->Close();
+            }
+        }
+
+        // How many times the muxer waited for the disk, over every segment.
+        uint64_t Stalls() const {
+            return _stalls + (_file != nullptr ? _file->Stalls() : 0);
+        }
+    };
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include "Simd.h"
+#include <cstring>
+
+namespace util
+{
+    // Output layouts for the BGRA pixels we read back from DXGI_FORMAT_B8G8R8A8_UNORM textures, so
+    // callers get tightly packed pixels without the row pitch padding or the alpha channel.
+    enum class PixelFormat
+    {
+        Bgra = 0,
+        Bgr = 1,
+        Rgb = 2,
+        Gray8 = 3 // same weights as OpenCV's COLOR_BGR2GRAY.
+    };
+
+    inline int BytesPerPixel(PixelFormat format)
+    {
+        switch (format) {
+        case PixelFormat::Bgra:
+            return 4;
+        case PixelFormat::Bgr:
+        case PixelFormat::Rgb:
+            return 3;
+        default:
+            return 1;
+        }
+    }
+
+    inline bool IsValidPixelFormat(int format)
+    {
+        return format >= static_cast<int>(PixelFormat::Bgra) && format <= static_cast<int>(PixelFormat::Gray8);
+    }
+
+    namespace detail
+    {
+        // 14 bit fixed point gray weights, the same ones cv::cvtColor uses for 8 bit images.
+        const int GrayB = 1868, GrayG = 9617, GrayR = 4899;
+        const int GrayShift = 14;
+
+        inline void SwizzleRowScalar(const uint8_t* src, uint8_t* dst, int x, int width, PixelFormat format)
+        {
+            switch (format) {
+            case PixelFormat::Bgra:
+                ::memcpy(dst + x * 4, src + x * 4, static_cast<size_t>(width - x) * 4);
+                break;
+            case PixelFormat::Bgr:
+                for (; x < width; x++) {
+                    dst[x * 3] = src[x * 4];
+                    dst[x * 3 + 1] = src[x * 4 + 1];
+                    dst[x * 3 + 2] = src[x * 4 + 2];
+                }
+                break;
+            case PixelFormat::Rgb:
+                for (; x < width; x++) {
+                    dst[x * 3] = src[x * 4 + 2];
+                    dst[x * 3 + 1] = src[x * 4 + 1];
+                    dst[x * 3 + 2] = src[x * 4];
+                }
+                break;
+            case PixelFormat::Gray8:
+                for (; x < width; x++) {
+                    const uint8_t* p = src + x * 4;
+                    dst[x] = static_cast<uint8_t>((GrayB * p[0] + GrayG * p[1] + GrayR * p[2] + (1 << (GrayShift - 1))) >> GrayShift);
+                }
+                break;
+            }
+        }
+
+#if UTIL_X86
+        // Shuffle that drops the alpha byte of 4 BGRA pixels, leaving 12 bytes followed by 4 zeros.
+        UTIL_TARGET_SSE41 inline __m128i PackMaskSse41(PixelFormat format)
+        {
+            if (format == PixelFormat::Rgb) {
+                return _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+            }
+            return _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        }
+
+        // 8 BGRA pixels to 8 gray bytes in the low half of the result.
+        UTIL_TARGET_SSE41 inline __m128i Gray8Sse41(__m128i a, __m128i b)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i coeff = _mm_setr_epi16(GrayB, GrayG, GrayR, 0, GrayB, GrayG, GrayR, 0);
+            const __m128i round = _mm_set1_epi32(1 << (GrayShift - 1));
+            __m128i ga = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(a), coeff), _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), coeff));
+            __m128i gb = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(b), coeff), _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), coeff));
+            ga = _mm_srli_epi32(_mm_add_epi32(ga, round), GrayShift);
+            gb = _mm_srli_epi32(_mm_add_epi32(gb, round), GrayShift);
+            __m128i g = _mm_packs_epi32(ga, gb);
+            return _mm_packus_epi16(g, g);
+        }
+
+        UTIL_TARGET_SSE41 inline void SwizzleRowSse41(const uint8_t* src, uint8_t* dst, int width, PixelFormat format)
+        {
+            int x = 0;
+            if (format == PixelFormat::Bgr || format == PixelFormat::Rgb) {
+                const __m128i mask = PackMaskSse41(format);
+                // each store writes 4 bytes past the 4 pixels, the next store overwrites them, so
+                // stop while the spill still lands inside the row.
+                for (; x + 6 <= width; x += 4) {
+                    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_shuffle_epi8(p, mask));
+                }
+            }
+            else if (format == PixelFormat::Gray8) {
+                for (; x + 8 <= width; x += 8) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 16));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), Gray8Sse41(a, b));
+                }
+            }
+            SwizzleRowScalar(src, dst, x, width, format);
+        }
+
+        // 16 BGRA pixels to 16 gray bytes, see Luma16Avx2 for the lane order fix ups.
+        UTIL_TARGET_AVX2 inline __m128i Gray16Avx2(__m256i a, __m256i b)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i coeff = _mm256_setr_epi16(GrayB, GrayG, GrayR, 0, GrayB, GrayG, GrayR, 0,
+                GrayB, GrayG, GrayR, 0, GrayB, GrayG, GrayR, 0);
+            const __m256i round = _mm256_set1_epi32(1 << (GrayShift - 1));
+            __m256i ga = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(a, zero), coeff), _mm256_madd_epi16(_mm256_unpackhi_epi8(a, zero), coeff));
+            __m256i gb = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(b, zero), coeff), _mm256_madd_epi16(_mm256_unpackhi_epi8(b, zero), coeff));
+            ga = _mm256_srli_epi32(_mm256_add_epi32(ga, round), GrayShift);
+            gb = _mm256_srli_epi32(_mm256_add_epi32(gb, round), GrayShift);
+            __m256i g = _mm256_permute4x64_epi64(_mm256_packs_epi32(ga, gb), 0xD8);
+            g = _mm256_permute4x64_epi64(_mm256_packus_epi16(g, g), 0x08);
+            return _mm256_castsi256_si128(g);
+        }
+
+        UTIL_TARGET_AVX2 inline void SwizzleRowAvx2(const uint8_t* src, uint8_t* dst, int width, PixelFormat format)
+        {
+            int x = 0;
+            if (format == PixelFormat::Bgr || format == PixelFormat::Rgb) {
+                const __m128i mask128 = PackMaskSse41(format);
+                const __m256i mask = _mm256_broadcastsi128_si256(mask128);
+                // the shuffle packs each 128 bit lane to 12 bytes, the permute closes the gap between them.
+                const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+                // 24 bytes per 8 pixels, each store spills 8 bytes that the next one overwrites.
+                for (; x + 11 <= width; x += 8) {
+                    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+                    p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, mask), compact);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 3), p);
+                }
+            }
+            else if (format == PixelFormat::Gray8) {
+                for (; x + 16 <= width; x += 16) {
+                    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+                    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4 + 32));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), Gray16Avx2(a, b));
+                }
+            }
+            SwizzleRowScalar(src, dst, x, width, format);
+        }
+#endif
+    }
+
+    // Converts one row of width BGRA pixels into the given format.
+    inline void ConvertBgraRow(const uint8_t* src, uint8_t* dst, int width, PixelFormat format, CpuLevel level)
+    {
+        switch (level) {
+#if UTIL_X86
+        case CpuLevel::Avx2:
+            detail::SwizzleRowAvx2(src, dst, width, format);
+            break;
+        case CpuLevel::Sse41:
+            detail::SwizzleRowSse41(src, dst, width, format);
+            break;
+#endif
+        default:
+            detail::SwizzleRowScalar(src, dst, 0, width, format);
+            break;
+        }
+    }
+
+    // Converts width x height BGRA pixels with the given source row pitch (in bytes) into dst with
+    // dstStride bytes per row in one pass. Never writes past width * BytesPerPixel(format) in a row,
+    // so dstStride can be exactly that for a tightly packed image.
+    inline void ConvertBgra(const uint8_t* src, int srcPitch, int width, int height,
+        uint8_t* dst, int dstStride, PixelFormat format, CpuLevel level)
+    {
+        for (int y = 0; y < height; y++) {
+            ConvertBgraRow(src + static_cast<int64_t>(y) * srcPitch, dst + static_cast<int64_t>(y) * dstStride, width, format, level);
+        }
+    }
+
+    inline void ConvertBgra(const uint8_t* src, int srcPitch, int width, int height,
+        uint8_t* dst, int dstStride, PixelFormat format)
+    {
+        ConvertBgra(src, srcPitch, width, height, dst, dstStride, format, GetCpuLevel());
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util
+{
+    // Does the actual copies for a ReadbackRing, for D3D a slot is a staging texture.
+    class ReadbackBackend
+    {
+    public:
+        virtual ~ReadbackBackend() {}
+
+        // Starts copying the frame into the slot, this should not wait for the copy to finish.
+        virtual void BeginCopy(size_t slot, void* frame) = 0;
+
+        // Waits for the copy into the slot to finish and copies it into the buffer.
+        virtual void ReadSlot(size_t slot, uint8_t* buffer, unsigned int size) = 0;
+    };
+
+    struct ReadbackSlot
+    {
+        uint64_t sequence = 0; // of the frame in this slot, 0 if it never held one.
+        double time = 0;
+        bool pending = false;  // copy started but not read yet.
+    };
+
+    // A ring of readback slots so the GPU to CPU copy of frame k can run while the caller reads
+    // frame k - latency, instead of every read waiting for its own copy. Latency 0 reads each frame
+    // right after submitting it, like a plain synchronous readback. Not thread safe.
+    class ReadbackRing
+    {
+        ReadbackBackend& _backend;
+        std::vector<ReadbackSlot> _slots;
+        size_t _latency;
+        size_t _next = 0;    // slot the next Submit goes into.
+        size_t _pending = 0; // slots between the oldest pending one and _next.
+        uint64_t _lastSequence = 0;
+
+    public:
+        ReadbackRing(ReadbackBackend& backend, size_t latency)
+            : _backend(backend), _slots(latency + 1), _latency(latency) {
+        }
+
+        size_t Slots() const {
+            return _slots.size();
+        }
+
+        size_t Latency() const {
+            return _latency;
+        }
+
+        size_t Pending() const {
+            return _pending;
+        }
+
+        // Sequence number of the last submitted frame.
+        uint64_t LastSequence() const {
+            return _lastSequence;
+        }
+
+        const ReadbackSlot& GetSlot(size_t index) const {
+            return _slots[index];
+        }
+
+        // True once enough frames are in flight that Read returns the one latency frames back.
+        bool Ready() const {
+            return _pending > _latency;
+        }
+
+        // Drops anything in flight, the slots themselves are kept.
+        void Reset() {
+            for (auto& slot : _slots) {
+                slot.pending = false;
+            }
+            _pending = 0;
+        }
+
+        // Changes the number of frames to keep in flight, this drops anything in flight.
+        void SetLatency(size_t latency) {
+            Reset();
+            _latency = latency;
+            _slots.resize(latency + 1);
+            _next = 0;
+        }
+
+        // Starts copying a frame, returns false if every slot is still waiting to be read.
+        bool Submit(void* frame, uint64_t sequence, double time) {
+            if (_pending == _slots.size()) {
+                return false;
+            }
+            ReadbackSlot& slot = _slots[_next];
+            slot.sequence = sequence;
+            slot.time = time;
+            slot.pending = true;
+            _backend.BeginCopy(_next, frame);
+            _next = (_next + 1) % _slots.size();
+            _pending++;
+            _lastSequence = sequence;
+            return true;
+        }
+
+        // Reads the oldest pending frame into the buffer, returns false if nothing is pending.
+        bool Read(uint8_t* buffer, unsigned int size, uint64_t& sequence, double& time) {
+            if (_pending == 0) {
+                return false;
+            }
+            size_t index = (_next + _slots.size() - _pending) % _slots.size();
+            ReadbackSlot& slot = _slots[index];
+            _backend.ReadSlot(index, buffer, size);
+            slot.pending = false;
+            _pending--;
+            sequence = slot.sequence;
+            time = slot.time;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,260 @@
+#pragma once
+#include "Resize.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace util
+{
+    struct RegionRect
+    {
+        int left = 0;
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+
+        int Width() const {
+            return right - left;
+        }
+
+        int Height() const {
+            return bottom - top;
+        }
+
+        int64_t Area() const {
+            return static_cast<int64_t>(Width()) * Height();
+        }
+
+        bool Empty() const {
+            return right <= left || bottom <= top;
+        }
+
+        bool Contains(const RegionRect& other) const {
+            return other.left >= left && other.top >= top && other.right <= right && other.bottom <= bottom;
+        }
+
+        RegionRect Union(const RegionRect& other) const {
+            return { std::min(left, other.left), std::min(top, other.top), std::max(right, other.right), std::max(bottom, other.bottom) };
+        }
+
+        RegionRect Intersect(const RegionRect& other) const {
+            return { std::max(left, other.left), std::max(top, other.top), std::min(right, other.right), std::min(bottom, other.bottom) };
+        }
+    };
+
+    // One region of interest in a capture: a rectangle in capture coordinates and what the reader
+    // wants it converted to.
+    struct RegionSpec
+    {
+        RegionRect bounds;
+        int outputWidth = 0; // 0 means the size of bounds.
+        int outputHeight = 0;
+        PixelFormat format = PixelFormat::Bgra;
+        ResizeFilter filter = ResizeFilter::Box;
+
+        int OutputWidth() const {
+            return (outputWidth > 0 && outputHeight > 0) ? outputWidth : bounds.Width();
+        }
+
+        int OutputHeight() const {
+            return (outputWidth > 0 && outputHeight > 0) ? outputHeight : bounds.Height();
+        }
+    };
+
+    // A rectangle of the captured frame that is copied to (x, y) in the atlas texture.
+    struct RegionCopy
+    {
+        RegionRect source;
+        int x = 0;
+        int y = 0;
+    };
+
+    // Where a region ended up in the atlas.
+    struct RegionPlacement
+    {
+        int id = 0;
+        RegionSpec spec;
+        int x = 0;
+        int y = 0;
+    };
+
+    // Decides how a set of regions is copied out of each captured frame: regions that are close
+    // enough (or overlap) share one copy of their bounding box, the rest get their own, and all
+    // the copies are packed into one atlas so the whole set needs a single texture and a single
+    // readback. Immutable once built so the capture callback and readers can share it.
+    class RegionPlan
+    {
+    public:
+        std::vector<RegionCopy> copies;
+        std::vector<RegionPlacement> regions;
+        int width = 0;  // of the atlas.
+        int height = 0;
+
+        // Each extra copy costs about this many pixels worth of copying, so two regions are copied
+        // as their bounding box when that wastes fewer pixels than this.
+        static const int64_t DefaultCopyOverhead = 64 * 64;
+
+        static std::shared_ptr<const RegionPlan> Build(const std::map<int, RegionSpec>& specs, int64_t copyOverhead = DefaultCopyOverhead) {
+            auto plan = std::make_shared<RegionPlan>();
+            std::vector<RegionRect> clusters;
+            for (auto& pair : specs) {
+                clusters.push_back(pair.second.bounds);
+            }
+
+            // merge the pair with the least waste until no merge is worth it.
+            while (clusters.size() > 1) {
+                int64_t best = copyOverhead;
+                size_t bestA = 0, bestB = 0;
+                bool found = false;
+                for (size_t a = 0; a < clusters.size(); a++) {
+                    for (size_t b = a + 1; b < clusters.size(); b++) {
+                        int64_t waste = clusters[a].Union(clusters[b]).Area() - clusters[a].Area() - clusters[b].Area();
+                        if (waste <= best) {
+                            best = waste;
+                            bestA = a;
+                            bestB = b;
+                            found = true;
+                        }
+                    }
+                }
+                if (!found) {
+                    break;
+                }
+                clusters[bestA] = clusters[bestA].Union(clusters[bestB]);
+                clusters.erase(clusters.begin() + bestB);
+            }
+
+            // shelf pack the copies, tallest first, into rows about as wide as the atlas is tall.
+            std::sort(clusters.begin(), clusters.end(), [](const RegionRect& a, const RegionRect& b) {
+                return a.Height() > b.Height();
+            });
+            int64_t area = 0;
+            int widest = 0;
+            for (auto& cluster : clusters) {
+                area += cluster.Area();
+                widest = std::max(widest, cluster.Width());
+            }
+            int rowLimit = std::max(widest, static_cast<int>(std::sqrt(static_cast<double>(area))));
+            int x = 0, y = 0, rowHeight = 0;
+            for (auto& cluster : clusters) {
+                if (x > 0 && x + cluster.Width() > rowLimit) {
+                    y += rowHeight;
+                    x = 0;
+                    rowHeight = 0;
+                }
+                plan->copies.push_back({ cluster, x, y });
+                x += cluster.Width();
+                rowHeight = std::max(rowHeight, cluster.Height());
+                plan->width = std::max(plan->width, x);
+            }
+            plan->height = y + rowHeight;
+
+            for (auto& pair : specs) {
+                for (auto& copy : plan->copies) {
+                    if (copy.source.Contains(pair.second.bounds)) {
+                        RegionPlacement placement;
+                        placement.id = pair.first;
+                        placement.spec = pair.second;
+                        placement.x = copy.x + pair.second.bounds.left - copy.source.left;
+                        placement.y = copy.y + pair.second.bounds.top - copy.source.top;
+                        plan->regions.push_back(placement);
+                        break;
+                    }
+                }
+            }
+            return plan;
+        }
+
+        const RegionPlacement* Find(int id) const {
+            for (auto& region : regions) {
+                if (region.id == id) {
+                    return &region;
+                }
+            }
+            return nullptr;
+        }
+
+        int64_t CopiedPixels() const {
+            int64_t total = 0;
+            for (auto& copy : copies) {
+                total += copy.source.Area();
+            }
+            return total;
+        }
+    };
+
+    // Bytes ExtractRegion writes for the region with the given row stride (0 means tightly packed).
+    inline uint64_t RegionBufferSize(const RegionSpec& spec, int stride)
+    {
+        int packed = spec.OutputWidth() * BytesPerPixel(spec.format);
+        if (stride == 0) {
+            stride = packed;
+        }
+        return static_cast<uint64_t>(stride) * (spec.OutputHeight() - 1) + packed;
+    }
+
+    // Converts (and resizes if asked) one region out of the BGRA atlas we read back.
+    inline void ExtractRegion(const uint8_t* atlas, int atlasPitch, const RegionPlacement& region, uint8_t* dst, int stride)
+    {
+        const RegionSpec& spec = region.spec;
+        if (stride == 0) {
+            stride = spec.OutputWidth() * BytesPerPixel(spec.format);
+        }
+        const uint8_t* src = atlas + static_cast<int64_t>(region.y) * atlasPitch + static_cast<int64_t>(region.x) * 4;
+        if (spec.OutputWidth() == spec.bounds.Width() && spec.OutputHeight() == spec.bounds.Height()) {
+            ConvertBgra(src, atlasPitch, spec.bounds.Width(), spec.bounds.Height(), dst, stride, spec.format);
+        }
+        else {
+            ResizeBgra(src, atlasPitch, spec.bounds.Width(), spec.bounds.Height(), dst, stride,
+                spec.OutputWidth(), spec.OutputHeight(), spec.format, spec.filter);
+        }
+    }
+
+    // The regions of one capture, thread safe. Every change builds a new plan that the capture
+    // callback picks up on the next frame.
+    class RegionSet
+    {
+        std::mutex _mutex;
+        std::map<int, RegionSpec> _specs;
+        int _nextId = 1;
+        std::shared_ptr<const RegionPlan> _plan = std::make_shared<RegionPlan>();
+
+    public:
+        // Clips the region to the capture bounds, returns its id or 0 if nothing is left of it.
+        int Add(RegionSpec spec, const RegionRect& captureBounds) {
+            spec.bounds = spec.bounds.Intersect(captureBounds);
+            if (spec.bounds.Empty()) {
+                return 0;
+            }
+            std::scoped_lock lock(_mutex);
+            int id = _nextId++;
+            _specs[id] = spec;
+            std::atomic_store(&_plan, RegionPlan::Build(_specs));
+            return id;
+        }
+
+        bool Remove(int id) {
+            std::scoped_lock lock(_mutex);
+            if (_specs.erase(id) == 0) {
+                return false;
+            }
+            std::atomic_store(&_plan, RegionPlan::Build(_specs));
+            return true;
+        }
+
+        void Clear() {
+            std::scoped_lock lock(_mutex);
+            _specs.clear();
+            std::atomic_store(&_plan, std::shared_ptr<const RegionPlan>(std::make_shared<RegionPlan>()));
+        }
+
+        // Lock free so the capture callback never waits on Add or Remove.
+        std::shared_ptr<const RegionPlan> Plan() const {
+            return std::atomic_load(&_plan);
+        }
+    };
+}
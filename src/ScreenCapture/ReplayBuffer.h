@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace util
+{
+    // One encoded packet, timestamps are in the time base of the ReplayBuffer it is in.
+    struct ReplayPacket
+    {
+        std::vector<uint8_t> data;
+        int64_t pts = 0;
+        int64_t dts = 0;
+        int64_t duration = 0;
+        bool key = false;
+    };
+
+    // The last few seconds of encoded video kept in memory, for "save what just happened" without
+    // writing to the disk all the time. Packets are dropped from the front a whole group of
+    // pictures at a time so the buffer always starts on a key frame and can be muxed on its own.
+    // Time is only given back while what is left still covers maxSeconds, so a saved clip is
+    // between maxSeconds and maxSeconds plus one key frame interval long. The memory cap is
+    // strict except that the newest group of pictures is always kept. One writer, Snapshot can be
+    // called from any thread.
+    class ReplayBuffer
+    {
+        mutable std::mutex _mutex;
+        std::deque<std::shared_ptr<const ReplayPacket>> _packets;
+        double _secondsPerTick = 0.001;
+        double _maxSeconds = 60;
+        size_t _maxBytes = 256 * 1024 * 1024;
+        size_t _bytes = 0;
+
+        // How many packets from the front make up the first group of pictures, or 0 if the
+        // buffer holds less than two key frames.
+        size_t FirstGroupSize() const {
+            for (size_t i = 1; i < _packets.size(); i++) {
+                if (_packets[i]->key) {
+                    return i;
+                }
+            }
+            return 0;
+        }
+
+        double Seconds(size_t first) const {
+            auto& last = _packets.back();
+            return (last->dts + last->duration - _packets[first]->dts) * _secondsPerTick;
+        }
+
+        void DropFront(size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                _bytes -= _packets.front()->data.size();
+                _packets.pop_front();
+            }
+        }
+
+    public:
+        // Clears the buffer, timeBaseNum / timeBaseDen is the length of a tick in seconds.
+        void Configure(double maxSeconds, size_t maxBytes, int timeBaseNum, int timeBaseDen) {
+            std::scoped_lock lock(_mutex);
+            _packets.clear();
+            _bytes = 0;
+            _maxSeconds = maxSeconds;
+            _maxBytes = maxBytes;
+            _secondsPerTick = static_cast<double>(timeBaseNum) / timeBaseDen;
+        }
+
+        void Add(std::shared_ptr<const ReplayPacket> packet) {
+            std::scoped_lock lock(_mutex);
+            if (_packets.empty() && !packet->key) {
+                return; // nothing can be decoded before the first key frame.
+            }
+            _bytes += packet->data.size();
+            _packets.push_back(std::move(packet));
+            while (true) {
+                size_t group = FirstGroupSize();
+                if (group == 0) {
+                    break;
+                }
+                if (_bytes > _maxBytes || Seconds(group) >= _maxSeconds) {
+                    DropFront(group);
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        // The packets in decoding order, the first one is a key frame. They are shared with the
+        // buffer so this is cheap enough to call while encoding.
+        std::vector<std::shared_ptr<const ReplayPacket>> Snapshot() const {
+            std::scoped_lock lock(_mutex);
+            return std::vector<std::shared_ptr<const ReplayPacket>>(_packets.begin(), _packets.end());
+        }
+
+        // From the first decoded to the end of the last packet.
+        double Seconds() const {
+            std::scoped_lock lock(_mutex);
+            return _packets.empty() ? 0 : Seconds(0);
+        }
+
+        size_t Bytes() const {
+            std::scoped_lock lock(_mutex);
+            return _bytes;
+        }
+
+        void Clear() {
+            std::scoped_lock lock(_mutex);
+            _packets.clear();
+            _bytes = 0;
+        }
+    };
+}
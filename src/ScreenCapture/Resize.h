@@ -0,0 +1,285 @@
+#pragma once
+#include "PixelConvert.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+    // Filters for scaling the captured BGRA frame to a requested output size while it is converted
+    // to the output pixel format, so a 4K capture can be handed over as a 224 px image.
+    enum class ResizeFilter
+    {
+        Nearest = 0,  // the source pixel under the center of each output pixel.
+        Box = 1,      // average of the source pixels each output pixel covers, best for downscaling.
+        Bilinear = 2  // blend of the 4 source pixels around the center of each output pixel.
+    };
+
+    inline bool IsValidResizeFilter(int filter)
+    {
+        return filter >= static_cast<int>(ResizeFilter::Nearest) && filter <= static_cast<int>(ResizeFilter::Bilinear);
+    }
+
+    namespace detail
+    {
+        // bilinear weights are 11 bit fixed point, so a full 2x2 blend still fits in 32 bits.
+        const int LerpBits = 11;
+        const int LerpOne = 1 << LerpBits;
+
+        // Source pixels each output row or column reads from, along one axis.
+        struct ResizeAxis
+        {
+            std::vector<int> start;  // nearest: the pixel, box: first pixel, bilinear: left/top pixel.
+            std::vector<int> end;    // box: one past the last pixel, bilinear: right/bottom pixel.
+            std::vector<int> weight; // bilinear: weight of the end pixel out of LerpOne.
+        };
+
+        inline ResizeAxis BuildResizeAxis(int srcSize, int dstSize, ResizeFilter filter)
+        {
+            ResizeAxis axis;
+            axis.start.resize(dstSize);
+            axis.end.resize(dstSize);
+            axis.weight.resize(dstSize);
+            for (int i = 0; i < dstSize; i++) {
+                switch (filter) {
+                case ResizeFilter::Nearest:
+                    axis.start[i] = std::min(srcSize - 1, static_cast<int>((static_cast<int64_t>(i) * 2 + 1) * srcSize / (2 * static_cast<int64_t>(dstSize))));
+                    axis.end[i] = axis.start[i] + 1;
+                    break;
+                case ResizeFilter::Box:
+                    axis.start[i] = static_cast<int>(static_cast<int64_t>(i) * srcSize / dstSize);
+                    axis.end[i] = std::max(axis.start[i] + 1, static_cast<int>(static_cast<int64_t>(i + 1) * srcSize / dstSize));
+                    break;
+                case ResizeFilter::Bilinear: {
+                    double center = std::max(0.0, (i + 0.5) * srcSize / dstSize - 0.5);
+                    int first = std::min(static_cast<int>(center), srcSize - 1);
+                    int weight = static_cast<int>((center - first) * LerpOne + 0.5);
+                    if (first == srcSize - 1) {
+                        // past the center of the last pixel, so it's all that pixel.
+                        weight = 0;
+                    }
+                    axis.start[i] = first;
+                    axis.end[i] = std::min(first + 1, srcSize - 1);
+                    axis.weight[i] = weight;
+                    break;
+                }
+                }
+            }
+            return axis;
+        }
+
+        inline void NearestRowScalar(const uint8_t* row, const ResizeAxis& xs, uint8_t* dst, int x, int width)
+        {
+            for (; x < width; x++) {
+                ::memcpy(dst + x * 4, row + xs.start[x] * 4, 4);
+            }
+        }
+
+        // Adds a row of bytes into 32 bit sums.
+        inline void AccumulateRowScalar(const uint8_t* row, uint32_t* sums, int i, int count)
+        {
+            for (; i < count; i++) {
+                sums[i] += row[i];
+            }
+        }
+
+        // Averages the summed columns of each output pixel, rows is how many source rows were summed.
+        inline void BoxRow(const uint32_t* sums, const ResizeAxis& xs, int rows, uint8_t* dst, int width)
+        {
+            for (int x = 0; x < width; x++) {
+                uint32_t b = 0, g = 0, r = 0, a = 0;
+                for (int i = xs.start[x]; i < xs.end[x]; i++) {
+                    b += sums[i * 4];
+                    g += sums[i * 4 + 1];
+                    r += sums[i * 4 + 2];
+                    a += sums[i * 4 + 3];
+                }
+                uint32_t count = static_cast<uint32_t>(xs.end[x] - xs.start[x]) * rows;
+                dst[x * 4] = static_cast<uint8_t>((b + count / 2) / count);
+                dst[x * 4 + 1] = static_cast<uint8_t>((g + count / 2) / count);
+                dst[x * 4 + 2] = static_cast<uint8_t>((r + count / 2) / count);
+                dst[x * 4 + 3] = static_cast<uint8_t>((a + count / 2) / count);
+            }
+        }
+
+        inline void BilinearRowScalar(const uint8_t* row0, const uint8_t* row1, int wy, const ResizeAxis& xs, uint8_t* dst, int x, int width)
+        {
+            const uint32_t round = 1u << (2 * LerpBits - 1);
+            for (; x < width; x++) {
+                const uint8_t* a0 = row0 + xs.start[x] * 4;
+                const uint8_t* a1 = row0 + xs.end[x] * 4;
+                const uint8_t* b0 = row1 + xs.start[x] * 4;
+                const uint8_t* b1 = row1 + xs.end[x] * 4;
+                uint32_t wx = xs.weight[x];
+                for (int c = 0; c < 4; c++) {
+                    uint32_t top = a0[c] * (LerpOne - wx) + a1[c] * wx;
+                    uint32_t bottom = b0[c] * (LerpOne - wx) + b1[c] * wx;
+                    dst[x * 4 + c] = static_cast<uint8_t>((top * (LerpOne - wy) + bottom * wy + round) >> (2 * LerpBits));
+                }
+            }
+        }
+
+#if UTIL_X86
+        UTIL_TARGET_SSE41 inline void AccumulateRowSse41(const uint8_t* row, uint32_t* sums, int count)
+        {
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+                for (int j = 0; j < 4; j++) {
+                    __m128i* s = reinterpret_cast<__m128i*>(sums + i + j * 4);
+                    _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), _mm_cvtepu8_epi32(bytes)));
+                    bytes = _mm_srli_si128(bytes, 4);
+                }
+            }
+            AccumulateRowScalar(row, sums, i, count);
+        }
+
+        // One output pixel per iteration: the two neighbouring pixels of each row are spread into
+        // 16 bit (left, right) pairs per channel so a single madd does the horizontal blend.
+        UTIL_TARGET_SSE41 inline void BilinearRowSse41(const uint8_t* row0, const uint8_t* row1, int wy, const ResizeAxis& xs, uint8_t* dst, int width, int srcWidth)
+        {
+            const __m128i spread = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+            const __m128i wTop = _mm_set1_epi32(LerpOne - wy);
+            const __m128i wBottom = _mm_set1_epi32(wy);
+            const __m128i round = _mm_set1_epi32(1 << (2 * LerpBits - 1));
+            int x = 0;
+            // the 8 byte loads read start and start + 1, which only exists when start is not the last pixel.
+            for (; x < width && xs.start[x] + 1 < srcWidth; x++) {
+                int offset = xs.start[x] * 4;
+                int wx = xs.weight[x];
+                __m128i weights = _mm_set1_epi32(((wx & 0xFFFF) << 16) | (LerpOne - wx));
+                __m128i a = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0 + offset)), spread);
+                __m128i b = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1 + offset)), spread);
+                __m128i top = _mm_madd_epi16(a, weights);
+                __m128i bottom = _mm_madd_epi16(b, weights);
+                __m128i v = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(top, wTop), _mm_mullo_epi32(bottom, wBottom)), round);
+                v = _mm_srli_epi32(v, 2 * LerpBits);
+                v = _mm_packus_epi16(_mm_packus_epi32(v, v), v);
+                int32_t pixel = _mm_cvtsi128_si32(v);
+                ::memcpy(dst + x * 4, &pixel, 4);
+            }
+            BilinearRowScalar(row0, row1, wy, xs, dst, x, width);
+        }
+
+        UTIL_TARGET_AVX2 inline void NearestRowAvx2(const uint8_t* row, const ResizeAxis& xs, uint8_t* dst, int width)
+        {
+            int x = 0;
+            for (; x + 8 <= width; x += 8) {
+                __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs.start.data() + x));
+                __m256i pixels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row), index, 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), pixels);
+            }
+            NearestRowScalar(row, xs, dst, x, width);
+        }
+
+        UTIL_TARGET_AVX2 inline void AccumulateRowAvx2(const uint8_t* row, uint32_t* sums, int count)
+        {
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+                __m256i* lo = reinterpret_cast<__m256i*>(sums + i);
+                __m256i* hi = reinterpret_cast<__m256i*>(sums + i + 8);
+                _mm256_storeu_si256(lo, _mm256_add_epi32(_mm256_loadu_si256(lo), _mm256_cvtepu8_epi32(bytes)));
+                _mm256_storeu_si256(hi, _mm256_add_epi32(_mm256_loadu_si256(hi), _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+            }
+            AccumulateRowScalar(row, sums, i, count);
+        }
+#endif
+
+        // Resizes the source rows needed for output rows [firstRow, lastRow) and converts them.
+        inline void ResizeBand(const uint8_t* src, int srcPitch, int srcWidth, const ResizeAxis& xs, const ResizeAxis& ys,
+            uint8_t* dst, int dstStride, int dstWidth, int firstRow, int lastRow, PixelFormat format, ResizeFilter filter, CpuLevel level)
+        {
+            std::vector<uint8_t> scratch;
+            if (format != PixelFormat::Bgra) {
+                scratch.resize(static_cast<size_t>(dstWidth) * 4);
+            }
+            std::vector<uint32_t> sums;
+            if (filter == ResizeFilter::Box) {
+                sums.resize(static_cast<size_t>(srcWidth) * 4);
+            }
+            for (int y = firstRow; y < lastRow; y++) {
+                uint8_t* out = dst + static_cast<int64_t>(y) * dstStride;
+                // BGRA output is resized in place, the other formats go through one BGRA row.
+                uint8_t* bgra = scratch.empty() ? out : scratch.data();
+                const uint8_t* row0 = src + static_cast<int64_t>(ys.start[y]) * srcPitch;
+                switch (filter) {
+                case ResizeFilter::Nearest:
+#if UTIL_X86
+                    if (level == CpuLevel::Avx2) {
+                        NearestRowAvx2(row0, xs, bgra, dstWidth);
+                        break;
+                    }
+#endif
+                    NearestRowScalar(row0, xs, bgra, 0, dstWidth);
+                    break;
+                case ResizeFilter::Box:
+                    std::fill(sums.begin(), sums.end(), 0);
+                    for (int sy = ys.start[y]; sy < ys.end[y]; sy++) {
+                        const uint8_t* row = src + static_cast<int64_t>(sy) * srcPitch;
+                        switch (level) {
+#if UTIL_X86
+                        case CpuLevel::Avx2:
+                            AccumulateRowAvx2(row, sums.data(), srcWidth * 4);
+                            break;
+                        case CpuLevel::Sse41:
+                            AccumulateRowSse41(row, sums.data(), srcWidth * 4);
+                            break;
+#endif
+                        default:
+                            AccumulateRowScalar(row, sums.data(), 0, srcWidth * 4);
+                            break;
+                        }
+                    }
+                    BoxRow(sums.data(), xs, ys.end[y] - ys.start[y], bgra, dstWidth);
+                    break;
+                case ResizeFilter::Bilinear: {
+                    const uint8_t* row1 = src + static_cast<int64_t>(ys.end[y]) * srcPitch;
+#if UTIL_X86
+                    if (level != CpuLevel::Scalar) {
+                        BilinearRowSse41(row0, row1, ys.weight[y], xs, bgra, dstWidth, srcWidth);
+                        break;
+                    }
+#endif
+                    BilinearRowScalar(row0, row1, ys.weight[y], xs, bgra, 0, dstWidth);
+                    break;
+                }
+                }
+                if (bgra != out) {
+                    ConvertBgraRow(bgra, out, dstWidth, format, level);
+                }
+            }
+        }
+    }
+
+    // Scales a srcWidth x srcHeight BGRA image with the given row pitch to dstWidth x dstHeight and
+    // writes it in the given format with dstStride bytes per row, one output row at a time so there
+    // is no full size intermediate image. With threads > 1 the output rows are split into that many
+    // bands that are done in parallel.
+    inline void ResizeBgra(const uint8_t* src, int srcPitch, int srcWidth, int srcHeight,
+        uint8_t* dst, int dstStride, int dstWidth, int dstHeight, PixelFormat format, ResizeFilter filter,
+        int threads, CpuLevel level)
+    {
+        detail::ResizeAxis xs = detail::BuildResizeAxis(srcWidth, dstWidth, filter);
+        detail::ResizeAxis ys = detail::BuildResizeAxis(srcHeight, dstHeight, filter);
+        int bands = std::max(1, std::min(threads, dstHeight));
+        std::vector<std::thread> workers;
+        for (int band = 1; band < bands; band++) {
+            int first = static_cast<int>(static_cast<int64_t>(band) * dstHeight / bands);
+            int last = static_cast<int>(static_cast<int64_t>(band + 1) * dstHeight / bands);
+            workers.emplace_back([=, &xs, &ys]() {
+                detail::ResizeBand(src, srcPitch, srcWidth, xs, ys, dst, dstStride, dstWidth, first, last, format, filter, level);
+            });
+        }
+        detail::ResizeBand(src, srcPitch, srcWidth, xs, ys, dst, dstStride, dstWidth, 0, dstHeight / bands, format, filter, level);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    inline void ResizeBgra(const uint8_t* src, int srcPitch, int srcWidth, int srcHeight,
+        uint8_t* dst, int dstStride, int dstWidth, int dstHeight, PixelFormat format, ResizeFilter filter, int threads = 1)
+    {
+        ResizeBgra(src, srcPitch, srcWidth, srcHeight, dst, dstStride, dstWidth, dstHeight, format, filter, threads, GetCpuLevel());
+    }
+}
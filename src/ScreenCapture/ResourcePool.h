@@ -0,0 +1,163 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace util
+{
+    // Creates and destroys the resources a ResourcePool hands out, so the pool itself doesn't depend
+    // on D3D and can be tested with a mock.
+    template <typename Key, typename Resource>
+    class ResourceAllocator
+    {
+    public:
+        virtual ~ResourceAllocator() {}
+
+        // Returns null if the resource cannot be created.
+        virtual Resource* Create(const Key& key) = 0;
+
+        virtual void Destroy(Resource* resource) = 0;
+    };
+
+    struct PoolStats
+    {
+        uint64_t created = 0;
+        uint64_t reused = 0;
+        uint64_t destroyed = 0;
+        uint64_t rejected = 0; // Acquire calls that hit the outstanding limit.
+        size_t outstanding = 0;
+        size_t available = 0;
+    };
+
+    // Hands out resources as shared_ptrs that come back to the pool when the last reference is
+    // released, and reuses them for later requests with the same key (e.g. texture size and format).
+    // At most maxOutstanding resources can be handed out at once and at most maxAvailable are kept
+    // for reuse, the least recently returned ones are destroyed first. Thread safe, resources can be
+    // released from any thread and may outlive the pool.
+    template <typename Key, typename Resource>
+    class ResourcePool
+    {
+        struct Entry
+        {
+            Key key;
+            Resource* resource;
+        };
+
+        struct State
+        {
+            std::mutex mutex;
+            std::shared_ptr<ResourceAllocator<Key, Resource>> allocator;
+            std::list<Entry> available; // most recently returned at the front.
+            size_t maxOutstanding = 0;
+            size_t maxAvailable = 0;
+            bool closed = false;
+            PoolStats stats;
+
+            // Must be called with the mutex held, returns the resources to destroy outside of it.
+            void Trim(std::list<Entry>& evicted) {
+                size_t limit = closed ? 0 : maxAvailable;
+                while (available.size() > limit) {
+                    evicted.splice(evicted.end(), available, std::prev(available.end()));
+                }
+                stats.destroyed += evicted.size();
+            }
+
+            void Destroy(std::list<Entry>& evicted) {
+                for (auto& entry : evicted) {
+                    allocator->Destroy(entry.resource);
+                }
+            }
+
+            void Return(const Key& key, Resource* resource) {
+                std::list<Entry> evicted;
+                {
+                    std::scoped_lock lock(mutex);
+                    stats.outstanding--;
+                    available.push_front({ key, resource });
+                    Trim(evicted);
+                }
+                Destroy(evicted);
+            }
+        };
+
+        std::shared_ptr<State> _state;
+
+    public:
+        ResourcePool(std::shared_ptr<ResourceAllocator<Key, Resource>> allocator, size_t maxOutstanding, size_t maxAvailable)
+            : _state(std::make_shared<State>()) {
+            _state->allocator = allocator;
+            _state->maxOutstanding = maxOutstanding;
+            _state->maxAvailable = maxAvailable;
+        }
+
+        ~ResourcePool() {
+            // outstanding resources are destroyed when they come back.
+            std::list<Entry> evicted;
+            {
+                std::scoped_lock lock(_state->mutex);
+                _state->closed = true;
+                _state->Trim(evicted);
+            }
+            _state->Destroy(evicted);
+        }
+
+        ResourcePool(const ResourcePool&) = delete;
+        ResourcePool& operator=(const ResourcePool&) = delete;
+
+        // Returns a resource matching the key, or null if maxOutstanding are already handed out or
+        // the allocator failed.
+        std::shared_ptr<Resource> Acquire(const Key& key) {
+            Resource* resource = nullptr;
+            {
+                std::scoped_lock lock(_state->mutex);
+                if (_state->stats.outstanding >= _state->maxOutstanding) {
+                    _state->stats.rejected++;
+                    return nullptr;
+                }
+                for (auto it = _state->available.begin(); it != _state->available.end(); ++it) {
+                    if (it->key == key) {
+                        resource = it->resource;
+                        _state->available.erase(it);
+                        _state->stats.reused++;
+                        break;
+                    }
+                }
+                // reserve the slot so another thread can't go over the limit while we create.
+                _state->stats.outstanding++;
+            }
+            if (resource == nullptr) {
+                resource = _state->allocator->Create(key);
+                std::scoped_lock lock(_state->mutex);
+                if (resource == nullptr) {
+                    _state->stats.outstanding--;
+                    return nullptr;
+                }
+                _state->stats.created++;
+            }
+            std::shared_ptr<State> state = _state;
+            return std::shared_ptr<Resource>(resource, [state, key](Resource* r) {
+                state->Return(key, r);
+            });
+        }
+
+        void SetLimits(size_t maxOutstanding, size_t maxAvailable) {
+            std::list<Entry> evicted;
+            {
+                std::scoped_lock lock(_state->mutex);
+                _state->maxOutstanding = maxOutstanding;
+                _state->maxAvailable = maxAvailable;
+                _state->Trim(evicted);
+            }
+            _state->Destroy(evicted);
+        }
+
+        PoolStats GetStats() {
+            std::scoped_lock lock(_state->mutex);
+            PoolStats result = _state->stats;
+            result.available = _state->available.size();
+            return result;
+        }
+    };
+}
@@ -1,6 +1,11 @@
 #include "pch.h"
 #include "ScreenCapture.h"
 #include "Errors.h"
+#include "Mailbox.h"
+#include "ResourcePool.h"
+#include "ReadbackRing.h"
+#include "Trace.h"
+#include "Clock.h"
 
 #include <winrt/Windows.Graphics.Capture.h>
 #include <windows.graphics.capture.interop.h>
@@ -11,6 +16,8 @@
 #include <d2d1_1.h>
 #include <dxgi1_6.h>
 #include <d3d11.h>
+#include <thread>
+#include <functional>
 
 namespace winrt
 {
@@ -48,15 +55,140 @@ namespace util {
 // since we are requesting B8G8R8A8UIntNormalized
 const int CHANNELS = 4;
 
-CRITICAL_SECTION m_mutex;
+// Counts the threads inside a callback for as long as it is in scope.
+class CallbackGuard
+{
+    std::atomic<int>& m_count;
+public:
+    CallbackGuard(std::atomic<int>& count) : m_count(count) { m_count++; }
+    ~CallbackGuard() { m_count--; }
+};
 
-class CriticalSectionGuard
+// Textures in the pool are interchangeable if they have the same size and format.
+struct TextureKey
 {
+    UINT width;
+    UINT height;
+    DXGI_FORMAT format;
+
+    bool operator==(const TextureKey& other) const {
+        return width == other.width && height == other.height && format == other.format;
+    }
+};
+
+// Creates the cropped copies of the captured frames.
+class CroppedTextureAllocator : public util::ResourceAllocator<TextureKey, ID3D11Texture2D>
+{
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
 public:
-    CriticalSectionGuard() { EnterCriticalSection(&m_mutex); }
-    ~CriticalSectionGuard() { LeaveCriticalSection(&m_mutex); }
+    CroppedTextureAllocator(winrt::com_ptr<ID3D11Device> device) : m_d3dDevice(device) {}
+
+    ID3D11Texture2D* Create(const TextureKey& key) override {
+        D3D11_TEXTURE2D_DESC desc{};
+        desc.Width = key.width;
+        desc.Height = key.height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = key.format;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+        ID3D11Texture2D* texture = nullptr;
+        HRESULT hr = m_d3dDevice->CreateTexture2D(&desc, NULL, &texture);
+        debug_hresult(L"CreateTexture2D", hr, false);
+        return SUCCEEDED(hr) ? texture : nullptr;
+    }
+
+    void Destroy(ID3D11Texture2D* texture) override {
+        texture->Release();
+    }
+};
+
+// Copies frames into a set of staging textures for a ReadbackRing, the copy is queued on the GPU
+// and only Map waits for it.
+class StagingTextureBackend : public util::ReadbackBackend
+{
+public:
+    using MappedCallback = std::function<void(const D3D11_MAPPED_SUBRESOURCE& mapped, const D3D11_TEXTURE2D_DESC& desc, uint8_t* buffer, unsigned int size)>;
+
+private:
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    std::vector<winrt::com_ptr<ID3D11Texture2D>> m_staging;
+    MappedCallback m_onMapped;
+
+public:
+    StagingTextureBackend(winrt::com_ptr<ID3D11Device> device, winrt::com_ptr<ID3D11DeviceContext> context, MappedCallback onMapped)
+        : m_d3dDevice(device), m_d3dContext(context), m_onMapped(onMapped) {}
+
+    void BeginCopy(size_t slot, void* frame) override {
+        auto texture = static_cast<ID3D11Texture2D*>(frame);
+        D3D11_TEXTURE2D_DESC desc{};
+        texture->GetDesc(&desc);
+        if (desc.SampleDesc.Count != 1) {
+            throw std::exception("SampleDesc.Count != 1\n");
+        }
+        if (desc.MipLevels != 1) {
+            throw std::exception("MipLevels != 1\n");
+        }
+        if (desc.ArraySize != 1) {
+            throw std::exception("ArraySize != 1\n");
+        }
+        if (desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM) {
+            throw std::exception("Format != DXGI_FORMAT_B8G8R8A8_UNORM\n");
+        }
+        desc.Usage = D3D11_USAGE_STAGING; // A resource that supports data transfer (copy) from the GPU to the CPU.
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+
+        if (slot >= m_staging.size()) {
+            m_staging.resize(slot + 1);
+        }
+        auto& staging = m_staging[slot];
+        if (staging) {
+            // only recreate the staging texture when the frame size changes.
+            D3D11_TEXTURE2D_DESC existing{};
+            staging->GetDesc(&existing);
+            if (existing.Width != desc.Width || existing.Height != desc.Height) {
+                staging = nullptr;
+            }
+        }
+        if (!staging) {
+            HRESULT hr = m_d3dDevice->CreateTexture2D(&desc, NULL, staging.put());
+            debug_hresult(L"failed to create texture", hr, true);
+        }
+
+        // Copy the image out of the backbuffer.
+        UTIL_TRACE_SCOPE("CopyResource");
+        m_d3dContext->CopyResource(staging.get(), texture);
+    }
+
+    void ReadSlot(size_t slot, uint8_t* buffer, unsigned int size) override {
+        UTIL_TRACE_SCOPE("ReadPixels");
+        auto& staging = m_staging[slot];
+        D3D11_TEXTURE2D_DESC desc{};
+        staging->GetDesc(&desc);
+        D3D11_MAPPED_SUBRESOURCE resource{};
+        // this is where we wait for the GPU if the copy has not finished yet.
+        HRESULT hr = m_d3dContext->Map(staging.get(), 0, D3D11_MAP_READ, 0, &resource);
+        debug_hresult(L"failed to map texture", hr, true);
+        m_onMapped(resource, desc, buffer, size);
+        m_d3dContext->Unmap(staging.get(), 0);
+    }
 };
 
+// Enough for the mailbox slots, the encoder pipeline and a few readers, beyond that new frames are
+// dropped until someone releases a texture.
+const size_t DEFAULT_MAX_TEXTURES = 16;
+const size_t MAX_AVAILABLE_TEXTURES = 4;
+
+// The regions of interest copied out of one frame into an atlas, with the plan saying where each is.
+struct RegionFrame
+{
+    std::shared_ptr<ID3D11Texture2D> texture;
+    std::shared_ptr<const util::RegionPlan> plan;
+};
 
 class SimpleCaptureImpl
 {
@@ -68,20 +200,43 @@ public:
     winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice m_device{ nullptr };
     winrt::com_ptr<ID3D11Device> m_d3dDevice{ nullptr };
     winrt::com_ptr<ID3D11DeviceContext> m_d3dContext{ nullptr };
-    std::mutex frame_mutex; // to protect updating and reading of m_d3dCurrentFrame
-    winrt::com_ptr<ID3D11Texture2D> m_d3dCurrentFrame{ nullptr };
+    util::Mailbox<std::shared_ptr<ID3D11Texture2D>> m_frames; // latest frame from OnFrameArrived.
+    std::unique_ptr<util::ResourcePool<TextureKey, ID3D11Texture2D>> m_texturePool;
+    size_t m_maxTextures = DEFAULT_MAX_TEXTURES;
+    std::mutex m_pixelsMutex; // ReadPixels can be called from an encoder thread.
+    std::unique_ptr<StagingTextureBackend> m_pixelsBackend;
+    std::unique_ptr<util::ReadbackRing> m_pixelsRing;
+    std::mutex m_readbackMutex; // for ReadNextFrame
+    std::unique_ptr<StagingTextureBackend> m_readbackBackend;
+    std::unique_ptr<util::ReadbackRing> m_readbackRing;
+    size_t m_readbackLatency = 0;
+    std::atomic<uint64_t> m_lastReadSequence{ 0 };
+    // how the frame being read by ReadNextFrame is written out, null means the raw pitched BGRA.
+    const ReadbackOutput* m_readbackOutput = nullptr;
+    ResizeSettings m_resize;
+    util::RegionSet m_regions;
+    util::Mailbox<RegionFrame> m_regionFrames; // latest region atlas from OnFrameArrived.
+    std::mutex m_regionMutex; // for ReadRegion
+    std::unique_ptr<StagingTextureBackend> m_regionBackend;
+    std::unique_ptr<util::ReadbackRing> m_regionRing;
+    std::vector<uint8_t> m_regionAtlas; // CPU copy of the last atlas read back, shared by all regions.
+    int m_regionAtlasPitch = 0;
+    uint64_t m_regionAtlasSequence = 0;
+    double m_regionAtlasTime = 0;
+    std::shared_ptr<const util::RegionPlan> m_regionAtlasPlan;
     winrt::Windows::Graphics::DirectX::DirectXPixelFormat m_pixelFormat = winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8A8UIntNormalized;
-    bool m_closed = false;
+    std::atomic<bool> m_closed{ false };
+    std::atomic<int> m_inCallback{ 0 }; // so Close can wait for a running OnFrameArrived.
     winrt::event_token m_frameArrivedToken;
     RECT m_bounds = { 0 };
     RECT m_croppedBounds = { 0 };;
     RECT m_captureBounds = { 0 };
     unsigned long long m_frameId = 0;
-    double m_frameTime = 0;
     HANDLE m_event = NULL;
     bool m_saveBitmap = false;
-    std::vector<double> m_arrivalTimes;
+    util::TimingLog m_arrivalTimes; // written by OnFrameArrived, read from any thread.
     double m_firstFrameTime = 0;
+    std::atomic<int64_t> m_lastArrival{ 0 }; // util::Clock nanoseconds, for throttles to align to.
 
 public:
     void StartCapture(
@@ -106,6 +261,31 @@ public:
 
         m_d3dDevice = util::GetDXGIInterfaceFromObject<ID3D11Device>(m_device);
         m_d3dDevice->GetImmediateContext(m_d3dContext.put());
+        // the immediate context is used from the FrameArrived thread and from whoever reads the frames.
+        auto multithread = m_d3dContext.try_as<ID3D11Multithread>();
+        if (multithread) {
+            multithread->SetMultithreadProtected(TRUE);
+        }
+        m_texturePool = std::make_unique<util::ResourcePool<TextureKey, ID3D11Texture2D>>(
+            std::make_shared<CroppedTextureAllocator>(m_d3dDevice), m_maxTextures, MAX_AVAILABLE_TEXTURES);
+
+        m_pixelsBackend = std::make_unique<StagingTextureBackend>(m_d3dDevice, m_d3dContext,
+            [this](const D3D11_MAPPED_SUBRESOURCE& mapped, const D3D11_TEXTURE2D_DESC& desc, uint8_t* buffer, unsigned int size) {
+                CopyMappedPixels(mapped, desc, buffer, size, nullptr);
+            });
+        m_pixelsRing = std::make_unique<util::ReadbackRing>(*m_pixelsBackend, 0);
+        m_readbackBackend = std::make_unique<StagingTextureBackend>(m_d3dDevice, m_d3dContext,
+            [this](const D3D11_MAPPED_SUBRESOURCE& mapped, const D3D11_TEXTURE2D_DESC& desc, uint8_t* buffer, unsigned int size) {
+                CopyMappedPixels(mapped, desc, buffer, size, m_readbackOutput);
+            });
+        m_readbackRing = std::make_unique<util::ReadbackRing>(*m_readbackBackend, m_readbackLatency);
+        m_regionBackend = std::make_unique<StagingTextureBackend>(m_d3dDevice, m_d3dContext,
+            [this](const D3D11_MAPPED_SUBRESOURCE& mapped, const D3D11_TEXTURE2D_DESC& desc, uint8_t*, unsigned int) {
+                m_regionAtlasPitch = static_cast<int>(mapped.RowPitch);
+                m_regionAtlas.resize(static_cast<size_t>(mapped.RowPitch) * desc.Height);
+                ::memcpy(m_regionAtlas.data(), mapped.pData, m_regionAtlas.size());
+            });
+        m_regionRing = std::make_unique<util::ReadbackRing>(*m_regionBackend, 0);
 
         // Creating our frame pool with 'Create' instead of 'CreateFreeThreaded'
         // means that the frame pool's FrameArrived event is called on the thread
@@ -145,10 +325,14 @@ public:
     {
         if (!m_closed)
         {
-            m_framePool.FrameArrived(m_frameArrivedToken); // Remove the handler
-            CriticalSectionGuard guard;
             m_closed = true;
-            m_d3dCurrentFrame = nullptr;
+            m_framePool.FrameArrived(m_frameArrivedToken); // Remove the handler
+            // a callback that started before we set m_closed may still be publishing a frame.
+            while (m_inCallback > 0) {
+                std::this_thread::yield();
+            }
+            m_frames.Clear();
+            m_regionFrames.Clear();
             m_session.Close();
             m_framePool.Close();
             m_framePool = nullptr;
@@ -157,36 +341,130 @@ public:
             CloseHandle(m_event);
         }
     }
-    double ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size)
+    double ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size, const ReadbackOutput* output)
     {
         if (m_closed) {
             debug_hresult(L"ReadNextFrame: Capture is closed", E_FAIL, true);
         }
-        // make sure a frame has been written.
-        int hr = WaitForMultipleObjects(1, &m_event, TRUE, timeout);
-        if (hr == WAIT_TIMEOUT) {
-            printf("timeout waiting for FrameArrived event\n");
-            return 0;
+        std::scoped_lock lock(m_readbackMutex);
+        if (output) {
+            int width = m_croppedBounds.right - m_croppedBounds.left;
+            int height = m_croppedBounds.bottom - m_croppedBounds.top;
+            if (m_resize.width > 0 && m_resize.height > 0) {
+                width = m_resize.width;
+                height = m_resize.height;
+            }
+            int packed = width * util::BytesPerPixel(output->format);
+            int stride = output->stride ? output->stride : packed;
+            uint64_t required = static_cast<uint64_t>(stride) * (height - 1) + packed;
+            if (stride < packed || size < required) {
+                debug_hresult(L"ReadNextFrame: buffer is too small for the frame", E_INVALIDARG, true);
+            }
         }
+        // queue copies of new frames until latency frames are in flight behind the one we read.
+        while (!m_readbackRing->Ready()) {
+            // make sure a frame has been written.
+            int hr = WaitForMultipleObjects(1, &m_event, TRUE, timeout);
+            if (hr == WAIT_TIMEOUT) {
+                printf("timeout waiting for FrameArrived event\n");
+                return 0;
+            }
+            double frameTime = 0;
+            uint64_t sequence = 0;
+            std::shared_ptr<ID3D11Texture2D> frame;
+            m_frames.Read(frame, frameTime, sequence);
+            if (frame == nullptr) {
+                return 0;
+            }
+            if (sequence != m_readbackRing->LastSequence()) {
+                // the GPU copy is queued before the pool can hand this texture out again, so it's
+                // fine to let go of it right away.
+                m_readbackRing->Submit(frame.get(), sequence, frameTime);
+            }
+        }
+
         double frameTime = 0;
-        winrt::com_ptr<ID3D11Texture2D> frame;
-        {
-            std::scoped_lock lock(frame_mutex);
-            frame = m_d3dCurrentFrame;
-            frameTime = m_frameTime;
+        uint64_t sequence = 0;
+        m_readbackOutput = output;
+        m_readbackRing->Read(reinterpret_cast<uint8_t*>(buffer), size, sequence, frameTime);
+        m_readbackOutput = nullptr;
+        m_lastReadSequence = sequence;
+        return frameTime;
+    }
+
+    void SetReadbackLatency(unsigned int frames)
+    {
+        std::scoped_lock lock(m_readbackMutex);
+        m_readbackLatency = frames;
+        if (m_readbackRing) {
+            m_readbackRing->SetLatency(frames);
         }
+    }
 
-        if (frame != nullptr) {
-            ReadPixels(frame.get(), buffer, size);
+    int AddRegion(const util::RegionSpec& spec)
+    {
+        util::RegionRect captureBounds = { 0, 0, m_bounds.right - m_bounds.left, m_bounds.bottom - m_bounds.top };
+        return m_regions.Add(spec, captureBounds);
+    }
+
+    bool RemoveRegion(int id)
+    {
+        return m_regions.Remove(id);
+    }
+
+    double ReadRegion(int id, uint32_t timeout, char* buffer, unsigned int size, int stride)
+    {
+        if (m_closed) {
+            debug_hresult(L"ReadRegion: Capture is closed", E_FAIL, true);
         }
-        else {
-            return 0;
+        if (m_regions.Plan()->Find(id) == nullptr) {
+            debug_hresult(L"ReadRegion: no such region", E_INVALIDARG, true);
+        }
+        std::scoped_lock lock(m_regionMutex);
+        RegionFrame frame;
+        double frameTime = 0;
+        uint64_t sequence = 0;
+        // a region that was just added shows up in the next frame.
+        while (!m_regionFrames.Read(frame, frameTime, sequence) || frame.plan == nullptr || frame.plan->Find(id) == nullptr) {
+            int hr = WaitForMultipleObjects(1, &m_event, TRUE, timeout);
+            if (hr == WAIT_TIMEOUT) {
+                printf("timeout waiting for a frame with region %d\n", id);
+                return 0;
+            }
         }
 
-        return frameTime;
+        if (sequence != m_regionAtlasSequence) {
+            // one readback per frame no matter how many regions are read from it.
+            uint64_t readSequence = 0;
+            double readTime = 0;
+            m_regionRing->Submit(frame.texture.get(), sequence, frameTime);
+            m_regionRing->Read(nullptr, 0, readSequence, readTime);
+            m_regionAtlasSequence = sequence;
+            m_regionAtlasTime = frameTime;
+            m_regionAtlasPlan = frame.plan;
+        }
+
+        const util::RegionPlacement* region = m_regionAtlasPlan->Find(id);
+        if (stride < 0 || util::RegionBufferSize(region->spec, stride) > size) {
+            debug_hresult(L"ReadRegion: buffer is too small for the region", E_INVALIDARG, true);
+        }
+        UTIL_TRACE_SCOPE("ExtractRegion");
+        util::ExtractRegion(m_regionAtlas.data(), m_regionAtlasPitch, *region, reinterpret_cast<uint8_t*>(buffer), stride);
+        return m_regionAtlasTime;
     }
 
-    double ReadNextTexture(uint32_t timeout, winrt::com_ptr<ID3D11Texture2D>& result)
+    void SetOutputSize(const ResizeSettings& settings)
+    {
+        std::scoped_lock lock(m_readbackMutex);
+        m_resize = settings;
+    }
+
+    uint64_t GetLastReadSequence()
+    {
+        return m_lastReadSequence;
+    }
+
+    double ReadNextTexture(uint32_t timeout, std::shared_ptr<ID3D11Texture2D>& result)
     {
         if (m_closed) {
             debug_hresult(L"ReadNextFrame: Capture is closed", E_FAIL, true);
@@ -200,25 +478,43 @@ public:
             return -1;
         }
         double frameTime = 0;
-        {
-            std::scoped_lock lock(frame_mutex);
-            result = m_d3dCurrentFrame;;
-            frameTime = m_frameTime;
-        }
+        uint64_t sequence = 0;
+        m_frames.Read(result, frameTime, sequence);
 
         return frameTime;
     }
 
+    double ReadLatestTexture(std::shared_ptr<ID3D11Texture2D>& result)
+    {
+        if (m_closed) {
+            debug_hresult(L"ReadLatestTexture: Capture is closed", E_FAIL, true);
+            return -1;
+        }
+        double frameTime = 0;
+        uint64_t sequence = 0;
+        if (!m_frames.Read(result, frameTime, sequence) || result == nullptr) {
+            return -1;
+        }
+        return frameTime;
+    }
+
+
+    void SetMaxTextures(unsigned int maxTextures)
+    {
+        m_maxTextures = maxTextures;
+        if (m_texturePool) {
+            m_texturePool->SetLimits(maxTextures, MAX_AVAILABLE_TEXTURES);
+        }
+    }
 
     RECT GetCaptureBounds()
     {
         // to get the proper CPU mapped memory bounds we need to call ReadPixels at least once.
         WaitForNextFrame(10000);
-        winrt::com_ptr<ID3D11Texture2D> frame;
-        {
-            std::scoped_lock lock(frame_mutex);
-            frame = m_d3dCurrentFrame;
-        }
+        std::shared_ptr<ID3D11Texture2D> frame;
+        double frameTime = 0;
+        uint64_t sequence = 0;
+        m_frames.Read(frame, frameTime, sequence);
         if (frame != nullptr) {
             ReadPixels(frame.get(), nullptr, 0);
         }
@@ -236,15 +532,15 @@ public:
 
     void OnFrameArrived(winrt::Direct3D11CaptureFramePool const& sender, winrt::IInspectable const&)
     {
-        // mutex ensures we don't try and shut down this class while it is in the middle of handling a frame.
-        CriticalSectionGuard guard;
-        {
-            if (m_closed) {
-                return;
-            }
+        // Close waits for m_inCallback so we don't shut down this class in the middle of handling a frame.
+        CallbackGuard guard(m_inCallback);
+        if (m_closed) {
+            return;
         }
 
         {
+            UTIL_TRACE_SCOPE("OnFrameArrived");
+            m_lastArrival.store(util::Clock::Nanoseconds(), std::memory_order_relaxed);
             auto frame = sender.TryGetNextFrame();
             auto _systemFrameTime = frame.SystemRelativeTime();
             auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(_systemFrameTime);
@@ -253,7 +549,7 @@ public:
                 m_firstFrameTime = frameTime;
             }
             frameTime -= m_firstFrameTime;
-            m_arrivalTimes.push_back(frameTime);
+            m_arrivalTimes.Add(frameTime);
 
             auto frameSize = frame.ContentSize();
 
@@ -273,13 +569,15 @@ public:
                 1
             };
 
-            // Then we need to crop by using CopySubresourceRegion
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.Width = srcBox.right - srcBox.left;
-            desc.Height = srcBox.bottom - srcBox.top;
+            auto regionPlan = m_regions.Plan();
+            if (!regionPlan->copies.empty()) {
+                PublishRegions(regionPlan, sourceTexture.get(), width, height, desc.Format, frameTime);
+            }
+
+            // The full frame is published alongside the regions so ReadNextFrame and the encoders keep
+            // working, it is only read back when someone reads it. Then we need to crop by using
+            // CopySubresourceRegion into a recycled texture.
+            TextureKey key = { srcBox.right - srcBox.left, srcBox.bottom - srcBox.top, desc.Format };
 
             m_croppedBounds.left = 0;
             m_croppedBounds.top = 0;
@@ -287,18 +585,17 @@ public:
             m_croppedBounds.bottom = srcBox.bottom - srcBox.top;
             m_captureBounds = m_croppedBounds;
 
-            winrt::com_ptr<ID3D11Texture2D> croppedTexture;
-            int hr = m_d3dDevice->CreateTexture2D(&desc, NULL, croppedTexture.put());
-            debug_hresult(L"CreateTexture2D", hr, true);
-
-            winrt::com_ptr<ID3D11DeviceContext> immediate;
-            m_d3dDevice->GetImmediateContext(immediate.put());
-            immediate->CopySubresourceRegion(croppedTexture.get(), 0, 0, 0, 0, sourceTexture.get(), 0, &srcBox);
-
-            {
-                std::scoped_lock lock(frame_mutex);
-                m_d3dCurrentFrame = croppedTexture;
-                m_frameTime = frameTime;
+            auto croppedTexture = m_texturePool->Acquire(key);
+            if (croppedTexture != nullptr) {
+                {
+                    UTIL_TRACE_SCOPE("CropCopy");
+                    m_d3dContext->CopySubresourceRegion(croppedTexture.get(), 0, 0, 0, 0, sourceTexture.get(), 0, &srcBox);
+                }
+                m_frames.Publish(croppedTexture, frameTime);
+            }
+            else if (regionPlan->copies.empty()) {
+                // every texture is still held by a reader, drop this frame rather than grow the pool.
+                return;
             }
         }
 
@@ -400,77 +697,91 @@ public:
         }
     }
 
-    void ReadPixels(ID3D11Texture2D* texture, char* buffer, unsigned int size) {
-        // Copy GPU Resource to CPU
-        D3D11_TEXTURE2D_DESC desc{};
-        winrt::com_ptr<ID3D11Texture2D> copiedImage;
-
-        texture->GetDesc(&desc);
-        if (desc.SampleDesc.Count != 1) {
-            throw std::exception("SampleDesc.Count != 1\n");
-        }
-        if (desc.MipLevels != 1) {
-            throw std::exception("MipLevels != 1\n");
-        }
-        if (desc.ArraySize != 1) {
-            throw std::exception("ArraySize != 1\n");
-        }
-
-        desc.Usage = D3D11_USAGE_STAGING; // A resource that supports data transfer (copy) from the GPU to the CPU.
-        desc.BindFlags = 0;
-        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-        if (desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM) {
-            throw std::exception("Format != DXGI_FORMAT_B8G8R8A8_UNORM\n");
+    // Copies just the regions out of the captured surface into one atlas texture, so reading any
+    // number of regions reads back only their pixels.
+    void PublishRegions(const std::shared_ptr<const util::RegionPlan>& plan, ID3D11Texture2D* surface,
+        int32_t width, int32_t height, DXGI_FORMAT format, double frameTime)
+    {
+        UTIL_TRACE_SCOPE("RegionCopy");
+        TextureKey key = { (UINT)plan->width, (UINT)plan->height, format };
+        auto atlas = m_texturePool->Acquire(key);
+        if (atlas == nullptr) {
+            // every texture is still held by a reader, drop this frame rather than grow the pool.
+            return;
         }
-
-        HRESULT hr = m_d3dDevice->CreateTexture2D(&desc, NULL, copiedImage.put());
-        if (hr != S_OK) {
-            debug_hresult(L"failed to create texture", hr, true);
+        for (auto& copy : plan->copies) {
+            int32_t left = m_bounds.left + copy.source.left;
+            int32_t top = m_bounds.top + copy.source.top;
+            D3D11_BOX box = {
+                (UINT)Clamp(left, 0, width),
+                (UINT)Clamp(top, 0, height),
+                0,
+                (UINT)Clamp(m_bounds.left + copy.source.right, 0, width),
+                (UINT)Clamp(m_bounds.top + copy.source.bottom, 0, height),
+                1
+            };
+            if (box.right > box.left && box.bottom > box.top) {
+                // if the surface shrank the box may be clipped, keep the pixels where the plan expects them.
+                UINT x = (UINT)(copy.x + ((int32_t)box.left - left));
+                UINT y = (UINT)(copy.y + ((int32_t)box.top - top));
+                m_d3dContext->CopySubresourceRegion(atlas.get(), 0, x, y, 0, surface, 0, &box);
+            }
         }
+        m_regionFrames.Publish({ atlas, plan }, frameTime);
+    }
 
-        // Copy the image out of the backbuffer.
-        m_d3dContext->CopyResource(copiedImage.get(), texture);
-
-        D3D11_MAPPED_SUBRESOURCE resource{};
-        UINT subresource = D3D11CalcSubresource(0 /* slice */, 0 /* array slice */, 1 /* mip levels */); //  desc.MipLevels);
-        m_d3dContext->ResolveSubresource(copiedImage.get(), subresource, texture, subresource, desc.Format);
-        hr = m_d3dContext->Map(copiedImage.get(), subresource, D3D11_MAP_READ, 0, &resource);
-        if (hr != S_OK) {
-            debug_hresult(L"failed to map texture", hr, true);
-        }
+    void ReadPixels(ID3D11Texture2D* texture, char* buffer, unsigned int size) {
+        // Copy GPU Resource to CPU, reusing the same staging texture each time.
+        std::scoped_lock lock(m_pixelsMutex);
+        uint64_t sequence = 0;
+        double frameTime = 0;
+        m_pixelsRing->Submit(texture, 0, 0);
+        m_pixelsRing->Read(reinterpret_cast<uint8_t*>(buffer), size, sequence, frameTime);
+    }
 
+    void CopyMappedPixels(const D3D11_MAPPED_SUBRESOURCE& resource, const D3D11_TEXTURE2D_DESC& desc, uint8_t* buffer, unsigned int size, const ReadbackOutput* output) {
         UINT rowPitch = resource.RowPitch;
         unsigned int captureSize = rowPitch * desc.Height;
 
         if (m_saveBitmap) {
-            SaveBitmap(reinterpret_cast<UCHAR*>(resource.pData), desc, rowPitch);
+            D3D11_TEXTURE2D_DESC copy = desc;
+            SaveBitmap(reinterpret_cast<UCHAR*>(resource.pData), copy, rowPitch);
         }
 
-        int x = m_croppedBounds.left;
-        int y = m_croppedBounds.top;
         int w = (m_croppedBounds.right - m_croppedBounds.left);
-        int h = m_croppedBounds.bottom - m_croppedBounds.top;
         if (rowPitch != w * 4)
         {
-            // ResolveSubresource returns a buffer that is 8 byte aligned (64 bit).
+            // Map returns rows that are 8 byte aligned (64 bit).
             // Record this in the m_captureBounds so the caller can adjust their buffer accordingly.
             m_captureBounds.right = rowPitch / 4;
         }
 
-        if (buffer) {
-            char* ptr = buffer;
-            char* src = reinterpret_cast<char*>(resource.pData);
-            ::memcpy(ptr, src, min(size, captureSize));
+        if (buffer && output) {
+            UTIL_TRACE_SCOPE("ConvertPixels");
+            // tightly packed (or caller strided) rows straight from the mapped texture, ReadNextFrame
+            // already checked the buffer is big enough.
+            const uint8_t* pixels = reinterpret_cast<const uint8_t*>(resource.pData);
+            int width = static_cast<int>(desc.Width);
+            int height = static_cast<int>(desc.Height);
+            if (m_resize.width > 0 && m_resize.height > 0) {
+                int stride = output->stride ? output->stride : m_resize.width * util::BytesPerPixel(output->format);
+                util::ResizeBgra(pixels, static_cast<int>(rowPitch), width, height, buffer, stride,
+                    m_resize.width, m_resize.height, output->format, m_resize.filter, m_resize.threads);
+            }
+            else {
+                int stride = output->stride ? output->stride : width * util::BytesPerPixel(output->format);
+                util::ConvertBgra(pixels, static_cast<int>(rowPitch), width, height, buffer, stride, output->format);
+            }
+        }
+        else if (buffer) {
+            ::memcpy(buffer, resource.pData, std::min(size, captureSize));
         }
-
-        m_d3dContext->Unmap(copiedImage.get(), subresource);
     }
 };
 
 ScreenCapture::ScreenCapture()
 {
 	m_pimpl = std::make_unique<SimpleCaptureImpl>();
-    InitializeCriticalSection(&m_mutex);
 }
 
 ScreenCapture::~ScreenCapture()
@@ -490,7 +801,26 @@ RECT ScreenCapture::GetTextureBounds()
 
 std::vector<double> ScreenCapture::GetCaptureTimes()
 {
-    return m_pimpl->m_arrivalTimes;
+    std::vector<double> times(m_pimpl->m_arrivalTimes.Copy(nullptr, 0));
+    // more frames may have arrived since, we still only copy as many as we made room for, and
+    // fewer if the new ones overwrote some of them.
+    times.resize(m_pimpl->m_arrivalTimes.Copy(times.data(), times.size()));
+    return times;
+}
+
+unsigned int ScreenCapture::ReadCaptureTimes(uint64_t& cursor, double* buffer, unsigned int size)
+{
+    return static_cast<unsigned int>(m_pimpl->m_arrivalTimes.Read(cursor, buffer, size));
+}
+
+util::TimingSummary ScreenCapture::GetCaptureTimingSummary()
+{
+    return m_pimpl->m_arrivalTimes.Summary();
+}
+
+int64_t ScreenCapture::GetLastArrival()
+{
+    return m_pimpl->m_lastArrival.load(std::memory_order_relaxed);
 }
 
 void ScreenCapture::ReadPixels(ID3D11Texture2D* texture, char* buffer, unsigned int size)
@@ -515,10 +845,54 @@ bool ScreenCapture::WaitForNextFrame(uint32_t timeout)
 
 double ScreenCapture::ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size)
 {
-	return m_pimpl->ReadNextFrame(timeout, buffer, size);
+	return m_pimpl->ReadNextFrame(timeout, buffer, size, nullptr);
+}
+
+double ScreenCapture::ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size, const ReadbackOutput& output)
+{
+	return m_pimpl->ReadNextFrame(timeout, buffer, size, &output);
 }
 
-double ScreenCapture::ReadNextTexture(uint32_t timeout, winrt::com_ptr<ID3D11Texture2D>& result)
+double ScreenCapture::ReadNextTexture(uint32_t timeout, std::shared_ptr<ID3D11Texture2D>& result)
 {
 	return m_pimpl->ReadNextTexture(timeout, result);
-}
\ No newline at end of file
+}
+
+double ScreenCapture::ReadLatestTexture(std::shared_ptr<ID3D11Texture2D>& result)
+{
+	return m_pimpl->ReadLatestTexture(result);
+}
+void ScreenCapture::SetMaxTextures(unsigned int maxTextures)
+{
+    m_pimpl->SetMaxTextures(maxTextures);
+}
+
+int ScreenCapture::AddRegion(const util::RegionSpec& spec)
+{
+    return m_pimpl->AddRegion(spec);
+}
+
+bool ScreenCapture::RemoveRegion(int id)
+{
+    return m_pimpl->RemoveRegion(id);
+}
+
+double ScreenCapture::ReadRegion(int id, uint32_t timeout, char* buffer, unsigned int size, int stride)
+{
+    return m_pimpl->ReadRegion(id, timeout, buffer, size, stride);
+}
+
+void ScreenCapture::SetOutputSize(const ResizeSettings& settings)
+{
+    m_pimpl->SetOutputSize(settings);
+}
+
+void ScreenCapture::SetReadbackLatency(unsigned int frames)
+{
+    m_pimpl->SetReadbackLatency(frames);
+}
+
+uint64_t ScreenCapture::GetFrameSequence()
+{
+    return m_pimpl->GetLastReadSequence();
+}
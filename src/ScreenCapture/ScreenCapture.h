@@ -1,8 +1,24 @@
 #pragma once
 #include <mutex>
+#include "RegionPlan.h"
+#include "TimingLog.h"
 
 class SimpleCaptureImpl;
 
+struct ReadbackOutput
+{
+    util::PixelFormat format = util::PixelFormat::Bgra;
+    int stride = 0; // bytes per row in the destination, 0 means tightly packed.
+};
+
+struct ResizeSettings
+{
+    int width = 0; // 0 means no resizing.
+    int height = 0;
+    util::ResizeFilter filter = util::ResizeFilter::Box;
+    int threads = 1;
+};
+
 class ScreenCapture
 {
 public:
@@ -26,11 +42,59 @@ public:
 
     __declspec(dllexport) double ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size);
 
+    // Same as above but writes the frame in the given pixel format and stride with no row pitch
+    // padding, converting straight from the mapped texture.  The frame is GetTextureBounds() in size.
+    __declspec(dllexport) double ReadNextFrame(uint32_t timeout, char* buffer, unsigned int size, const ReadbackOutput& output);
+
+    // Makes the ReadbackOutput version of ReadNextFrame scale frames to the given size as part of
+    // the format conversion, a width or height of 0 turns it off.
+    __declspec(dllexport) void SetOutputSize(const ResizeSettings& settings);
+
+    // Regions of interest (in capture coordinates) served from this one capture session. Each frame
+    // the regions are copied into one atlas texture that is read back once however many regions are
+    // read, and ReadNextFrame, ReadNextTexture and the encoders still get the full frame.
+    // AddRegion returns 0 if the region is outside the capture.
+    __declspec(dllexport) int AddRegion(const util::RegionSpec& spec);
+    __declspec(dllexport) bool RemoveRegion(int id);
+    // Writes the latest frame of the region in its output size and format, stride 0 means tightly
+    // packed. Returns the frame time, or 0 on timeout.
+    __declspec(dllexport) double ReadRegion(int id, uint32_t timeout, char* buffer, unsigned int size, int stride);
+
     __declspec(dllexport) RECT GetTextureBounds();
-    __declspec(dllexport) double ReadNextTexture(uint32_t timeout, winrt::com_ptr<ID3D11Texture2D>& result);
+    // The texture comes from a pool and is reused for a later frame once every reference to it is
+    // released, so hold on to it for as long as something (like an encoder) still reads from it.
+    __declspec(dllexport) double ReadNextTexture(uint32_t timeout, std::shared_ptr<ID3D11Texture2D>& result);
 
+    // The newest texture without waiting, even if it was read before. Returns its frame time, or -1
+    // if no frame has arrived yet. Together with WaitForNextFrame this waits for a frame with a
+    // timeout that is not an error.
+    __declspec(dllexport) double ReadLatestTexture(std::shared_ptr<ID3D11Texture2D>& result);
+
+    // How many captured textures can be held by readers at once before new frames are dropped.
+    __declspec(dllexport) void SetMaxTextures(unsigned int maxTextures);
+
+    // With a latency of N, ReadNextFrame keeps the GPU copies of the N newest frames in flight and
+    // returns the frame N captures behind them, so it doesn't wait on each copy. 0 (the default)
+    // copies and returns the latest frame.
+    __declspec(dllexport) void SetReadbackLatency(unsigned int frames);
+
+    // The capture sequence number of the frame last returned by ReadNextFrame.
+    __declspec(dllexport) uint64_t GetFrameSequence();
+
+    // Arrival times of the most recent frames (up to util::TimingRing::DefaultCapacity of them).
     __declspec(dllexport) std::vector<double> GetCaptureTimes();
 
+    // Copies the arrival times after cursor and moves it past them, so polling only copies what
+    // is new. Start with a cursor of 0.
+    __declspec(dllexport) unsigned int ReadCaptureTimes(uint64_t& cursor, double* buffer, unsigned int size);
+
+    // Frame count and frame interval statistics since the capture started.
+    __declspec(dllexport) util::TimingSummary GetCaptureTimingSummary();
+
+    // When the newest frame arrived in util::Clock nanoseconds, 0 before the first. FpsThrottle::AlignTo
+    // takes this.
+    __declspec(dllexport) int64_t GetLastArrival();
+
     // C++ only interface.
     void ReadPixels(ID3D11Texture2D* texture, char* buffer, unsigned int size);
 
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <stdio.h>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <filesystem>
 
 #include <winrt/Windows.Graphics.Capture.h>
 #include <windows.graphics.capture.interop.h>
@@ -15,7 +19,11 @@
 #include "ScreenCapture.h"
 #include "VideoEncoder.h"
 #include "Timer.h"
+#include "FpsThrottle.h"
+#include "FrameBuffers.h"
+#include "Clock.h"
 #include "Errors.h"
+#include "Trace.h"
 #undef min
 
 namespace winrt
@@ -87,7 +95,10 @@ inline auto CreateDirect3DDevice(IDXGIDevice* dxgi_device)
 
 std::mutex m_list_lock;
 std::vector<std::shared_ptr<ScreenCapture>> m_captures;
-util::Timer m_timer;
+// SleepMicroseconds can be called from any number of threads, each gets its own waitable timer and
+// learns its own overshoots.
+thread_local util::Timer m_timer;
+std::atomic<int> m_sleepPolicy{ static_cast<int>(util::SleepPolicy::Balanced) };
 
 std::shared_ptr<ScreenCapture> get_capture(unsigned int h)
 {
@@ -121,6 +132,18 @@ std::shared_ptr<ScreenCapture> remove_capture(unsigned int h)
     return ptr;
 }
 
+static void copy_timing_stats(const util::TimingSummary& summary, FrameTimingStats* stats)
+{
+    stats->count = summary.count;
+    stats->first = summary.first;
+    stats->last = summary.last;
+    stats->meanGap = summary.meanGap;
+    stats->p50Gap = summary.p50Gap;
+    stats->p95Gap = summary.p95Gap;
+    stats->p99Gap = summary.p99Gap;
+    stats->maxGap = summary.maxGap;
+}
+
 unsigned int add_capture(std::shared_ptr<ScreenCapture> capture)
 {
     std::scoped_lock lock(m_list_lock);
@@ -135,19 +158,198 @@ unsigned int add_capture(std::shared_ptr<ScreenCapture> capture)
     return (int)(m_captures.size() - 1);
 }
 
-VideoEncoder encoder; // PS: this means we can only do one at a time
+// One recording started by EncodeVideo. Each has its own encoder and thread, so any number can
+// run at once, the only thing they share is the capture they read from.
+struct EncoderSession
+{
+    std::shared_ptr<ScreenCapture> capture;
+    VideoEncoder encoder;
+    VideoEncoderProperties properties{};
+    std::string encoderOptions; // what properties.encoderOptions points to.
+    std::wstring path;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    int result = 0;
+
+    // Sessions that were never closed are destroyed with m_encoders when the process exits, a
+    // joinable thread would call std::terminate there. The thread holds a reference too, so if it
+    // drops the last one it only has to let go of itself.
+    ~EncoderSession()
+    {
+        if (thread.joinable()) {
+            if (thread.get_id() == std::this_thread::get_id()) {
+                thread.detach();
+            }
+            else {
+                encoder.Stop();
+                thread.join();
+            }
+        }
+    }
+
+    void Run()
+    {
+        winrt::init_apartment(winrt::apartment_type::multi_threaded);
+        int rc = 0;
+        try {
+            rc = encoder.EncodeAsync(capture, &properties, path).get();
+        }
+        catch (winrt::hresult_error const& ex) {
+            rc = (int)(ex.code());
+        }
+        winrt::uninit_apartment();
+        std::scoped_lock lock(mutex);
+        result = rc;
+        done = true;
+        finished.notify_all();
+    }
+
+    int Wait()
+    {
+        std::unique_lock lock(mutex);
+        finished.wait(lock, [this] { return done; });
+        return result;
+    }
+
+    bool IsDone()
+    {
+        std::scoped_lock lock(mutex);
+        return done;
+    }
+};
+
+// Encoder ids are the index + 1 so that 0 can mean no encoder.
+std::vector<std::shared_ptr<EncoderSession>> m_encoders;
+
+const int ERROR_INVALID_ENCODER = -1;
+
+std::shared_ptr<EncoderSession> get_encoder(unsigned int id)
+{
+    std::shared_ptr<EncoderSession> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_encoders.size()) {
+        ptr = m_encoders[id - 1];
+    }
+    return ptr;
+}
+
+// Starts the session on its own thread and returns its id, or 0 if another encoder is still
+// recording the same capture, they would steal each other's frames.
+unsigned int start_encoder(std::shared_ptr<EncoderSession> session)
+{
+    std::scoped_lock lock(m_list_lock);
+    for (auto& other : m_encoders) {
+        if (other != nullptr && other->capture == session->capture && !other->IsDone()) {
+            return 0;
+        }
+    }
+    // started under the lock so that CloseEncoder always finds a thread to join.
+    session->thread = std::thread([session]() { session->Run(); });
+    for (int i = 0; i < m_encoders.size(); i++) {
+        if (m_encoders[i] == nullptr) {
+            m_encoders[i] = session;
+            return i + 1;
+        }
+    }
+    m_encoders.push_back(session);
+    return (unsigned int)m_encoders.size();
+}
+
+std::shared_ptr<EncoderSession> remove_encoder(unsigned int id)
+{
+    std::shared_ptr<EncoderSession> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_encoders.size()) {
+        ptr = m_encoders[id - 1];
+        m_encoders[id - 1] = nullptr;
+        while (m_encoders.size() > 0 && m_encoders.back() == nullptr) {
+            m_encoders.pop_back();
+        }
+    }
+    return ptr;
+}
+
+// Throttle ids are the index + 1 like encoder ids.
+std::vector<std::shared_ptr<util::FpsThrottle>> m_throttles;
 
-const int ERROR_ENCODER_BUSY = -1;
+std::shared_ptr<util::FpsThrottle> get_throttle(unsigned int id)
+{
+    std::shared_ptr<util::FpsThrottle> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_throttles.size()) {
+        ptr = m_throttles[id - 1];
+    }
+    return ptr;
+}
 
-static winrt::Windows::Foundation::IAsyncOperation<int> RunEncodeVideo(std::shared_ptr<ScreenCapture> capture, const WCHAR* fullPath, VideoEncoderProperties* properties)
+unsigned int add_throttle(std::shared_ptr<util::FpsThrottle> throttle)
 {
-    if (encoder.IsRunning()) {
-        co_return ERROR_ENCODER_BUSY;
+    std::scoped_lock lock(m_list_lock);
+    for (int i = 0; i < m_throttles.size(); i++) {
+        if (m_throttles[i] == nullptr) {
+            m_throttles[i] = throttle;
+            return i + 1;
+        }
     }
+    m_throttles.push_back(throttle);
+    return (unsigned int)m_throttles.size();
+}
 
-    auto result = encoder.EncodeAsync(capture, properties, fullPath);
-    auto rc = co_await result;
-    co_return rc;
+std::shared_ptr<util::FpsThrottle> remove_throttle(unsigned int id)
+{
+    std::shared_ptr<util::FpsThrottle> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_throttles.size()) {
+        ptr = m_throttles[id - 1];
+        m_throttles[id - 1] = nullptr;
+        while (m_throttles.size() > 0 && m_throttles.back() == nullptr) {
+            m_throttles.pop_back();
+        }
+    }
+    return ptr;
+}
+
+// Frame pool ids are the index + 1 too. A closed pool stays in the list until its last buffer is
+// returned, since python may still be reading it.
+std::vector<std::shared_ptr<util::FrameBufferLender>> m_framePools;
+
+std::shared_ptr<util::FrameBufferLender> get_frame_pool(unsigned int id)
+{
+    std::shared_ptr<util::FrameBufferLender> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_framePools.size()) {
+        ptr = m_framePools[id - 1];
+    }
+    return ptr;
+}
+
+unsigned int add_frame_pool(std::shared_ptr<util::FrameBufferLender> pool)
+{
+    std::scoped_lock lock(m_list_lock);
+    for (int i = 0; i < m_framePools.size(); i++) {
+        if (m_framePools[i] == nullptr) {
+            m_framePools[i] = pool;
+            return i + 1;
+        }
+    }
+    m_framePools.push_back(pool);
+    return (unsigned int)m_framePools.size();
+}
+
+// Frees the pool if it is closed and all its buffers are back.
+void remove_frame_pool_if_done(unsigned int id)
+{
+    std::shared_ptr<util::FrameBufferLender> ptr;
+    std::scoped_lock lock(m_list_lock);
+    if (id > 0 && id <= m_framePools.size() && m_framePools[id - 1] != nullptr && m_framePools[id - 1]->Done()) {
+        ptr = m_framePools[id - 1];
+        m_framePools[id - 1] = nullptr;
+        while (m_framePools.size() > 0 && m_framePools.back() == nullptr) {
+            m_framePools.pop_back();
+        }
+    }
 }
 
 extern "C" {
@@ -165,6 +367,88 @@ extern "C" {
         return 0;
     }
 
+    double __declspec(dllexport) __stdcall ReadNextFrameEx(unsigned int h, char* buffer, unsigned int size, int format, unsigned int stride)
+    {
+        if (!util::IsValidPixelFormat(format)) {
+            debug_hresult(L"ReadNextFrameEx: unknown pixel format", E_INVALIDARG, false);
+            return 0;
+        }
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            ReadbackOutput output;
+            output.format = static_cast<util::PixelFormat>(format);
+            output.stride = static_cast<int>(stride);
+            try {
+                return ptr->ReadNextFrame(10000, buffer, size, output);
+            }
+            catch (winrt::hresult_error const&) {
+                // already reported, 0 means no frame was read.
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    void __declspec(dllexport) __stdcall SetOutputSize(unsigned int h, unsigned int width, unsigned int height, int filter, unsigned int threads)
+    {
+        if (!util::IsValidResizeFilter(filter)) {
+            debug_hresult(L"SetOutputSize: unknown resize filter", E_INVALIDARG, false);
+            return;
+        }
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            ResizeSettings settings;
+            settings.width = static_cast<int>(width);
+            settings.height = static_cast<int>(height);
+            settings.filter = static_cast<util::ResizeFilter>(filter);
+            settings.threads = std::max(1, static_cast<int>(threads));
+            ptr->SetOutputSize(settings);
+        }
+    }
+
+    unsigned int __declspec(dllexport) __stdcall AddRegion(unsigned int h, int x, int y, int width, int height,
+        unsigned int outputWidth, unsigned int outputHeight, int format, int filter)
+    {
+        if (!util::IsValidPixelFormat(format) || !util::IsValidResizeFilter(filter)) {
+            debug_hresult(L"AddRegion: unknown pixel format or resize filter", E_INVALIDARG, false);
+            return 0;
+        }
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            util::RegionSpec spec;
+            spec.bounds = { x, y, x + width, y + height };
+            spec.outputWidth = static_cast<int>(outputWidth);
+            spec.outputHeight = static_cast<int>(outputHeight);
+            spec.format = static_cast<util::PixelFormat>(format);
+            spec.filter = static_cast<util::ResizeFilter>(filter);
+            return static_cast<unsigned int>(ptr->AddRegion(spec));
+        }
+        return 0;
+    }
+
+    void __declspec(dllexport) __stdcall RemoveRegion(unsigned int h, unsigned int region)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            ptr->RemoveRegion(static_cast<int>(region));
+        }
+    }
+
+    double __declspec(dllexport) __stdcall ReadRegion(unsigned int h, unsigned int region, char* buffer, unsigned int size, unsigned int stride)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            try {
+                return ptr->ReadRegion(static_cast<int>(region), 10000, buffer, size, static_cast<int>(stride));
+            }
+            catch (winrt::hresult_error const&) {
+                // already reported, 0 means no frame was read.
+                return 0;
+            }
+        }
+        return 0;
+    }
+
     bool  __declspec(dllexport) __stdcall WaitForNextFrame(unsigned int h, int timeout)
     {
         std::shared_ptr<ScreenCapture> ptr = get_capture(h);
@@ -174,6 +458,31 @@ extern "C" {
         return false;
     }
 
+    void __declspec(dllexport) __stdcall SetMaxTextures(unsigned int h, unsigned int maxTextures)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            ptr->SetMaxTextures(maxTextures);
+        }
+    }
+
+    void __declspec(dllexport) __stdcall SetReadbackLatency(unsigned int h, unsigned int frames)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            ptr->SetReadbackLatency(frames);
+        }
+    }
+
+    unsigned long long __declspec(dllexport) __stdcall GetFrameSequence(unsigned int h)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(h);
+        if (ptr != nullptr) {
+            return ptr->GetFrameSequence();
+        }
+        return 0;
+    }
+
     RECT  __declspec(dllexport) __stdcall GetCaptureBounds(unsigned int h)
     {
         std::shared_ptr<ScreenCapture> ptr = get_capture(h);
@@ -221,26 +530,81 @@ extern "C" {
         return -1;
     }
 
-    int __declspec(dllexport) __stdcall  EncodeVideo(unsigned int captureHandle, const WCHAR* fullPath, VideoEncoderProperties* properties)
+    unsigned int __declspec(dllexport) __stdcall  EncodeVideo(unsigned int captureHandle, const WCHAR* fullPath, VideoEncoderProperties* properties)
     {
-        int rc = 0;
-        std::wstring saved(fullPath);
         std::shared_ptr<ScreenCapture> ptr = get_capture(captureHandle);
-        if (ptr != nullptr) {
-            rc = RunEncodeVideo(ptr, saved.c_str(), properties).get();
+        if (ptr == nullptr) {
+            return 0;
+        }
+        auto session = std::make_shared<EncoderSession>();
+        session->capture = ptr;
+        session->path = fullPath != nullptr ? fullPath : L"";
+        session->encoder.Configure(properties);
+        session->properties = *properties;
+        if (properties->encoderOptions != nullptr) {
+            // the caller's string is only valid during this call.
+            session->encoderOptions = properties->encoderOptions;
+            session->properties.encoderOptions = session->encoderOptions.c_str();
+        }
+        unsigned int id = start_encoder(session);
+        if (id == 0) {
+            debug_hresult(L"EncodeVideo: the capture is already being encoded", E_INVALIDARG, false);
         }
-        return rc;
+        return id;
     }
 
-    int __declspec(dllexport) __stdcall WINAPI StopEncoding()
+    int __declspec(dllexport) __stdcall WaitForEncoder(unsigned int id)
     {
-        encoder.Stop();
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session == nullptr) {
+            return ERROR_INVALID_ENCODER;
+        }
+        return session->Wait();
+    }
+
+    bool __declspec(dllexport) __stdcall IsEncoding(unsigned int id)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        return session != nullptr && !session->IsDone();
+    }
+
+    int __declspec(dllexport) __stdcall WINAPI StopEncoding(unsigned int id)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session == nullptr) {
+            return ERROR_INVALID_ENCODER;
+        }
+        session->encoder.Stop();
         return 0;
     }
 
-    unsigned int __declspec(dllexport) __stdcall  WINAPI GetSampleTimes(double* buffer, unsigned int size)
+    int __declspec(dllexport) __stdcall SaveReplay(unsigned int id, const WCHAR* fullPath)
     {
-        return encoder.GetSampleTimes(buffer, size);
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session == nullptr) {
+            return ERROR_INVALID_ENCODER;
+        }
+        return session->encoder.SaveReplay(fullPath);
+    }
+
+    void __declspec(dllexport) __stdcall CloseEncoder(unsigned int id)
+    {
+        std::shared_ptr<EncoderSession> session = remove_encoder(id);
+        if (session != nullptr) {
+            session->encoder.Stop();
+            if (session->thread.joinable()) {
+                session->thread.join();
+            }
+        }
+    }
+
+    unsigned int __declspec(dllexport) __stdcall  WINAPI GetSampleTimes(unsigned int id, double* buffer, unsigned int size)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session != nullptr) {
+            return session->encoder.GetSampleTimes(buffer, size);
+        }
+        return 0;
     }
 
     unsigned int __declspec(dllexport) __stdcall WINAPI GetCaptureTimes(unsigned int captureHandle, double* buffer, unsigned int size)
@@ -252,23 +616,237 @@ extern "C" {
             if (buffer != nullptr && available > 0) {
                 auto count = std::min(available, size);
                 ::memcpy(buffer, arrivals.data(), count * sizeof(double));
+                return count;
             }
             return available;
         }
         return 0;
     }
 
+    unsigned int __declspec(dllexport) WINAPI ReadSampleTimes(unsigned int id, unsigned long long* cursor, double* buffer, unsigned int size)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session != nullptr && cursor != nullptr) {
+            uint64_t position = *cursor;
+            auto count = session->encoder.ReadSampleTimes(position, buffer, size);
+            *cursor = position;
+            return count;
+        }
+        return 0;
+    }
+
+    unsigned int __declspec(dllexport) WINAPI ReadCaptureTimes(unsigned int captureHandle, unsigned long long* cursor, double* buffer, unsigned int size)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(captureHandle);
+        if (ptr != nullptr && cursor != nullptr) {
+            uint64_t position = *cursor;
+            auto count = ptr->ReadCaptureTimes(position, buffer, size);
+            *cursor = position;
+            return count;
+        }
+        return 0;
+    }
+
+    bool __declspec(dllexport) WINAPI GetSampleTimingStats(unsigned int id, FrameTimingStats* stats)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session == nullptr) {
+            return false;
+        }
+        copy_timing_stats(session->encoder.GetSampleTimingSummary(), stats);
+        return true;
+    }
+
+    bool __declspec(dllexport) WINAPI GetCaptureTimingStats(unsigned int captureHandle, FrameTimingStats* stats)
+    {
+        std::shared_ptr<ScreenCapture> ptr = get_capture(captureHandle);
+        if (ptr == nullptr) {
+            return false;
+        }
+        copy_timing_stats(ptr->GetCaptureTimingSummary(), stats);
+        return true;
+    }
+
+    unsigned int __declspec(dllexport) WINAPI GetEncoderAdjustments(unsigned int id, EncoderAdjustment* buffer, unsigned int size)
+    {
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (session == nullptr) {
+            return 0;
+        }
+        auto adjustments = session->encoder.GetLoadAdjustments();
+        for (unsigned int i = 0; buffer != nullptr && i < size && i < adjustments.size(); i++) {
+            buffer[i].time = adjustments[i].time;
+            buffer[i].frameRate = adjustments[i].frameRate;
+            buffer[i].load = adjustments[i].load;
+        }
+        return static_cast<unsigned int>(adjustments.size());
+    }
+
     void __declspec(dllexport) WINAPI SleepMicroseconds(uint64_t microseconds)
     {
+        m_timer.SetPolicy(static_cast<util::SleepPolicy>(m_sleepPolicy.load()));
         m_timer.Sleep(microseconds);
     }
 
-    LPCSTR __declspec(dllexport) WINAPI GetErrorMessage(int hr)
+    void __declspec(dllexport) WINAPI SetSleepPolicy(int policy)
+    {
+        if (policy >= static_cast<int>(util::SleepPolicy::Precise) && policy <= static_cast<int>(util::SleepPolicy::LowPower)) {
+            m_sleepPolicy = policy;
+        }
+    }
+
+    bool __declspec(dllexport) WINAPI SetClockSource(int source, unsigned int calibrationMilliseconds)
+    {
+        if (source == static_cast<int>(util::ClockSource::Tsc)) {
+            return util::Clock::UseTsc(util::Clock::Calibrate(std::chrono::milliseconds(calibrationMilliseconds)));
+        }
+        util::Clock::UseSteady();
+        return true;
+    }
+
+    unsigned int __declspec(dllexport) WINAPI CreateThrottle(double fps, int catchUp)
+    {
+        if (!(fps > 0) || catchUp < static_cast<int>(util::CatchUpPolicy::Burst) || catchUp > static_cast<int>(util::CatchUpPolicy::Reanchor)) {
+            return 0;
+        }
+        auto throttle = std::make_shared<util::FpsThrottle>(fps, static_cast<util::CatchUpPolicy>(catchUp));
+        throttle->SetSleepPolicy(static_cast<util::SleepPolicy>(m_sleepPolicy.load()));
+        return add_throttle(throttle);
+    }
+
+    double __declspec(dllexport) WINAPI ThrottleStep(unsigned int id)
+    {
+        std::shared_ptr<util::FpsThrottle> throttle = get_throttle(id);
+        if (throttle == nullptr) {
+            return -1;
+        }
+        return throttle->Step();
+    }
+
+    void __declspec(dllexport) WINAPI ResetThrottle(unsigned int id)
+    {
+        std::shared_ptr<util::FpsThrottle> throttle = get_throttle(id);
+        if (throttle != nullptr) {
+            throttle->Reset();
+        }
+    }
+
+    void __declspec(dllexport) WINAPI AlignThrottle(unsigned int id, unsigned int captureHandle)
+    {
+        std::shared_ptr<util::FpsThrottle> throttle = get_throttle(id);
+        std::shared_ptr<ScreenCapture> capture = get_capture(captureHandle);
+        if (throttle != nullptr && capture != nullptr) {
+            throttle->AlignTo(capture->GetLastArrival());
+        }
+    }
+
+    bool __declspec(dllexport) WINAPI GetThrottleStats(unsigned int id, ThrottleStats* stats)
+    {
+        std::shared_ptr<util::FpsThrottle> throttle = get_throttle(id);
+        if (throttle == nullptr || stats == nullptr) {
+            return false;
+        }
+        util::ThrottleStats summary = throttle->Stats();
+        stats->steps = summary.steps;
+        stats->missed = summary.missed;
+        stats->p50 = summary.p50;
+        stats->p90 = summary.p90;
+        stats->p99 = summary.p99;
+        stats->p999 = summary.p999;
+        stats->max = summary.max;
+        return true;
+    }
+
+    unsigned int __declspec(dllexport) WINAPI GetThrottleHistogram(unsigned int id, double* seconds, unsigned long long* counts, unsigned int size)
+    {
+        std::shared_ptr<util::FpsThrottle> throttle = get_throttle(id);
+        if (throttle == nullptr) {
+            return 0;
+        }
+        if (seconds == nullptr || counts == nullptr) {
+            size = 0;
+        }
+        static_assert(sizeof(unsigned long long) == sizeof(uint64_t));
+        return static_cast<unsigned int>(throttle->Histogram().Read(seconds, reinterpret_cast<uint64_t*>(counts), size));
+    }
+
+    void __declspec(dllexport) WINAPI CloseThrottle(unsigned int id)
+    {
+        remove_throttle(id);
+    }
+
+    unsigned int __declspec(dllexport) WINAPI CreateFramePool(unsigned int alignment, unsigned int maxBuffers)
+    {
+        if (alignment == 0) {
+            alignment = 64;
+        }
+        if ((alignment & (alignment - 1)) != 0 || maxBuffers == 0) {
+            return 0;
+        }
+        return add_frame_pool(std::make_shared<util::FrameBufferLender>(alignment, maxBuffers));
+    }
+
+    void* __declspec(dllexport) WINAPI LendFrameBuffer(unsigned int id, unsigned long long size)
+    {
+        std::shared_ptr<util::FrameBufferLender> pool = get_frame_pool(id);
+        if (pool == nullptr || size == 0) {
+            return nullptr;
+        }
+        return pool->Lend(static_cast<size_t>(size));
+    }
+
+    bool __declspec(dllexport) WINAPI ReturnFrameBuffer(unsigned int id, void* buffer)
+    {
+        std::shared_ptr<util::FrameBufferLender> pool = get_frame_pool(id);
+        if (pool == nullptr || !pool->Return(buffer)) {
+            return false;
+        }
+        remove_frame_pool_if_done(id);
+        return true;
+    }
+
+    unsigned int __declspec(dllexport) WINAPI GetLentFrameBuffers(unsigned int id)
+    {
+        std::shared_ptr<util::FrameBufferLender> pool = get_frame_pool(id);
+        return pool != nullptr ? static_cast<unsigned int>(pool->Lent()) : 0;
+    }
+
+    void __declspec(dllexport) WINAPI CloseFramePool(unsigned int id)
+    {
+        std::shared_ptr<util::FrameBufferLender> pool = get_frame_pool(id);
+        if (pool != nullptr) {
+            pool->Close();
+            remove_frame_pool_if_done(id);
+        }
+    }
+
+    void __declspec(dllexport) WINAPI EnableTracing(bool enable)
+    {
+        util::Tracer::Instance().Enable(enable);
+    }
+
+    void __declspec(dllexport) WINAPI ClearTrace()
+    {
+        util::Tracer::Instance().Clear();
+    }
+
+    bool __declspec(dllexport) WINAPI SaveTrace(const WCHAR* filename)
+    {
+        std::ofstream out(std::filesystem::path(filename), std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        util::Tracer::Instance().WriteChromeJson(out);
+        return out.good();
+    }
+
+    LPCSTR __declspec(dllexport) WINAPI GetErrorMessage(unsigned int id, int hr)
     {
-        if (hr == ERROR_ENCODER_BUSY) {
-            return "Another encoder is running, you can encode one video at a time";
+        std::shared_ptr<EncoderSession> session = get_encoder(id);
+        if (hr == ERROR_INVALID_ENCODER || session == nullptr) {
+            return "Unknown encoder id";
         }
-        return encoder.GetErrorMessage(hr);
+        return session->encoder.GetErrorMessage(hr);
     }
 
 }
\ No newline at end of file
@@ -7,7 +7,37 @@ extern "C" {
     unsigned int __declspec(dllexport) WINAPI StartCapture(int x, int y, int width, int height, bool captureCursor);
     void __declspec(dllexport) WINAPI StopCapture(unsigned int handle);
     double __declspec(dllexport) WINAPI ReadNextFrame(unsigned int handle, char* buffer, unsigned int size);
+    const int PixelFormatBGRA = 0;
+    const int PixelFormatBGR = 1;
+    const int PixelFormatRGB = 2;
+    const int PixelFormatGRAY8 = 3;
+    // Reads the next frame as tightly packed pixels in one of the formats above, without the row
+    // pitch padding ReadNextFrame leaves in. stride is the bytes per row in buffer, 0 means
+    // width * bytes per pixel. Returns 0 if the buffer is too small.
+    double __declspec(dllexport) WINAPI ReadNextFrameEx(unsigned int handle, char* buffer, unsigned int size, int format, unsigned int stride);
+    const int ResizeFilterNearest = 0;
+    const int ResizeFilterBox = 1;
+    const int ResizeFilterBilinear = 2;
+    // Makes ReadNextFrameEx scale frames to width x height with one of the filters above while it
+    // converts them, using up to threads threads per frame. 0 x 0 turns this off again.
+    void __declspec(dllexport) WINAPI SetOutputSize(unsigned int handle, unsigned int width, unsigned int height, int filter, unsigned int threads);
+    // Adds a region of interest in capture coordinates that is read with ReadRegion, with its own
+    // output size (0 x 0 means unscaled), pixel format and resize filter. All regions of a capture
+    // share one copy and one readback per frame, and ReadNextFrame and EncodeVideo still get the
+    // full frame. Returns the region id, or 0 if it is outside the capture.
+    unsigned int __declspec(dllexport) WINAPI AddRegion(unsigned int handle, int x, int y, int width, int height,
+        unsigned int outputWidth, unsigned int outputHeight, int format, int filter);
+    void __declspec(dllexport) WINAPI RemoveRegion(unsigned int handle, unsigned int region);
+    double __declspec(dllexport) WINAPI ReadRegion(unsigned int handle, unsigned int region, char* buffer, unsigned int size, unsigned int stride);
     bool __declspec(dllexport)  WINAPI WaitForNextFrame(unsigned int handle, int timeout);
+    // Captured frames are copied into pooled textures, this limits how many can be in use at once
+    // (default 16), new frames are dropped while they are all held by readers or the encoder.
+    void __declspec(dllexport) WINAPI SetMaxTextures(unsigned int handle, unsigned int maxTextures);
+    // Lets ReadNextFrame return frames this many captures late so the GPU to CPU copies of the newer
+    // ones overlap with reading, 0 (the default) returns the latest frame.
+    void __declspec(dllexport) WINAPI SetReadbackLatency(unsigned int handle, unsigned int frames);
+    // The capture sequence number of the frame last returned by ReadNextFrame, starting at 1.
+    unsigned long long __declspec(dllexport) WINAPI GetFrameSequence(unsigned int handle);
 
     const int VideoEncodingQualityAuto = 0;
     const int VideoEncodingQualityHD1080p = 1;
@@ -27,13 +57,161 @@ extern "C" {
         unsigned int quality; // see above
         unsigned int seconds; // maximum length before encoding finishes or 0 for infinite.
         unsigned int ffmpeg; // 1=use ffmpeg, returns 0 if ffmpeg is not found.
+        unsigned int queueDepth; // ffmpeg only: frames in flight between the encoder stages, or 0 for the default (3).
+        unsigned int dropPolicy; // ffmpeg only: 0=capture waits for the encoder, 1=drop frames when the encoder falls behind.
+        unsigned int container; // ffmpeg only: see below.
+        unsigned int fragmentMilliseconds; // ffmpeg only: fragment length for the streaming containers, or 0 for the default (1000).
+        unsigned int replaySeconds; // ffmpeg only: keep this much in memory for SaveReplay instead of writing a file, 0 is off.
+        unsigned int replayMegabytes; // ffmpeg only: memory cap for the replay, or 0 for the default (256).
+        unsigned int segmentSeconds; // ffmpeg only: start a new file this often, or 0 for one file.
+        unsigned int segmentMegabytes; // ffmpeg only: start a new file once one is this big, or 0 for no limit.
+        unsigned int profile; // ffmpeg only: see below.
+        const char* encoderOptions; // ffmpeg only: null or "key=value:key=value" encoder options applied on top of the profile.
+        unsigned int variableFrameRate; // ffmpeg only: 1=skip frames where the screen did not change, 0=encode every frame.
+        unsigned int changeTolerance; // ffmpeg only: with variableFrameRate, ignore changes in the lowest 0-7 bits of each color.
+        unsigned int holdLastFrame; // 1=repeat the last frame when the screen does not change so the video keeps frameRate.
+        unsigned int adaptiveFrameRate; // ffmpeg only: 1=lower the frame rate in steps while the encoder cannot keep up.
+        unsigned int minFrameRate; // ffmpeg only: with adaptiveFrameRate the lowest it goes, or 0 for a quarter of frameRate.
     };
 
-    int __declspec(dllexport) WINAPI EncodeVideo(unsigned int captureHandle, const WCHAR* filename, VideoEncoderProperties* properties);
-    int __declspec(dllexport) WINAPI StopEncoding();
-    unsigned int __declspec(dllexport) WINAPI GetSampleTimes(double* buffer, unsigned int size);
+    // The default profile is x264 preset fast at crf 20 with a key frame every 10 frames. Low latency
+    // has no b-frames or lookahead (tune zerolatency) and keeps to bitrateInBps, high throughput
+    // encodes the most frames per second of CPU. In every profile the bitrate is the upper limit,
+    // and encoderOptions can change anything, e.g. "preset=veryfast:crf=18:g=120:bf=0:threads=4".
+    const int VideoEncoderProfileDefault = 0;
+    const int VideoEncoderProfileLowLatency = 1;
+    const int VideoEncoderProfileHighThroughput = 2;
+
+    // Segmented recordings write the first segment to the EncodeVideo filename and the next ones to
+    // name_1.mp4, name_2.mp4 and so on. The capture and the encoder keep running across segments,
+    // each starts on a key frame at time 0 with no frames lost or repeated between them.
+
+    // A regular mp4 is only readable once encoding finishes. The other two are written in fragments
+    // that are flushed to the file as they complete, so a crash only loses the last fragment and
+    // the file can be read while it is being recorded.
+    const int VideoContainerMp4 = 0;
+    const int VideoContainerFragmentedMp4 = 1;
+    const int VideoContainerMpegTs = 2;
+
+    // Starts encoding the capture to filename on a thread of its own and returns an encoder id right
+    // away, or 0 if the capture handle is not valid or the capture is already being encoded. Any
+    // number of encoders can run at once on different captures. bitrateInBps and ffmpeg are filled
+    // in with what the encoder will use.
+    unsigned int __declspec(dllexport) WINAPI EncodeVideo(unsigned int captureHandle, const WCHAR* filename, VideoEncoderProperties* properties);
+    // Waits for the encoder to finish and returns 0 or an error code for GetErrorMessage.
+    int __declspec(dllexport) WINAPI WaitForEncoder(unsigned int encoder);
+    bool __declspec(dllexport) WINAPI IsEncoding(unsigned int encoder);
+    // Asks the encoder to finish the video, use WaitForEncoder to know when it has.
+    int __declspec(dllexport) WINAPI StopEncoding(unsigned int encoder);
+    // With replaySeconds set the encoder writes nothing (filename can be null) and keeps the last
+    // replaySeconds, up to one key frame interval more, in memory. This writes them to an mp4 that
+    // starts on a key frame, while the encoder keeps going or after it finished. Returns 0 or an
+    // error code for GetErrorMessage.
+    int __declspec(dllexport) WINAPI SaveReplay(unsigned int encoder, const WCHAR* filename);
+    // Stops the encoder if it is still running, waits for it and frees the id.
+    void __declspec(dllexport) WINAPI CloseEncoder(unsigned int encoder);
+    // These copy the oldest of the last 65536 frame times and return how many were copied, or
+    // with a null buffer how many there are.
+    unsigned int __declspec(dllexport) WINAPI GetSampleTimes(unsigned int encoder, double* buffer, unsigned int size);
     unsigned int __declspec(dllexport) WINAPI GetCaptureTimes(unsigned int captureHandle, double* buffer, unsigned int size);
+
+    // Frame times in seconds after *cursor, which is moved past the ones copied, so each poll only
+    // copies what is new. Start with *cursor = 0. Returns how many were copied, 0 if cursor is null.
+    unsigned int __declspec(dllexport) WINAPI ReadSampleTimes(unsigned int encoder, unsigned long long* cursor, double* buffer, unsigned int size);
+    unsigned int __declspec(dllexport) WINAPI ReadCaptureTimes(unsigned int captureHandle, unsigned long long* cursor, double* buffer, unsigned int size);
+
+    // Running statistics over every frame, a gap is the seconds between two consecutive frames.
+    struct FrameTimingStats
+    {
+        unsigned long long count;
+        double first;
+        double last;
+        double meanGap;
+        double p50Gap;
+        double p95Gap;
+        double p99Gap;
+        double maxGap;
+    };
+
+    // These return false if the encoder id or capture handle is not valid.
+    bool __declspec(dllexport) WINAPI GetSampleTimingStats(unsigned int encoder, FrameTimingStats* stats);
+    bool __declspec(dllexport) WINAPI GetCaptureTimingStats(unsigned int captureHandle, FrameTimingStats* stats);
     void __declspec(dllexport) WINAPI SleepMicroseconds(uint64_t microseconds);
-    LPCSTR __declspec(dllexport) WINAPI GetErrorMessage(int hr);
+    // How much CPU SleepMicroseconds may spin to wake up on time: 0 for Precise, 1 for Balanced (the
+    // default) and 2 for LowPower, see util::SleepPolicy.
+    void __declspec(dllexport) WINAPI SetSleepPolicy(int policy);
+    // Which clock times the sleeps, frame pacing and encoder statistics of this process: 0 for
+    // QueryPerformanceCounter (the default), 1 for the time stamp counter, which is cheaper to read
+    // and is calibrated against it for calibrationMilliseconds first. Returns false if the cpu has no
+    // invariant time stamp counter, the clock is then left as it was.
+    bool __declspec(dllexport) WINAPI SetClockSource(int source, unsigned int calibrationMilliseconds);
+
+    // Paces a loop to a frame rate on a fixed schedule of deadlines, see util::FpsThrottle. catchUp
+    // is what a step does after a stall of a frame or more: 0 runs the missed steps back to back, 1
+    // (the default) skips them and 2 starts a new schedule. The throttle uses the sleep policy set
+    // when it is created. Returns a throttle id, 0 for an invalid fps or catchUp.
+    unsigned int __declspec(dllexport) WINAPI CreateThrottle(double fps, int catchUp);
+    // Waits for the next deadline and returns the seconds it waited, or -1 for an invalid id. Call
+    // it from one thread at a time.
+    double __declspec(dllexport) WINAPI ThrottleStep(unsigned int throttle);
+    // The next step starts a new schedule.
+    void __declspec(dllexport) WINAPI ResetThrottle(unsigned int throttle);
+    // Moves the schedule towards just after the frames of the capture arrive, a little each call, so
+    // a step doesn't return just before a new frame. Call it after each step that read a frame.
+    void __declspec(dllexport) WINAPI AlignThrottle(unsigned int throttle, unsigned int captureHandle);
+
+    // How late the steps of a throttle returned after their deadlines, in seconds.
+    struct ThrottleStats
+    {
+        unsigned long long steps;
+        unsigned long long missed; // deadlines skipped (catchUp 1) or given up (catchUp 2) after stalls.
+        double p50;
+        double p90;
+        double p99;
+        double p999;
+        double max;
+    };
+
+    bool __declspec(dllexport) WINAPI GetThrottleStats(unsigned int throttle, ThrottleStats* stats);
+    // Copies up to size non empty buckets of the lateness histogram, the middle of each in
+    // seconds and its count, and returns how many there are.
+    unsigned int __declspec(dllexport) WINAPI GetThrottleHistogram(unsigned int throttle, double* seconds, unsigned long long* counts, unsigned int size);
+    void __declspec(dllexport) WINAPI CloseThrottle(unsigned int throttle);
+
+    // A pool of frame buffers owned by this library that are lent to the caller by address, so a
+    // frame can be read with ReadNextFrameEx straight into memory that python wraps in a numpy array,
+    // without allocating or copying each frame. Buffers start on a multiple of alignment (a power of
+    // 2, 0 for 64) and at most maxBuffers are lent at once. Returns the pool id.
+    unsigned int __declspec(dllexport) WINAPI CreateFramePool(unsigned int alignment, unsigned int maxBuffers);
+    // Returns a buffer of size bytes, or null if maxBuffers are lent already or the pool is closed.
+    void* __declspec(dllexport) WINAPI LendFrameBuffer(unsigned int pool, unsigned long long size);
+    // Gives a lent buffer back to the pool to be reused, false if it is not from this pool.
+    bool __declspec(dllexport) WINAPI ReturnFrameBuffer(unsigned int pool, void* buffer);
+    // How many buffers of the pool are lent right now.
+    unsigned int __declspec(dllexport) WINAPI GetLentFrameBuffers(unsigned int pool);
+    // Stops lending, the pool is freed once every lent buffer has been returned.
+    void __declspec(dllexport) WINAPI CloseFramePool(unsigned int pool);
+
+    // A change of the frame rate an encoder with adaptiveFrameRate keeps, time is in seconds since
+    // encoding started and load is how busy its busiest stage was, 1 meaning all of the time.
+    struct EncoderAdjustment
+    {
+        double time;
+        double frameRate;
+        double load;
+    };
+
+    // Copies the first size adjustments and returns how many there are, 0 for an invalid encoder id.
+    unsigned int __declspec(dllexport) WINAPI GetEncoderAdjustments(unsigned int encoder, EncoderAdjustment* buffer, unsigned int size);
+
+    // Records how long each step takes from a frame arriving to its bytes being written, in every
+    // capture and encoder thread. Off by default, when on each thread keeps its last 65536 events.
+    void __declspec(dllexport) WINAPI EnableTracing(bool enable);
+    void __declspec(dllexport) WINAPI ClearTrace();
+    // Writes the recorded events as Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+    // Returns false if the file could not be written.
+    bool __declspec(dllexport) WINAPI SaveTrace(const WCHAR* filename);
+    // The message stays valid until the encoder is closed.
+    LPCSTR __declspec(dllexport) WINAPI GetErrorMessage(unsigned int encoder, int hr);
 
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+
+// Portable helpers for the SIMD pixel kernels. Each kernel is compiled for every instruction set we
+// support and the best one is picked at runtime with GetCpuLevel(), so the binary still runs on
+// machines without AVX2.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UTIL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define UTIL_X86 0
+#endif
+
+// MSVC lets any function use any intrinsic, gcc and clang need to be told per function.
+#if UTIL_X86 && !defined(_MSC_VER)
+#define UTIL_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define UTIL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define UTIL_TARGET_SSE41
+#define UTIL_TARGET_AVX2
+#endif
+
+namespace util
+{
+    enum class CpuLevel
+    {
+        Scalar = 0,
+        Sse41 = 1,
+        Avx2 = 2
+    };
+
+    inline const char* CpuLevelName(CpuLevel level)
+    {
+        switch (level) {
+        case CpuLevel::Sse41:
+            return "sse4.1";
+        case CpuLevel::Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+        }
+    }
+
+    inline CpuLevel DetectCpuLevel()
+    {
+#if UTIL_X86
+#if defined(_MSC_VER)
+        int info[4] = { 0 };
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool avx2 = false;
+        if (maxLeaf >= 7 && avx && osxsave && (_xgetbv(0) & 6) == 6) {
+            // the OS saves the YMM registers, so it is safe to use AVX2 if the cpu has it.
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool sse41 = __builtin_cpu_supports("sse4.1");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2) {
+            return CpuLevel::Avx2;
+        }
+        if (sse41) {
+            return CpuLevel::Sse41;
+        }
+#endif
+        return CpuLevel::Scalar;
+    }
+
+    // The best level supported by this machine, detected once.
+    inline CpuLevel GetCpuLevel()
+    {
+        static const CpuLevel level = DetectCpuLevel();
+        return level;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace util
+{
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread.
+    template <typename T>
+    class SpscQueue
+    {
+    private:
+        std::vector<T> _items;
+        size_t _capacity;
+        // head and tail on separate cache lines so producer and consumer don't fight over them.
+        alignas(64) std::atomic<size_t> _head{ 0 }; // next slot to pop, written by the consumer.
+        alignas(64) std::atomic<size_t> _tail{ 0 }; // next slot to push, written by the producer.
+
+    public:
+        explicit SpscQueue(size_t capacity) : _items(capacity + 1), _capacity(capacity + 1) {
+        }
+
+        size_t Capacity() const {
+            return _capacity - 1;
+        }
+
+        // Returns false if the queue is full.
+        bool TryPush(const T& item) {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t next = (tail + 1) % _capacity;
+            if (next == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            _items[tail] = item;
+            _tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false if the queue is empty.
+        bool TryPop(T& item) {
+            size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = std::move(_items[head]);
+            _head.store((head + 1) % _capacity, std::memory_order_release);
+            return true;
+        }
+
+        // Approximate when called from a thread other than the producer or consumer.
+        size_t Size() const {
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t tail = _tail.load(std::memory_order_acquire);
+            return (tail + _capacity - head) % _capacity;
+        }
+    };
+}
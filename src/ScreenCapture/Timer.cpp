@@ -1,10 +1,23 @@
-#include "pch.h"
-
 #include "Timer.h"
+#include <thread>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <Windows.h>
+#else
+#include <cerrno>
+#include <time.h>
+#include <sys/prctl.h>
+#endif
 
 using namespace util;
 
+#if defined(_WIN32)
+
+// The waitable timer fires on the system timer tick, so until the overshoots come in assume a tick.
+static const int64_t InitialSpin = 1000000;
+
 unsigned long SetHighestTimerResolution(unsigned long timer_res_us)
 {
     unsigned long timer_current_res = ULONG_MAX;
@@ -28,7 +41,7 @@ unsigned long SetHighestTimerResolution(unsigned long timer_res_us)
     return timer_current_res;
 }
 
-Timer::Timer() {
+Timer::Timer() : _tuner(InitialSpin) {
     _currentResolution = SetHighestTimerResolution(1);
     _timer = CreateWaitableTimer(NULL, TRUE, NULL);
     if (_timer == nullptr) {
@@ -42,21 +55,95 @@ Timer::~Timer() {
     }
 }
 
+void Timer::OsSleep(int64_t nanoseconds)
+{
+    LARGE_INTEGER period;
+    // negative values are for relative time, in 100 nanosecond units.
+    period.QuadPart = -(nanoseconds / 100);
+    SetWaitableTimer(_timer, &period, 0, NULL, NULL, 0);
+    WaitForSingleObject(_timer, INFINITE);
+}
+
+double Timer::ThreadCpuSeconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto seconds = [](const FILETIME& time) {
+        return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return seconds(kernel) + seconds(user);
+}
+
+#else
+
+// clock_nanosleep usually overshoots by tens of microseconds once the timer slack is gone.
+static const int64_t InitialSpin = 100000;
+
+Timer::Timer() : _tuner(InitialSpin) {
+}
+
+Timer::~Timer() {
+}
+
+void Timer::OsSleep(int64_t nanoseconds)
+{
+    // the default 50 microseconds of timer slack is more than the whole overshoot otherwise, it is
+    // per thread so each sleeping thread turns it down the first time.
+    static thread_local bool slack = (prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0), true);
+    (void)slack;
+    timespec wake;
+    clock_gettime(CLOCK_MONOTONIC, &wake);
+    wake.tv_sec += static_cast<time_t>(nanoseconds / 1000000000);
+    wake.tv_nsec += static_cast<long>(nanoseconds % 1000000000);
+    if (wake.tv_nsec >= 1000000000) {
+        wake.tv_sec++;
+        wake.tv_nsec -= 1000000000;
+    }
+    // an absolute wake up time, so a signal doesn't restart the whole sleep.
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {
+    }
+}
+
+double Timer::ThreadCpuSeconds()
+{
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+        return 0;
+    }
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+#endif
+
+static void CpuRelax()
+{
+#if UTIL_X86
+    // tells the core this is a spin loop, which saves power and frees up its hyper thread sibling.
+    _mm_pause();
+#endif
+}
+
 void Timer::Sleep(int64_t usec)
 {
-    auto start = Microseconds();
-    if (usec > 1000) {
-        // this can do millisecond accurate sleeps
-        LARGE_INTEGER period;
-        // negative values are for relative time
-        period.QuadPart = -(10 * (usec - 200));
-        SetWaitableTimer(_timer, &period, 0, NULL, NULL, 0);
-        WaitForSingleObject(_timer, INFINITE);
-    }
-
-    // for less than millisecond we need to spin wait, this will also correct any remainder
-    // left on the table by the SetWaitableTimer.
-	while (Microseconds() - start < usec) {
-        // tradeoff: burn up the core in this tight loop in order to get precise timing...
-    }
-}
\ No newline at end of file
+    // the last stretch is too short to trust the OS with, yield while another thread could still use
+    // the core and spin for the rest.
+    const int64_t yieldNanoseconds = 50000;
+    int64_t start = Clock::Nanoseconds();
+    int64_t deadline = start + usec * 1000;
+    int64_t margin = _tuner.WakeBefore(usec * 1000);
+    if (margin >= 0) {
+        int64_t wake = deadline - margin;
+        OsSleep(wake - start);
+        _tuner.Record(Clock::Nanoseconds() - wake, _policy);
+    }
+    for (int64_t left = deadline - Clock::Nanoseconds(); left > 0; left = deadline - Clock::Nanoseconds()) {
+        if (left > yieldNanoseconds) {
+            std::this_thread::yield();
+        }
+        else {
+            CpuRelax();
+        }
+    }
+}
@@ -1,10 +1,82 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include "Clock.h"
+
+#if defined(_WIN32)
+#define UTIL_TIMER_API __declspec(dllexport)
+#else
+#define UTIL_TIMER_API
+#endif
 
 namespace util
 {
-    class __declspec(dllexport) Timer
+    // How Timer::Sleep trades precision for CPU time. Each sleep waits in the OS for most of the time,
+    // then yields and spins the rest, the policy picks how much of the OS sleep's usual overshoot to
+    // spin instead.
+    enum class SleepPolicy
+    {
+        Precise = 0,  // spin for half again the 95th percentile overshoot, wakes up on time nearly always.
+        Balanced = 1, // spin for the 90th percentile overshoot, the odd wake up is late by the rest.
+        LowPower = 2  // spin for the median overshoot, about half the wake ups are a little late.
+    };
+
+    // Keeps the last few overshoots of the OS sleep and how long to spin after it to absorb them.
+    class SleepTuner
+    {
+        static constexpr int History = 64;
+        static constexpr int ProbeEvery = 16;
+        static constexpr int64_t MinProbe = 100000;
+        int64_t _overshoots[History] = {};
+        int _count = 0;
+        int _next = 0;
+        int _skipped = 0;
+        int64_t _margin;
+
+    public:
+        // initialMargin is used until there are enough overshoots to go by.
+        explicit SleepTuner(int64_t initialMargin) : _margin(initialMargin) {
+        }
+
+        // Nanoseconds to stop the OS sleep short of the wake up time by.
+        int64_t Margin() const {
+            return _margin;
+        }
+
+        // How long before the end of a sleep of this many nanoseconds to wake up from the OS sleep, -1
+        // to spin all of it. Sleeps that fit in the margin are spun, except that every so often half of
+        // one is slept to measure the overshoot again, or a single bad one would leave the margin high
+        // and the sleeps spinning for good.
+        int64_t WakeBefore(int64_t nanoseconds) {
+            if (nanoseconds > _margin) {
+                return _margin;
+            }
+            if (nanoseconds >= MinProbe && ++_skipped >= ProbeEvery) {
+                _skipped = 0;
+                return nanoseconds / 2;
+            }
+            return -1;
+        }
+
+        void Record(int64_t overshoot, SleepPolicy policy) {
+            _overshoots[_next] = std::max<int64_t>(overshoot, 0);
+            _next = (_next + 1) % History;
+            _count = std::min(_count + 1, History);
+            if (_count < 16) {
+                return;
+            }
+            int64_t sorted[History];
+            std::copy(_overshoots, _overshoots + _count, sorted);
+            int index = policy == SleepPolicy::Precise ? _count * 95 / 100 : policy == SleepPolicy::Balanced ? _count * 9 / 10 : _count / 2;
+            std::nth_element(sorted, sorted + index, sorted + _count);
+            // the history is too short to go by its worst, one preempted wake up would set the margin.
+            _margin = policy == SleepPolicy::Precise ? sorted[index] + sorted[index] / 2 : sorted[index];
+        }
+    };
+
+    class UTIL_TIMER_API Timer
     {
     public:
         Timer();
@@ -28,17 +100,40 @@ namespace util
             return static_cast<double>(now() - _start);
         }
 
-        // A much more accurate sleep...
+        // A much more accurate sleep than the OS gives, see SleepPolicy.
         void Sleep(int64_t usec);
 
+        void SetPolicy(SleepPolicy policy)
+        {
+            _policy = policy;
+        }
+        SleepPolicy Policy() const
+        {
+            return _policy;
+        }
+        // Microseconds the current policy spins at the end of each sleep.
+        double SpinMicroseconds() const
+        {
+            return _tuner.Margin() / 1000.0;
+        }
+
+        // CPU seconds used by the calling thread, for measuring what sleeping costs.
+        static double ThreadCpuSeconds();
+
     private:
+        // Monotonic, so a wall clock change or NTP adjustment can't stretch or shrink a measurement.
         int64_t now()
         {
-            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            return Clock::Nanoseconds() / 1000;
         }
 
+        // Sleeps in the OS for about this many nanoseconds, it may be longer but never shorter.
+        void OsSleep(int64_t nanoseconds);
+
         int64_t _start = 0;
         void* _timer = nullptr;
         unsigned long _currentResolution = 0;
+        SleepPolicy _policy = SleepPolicy::Balanced;
+        SleepTuner _tuner;
     };
 }
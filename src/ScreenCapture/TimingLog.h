@@ -0,0 +1,334 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace util
+{
+    // Fixed capacity ring of timestamps for one writer and any number of readers, neither of which
+    // ever blocks. Every time gets an index that keeps counting up, readers keep a cursor with the
+    // next index they want, so each poll only copies what is new. When a reader falls more than the
+    // capacity behind the oldest times are overwritten and its cursor skips ahead to what is left.
+    class TimingRing
+    {
+        std::unique_ptr<std::atomic<double>[]> _times;
+        size_t _mask;
+        std::atomic<uint64_t> _writing{ 0 }; // index the writer is about to overwrite + 1.
+        std::atomic<uint64_t> _head{ 0 };    // times below this index are written.
+        std::atomic<uint64_t> _start{ 0 };   // first index since the last Reset.
+
+    public:
+        static const size_t DefaultCapacity = 1 << 16; // about 18 minutes at 60 fps.
+
+        // The capacity is rounded up to a power of 2.
+        explicit TimingRing(size_t capacity = DefaultCapacity) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            _times = std::make_unique<std::atomic<double>[]>(size);
+            _mask = size - 1;
+        }
+
+        size_t Capacity() const {
+            return _mask + 1;
+        }
+
+        // Writer only.
+        void Add(double time) {
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            // announce the overwrite before doing it, a reader that sees the new value then sees this.
+            _writing.store(head + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _times[head & _mask].store(time, std::memory_order_relaxed);
+            _head.store(head + 1, std::memory_order_release);
+        }
+
+        // Writer only (or while nothing is added), forgets everything added so far. Cursors from
+        // before the reset skip ahead to the first time added after it.
+        void Reset() {
+            _start.store(_head.load(std::memory_order_relaxed), std::memory_order_release);
+        }
+
+        // How many times were added since the last Reset, including ones that were overwritten.
+        uint64_t Count() const {
+            return _head.load(std::memory_order_acquire) - _start.load(std::memory_order_acquire);
+        }
+
+        // How many times are still in the ring.
+        uint64_t Available() const {
+            return std::min<uint64_t>(Count(), Capacity());
+        }
+
+        // Copies up to size times starting at cursor (0 reads everything still in the ring) and
+        // moves the cursor past them. Returns how many were copied.
+        size_t Read(uint64_t& cursor, double* buffer, size_t size) const {
+            uint64_t start = _start.load(std::memory_order_acquire);
+            uint64_t head = _head.load(std::memory_order_acquire);
+            uint64_t first = std::max(cursor, start);
+            if (head > Capacity()) {
+                first = std::max(first, head - Capacity());
+            }
+            if (first > head) {
+                // a cursor from before the ring was created or bogus, start over.
+                first = std::max(start, head > Capacity() ? head - Capacity() : 0);
+            }
+            size_t count = static_cast<size_t>(std::min<uint64_t>(head - first, size));
+            for (size_t i = 0; i < count; i++) {
+                buffer[i] = _times[(first + i) & _mask].load(std::memory_order_relaxed);
+            }
+            // anything the writer started overwriting while we copied is not what we wanted.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t writing = _writing.load(std::memory_order_relaxed);
+            size_t skip = 0;
+            if (writing > Capacity() && writing - Capacity() > first) {
+                skip = static_cast<size_t>(std::min<uint64_t>(writing - Capacity() - first, count));
+                std::copy(buffer + skip, buffer + count, buffer);
+            }
+            cursor = first + count;
+            return count - skip;
+        }
+    };
+
+    // What TimingStats knows about the times added to it. A gap is the seconds between two
+    // consecutive times, for frames the inverse of the frame rate.
+    struct TimingSummary
+    {
+        uint64_t count = 0;
+        double first = 0;
+        double last = 0;
+        double meanGap = 0;
+        double p50Gap = 0;
+        double p95Gap = 0;
+        double p99Gap = 0;
+        double maxGap = 0;
+    };
+
+    // Counts durations in seconds in a log scale histogram of microseconds with 32 buckets per power
+    // of 2, so percentiles are within about 1.6% of the real ones whatever the range, in constant
+    // memory. One writer, the rest can be called from any thread.
+    class DurationHistogram
+    {
+        static const int SubBits = 5;
+        static const int SubBuckets = 1 << SubBits;
+        static const int Buckets = SubBuckets * (64 - SubBits + 1);
+
+        std::atomic<uint64_t> _buckets[Buckets];
+        std::atomic<uint64_t> _count{ 0 };
+        std::atomic<double> _max{ 0 };
+
+        static int BucketOf(uint64_t microseconds) {
+            if (microseconds < SubBuckets) {
+                return static_cast<int>(microseconds);
+            }
+            int exponent = 63;
+            while ((microseconds >> exponent) == 0) {
+                exponent--;
+            }
+            int sub = static_cast<int>((microseconds >> (exponent - SubBits)) & (SubBuckets - 1));
+            return SubBuckets + (exponent - SubBits) * SubBuckets + sub;
+        }
+
+        // The middle of the range of durations that land in the bucket, in seconds.
+        static double BucketValue(int bucket) {
+            if (bucket < SubBuckets) {
+                return bucket * 1e-6;
+            }
+            int exponent = (bucket - SubBuckets) / SubBuckets + SubBits;
+            int sub = (bucket - SubBuckets) % SubBuckets;
+            double width = static_cast<double>(uint64_t(1) << (exponent - SubBits));
+            double low = static_cast<double>(uint64_t(1) << exponent) + sub * width;
+            return (low + width / 2) * 1e-6;
+        }
+
+    public:
+        DurationHistogram() {
+            Reset();
+        }
+
+        // Writer only, negative durations count as 0.
+        void Add(double seconds) {
+            seconds = std::max(0.0, seconds);
+            if (seconds > _max.load(std::memory_order_relaxed)) {
+                _max.store(seconds, std::memory_order_relaxed);
+            }
+            double microseconds = std::min(seconds * 1e6, 1e18);
+            _buckets[BucketOf(static_cast<uint64_t>(microseconds))].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_release);
+        }
+
+        // Writer only (or while nothing is added).
+        void Reset() {
+            for (auto& bucket : _buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            _max.store(0, std::memory_order_relaxed);
+            _count.store(0, std::memory_order_release);
+        }
+
+        uint64_t Count() const {
+            return _count.load(std::memory_order_acquire);
+        }
+
+        double Max() const {
+            return _max.load(std::memory_order_relaxed);
+        }
+
+        // Fills in the given percentiles (0 to 1, in increasing order), never more than the largest
+        // duration actually added. Walks the fixed size histogram so this costs the same however many
+        // durations were added.
+        void Percentiles(const double* percentiles, double* results, int count) const {
+            uint64_t counts[Buckets];
+            uint64_t total = 0;
+            for (int i = 0; i < Buckets; i++) {
+                counts[i] = _buckets[i].load(std::memory_order_relaxed);
+                total += counts[i];
+            }
+            double max = Max();
+            uint64_t seen = 0;
+            int next = 0;
+            for (int i = 0; i < Buckets && next < count; i++) {
+                seen += counts[i];
+                while (next < count && seen > 0 && seen >= percentiles[next] * total) {
+                    results[next] = std::min(BucketValue(i), max);
+                    next++;
+                }
+            }
+            for (; next < count; next++) {
+                results[next] = 0;
+            }
+        }
+
+        double Percentile(double percentile) const {
+            double result = 0;
+            Percentiles(&percentile, &result, 1);
+            return result;
+        }
+
+        // Copies up to size of the buckets that have anything in them, as the duration in the middle
+        // of each bucket and how many landed in it, shortest first. Returns how many buckets have
+        // anything in them.
+        size_t Read(double* seconds, uint64_t* counts, size_t size) const {
+            size_t found = 0;
+            for (int i = 0; i < Buckets; i++) {
+                uint64_t count = _buckets[i].load(std::memory_order_relaxed);
+                if (count == 0) {
+                    continue;
+                }
+                if (found < size) {
+                    seconds[found] = BucketValue(i);
+                    counts[found] = count;
+                }
+                found++;
+            }
+            return found;
+        }
+    };
+
+    // Running statistics over a sequence of increasing times in seconds, in constant memory so a
+    // recording can go on for days. Percentiles come from a DurationHistogram of the gaps.
+    // One writer, Summary can be called from any thread.
+    class TimingStats
+    {
+        DurationHistogram _gaps;
+        std::atomic<uint64_t> _count{ 0 };
+        std::atomic<double> _first{ 0 };
+        std::atomic<double> _last{ 0 };
+
+    public:
+        TimingStats() {
+            Reset();
+        }
+
+        // Writer only.
+        void Add(double time) {
+            uint64_t count = _count.load(std::memory_order_relaxed);
+            if (count == 0) {
+                _first.store(time, std::memory_order_relaxed);
+            }
+            else {
+                _gaps.Add(time - _last.load(std::memory_order_relaxed));
+            }
+            _last.store(time, std::memory_order_relaxed);
+            _count.store(count + 1, std::memory_order_release);
+        }
+
+        // Writer only (or while nothing is added).
+        void Reset() {
+            _gaps.Reset();
+            _first.store(0, std::memory_order_relaxed);
+            _last.store(0, std::memory_order_relaxed);
+            _count.store(0, std::memory_order_release);
+        }
+
+        TimingSummary Summary() const {
+            TimingSummary summary;
+            summary.count = _count.load(std::memory_order_acquire);
+            summary.first = _first.load(std::memory_order_relaxed);
+            summary.last = _last.load(std::memory_order_relaxed);
+            summary.maxGap = _gaps.Max();
+            if (summary.count < 2) {
+                return summary;
+            }
+            summary.meanGap = (summary.last - summary.first) / (summary.count - 1);
+            const double percentiles[] = { 0.50, 0.95, 0.99 };
+            double results[3];
+            _gaps.Percentiles(percentiles, results, 3);
+            summary.p50Gap = results[0];
+            summary.p95Gap = results[1];
+            summary.p99Gap = results[2];
+            return summary;
+        }
+    };
+
+    // The timestamps of something that happens once per frame: the recent ones to read
+    // incrementally and statistics over all of them.
+    class TimingLog
+    {
+        TimingRing _ring;
+        TimingStats _stats;
+
+    public:
+        explicit TimingLog(size_t capacity = TimingRing::DefaultCapacity) : _ring(capacity) {
+        }
+
+        // Writer only.
+        void Add(double time) {
+            _ring.Add(time);
+            _stats.Add(time);
+        }
+
+        // Writer only (or while nothing is added).
+        void Reset() {
+            _ring.Reset();
+            _stats.Reset();
+        }
+
+        size_t Read(uint64_t& cursor, double* buffer, size_t size) const {
+            return _ring.Read(cursor, buffer, size);
+        }
+
+        // Copies the oldest times still in the ring and returns how many were copied, or with no
+        // buffer how many there are. This is what the old GetSampleTimes and GetCaptureTimes did,
+        // with the difference that only the last Capacity times are kept. A writer that laps the
+        // copy leaves fewer times than there were, so only trust what this returns.
+        size_t Copy(double* buffer, size_t size) const {
+            size_t available = static_cast<size_t>(_ring.Available());
+            if (buffer == nullptr || size == 0) {
+                return available;
+            }
+            uint64_t cursor = 0;
+            return _ring.Read(cursor, buffer, std::min(size, available));
+        }
+
+        uint64_t Count() const {
+            return _ring.Count();
+        }
+
+        TimingSummary Summary() const {
+            return _stats.Summary();
+        }
+    };
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Clock.h"
+
+namespace util
+{
+    // One timed span on one thread, in Tracer::Now ticks.
+    struct TraceEvent
+    {
+        const char* name = nullptr;
+        uint64_t start = 0;
+        uint64_t duration = 0;
+    };
+
+    // The events of one thread, a fixed size ring that overwrites the oldest events when it is
+    // full. Only the owning thread writes, Tracer reads it from any thread without stopping it:
+    // the fields are relaxed atomics (plain moves on x64) and readers throw away any event the
+    // writer started overwriting while they copied it, the same way TimingRing does.
+    class TraceBuffer
+    {
+        struct Slot
+        {
+            std::atomic<const char*> name{ nullptr };
+            std::atomic<uint64_t> start{ 0 };
+            std::atomic<uint64_t> duration{ 0 };
+        };
+
+        std::unique_ptr<Slot[]> _slots;
+        size_t _mask;
+        std::atomic<uint64_t> _writing{ 0 };
+        std::atomic<uint64_t> _head{ 0 };
+        std::atomic<uint64_t> _start{ 0 };
+
+    public:
+        // The rest belong to Tracer and are guarded by its mutex.
+        std::string threadName;
+        int lane = 0;
+        bool inUse = true;
+
+        explicit TraceBuffer(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            _slots = std::make_unique<Slot[]>(size);
+            _mask = size - 1;
+        }
+
+        size_t Capacity() const {
+            return _mask + 1;
+        }
+
+        // Owning thread only.
+        void Add(const char* name, uint64_t start, uint64_t duration) {
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            _writing.store(head + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = _slots[head & _mask];
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.start.store(start, std::memory_order_relaxed);
+            slot.duration.store(duration, std::memory_order_relaxed);
+            _head.store(head + 1, std::memory_order_release);
+        }
+
+        // Any thread, the owner keeps writing after the cleared events.
+        void Clear() {
+            _start.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        // Appends the events still in the ring, oldest first.
+        void Read(std::vector<TraceEvent>& events) const {
+            uint64_t head = _head.load(std::memory_order_acquire);
+            uint64_t first = _start.load(std::memory_order_acquire);
+            if (head > Capacity()) {
+                first = std::max(first, head - Capacity());
+            }
+            size_t offset = events.size();
+            for (uint64_t i = first; i < head; i++) {
+                const Slot& slot = _slots[i & _mask];
+                TraceEvent e;
+                e.name = slot.name.load(std::memory_order_relaxed);
+                e.start = slot.start.load(std::memory_order_relaxed);
+                e.duration = slot.duration.load(std::memory_order_relaxed);
+                events.push_back(e);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t writing = _writing.load(std::memory_order_relaxed);
+            if (writing > Capacity() && writing - Capacity() > first) {
+                size_t skip = static_cast<size_t>(std::min<uint64_t>(writing - Capacity() - first, head - first));
+                events.erase(events.begin() + offset, events.begin() + offset + skip);
+            }
+        }
+    };
+
+    // Process wide tracer for finding where the time goes between a frame arriving and its bytes
+    // hitting the disk. Each thread records into its own TraceBuffer so recording never takes a
+    // lock, and Tracer::Enabled is a single relaxed load so the trace points can stay in the code:
+    // when tracing is off a UTIL_TRACE_SCOPE costs a load and a branch. The buffers of threads that
+    // exit are handed to the next new thread, so memory stays bounded by the number of threads
+    // alive at once, and a lane in the trace can show more than one thread over time.
+    class Tracer
+    {
+        std::atomic<bool> _enabled{ false };
+        std::mutex _mutex;
+        std::vector<std::shared_ptr<TraceBuffer>> _buffers;
+        uint64_t _originTicks;
+        std::chrono::steady_clock::time_point _originTime;
+
+        Tracer() : _originTicks(Now()), _originTime(std::chrono::steady_clock::now()) {
+        }
+
+        // Gives the buffer back when the thread exits.
+        struct ThreadSlot
+        {
+            Tracer* tracer = nullptr;
+            std::shared_ptr<TraceBuffer> buffer;
+            std::string name;
+
+            ~ThreadSlot() {
+                if (buffer != nullptr) {
+                    std::scoped_lock lock(tracer->_mutex);
+                    buffer->inUse = false;
+                }
+            }
+        };
+
+        static ThreadSlot& Slot() {
+            static thread_local ThreadSlot slot;
+            return slot;
+        }
+
+        // Buffers are only allocated once a thread records something.
+        TraceBuffer& ThreadBuffer() {
+            ThreadSlot& slot = Slot();
+            if (slot.buffer == nullptr) {
+                std::scoped_lock lock(_mutex);
+                for (auto& buffer : _buffers) {
+                    if (!buffer->inUse) {
+                        buffer->inUse = true;
+                        slot.buffer = buffer;
+                        break;
+                    }
+                }
+                if (slot.buffer == nullptr) {
+                    slot.buffer = std::make_shared<TraceBuffer>(Capacity);
+                    slot.buffer->lane = static_cast<int>(_buffers.size()) + 1;
+                    _buffers.push_back(slot.buffer);
+                }
+                slot.buffer->threadName = slot.name;
+                slot.tracer = this;
+            }
+            return *slot.buffer;
+        }
+
+        static void WriteString(std::ostream& out, const char* text) {
+            out << '"';
+            for (const char* p = text; p != nullptr && *p != 0; p++) {
+                if (*p == '"' || *p == '\\') {
+                    out << '\\';
+                }
+                if (static_cast<unsigned char>(*p) >= 0x20) {
+                    out << *p;
+                }
+            }
+            out << '"';
+        }
+
+    public:
+        static constexpr size_t Capacity = 1 << 16; // events per thread.
+
+        // There is only one since each thread keeps its buffer in a thread_local.
+        static Tracer& Instance() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        // Raw Clock::Ticks, several times cheaper to read than QueryPerformanceCounter or steady_clock
+        // on x86. Converted when the trace is written.
+        static uint64_t Now() {
+            return Clock::Ticks();
+        }
+
+        // Measured against steady_clock since the tracer was created, the longer the better.
+        double NanosecondsPerTick() {
+#if UTIL_X86
+            auto elapsed = std::chrono::steady_clock::now() - _originTime;
+            if (elapsed < std::chrono::milliseconds(20)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20) - elapsed);
+            }
+            uint64_t ticks = Now() - _originTicks;
+            std::chrono::duration<double, std::nano> nanoseconds = std::chrono::steady_clock::now() - _originTime;
+            return ticks > 0 ? nanoseconds.count() / ticks : 1.0;
+#else
+            return 1.0;
+#endif
+        }
+
+        bool Enabled() const {
+            return _enabled.load(std::memory_order_relaxed);
+        }
+
+        void Enable(bool enable) {
+            _enabled.store(enable, std::memory_order_relaxed);
+        }
+
+        // name must outlive the tracer, in practice a string literal.
+        void Record(const char* name, uint64_t start, uint64_t end) {
+            ThreadBuffer().Add(name, start, end - start);
+        }
+
+        // Names the lane of the calling thread in the trace.
+        void SetThreadName(const std::string& name) {
+            ThreadSlot& slot = Slot();
+            slot.name = name;
+            if (slot.buffer != nullptr) {
+                std::scoped_lock lock(_mutex);
+                slot.buffer->threadName = name;
+            }
+        }
+
+        void Clear() {
+            std::scoped_lock lock(_mutex);
+            for (auto& buffer : _buffers) {
+                buffer->Clear();
+            }
+        }
+
+        // Every event still in the buffers, with the lane it was recorded on.
+        std::vector<std::pair<int, TraceEvent>> Events() {
+            std::vector<std::pair<int, TraceEvent>> result;
+            std::vector<TraceEvent> events;
+            std::scoped_lock lock(_mutex);
+            for (auto& buffer : _buffers) {
+                events.clear();
+                buffer->Read(events);
+                for (auto& e : events) {
+                    result.push_back({ buffer->lane, e });
+                }
+            }
+            return result;
+        }
+
+        // Writes the Chrome trace event format that chrome://tracing and ui.perfetto.dev load, as
+        // complete ("X") events in microseconds relative to the oldest event.
+        void WriteChromeJson(std::ostream& out) {
+            auto events = Events();
+            double scale = NanosecondsPerTick();
+            uint64_t origin = UINT64_MAX;
+            for (auto& e : events) {
+                origin = std::min(origin, e.second.start);
+            }
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            bool first = true;
+            {
+                std::scoped_lock lock(_mutex);
+                for (auto& buffer : _buffers) {
+                    if (!buffer->threadName.empty()) {
+                        out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->lane << ",\"args\":{\"name\":";
+                        WriteString(out, buffer->threadName.c_str());
+                        out << "}}";
+                        first = false;
+                    }
+                }
+            }
+            char number[64];
+            for (auto& e : events) {
+                out << (first ? "\n" : ",\n") << "{\"name\":";
+                WriteString(out, e.second.name);
+                // fixed point so long captures keep their nanosecond precision.
+                uint64_t start = static_cast<uint64_t>((e.second.start - origin) * scale);
+                uint64_t duration = static_cast<uint64_t>(e.second.duration * scale);
+                snprintf(number, sizeof(number), "%llu.%03llu", static_cast<unsigned long long>(start / 1000), static_cast<unsigned long long>(start % 1000));
+                out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.first << ",\"ts\":" << number;
+                snprintf(number, sizeof(number), "%llu.%03llu", static_cast<unsigned long long>(duration / 1000), static_cast<unsigned long long>(duration % 1000));
+                out << ",\"dur\":" << number << "}";
+                first = false;
+            }
+            out << "\n]}\n";
+        }
+    };
+
+    // Records the time from construction to destruction when tracing is on.
+    class TraceScope
+    {
+        const char* _name;
+        uint64_t _start = 0;
+
+    public:
+        explicit TraceScope(const char* name) : _name(name) {
+            if (Tracer::Instance().Enabled()) {
+                _start = Tracer::Now();
+            }
+        }
+
+        ~TraceScope() {
+            if (_start != 0) {
+                Tracer::Instance().Record(_name, _start, Tracer::Now());
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+    };
+}
+
+#define UTIL_TRACE_CONCAT_INNER(a, b) a##b
+#define UTIL_TRACE_CONCAT(a, b) UTIL_TRACE_CONCAT_INNER(a, b)
+// Traces the rest of the enclosing block under name, which must be a string literal.
+#define UTIL_TRACE_SCOPE(name) util::TraceScope UTIL_TRACE_CONCAT(_traceScope, __LINE__)(name)
@@ -70,15 +70,41 @@ void VideoEncoder::Stop()
 
 bool VideoEncoder::IsRunning() { return m_pimpl->IsRunning(); }
 
+int VideoEncoder::SaveReplay(const std::wstring& filePath)
+{
+    return m_pimpl->SaveReplay(filePath);
+}
+
 unsigned int VideoEncoder::GetSampleTimes(double* buffer, unsigned int size)
 {
-	return m_pimpl->GetSampleTimes(buffer, size);
+	return static_cast<unsigned int>(m_pimpl->SampleTimes().Copy(buffer, size));
+}
+
+unsigned int VideoEncoder::ReadSampleTimes(uint64_t& cursor, double* buffer, unsigned int size)
+{
+	return static_cast<unsigned int>(m_pimpl->SampleTimes().Read(cursor, buffer, size));
+}
+
+util::TimingSummary VideoEncoder::GetSampleTimingSummary()
+{
+	return m_pimpl->SampleTimes().Summary();
+}
+
+std::vector<util::LoadAdjustment> VideoEncoder::GetLoadAdjustments()
+{
+	return m_pimpl->GetLoadAdjustments();
 }
 
 winrt::Windows::Foundation::IAsyncOperation<int> VideoEncoder::EncodeAsync(
     std::shared_ptr<ScreenCapture> capture,
     VideoEncoderProperties* properties,
     std::wstring filePath)
+{
+    Configure(properties);
+    return m_pimpl->EncodeAsync(capture, properties, filePath);
+}
+
+void VideoEncoder::Configure(VideoEncoderProperties* properties)
 {
     bool request_ffmpeg = (properties->ffmpeg == 1);
     if (_ffmpeg != request_ffmpeg) {
@@ -86,7 +112,9 @@ winrt::Windows::Foundation::IAsyncOperation<int> VideoEncoder::EncodeAsync(
         CreateImpl();
     }
     properties->ffmpeg = _ffmpeg ? 1 : 0;
-    return m_pimpl->EncodeAsync(capture, properties, filePath);
+    if (properties->bitrateInBps == 0) {
+        properties->bitrateInBps = m_pimpl->GetBestBitRate(properties->frameRate, properties->quality);
+    }
 }
 
 const char* VideoEncoder::GetErrorMessage(int hr)
@@ -1,6 +1,10 @@
 #pragma once
 #include "ScreenCapture.h"
 #include "ScreenCaptureApi.h"
+#include "LoadController.h"
+
+// SaveReplay on an encoder that does not keep a replay.
+const int ERROR_NO_REPLAY = -12;
 
 class VideoEncoderImpl
 {
@@ -12,10 +16,18 @@ public:
 
     virtual void Stop() = 0;
 
-    virtual unsigned int GetSampleTimes(double* buffer, unsigned int size) = 0;
+    // Times of the encoded frames since encoding started.
+    virtual const util::TimingLog& SampleTimes() = 0;
 
     virtual bool IsRunning() = 0;
 
+    // Writes the instant replay kept in memory to filePath without stopping the encoding, returns
+    // 0 or an error code for GetErrorMessage.
+    virtual int SaveReplay(const std::wstring& filePath) { return ERROR_NO_REPLAY; }
+
+    // How the frame rate was lowered and raised again to keep up, with adaptiveFrameRate.
+    virtual std::vector<util::LoadAdjustment> GetLoadAdjustments() { return {}; }
+
     unsigned int GetBestBitRate(int frameRate, int  quality);
 
     virtual const char* GetErrorMessage(int hr) = 0;
@@ -27,6 +39,10 @@ public:
     __declspec(dllexport) VideoEncoder();
     __declspec(dllexport) ~VideoEncoder();
 
+    // Picks FFmpeg or the Windows encoder and fills in the defaults EncodeAsync will use, so the
+    // caller can see them before encoding starts. EncodeAsync does this too.
+    __declspec(dllexport) void Configure(VideoEncoderProperties* properties);
+
     __declspec(dllexport) winrt::Windows::Foundation::IAsyncOperation<int> EncodeAsync(
         std::shared_ptr<ScreenCapture> capture,
         VideoEncoderProperties* properties,
@@ -34,10 +50,22 @@ public:
 
     __declspec(dllexport) void Stop();
 
+    // Copies the times of the oldest encoded frames still kept, returns how many were copied, or
+    // with no buffer how many are kept.
     __declspec(dllexport) unsigned int GetSampleTimes(double* buffer, unsigned int size);
 
+    // Copies the times of the frames encoded after cursor and moves it past them, start with 0.
+    __declspec(dllexport) unsigned int ReadSampleTimes(uint64_t& cursor, double* buffer, unsigned int size);
+
+    __declspec(dllexport) util::TimingSummary GetSampleTimingSummary();
+
+    __declspec(dllexport) std::vector<util::LoadAdjustment> GetLoadAdjustments();
+
     __declspec(dllexport) bool IsRunning();
 
+    // Writes the last properties->replaySeconds of the video to an mp4, while or after encoding.
+    __declspec(dllexport) int SaveReplay(const std::wstring& filePath);
+
     __declspec(dllexport) const char* GetErrorMessage(int hr);
 
 private:
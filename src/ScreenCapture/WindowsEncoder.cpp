@@ -43,12 +43,15 @@ winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DSurface CreateDirect3DSu
 class MediaTranscoderImpl : public VideoEncoderImpl {
 public:
     std::shared_ptr<ScreenCapture> _capture;
-    bool _stopped = false;
-    std::vector<double> _ticks;
+    std::atomic<bool> _stopped{ false }; // set by Stop before or during EncodeAsync, never cleared.
+    util::TimingLog _ticks;
     double _maxDuration = 0; // seconds
     bool _running = false;
     util::Timer _sampleTimer;
     std::string _errorString;
+    bool _holdLastFrame = false;
+    uint32_t _frameIntervalMs = 33;
+    std::shared_ptr<ID3D11Texture2D> _lastTexture; // the one to repeat while the screen is still.
 
 public:
 
@@ -58,14 +61,9 @@ public:
     void Stop() override {
         _stopped = true;
     }
-    unsigned int GetSampleTimes(double* buffer, unsigned int size) override
+    const util::TimingLog& SampleTimes() override
     {
-        auto available = (unsigned int)_ticks.size();
-        if (buffer != nullptr) {
-            auto count = std::min(available, size);
-            ::memcpy(buffer, _ticks.data(), count * sizeof(double));
-        }
-        return available;
+        return _ticks;
     }
 
     bool IsRunning() { return _running; }
@@ -75,16 +73,22 @@ public:
         VideoEncoderProperties* properties,
         std::wstring filePath) override
     {
-        _stopped = false;
+        if (_stopped) {
+            co_return 0; // stopped before it got going.
+        }
         _running = true;
-        _ticks.clear();
+        _ticks.Reset();
         _sampleTimer.Start();
         _capture = capture;
         _errorString = "";
 
         if (!capture->WaitForNextFrame(10000)) {
             _running = false;
-            co_return ERROR_NO_FRAMES;
+            co_return _stopped ? 0 : ERROR_NO_FRAMES;
+        }
+        if (_stopped) {
+            _running = false;
+            co_return 0;
         }
         auto bounds = capture->GetTextureBounds();
         auto width = bounds.right - bounds.left;
@@ -97,6 +101,9 @@ public:
             properties->bitrateInBps = bitrateInBps;
         }
         _maxDuration = properties->seconds;
+        _holdLastFrame = properties->holdLastFrame != 0;
+        _frameIntervalMs = frameRate > 0 ? (1000 + frameRate / 2) / frameRate : 33;
+        _lastTexture = nullptr;
 
         // Describe mp4 video properties
         auto encodingProfile = winrt::Windows::Media::MediaProperties::MediaEncodingProfile::CreateMp4(quality);
@@ -147,6 +154,7 @@ public:
             mediaStreamSource.Starting(token1);
             mediaStreamSource.SampleRequested(token2);
             _capture = nullptr;
+            _lastTexture = nullptr;
             _running = false;  
 
         }
@@ -156,6 +164,7 @@ public:
             mediaStreamSource.Starting(token1);
             mediaStreamSource.SampleRequested(token2);
             _capture = nullptr;
+            _lastTexture = nullptr;
             _running = false;
             result = ERROR_UNKNOWN;
         }
@@ -176,6 +185,8 @@ public:
             return "Invalid profile";
         case 3:
             return "Codec not found";
+        case ERROR_NO_REPLAY:
+            return "Instant replay needs the ffmpeg encoder";
         default:
             return "Unknown error";
         }
@@ -183,7 +194,7 @@ public:
 
     void OnVideoStarting(MediaStreamSource const& src, MediaStreamSourceStartingEventArgs const& args)
     {
-        winrt::com_ptr<ID3D11Texture2D> result;
+        std::shared_ptr<ID3D11Texture2D> result;
         auto timestamp = _capture->ReadNextTexture(10000, result);
 		if (result == nullptr) {
             _stopped = true;
@@ -201,19 +212,28 @@ public:
         }
         else
         {
-            winrt::com_ptr<ID3D11Texture2D> result;
-            auto timestamp = _capture->ReadNextTexture(10000, result);
+            std::shared_ptr<ID3D11Texture2D> result;
+            if (_holdLastFrame && _lastTexture != nullptr) {
+                // a still screen delivers no frames, so after a frame interval the last one is sent again.
+                if (!_capture->WaitForNextFrame(_frameIntervalMs) || _capture->ReadLatestTexture(result) < 0) {
+                    result = _lastTexture;
+                }
+            }
+            else {
+                _capture->ReadNextTexture(10000, result);
+            }
             if (result == nullptr) {
                 _stopped = true;
                 args.Request().Sample(nullptr);
                 return;
             }
+            _lastTexture = result;
             // the timestamp from windows can contain duplicate values if a frame is skipped which we don't want
 			// so we use our own timer to ensure a monotonically increasing time.
             auto seconds = _sampleTimer.Seconds();
             // Store ticks according to our start time so the user knows how much delay there was getting
             // the video pipeline up and running.
-            _ticks.push_back(seconds);
+            _ticks.Add(seconds);
             if (_maxDuration > 0 && seconds >= _maxDuration) {
                 _stopped = true;
             };
@@ -221,6 +241,12 @@ public:
                 std::chrono::microseconds ms(static_cast<long long>(seconds * 1e6));
                 auto sample = MediaStreamSample::CreateFromDirect3D11Surface(
                     CreateDirect3DSurfaceFromTexture(result.get()), ms);
+                // the texture goes back to the capture's pool when released, so keep it until the
+                // transcoder is done with the sample.
+                auto held = std::make_shared<std::shared_ptr<ID3D11Texture2D>>(result);
+                sample.Processed([held](MediaStreamSample const&, winrt::Windows::Foundation::IInspectable const&) {
+                    held->reset();
+                });
                 args.Request().Sample(sample);
             }
             else
@@ -1,5 +1,8 @@
 #pragma once
 
+// The portable headers use std::min and std::max, which the windows.h macros would break.
+#define NOMINMAX
+
 // Windows SDK support
 #include <Unknwn.h>
 #include <inspectable.h>
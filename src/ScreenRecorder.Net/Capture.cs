@@ -23,6 +23,7 @@ public class Capture : ICapture
     int height;
     int stride;
     uint captureHandle;
+    uint encoderHandle; // 0 until EncodeVideoNative starts one.
     bool started;
     const int channels = 4; // B8G8R8A8UIntNormalized;
     bool encoding;
@@ -124,7 +125,17 @@ public class Capture : ICapture
     public void StopEncoding()
     {
         encoding = false;
-        CaptureNative.StopEncoding();
+        CaptureNative.StopEncoding(this.encoderHandle);
+    }
+
+    public void SaveReplay(string file)
+    {
+        file = System.IO.Path.GetFullPath(file);
+        int hr = CaptureNative.SaveReplay(this.encoderHandle, file);
+        if (hr != 0)
+        {
+            throw new Exception(GetErrorMessage(hr));
+        }
     }
 
     private void NotifyError(int hr)
@@ -138,7 +149,7 @@ public class Capture : ICapture
 
     public string GetErrorMessage(int hr)
     {
-        nint ptr = CaptureNative.GetErrorMessage(hr);
+        nint ptr = CaptureNative.GetErrorMessage(this.encoderHandle, hr);
         // Convert the IntPtr to a string
         return Marshal.PtrToStringAnsi(ptr);
     }
@@ -157,13 +168,25 @@ public class Capture : ICapture
         var dir = System.IO.Path.GetDirectoryName(file);
         System.IO.Directory.CreateDirectory(dir);
 
+        if (this.encoderHandle != 0)
+        {
+            CaptureNative.CloseEncoder(this.encoderHandle);
+        }
+        // Call the native ScreenCapture library, which encodes on a thread of its own.
+        this.encoderHandle = CaptureNative.EncodeVideo(this.captureHandle, file, ref properties);
+        if (this.encoderHandle == 0)
+        {
+            NotifyError(-1);
+            return;
+        }
+
         encoding = true;
+        var encoder = this.encoderHandle;
         Task.Run(() =>
         {
             try
             {
-                // Call the native ScreenCapture library.
-                int rc = CaptureNative.EncodeVideo(this.captureHandle, file, ref properties);
+                int rc = CaptureNative.WaitForEncoder(encoder);
                 if (rc != 0)
                 {
                     NotifyError(rc);
@@ -176,9 +199,9 @@ public class Capture : ICapture
             }
 
             encoding = false;
-            var size = CaptureNative.GetSampleTimes(null, 0);
+            var size = CaptureNative.GetSampleTimes(encoder, null, 0);
             double[] samples = new double[size];
-            CaptureNative.GetSampleTimes(samples, size);
+            CaptureNative.GetSampleTimes(encoder, samples, size);
 
             size = CaptureNative.GetCaptureTimes(this.captureHandle, null, 0);
             double[] frames = new double[size];
@@ -202,7 +225,7 @@ public class Capture : ICapture
         this.disposed = true;
         if (this.started)
         {
-            CaptureNative.StopEncoding();
+            CaptureNative.CloseEncoder(this.encoderHandle);
             CaptureNative.StopCapture(this.captureHandle);
             this.started = false;
         }
@@ -319,18 +342,27 @@ class CaptureNative
     internal static extern ulong ReadNextFrame(uint handle, byte[] buffer, uint size);
 
     [DllImport("ScreenCapture.dll", CharSet = CharSet.Unicode)]
-    internal static extern int EncodeVideo(uint captureHandle, string filename, ref VideoEncoderProperties properties);
+    internal static extern uint EncodeVideo(uint captureHandle, string filename, ref VideoEncoderProperties properties);
+
+    [DllImport("ScreenCapture.dll")]
+    internal static extern int WaitForEncoder(uint encoder);
 
     [DllImport("ScreenCapture.dll")]
-    internal static extern int StopEncoding();
+    internal static extern int StopEncoding(uint encoder);
+
+    [DllImport("ScreenCapture.dll")]
+    internal static extern void CloseEncoder(uint encoder);
+
+    [DllImport("ScreenCapture.dll", CharSet = CharSet.Unicode)]
+    internal static extern int SaveReplay(uint encoder, string filename);
 
     [DllImport("ScreenCapture.dll")]
-    internal static extern uint GetSampleTimes(double[] buffer, uint size);
+    internal static extern uint GetSampleTimes(uint encoder, double[] buffer, uint size);
 
     [DllImport("ScreenCapture.dll")]
     internal static extern uint GetCaptureTimes(uint captureHandle, double[] buffer, uint size);
 
     [DllImport("ScreenCapture.dll")]
-    internal static extern nint GetErrorMessage(int hr);
+    internal static extern nint GetErrorMessage(uint encoder, int hr);
 
 }
@@ -42,6 +42,22 @@ namespace ScreenRecorder
         public VideoEncodingQuality quality;
         public uint seconds; // maximum length before encoding finishes or 0 for infinite.
         public uint ffmpeg; // 1=use ffmpeg, returns 0 if ffmpeg is not found.
+        public uint queueDepth; // ffmpeg only: frames in flight between the encoder stages, or 0 for the default (3).
+        public uint dropPolicy; // ffmpeg only: 0=capture waits for the encoder, 1=drop frames when the encoder falls behind.
+        public uint container; // ffmpeg only: 0=mp4, 1=fragmented mp4, 2=mpeg-ts, the last two can be read while recording.
+        public uint fragmentMilliseconds; // ffmpeg only: fragment length for the streaming containers, or 0 for the default (1000).
+        public uint replaySeconds; // ffmpeg only: keep this much in memory for SaveReplay instead of writing the file, 0 is off.
+        public uint replayMegabytes; // ffmpeg only: memory cap for the replay, or 0 for the default (256).
+        public uint segmentSeconds; // ffmpeg only: start a new file (name_1.mp4, ...) this often, or 0 for one file.
+        public uint segmentMegabytes; // ffmpeg only: start a new file once one is this big, or 0 for no limit.
+        public uint profile; // ffmpeg only: 0=default, 1=low latency, 2=high throughput.
+        [MarshalAs(UnmanagedType.LPStr)]
+        public string encoderOptions; // ffmpeg only: null or "key=value:key=value" encoder options applied on top of the profile.
+        public uint variableFrameRate; // ffmpeg only: 1=skip frames where the screen did not change, 0=encode every frame.
+        public uint changeTolerance; // ffmpeg only: with variableFrameRate, ignore changes in the lowest 0-7 bits of each color.
+        public uint holdLastFrame; // 1=repeat the last frame when the screen does not change so the video keeps frameRate.
+        public uint adaptiveFrameRate; // ffmpeg only: 1=lower the frame rate in steps while the encoder cannot keep up.
+        public uint minFrameRate; // ffmpeg only: with adaptiveFrameRate the lowest it goes, or 0 for a quarter of frameRate.
     };
 
     public interface ICapture : IDisposable
@@ -80,8 +96,9 @@ namespace ScreenRecorder
 
         /// <summary>
         /// Start encoding video using GPU hardware H264 encoding and write the video to the
-        /// specified file.  This call blocks until we read the "seconds" defined in the
-        /// VideoEncoderProperties or until another thread calls StopEncoding.
+        /// specified file.  Encoding runs in the background until we read the "seconds" defined
+        /// in the VideoEncoderProperties or until StopEncoding is called, then EncodingCompleted
+        /// is raised.
         /// </summary>
         /// <param name="file"></param>
         /// <param name="properties"></param>
@@ -92,6 +109,12 @@ namespace ScreenRecorder
         /// </summary>
         public void StopEncoding();
 
+        /// <summary>
+        /// Write the last replaySeconds of an encoding started with replaySeconds to an mp4,
+        /// the encoding keeps going. Throws if there is no replay to save.
+        /// </summary>
+        public void SaveReplay(string file);
+
         // Encode a video using software "RawCaptureImageBuffer" instead of using GPU.
         public Task EncodeVideoFrames(string file, VideoEncoderProperties properties, string outputFolder);
         public string GetErrorMessage(int hResult);
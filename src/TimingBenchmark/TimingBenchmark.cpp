@@ -0,0 +1,404 @@
+// TimingBenchmark.cpp : Measures how close each way of waiting (Timer sleeps, FpsThrottle steps and
+// the plain OS sleep they are compared to) comes to the time it was asked for and how much CPU it
+// burns doing so, and reports it as JSON so changes to the sleeping and pacing code can be compared
+// from one build to the next. It builds on Windows with the solution and on Linux with the
+// CMakeLists.txt here, and with --seconds and --warmup a full run fits in a few seconds.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include "Clock.h"
+#include "Timer.h"
+#include "FpsThrottle.h"
+#include "TimingLog.h"
+
+using namespace util;
+
+// A way of waiting that the benchmark can measure. Start is called once with the target of the run,
+// microseconds for sleeps and frames per second for pacers, then Wait over and over. Wait returns the
+// time in Clock nanoseconds it was meant to return at, the error is how long after that it did.
+class Strategy
+{
+public:
+	virtual ~Strategy() {}
+	virtual void Start(double target) = 0;
+	virtual int64_t Wait() = 0;
+	// Deadlines a pacer gave up on because it was already past them.
+	virtual uint64_t Missed() const { return 0; }
+};
+
+// std::this_thread::sleep_for, what the OS gives without any help, as the baseline.
+class OsSleep : public Strategy
+{
+	int64_t _nanoseconds = 0;
+
+public:
+	void Start(double microseconds) override {
+		_nanoseconds = static_cast<int64_t>(microseconds * 1000);
+	}
+
+	int64_t Wait() override {
+		int64_t deadline = Clock::Nanoseconds() + _nanoseconds;
+		std::this_thread::sleep_for(std::chrono::nanoseconds(_nanoseconds));
+		return deadline;
+	}
+};
+
+class TimerSleep : public Strategy
+{
+	Timer _timer;
+	int64_t _microseconds = 0;
+
+public:
+	explicit TimerSleep(SleepPolicy policy) {
+		_timer.SetPolicy(policy);
+	}
+
+	void Start(double microseconds) override {
+		_microseconds = static_cast<int64_t>(microseconds);
+	}
+
+	int64_t Wait() override {
+		// read before the timer reads its own start, so the error can only come out a little high.
+		int64_t deadline = Clock::Nanoseconds() + _microseconds * 1000;
+		_timer.Sleep(_microseconds);
+		return deadline;
+	}
+};
+
+// FpsThrottle steps, each measured against its deadline on the schedule. A step after missed deadlines
+// is measured against the last one it missed, the missed ones are counted separately.
+class ThrottleSteps : public Strategy
+{
+	SleepPolicy _policy;
+	std::unique_ptr<FpsThrottle> _throttle;
+
+public:
+	explicit ThrottleSteps(SleepPolicy policy) : _policy(policy) {
+	}
+
+	void Start(double fps) override {
+		_throttle = std::make_unique<FpsThrottle>(fps, CatchUpPolicy::SkipMissed);
+		_throttle->SetSleepPolicy(_policy);
+		_throttle->Step();
+	}
+
+	int64_t Wait() override {
+		_throttle->Step();
+		return _throttle->LastDeadline();
+	}
+
+	uint64_t Missed() const override {
+		return _throttle->Stats().missed;
+	}
+};
+
+struct StrategyInfo
+{
+	const char* name;
+	bool pacer; // takes frame rates instead of sleep lengths.
+	std::function<std::unique_ptr<Strategy>()> create;
+};
+
+// Add new clocks or pacing strategies here, they are then run with every target of their kind.
+static const std::vector<StrategyInfo>& Strategies()
+{
+	static const std::vector<StrategyInfo> strategies = {
+		{ "os-sleep", false, []() { return std::make_unique<OsSleep>(); } },
+		{ "timer-precise", false, []() { return std::make_unique<TimerSleep>(SleepPolicy::Precise); } },
+		{ "timer-balanced", false, []() { return std::make_unique<TimerSleep>(SleepPolicy::Balanced); } },
+		{ "timer-lowpower", false, []() { return std::make_unique<TimerSleep>(SleepPolicy::LowPower); } },
+		{ "throttle-precise", true, []() { return std::make_unique<ThrottleSteps>(SleepPolicy::Precise); } },
+		{ "throttle-balanced", true, []() { return std::make_unique<ThrottleSteps>(SleepPolicy::Balanced); } },
+		{ "throttle-lowpower", true, []() { return std::make_unique<ThrottleSteps>(SleepPolicy::LowPower); } },
+	};
+	return strategies;
+}
+
+struct RunOptions
+{
+	double seconds = 1;
+	double warmupSeconds = 0.25;
+	int64_t workMicroseconds = 0;
+};
+
+struct RunResult
+{
+	std::string strategy;
+	bool pacer = false;
+	double target = 0;
+	uint64_t samples = 0;
+	uint64_t early = 0; // returned before the deadline, which a wait must never do.
+	uint64_t missed = 0;
+	double seconds = 0;
+	double cpuSeconds = 0;
+	// errors in microseconds.
+	double min = 0;
+	double mean = 0;
+	double p50 = 0;
+	double p90 = 0;
+	double p99 = 0;
+	double p999 = 0;
+	double max = 0;
+	std::vector<std::pair<double, uint64_t>> histogram;
+};
+
+// Spins for up to workMicroseconds like a frame being processed between steps, returns how long.
+static int64_t Work(std::mt19937& random, int64_t workMicroseconds)
+{
+	if (workMicroseconds <= 0) {
+		return 0;
+	}
+	int64_t start = Clock::Nanoseconds();
+	int64_t end = start + std::uniform_int_distribution<int64_t>(0, workMicroseconds)(random) * 1000;
+	while (Clock::Nanoseconds() < end) {
+	}
+	return Clock::Nanoseconds() - start;
+}
+
+static RunResult Run(const StrategyInfo& info, double target, const RunOptions& options)
+{
+	RunResult result;
+	result.strategy = info.name;
+	result.pacer = info.pacer;
+	result.target = target;
+	std::unique_ptr<Strategy> strategy = info.create();
+	std::mt19937 random(1);
+	strategy->Start(target);
+
+	// lets the sleep tuners learn the overshoots before anything counts.
+	int64_t warmupEnd = Clock::Nanoseconds() + Clock::FromSeconds(options.warmupSeconds);
+	while (Clock::Nanoseconds() < warmupEnd) {
+		strategy->Wait();
+		Work(random, options.workMicroseconds);
+	}
+
+	uint64_t missedBefore = strategy->Missed();
+	std::vector<int64_t> errors;
+	DurationHistogram histogram;
+	int64_t work = 0;
+	double cpuStart = Timer::ThreadCpuSeconds();
+	int64_t start = Clock::Nanoseconds();
+	int64_t end = start + Clock::FromSeconds(options.seconds);
+	// at least a few samples however long the sleeps are.
+	while (Clock::Nanoseconds() < end || errors.size() < 10) {
+		int64_t deadline = strategy->Wait();
+		int64_t error = Clock::Nanoseconds() - deadline;
+		errors.push_back(error);
+		histogram.Add(Clock::ToSeconds(error));
+		work += Work(random, options.workMicroseconds);
+	}
+	result.seconds = Clock::ToSeconds(Clock::Nanoseconds() - start);
+	// the made up work is not what is being measured.
+	result.cpuSeconds = std::max(0.0, Timer::ThreadCpuSeconds() - cpuStart - Clock::ToSeconds(work));
+	result.missed = strategy->Missed() - missedBefore;
+
+	result.samples = errors.size();
+	double sum = 0;
+	for (int64_t error : errors) {
+		sum += Clock::ToMicroseconds(error);
+		if (error < 0) {
+			result.early++;
+		}
+	}
+	std::sort(errors.begin(), errors.end());
+	auto percentile = [&](double p) {
+		return Clock::ToMicroseconds(errors[std::min(errors.size() - 1, static_cast<size_t>(p * errors.size()))]);
+	};
+	result.min = Clock::ToMicroseconds(errors.front());
+	result.mean = sum / errors.size();
+	result.p50 = percentile(0.5);
+	result.p90 = percentile(0.9);
+	result.p99 = percentile(0.99);
+	result.p999 = percentile(0.999);
+	result.max = Clock::ToMicroseconds(errors.back());
+
+	// early wake ups are counted in the first bucket, they are reported separately.
+	std::vector<double> seconds(1024);
+	std::vector<uint64_t> counts(1024);
+	size_t buckets = std::min<size_t>(histogram.Read(seconds.data(), counts.data(), seconds.size()), seconds.size());
+	for (size_t i = 0; i < buckets; i++) {
+		result.histogram.emplace_back(seconds[i] * 1e6, counts[i]);
+	}
+	return result;
+}
+
+static void WriteJson(std::ostream& out, const RunOptions& options, const std::vector<RunResult>& runs)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"clock\": \"" << (Clock::Source() == ClockSource::Tsc ? "tsc" : "steady") << "\",\n";
+	out << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "  \"seconds\": " << options.seconds << ", \"warmupSeconds\": " << options.warmupSeconds
+		<< ", \"workMicroseconds\": " << options.workMicroseconds << ",\n";
+	out << "  \"runs\": [";
+	for (size_t i = 0; i < runs.size(); i++) {
+		auto& run = runs[i];
+		out << (i > 0 ? "," : "") << "\n    {\n";
+		out << "      \"strategy\": \"" << run.strategy << "\", " << (run.pacer ? "\"fps\": " : "\"sleepMicroseconds\": ") << run.target << ",\n";
+		out << "      \"samples\": " << run.samples << ", \"early\": " << run.early << ", \"missed\": " << run.missed
+			<< ", \"seconds\": " << run.seconds << ", \"cpuCores\": " << (run.seconds > 0 ? run.cpuSeconds / run.seconds : 0) << ",\n";
+		out << "      \"errorMicroseconds\": { \"min\": " << run.min << ", \"mean\": " << run.mean << ", \"p50\": " << run.p50
+			<< ", \"p90\": " << run.p90 << ", \"p99\": " << run.p99 << ", \"p999\": " << run.p999 << ", \"max\": " << run.max << " },\n";
+		// each bucket is the middle of its range in microseconds and how many errors fell in it.
+		out << "      \"histogram\": [";
+		for (size_t b = 0; b < run.histogram.size(); b++) {
+			out << (b > 0 ? ", " : "") << "[" << run.histogram[b].first << ", " << run.histogram[b].second << "]";
+		}
+		out << "]\n    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+static std::vector<std::string> Split(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static std::vector<double> SplitNumbers(const std::string& list)
+{
+	std::vector<double> numbers;
+	for (auto& item : Split(list)) {
+		double number = std::stod(item);
+		if (!(number > 0)) {
+			throw std::invalid_argument("expected positive numbers, got " + item);
+		}
+		numbers.push_back(number);
+	}
+	return numbers;
+}
+
+static void PrintUsage()
+{
+	std::cerr << "Usage: TimingBenchmark [options]\n"
+		"  --strategies name,...  what to measure (default all, see --list)\n"
+		"  --sleeps us,...        sleep lengths in microseconds for the sleep strategies (default 10000,1000,100)\n"
+		"  --fps n,...            frame rates for the throttle strategies (default 30,60,240)\n"
+		"  --seconds s            how long each run is measured for (default 1)\n"
+		"  --warmup s             how long each run waits before it is measured (default 0.25)\n"
+		"  --work us              spin up to this long between waits, like processing a frame (default 0)\n"
+		"  --clock steady|tsc     the clock everything is timed with (default steady)\n"
+		"  --output file.json     where the results go (default stdout)\n"
+		"  --list                 list the strategies\n"
+		"Exits with 1 if any wait returned early.\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> names;
+	std::vector<double> sleeps = { 10000, 1000, 100 };
+	std::vector<double> rates = { 30, 60, 240 };
+	RunOptions options;
+	std::string clock = "steady";
+	std::string outputPath;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> std::string {
+				if (i + 1 >= argc) {
+					throw std::invalid_argument(arg + " needs a value");
+				}
+				return argv[++i];
+			};
+			if (arg == "--strategies") names = Split(value());
+			else if (arg == "--sleeps") sleeps = SplitNumbers(value());
+			else if (arg == "--fps") rates = SplitNumbers(value());
+			else if (arg == "--seconds") options.seconds = std::stod(value());
+			else if (arg == "--warmup") options.warmupSeconds = std::stod(value());
+			else if (arg == "--work") options.workMicroseconds = std::stoll(value());
+			else if (arg == "--clock") clock = value();
+			else if (arg == "--output") outputPath = value();
+			else if (arg == "--list") {
+				for (auto& info : Strategies()) {
+					std::cout << info.name << (info.pacer ? " (fps)" : " (sleeps)") << "\n";
+				}
+				return 0;
+			}
+			else if (arg == "--help" || arg == "-h") {
+				PrintUsage();
+				return 0;
+			}
+			else {
+				throw std::invalid_argument("unknown argument " + arg);
+			}
+		}
+		for (auto& name : names) {
+			auto found = std::find_if(Strategies().begin(), Strategies().end(), [&](const StrategyInfo& info) { return name == info.name; });
+			if (found == Strategies().end()) {
+				throw std::invalid_argument("unknown strategy " + name);
+			}
+		}
+		if (options.seconds <= 0 || options.warmupSeconds < 0) {
+			throw std::invalid_argument("--seconds must be positive and --warmup not negative");
+		}
+		if (clock == "tsc") {
+			if (!Clock::UseTsc()) {
+				throw std::invalid_argument("this cpu has no invariant time stamp counter");
+			}
+		}
+		else if (clock != "steady") {
+			throw std::invalid_argument("unknown clock " + clock);
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<RunResult> runs;
+	bool early = false;
+	for (auto& info : Strategies()) {
+		if (!names.empty() && std::find(names.begin(), names.end(), info.name) == names.end()) {
+			continue;
+		}
+		for (double target : info.pacer ? rates : sleeps) {
+			std::cerr << info.name << " " << target << (info.pacer ? " fps: " : " us: ") << std::flush;
+			RunResult run = Run(info, target, options);
+			auto precision = std::cerr.precision();
+			std::cerr << std::fixed << std::setprecision(1) << "p50 " << run.p50 << "us, p99 " << run.p99 << "us, max "
+				<< run.max << "us, cpu " << (run.seconds > 0 ? run.cpuSeconds / run.seconds * 100 : 0) << "%" << std::endl;
+			std::cerr.unsetf(std::ios::floatfield);
+			std::cerr.precision(precision);
+			if (run.early > 0) {
+				std::cerr << "  " << run.early << " waits returned early" << std::endl;
+				early = true;
+			}
+			runs.push_back(std::move(run));
+		}
+	}
+
+	if (outputPath.empty()) {
+		WriteJson(std::cout, options, runs);
+	}
+	else {
+		std::ofstream file(outputPath);
+		WriteJson(file, options, runs);
+		if (!file) {
+			std::cerr << "cannot write " << outputPath << std::endl;
+			return 1;
+		}
+	}
+	return early ? 1 : 0;
+}
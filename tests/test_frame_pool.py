@@ -0,0 +1,139 @@
+import ctypes
+import gc
+from typing import Dict, List
+
+import numpy as np
+import pytest
+
+from wincam import FramePool, PixelFormat
+
+
+class MockFrameBuffers:
+    """Stands in for the frame pool functions of NativeScreenRecorder so the python side can be tested without the
+    native library, lending aligned ctypes buffers the way FrameBufferLender does."""
+
+    def __init__(self):
+        self.allocations = 0
+        self.closed = False
+        self.alignment = 64
+        self.max_buffers = 0
+        self.free: List[int] = []
+        self.lent: Dict[int, int] = {}
+        self.memory: Dict[int, ctypes.Array] = {}
+
+    def create_frame_pool(self, alignment: int, max_buffers: int) -> int:
+        self.alignment = alignment
+        self.max_buffers = max_buffers
+        return 1
+
+    def lend_frame_buffer(self, pool: int, size: int) -> int:
+        if self.closed or len(self.lent) >= self.max_buffers:
+            return 0
+        if self.free:
+            address = self.free.pop()
+        else:
+            block = ctypes.create_string_buffer(size + self.alignment)
+            address = (ctypes.addressof(block) + self.alignment - 1) // self.alignment * self.alignment
+            self.memory[address] = block
+            self.allocations += 1
+        self.lent[address] = size
+        return address
+
+    def return_frame_buffer(self, pool: int, address: int) -> bool:
+        if self.lent.pop(address, None) is None:
+            return False
+        self.free.append(address)
+        return True
+
+    def close_frame_pool(self, pool: int):
+        self.closed = True
+
+
+def render(address: int, width: int, height: int, channels: int, stride: int, value: int):
+    """Writes pixel (x, y) channel c as value + x + y + c, like a native conversion writing rows of stride bytes."""
+    row = (value + np.arange(width)[:, None] + np.arange(channels)[None, :]).astype(np.uint8).ravel()
+    for y in range(height):
+        ctypes.memmove(address + y * stride, ((row + y).astype(np.uint8)).ctypes.data, width * channels)
+
+
+def test_frame_pool_is_zero_copy():
+    native = MockFrameBuffers()
+    width, height = 101, 7
+    pool = FramePool(native, width, height, PixelFormat.BGR, max_buffers=2)
+    assert pool.stride % 64 == 0 and pool.stride >= width * 3
+
+    def read(address, size, stride):
+        assert size == stride * height
+        render(address, width, height, 3, stride, 10)
+        return 1.5
+
+    frame = pool.lend(read)
+    assert frame is not None and frame.timestamp == 1.5
+    image = np.asarray(frame)
+    assert image.ctypes.data == frame.address
+    assert image.shape == (height, width, 3)
+    assert image.strides == (pool.stride, 3, 1)
+    assert image[3, 5, 2] == 10 + 5 + 2 + 3
+    del image
+
+    gray = FramePool(MockFrameBuffers(), width, height, PixelFormat.GRAY8)
+    with gray.lend(lambda address, size, stride: 1.0) as frame:
+        assert frame.array.shape == (height, width)
+        assert frame.array.strides == (gray.stride, 1)
+
+
+def test_frame_pool_reuses_buffers():
+    native = MockFrameBuffers()
+    pool = FramePool(native, 64, 48, PixelFormat.BGRA, max_buffers=3)
+    for i in range(100):
+        with pool.lend(lambda address, size, stride: 1.0) as frame:
+            frame.array[0, 0, 0] = i
+    assert native.allocations == 1
+    assert pool.lent == 0
+
+    # frames go back when they and their arrays are gone, not only when released.
+    frame = pool.lend(lambda address, size, stride: 1.0)
+    image = frame.array
+    del frame
+    assert pool.lent == 1
+    del image
+    gc.collect()
+    assert pool.lent == 0
+
+    # a read without a frame gives the buffer straight back.
+    assert pool.lend(lambda address, size, stride: 0) is None
+    assert pool.lent == 0
+
+
+def test_frame_pool_limits_and_close():
+    native = MockFrameBuffers()
+    pool = FramePool(native, 16, 16, PixelFormat.RGB, max_buffers=2)
+    first = pool.lend(lambda address, size, stride: 1.0)
+    second = pool.lend(lambda address, size, stride: 2.0)
+    with pytest.raises(Exception):
+        pool.lend(lambda address, size, stride: 3.0)
+
+    first.release()
+    assert first.released
+    with pytest.raises(Exception):
+        np.asarray(first)
+
+    # frames still held stay valid after the pool is closed.
+    pool.close()
+    assert native.closed
+    with pytest.raises(Exception):
+        pool.lend(lambda address, size, stride: 1.0)
+    second.array[:] = 7
+    second.release()
+    assert pool.lent == 0 and not native.lent
+
+
+def test_frame_pool_allocates_once(width=1920, height=1080, frames=30):
+    """Reading frame after frame into lent buffers allocates one buffer, not one per frame."""
+    native = MockFrameBuffers()
+    pool = FramePool(native, width, height, PixelFormat.BGR, max_buffers=2)
+    for _ in range(frames):
+        with pool.lend(lambda address, size, stride: 1.0) as frame:
+            assert frame.array.shape == (height, width, 3)
+    assert native.allocations == 1
+    assert pool.lent == 0
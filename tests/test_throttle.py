@@ -29,6 +29,10 @@ def test_throttle(test_frames=60, fps=30):
         for step in times:
             f.write(f"{step}\n")
 
+    stats = throttle.stats()
+    print(f"lateness p50: {stats.p50 * 1000:.3f} ms, p99: {stats.p99 * 1000:.3f} ms, missed: {stats.missed}")
+    assert stats.steps == test_frames
+
     assert len(times) > test_frames * 0.9
     assert len(times) < test_frames * 1.1
     assert avg_step * 1000 > fps * 0.85
@@ -1,8 +1,42 @@
 from wincam.camera import Camera
 from wincam.dxcam import DXCamera
+from wincam.frame_pool import FramePool, PooledFrame
 from wincam.logger import Logger
-from wincam.native import EncodingProperties, VideoEncodingQuality
+from wincam.native import (
+    CatchUpPolicy,
+    ClockSource,
+    EncoderAdjustment,
+    EncoderProfile,
+    EncodingProperties,
+    FrameTimingStats,
+    PixelFormat,
+    ResizeFilter,
+    SleepPolicy,
+    ThrottleStats,
+    VideoContainer,
+    VideoEncodingQuality,
+)
 from wincam.throttle import FpsThrottle
 from wincam.timer import Timer
 
-__all__ = ["Camera", "DXCamera", "Logger", "Timer", "FpsThrottle", "EncodingProperties", "VideoEncodingQuality"]
+__all__ = [
+    "Camera",
+    "DXCamera",
+    "Logger",
+    "Timer",
+    "FpsThrottle",
+    "EncodingProperties",
+    "EncoderProfile",
+    "VideoEncodingQuality",
+    "VideoContainer",
+    "PixelFormat",
+    "ResizeFilter",
+    "FrameTimingStats",
+    "EncoderAdjustment",
+    "ClockSource",
+    "SleepPolicy",
+    "CatchUpPolicy",
+    "ThrottleStats",
+    "FramePool",
+    "PooledFrame",
+]
@@ -1,11 +1,20 @@
 import os
-from typing import List, Tuple
+from typing import Dict, List, Optional, Tuple
 
-import cv2
 import numpy as np
 
 from wincam.camera import Camera
-from wincam.native import EncodingProperties, NativeScreenRecorder, Rect
+from wincam.frame_pool import FramePool, PooledFrame
+from wincam.native import (
+    EncoderAdjustment,
+    EncodingProperties,
+    FrameTimingStats,
+    NativeScreenRecorder,
+    PixelFormat,
+    Rect,
+    ResizeFilter,
+    ThrottleStats,
+)
 from wincam.throttle import FpsThrottle
 
 script_dir = os.path.dirname(os.path.realpath(__file__))
@@ -18,7 +27,20 @@ class DXCamera(Camera):
     which is based on Direct3D11CaptureFramePool.
     See https://learn.microsoft.com/en-us/uwp/api/windows.graphics.capture.direct3d11captureframepool"""
 
-    def __init__(self, left: int, top: int, width: int, height: int, fps: int = 30, capture_cursor: bool = True):
+    def __init__(
+        self,
+        left: int,
+        top: int,
+        width: int,
+        height: int,
+        fps: int = 30,
+        capture_cursor: bool = True,
+        output_size: Optional[Tuple[int, int]] = None,
+        resize_filter: ResizeFilter = ResizeFilter.Box,
+        resize_threads: int = 1,
+    ):
+        """output_size is an optional (width, height) that frames are scaled to natively while they
+        are converted, which is a lot cheaper than returning the full frame and resizing it in python."""
         super().__init__()
         if os.name != "nt":
             raise Exception("This class only works on Windows")
@@ -28,13 +50,18 @@ class DXCamera(Camera):
         self._left = left
         self._top = top
         self._capture_cursor = capture_cursor
+        self._output_size = output_size
+        self._resize_filter = resize_filter
+        self._resize_threads = resize_threads
         self._throttle = FpsThrottle(fps)
         self._native = NativeScreenRecorder()
         self._started = False
-        self._buffer = None
-        self._size = 0
+        self._frames: Dict[PixelFormat, np.ndarray] = {}
+        self._regions: Dict[int, np.ndarray] = {}
+        self._pools: Dict[PixelFormat, FramePool] = {}
         self._capture_bounds = Rect()
         self._handle = -1
+        self._encoder = 0
 
     def __enter__(self):
         if self._instance is None:
@@ -50,34 +77,109 @@ class DXCamera(Camera):
     def reset_throttle(self):
         self._throttle.reset()
 
-    def get_bgr_frame(self) -> Tuple[np.ndarray, float]:
-        if not self._started:
-            self._handle = self._native.start_capture(
-                self._left, self._top, self._width, self._height, self._capture_cursor
-            )
-            if not self._native.wait_for_next_frame(self._handle, 10000):
-                raise Exception("Frames are not being captured")
-
-            self._capture_bounds = self._native.get_capture_bounds(self._handle)
-            self._size = self._capture_bounds.width * self._capture_bounds.height * 4
-            self._buffer = self._native.create_buffer(self._size)
-            self._started = True
-            self._throttle.reset()
-
-        timestamp = self._native.read_next_frame(self._handle, self._buffer, len(self._buffer))
-        image = np.reshape(
-            np.frombuffer(self._buffer, dtype=np.uint8), (self._capture_bounds.height, self._capture_bounds.width, 4)
+    def _start(self):
+        self._handle = self._native.start_capture(
+            self._left, self._top, self._width, self._height, self._capture_cursor
         )
-        # strip out the alpha channel, and any 64-byte aligned extra width
-        image = image[:, : self._width, :3]
+        if not self._native.wait_for_next_frame(self._handle, 10000):
+            raise Exception("Frames are not being captured")
+
+        self._capture_bounds = self._native.get_capture_bounds(self._handle)
+        if self._output_size is not None:
+            width, height = self._output_size
+            self._native.set_output_size(self._handle, width, height, self._resize_filter, self._resize_threads)
+        self._started = True
+        self._throttle.reset()
 
+    def _read_frame(self, format: PixelFormat) -> Tuple[np.ndarray, float]:
+        if not self._started:
+            self._start()
+
+        # the native side writes tightly packed pixels straight into this array, it is reused for
+        # the next frame in the same format so copy it if you need to keep it.
+        image = self._frames.get(format)
+        if image is None:
+            width, height = self._output_size if self._output_size is not None else (self._width, self._height)
+            if format == PixelFormat.GRAY8:
+                shape: Tuple[int, ...] = (height, width)
+            else:
+                shape = (height, width, format.channels)
+            image = np.empty(shape, dtype=np.uint8)
+            self._frames[format] = image
+
+        timestamp = self._native.read_next_frame_ex(self._handle, image.ctypes.data, image.nbytes, format)
         self._throttle.step()
+        self._throttle.align_to_capture(self._handle)
         return image, timestamp
 
+    def lend_frame(self, format: PixelFormat = PixelFormat.BGR, max_buffers: int = 4) -> Optional[PooledFrame]:
+        """Returns the next frame in a native buffer that np.asarray(frame) wraps without copying, unlike
+        get_bgr_frame the frame stays valid until it is released, so up to max_buffers of them can be
+        kept at once, for example while another thread processes them. Returns None if no frame was read."""
+        if not self._started:
+            self._start()
+        pool = self._pools.get(format)
+        if pool is None:
+            width, height = self._output_size if self._output_size is not None else (self._width, self._height)
+            pool = FramePool(self._native, width, height, format, max_buffers)
+            self._pools[format] = pool
+
+        frame = pool.lend(
+            lambda address, size, stride: self._native.read_next_frame_ex(self._handle, address, size, format, stride)
+        )
+        self._throttle.step()
+        self._throttle.align_to_capture(self._handle)
+        return frame
+
+    def get_bgr_frame(self) -> Tuple[np.ndarray, float]:
+        return self._read_frame(PixelFormat.BGR)
+
     def get_rgb_frame(self) -> Tuple[np.ndarray, float]:
-        frame, timestamp = self.get_bgr_frame()
-        frame = cv2.cvtColor(frame, cv2.COLOR_BGR2RGB)
-        return frame, timestamp
+        return self._read_frame(PixelFormat.RGB)
+
+    def get_gray_frame(self) -> Tuple[np.ndarray, float]:
+        """Returns the next frame as a single channel image using the same weights as cv2.COLOR_BGR2GRAY."""
+        return self._read_frame(PixelFormat.GRAY8)
+
+    def add_region(
+        self,
+        x: int,
+        y: int,
+        width: int,
+        height: int,
+        output_size: Optional[Tuple[int, int]] = None,
+        format: PixelFormat = PixelFormat.BGR,
+        resize_filter: ResizeFilter = ResizeFilter.Box,
+    ) -> int:
+        """Adds a region of interest relative to the camera bounds and returns its id for get_region_frame.
+        All regions are served from this one capture with a single copy and readback per frame, and
+        get_bgr_frame and video encoding still get the full frame."""
+        if not self._started:
+            self._start()
+        output_width, output_height = output_size if output_size is not None else (0, 0)
+        region = self._native.add_region(
+            self._handle, x, y, width, height, output_width, output_height, format, resize_filter
+        )
+        if region == 0:
+            raise Exception(f"Region ({x}, {y}) ({width} x {height}) is outside the camera bounds")
+        x0, y0 = max(x, 0), max(y, 0)
+        clipped = (min(x + width, self._width) - x0, min(y + height, self._height) - y0)
+        out_width, out_height = output_size if output_size is not None else clipped
+        shape: Tuple[int, ...] = (out_height, out_width)
+        if format != PixelFormat.GRAY8:
+            shape = (out_height, out_width, format.channels)
+        self._regions[region] = np.empty(shape, dtype=np.uint8)
+        return region
+
+    def remove_region(self, region: int):
+        self._native.remove_region(self._handle, region)
+        self._regions.pop(region, None)
+
+    def get_region_frame(self, region: int) -> Tuple[np.ndarray, float]:
+        """Returns the latest frame of the region, the array is reused for the next call."""
+        image = self._regions[region]
+        timestamp = self._native.read_region(self._handle, region, image.ctypes.data, image.nbytes)
+        return image, timestamp
 
     def encode_video(self, file_name: str, properties: EncodingProperties):
         self.get_bgr_frame()  # make sure we're getting frames.
@@ -85,23 +187,81 @@ class DXCamera(Camera):
         if os.path.isfile(full_path):
             os.remove(full_path)
 
-        self._native.encode_video(self._handle, full_path, properties)
+        if self._encoder:
+            self._native.close_encoder(self._encoder)
+        self._encoder = self._native.encode_video(self._handle, full_path, properties)
+        if not self._encoder:
+            raise Exception("This camera is already encoding a video")
+        error = self._native.wait_for_encoder(self._encoder)
+        if error != 0:
+            raise Exception(f"Video encoding failed: {self._native.get_error_message(self._encoder, error)}")
+
+    def start_replay(self, properties: EncodingProperties):
+        """Starts keeping the last properties.replay_seconds of video in memory without writing
+        anything, save_replay writes them out. Returns right away, stop_encoding ends it."""
+        if properties.replay_seconds <= 0:
+            raise ValueError("replay_seconds has to be set for a replay")
+        self.get_bgr_frame()  # make sure we're getting frames.
+        if self._encoder:
+            self._native.close_encoder(self._encoder)
+        self._encoder = self._native.encode_video(self._handle, None, properties)
+        if not self._encoder:
+            raise Exception("This camera is already encoding a video")
+
+    def save_replay(self, file_name: str):
+        """Writes what start_replay kept so far to an mp4 that starts on a key frame, the replay
+        keeps going."""
+        full_path = os.path.realpath(file_name)
+        error = self._native.save_replay(self._encoder, full_path)
+        if error != 0:
+            raise Exception(f"Saving the replay failed: {self._native.get_error_message(self._encoder, error)}")
 
     def stop_encoding(self):
-        self._native.stop_encoding()
+        if self._encoder:
+            self._native.stop_encoding(self._encoder)
 
     def stop_capture(self):
         self._native.stop_capture(self._handle)
         self._handle = -1
 
     def get_video_ticks(self) -> List[float]:
-        return self._native.get_sample_times()
+        if not self._encoder:
+            return []
+        return self._native.get_sample_times(self._encoder)
 
     def get_frame_times(self) -> List[float]:
         return self._native.get_capture_times(self._handle)
 
+    def read_frame_times(self, cursor: int = 0) -> Tuple[List[float], int]:
+        """Returns the frame times captured after cursor and the cursor for the next call, so polling
+        only copies the new ones. Only the most recent 65536 are kept."""
+        return self._native.read_capture_times(self._handle, cursor)
+
+    def get_frame_timing_stats(self) -> FrameTimingStats:
+        """Frame count, mean and p50/p95/p99/max gap between frames since the capture started."""
+        return self._native.get_capture_timing_stats(self._handle)
+
+    def get_video_timing_stats(self) -> FrameTimingStats:
+        return self._native.get_sample_timing_stats(self._encoder)
+
+    def get_throttle_stats(self) -> ThrottleStats:
+        """How late the frame reads returned after the times the fps throttle scheduled them for."""
+        return self._throttle.stats()
+
+    def get_encoder_adjustments(self) -> List[EncoderAdjustment]:
+        """When the encoder lowered or raised its frame rate to keep up, with adaptive_frame_rate."""
+        if not self._encoder:
+            return []
+        return self._native.get_encoder_adjustments(self._encoder)
+
     def stop(self):
         self._started = False
-        self.stop_encoding()
+        if self._encoder:
+            self._native.close_encoder(self._encoder)
+            self._encoder = 0
         self.stop_capture()
-        self._buffer = None
+        self._frames = {}
+        self._regions = {}
+        for pool in self._pools.values():
+            pool.close()
+        self._pools = {}
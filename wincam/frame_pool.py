@@ -0,0 +1,136 @@
+from typing import Any, Callable, Dict, Optional, Tuple
+
+import numpy as np
+
+from wincam.native import PixelFormat
+
+
+class PooledFrame:
+    """A frame in a buffer the native library lends to python. np.asarray(frame) or frame.array is a numpy view of
+    that buffer with the frame's shape and strides, nothing is copied. The buffer goes back to the pool to be reused
+    for another frame when you call release(), at the end of a with block, or when the frame and every array made from
+    it are gone, so don't use the array after releasing the frame."""
+
+    def __init__(
+        self,
+        pool: "FramePool",
+        address: int,
+        shape: Tuple[int, ...],
+        strides: Tuple[int, ...],
+        timestamp: float,
+    ):
+        self._pool: Optional[FramePool] = pool
+        self.address = address
+        self.shape = shape
+        self.strides = strides
+        self.timestamp = timestamp
+
+    @property
+    def __array_interface__(self) -> Dict[str, Any]:
+        if self._pool is None:
+            raise Exception("This frame has been released")
+        return {
+            "version": 3,
+            "shape": self.shape,
+            "strides": self.strides,
+            "typestr": "|u1",
+            "data": (self.address, False),
+        }
+
+    @property
+    def array(self) -> np.ndarray:
+        # not cached, the array keeps this frame alive through its base and a cycle would keep the buffer lent
+        # until the garbage collector runs.
+        return np.asarray(self)
+
+    @property
+    def released(self) -> bool:
+        return self._pool is None
+
+    def release(self):
+        """Gives the buffer back to the pool, the next frame can be read into it."""
+        pool = self._pool
+        if pool is not None:
+            self._pool = None
+            pool._return(self.address)
+
+    def __enter__(self) -> "PooledFrame":
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.release()
+
+    def __del__(self):
+        self.release()
+
+
+class FramePool:
+    """Lends frames of one size and pixel format in native buffers that are reused instead of allocating and
+    copying a numpy array for every frame. Each row starts on a multiple of alignment bytes so the native conversion
+    can write whole cache lines, and up to max_buffers frames can be held at once. native is the NativeScreenRecorder,
+    or anything else with its create_frame_pool, lend_frame_buffer, return_frame_buffer and close_frame_pool
+    methods."""
+
+    def __init__(
+        self,
+        native: Any,
+        width: int,
+        height: int,
+        format: PixelFormat,
+        max_buffers: int = 4,
+        alignment: int = 64,
+    ):
+        self._native = native
+        self.width = width
+        self.height = height
+        self.format = format
+        self.max_buffers = max_buffers
+        channels = format.channels
+        self.stride = (width * channels + alignment - 1) // alignment * alignment
+        self.size = self.stride * height
+        if format == PixelFormat.GRAY8:
+            self.shape: Tuple[int, ...] = (height, width)
+            self.strides: Tuple[int, ...] = (self.stride, 1)
+        else:
+            self.shape = (height, width, channels)
+            self.strides = (self.stride, channels, 1)
+        self._pool = native.create_frame_pool(alignment, max_buffers)
+        if self._pool == 0:
+            raise Exception(f"Invalid frame buffer alignment {alignment}")
+        self._lent = 0
+        self._closed = False
+
+    @property
+    def lent(self) -> int:
+        """How many frames of this pool have not been released yet."""
+        return self._lent
+
+    def lend(self, read: Callable[[int, int, int], float]) -> Optional[PooledFrame]:
+        """Borrows a buffer and calls read(address, size, stride) to read a frame into it, which returns the frame's
+        timestamp or 0 if there was none, in which case the buffer goes straight back and this returns None."""
+        if self._closed:
+            raise Exception("This frame pool is closed")
+        address = self._native.lend_frame_buffer(self._pool, self.size)
+        if not address:
+            raise Exception(f"All {self.max_buffers} frame buffers are in use, release some frames first")
+        self._lent += 1
+        frame = PooledFrame(self, address, self.shape, self.strides, 0)
+        frame.timestamp = read(address, self.size, self.stride)
+        if not frame.timestamp:
+            frame.release()
+            return None
+        return frame
+
+    def _return(self, address: int):
+        self._lent -= 1
+        self._native.return_frame_buffer(self._pool, address)
+
+    def close(self):
+        """No more frames are lent, the ones still held stay valid until they are released."""
+        if not self._closed:
+            self._closed = True
+            self._native.close_frame_pool(self._pool)
+
+    def __del__(self):
+        if getattr(self, "_pool", 0):
+            self.close()
@@ -1,7 +1,7 @@
 import ctypes as ct
 from enum import Enum
 import os
-from typing import Any, List
+from typing import Any, List, Optional, Tuple
 
 script_dir = os.path.dirname(os.path.realpath(__file__))
 
@@ -17,6 +17,62 @@ class _EncoderPropertiesStruct(ct.Structure):
         ("quality", ct.c_uint32),
         ("seconds", ct.c_uint32),
         ("ffmpeg", ct.c_uint32),
+        ("queue_depth", ct.c_uint32),
+        ("drop_policy", ct.c_uint32),
+        ("container", ct.c_uint32),
+        ("fragment_milliseconds", ct.c_uint32),
+        ("replay_seconds", ct.c_uint32),
+        ("replay_megabytes", ct.c_uint32),
+        ("segment_seconds", ct.c_uint32),
+        ("segment_megabytes", ct.c_uint32),
+        ("profile", ct.c_uint32),
+        ("encoder_options", ct.c_char_p),
+        ("variable_frame_rate", ct.c_uint32),
+        ("change_tolerance", ct.c_uint32),
+        ("hold_last_frame", ct.c_uint32),
+        ("adaptive_frame_rate", ct.c_uint32),
+        ("min_frame_rate", ct.c_uint32),
+    ]
+
+
+class FrameTimingStats(ct.Structure):
+    """Running statistics over every frame, a gap is the seconds between two consecutive frames."""
+
+    _fields_ = [
+        ("count", ct.c_uint64),
+        ("first", ct.c_double),
+        ("last", ct.c_double),
+        ("mean_gap", ct.c_double),
+        ("p50_gap", ct.c_double),
+        ("p95_gap", ct.c_double),
+        ("p99_gap", ct.c_double),
+        ("max_gap", ct.c_double),
+    ]
+
+
+class EncoderAdjustment(ct.Structure):
+    """A change of the frame rate an encoder with adaptive_frame_rate keeps, time is in seconds since
+    encoding started and load is how busy its busiest stage was, 1 meaning all of the time."""
+
+    _fields_ = [
+        ("time", ct.c_double),
+        ("frame_rate", ct.c_double),
+        ("load", ct.c_double),
+    ]
+
+
+class ThrottleStats(ct.Structure):
+    """How late the steps of a native throttle returned after their deadlines, in seconds, and how many
+    deadlines were skipped or given up after stalls."""
+
+    _fields_ = [
+        ("steps", ct.c_uint64),
+        ("missed", ct.c_uint64),
+        ("p50", ct.c_double),
+        ("p90", ct.c_double),
+        ("p99", ct.c_double),
+        ("p999", ct.c_double),
+        ("max", ct.c_double),
     ]
 
 
@@ -39,6 +95,62 @@ class VideoEncodingQuality(Enum):
     Uhd4320p = 9
 
 
+class PixelFormat(Enum):
+    BGRA = 0
+    BGR = 1
+    RGB = 2
+    GRAY8 = 3
+
+    @property
+    def channels(self) -> int:
+        return {PixelFormat.BGRA: 4, PixelFormat.BGR: 3, PixelFormat.RGB: 3, PixelFormat.GRAY8: 1}[self]
+
+
+class ResizeFilter(Enum):
+    Nearest = 0
+    Box = 1
+    Bilinear = 2
+
+
+class VideoContainer(Enum):
+    # a regular mp4 can only be read once encoding finishes, the other two are flushed to the file in
+    # fragments so a crash only loses the last fragment and the file can be read while recording.
+    Mp4 = 0
+    FragmentedMp4 = 1
+    MpegTs = 2
+
+
+class EncoderProfile(Enum):
+    # Default is preset fast at crf 20, LowLatency has no b-frames or lookahead and keeps to the bit rate,
+    # HighThroughput encodes the most frames per second of CPU.
+    Default = 0
+    LowLatency = 1
+    HighThroughput = 2
+
+
+class SleepPolicy(Enum):
+    # How much CPU sleep_microseconds spins at the end of each sleep to wake up on time, Precise spins for
+    # the worst recent oversleep of the OS, Balanced for the 90th percentile and LowPower for the median.
+    Precise = 0
+    Balanced = 1
+    LowPower = 2
+
+
+class ClockSource(Enum):
+    # Steady is QueryPerformanceCounter, Tsc the time stamp counter calibrated against it which is
+    # cheaper to read.
+    Steady = 0
+    Tsc = 1
+
+
+class CatchUpPolicy(Enum):
+    # What a throttle step does after a stall of a frame or more: Burst runs the missed steps back to back,
+    # SkipMissed waits for the next deadline on the schedule and Reanchor starts a new schedule from now.
+    Burst = 0
+    SkipMissed = 1
+    Reanchor = 2
+
+
 class EncodingProperties:
     def __init__(
         self,
@@ -47,6 +159,21 @@ class EncodingProperties:
         bit_rate: int = 0,
         seconds: int = 0,
         ffmpeg: int = 1,
+        queue_depth: int = 0,
+        drop_policy: int = 0,
+        container: VideoContainer = VideoContainer.Mp4,
+        fragment_milliseconds: int = 0,
+        replay_seconds: int = 0,
+        replay_megabytes: int = 0,
+        segment_seconds: int = 0,
+        segment_megabytes: int = 0,
+        profile: EncoderProfile = EncoderProfile.Default,
+        encoder_options: str = "",
+        variable_frame_rate: bool = False,
+        change_tolerance: int = 0,
+        hold_last_frame: bool = False,
+        adaptive_frame_rate: bool = False,
+        min_frame_rate: int = 0,
     ):
         # if you send bit_rate 0 it will compute the best bitrate from your frame rate and quality and set this field
         # for you which you can then query after calling start_encoding.
@@ -55,6 +182,37 @@ class EncodingProperties:
         self.quality = quality
         self.seconds = seconds
         self.ffmpeg = ffmpeg
+        # ffmpeg only: how many frames can be in flight between the capture, convert, encode and mux
+        # threads (0 means the default of 3), and whether to drop frames (1) instead of slowing down
+        # the capture (0) when the encoder falls behind.
+        self.queue_depth = queue_depth
+        self.drop_policy = drop_policy
+        # ffmpeg only: the file format, and the fragment length for the streaming ones (0 means 1000).
+        self.container = container
+        self.fragment_milliseconds = fragment_milliseconds
+        # ffmpeg only: keep the last replay_seconds in memory for save_replay instead of writing a file,
+        # using at most replay_megabytes (0 means 256).
+        self.replay_seconds = replay_seconds
+        self.replay_megabytes = replay_megabytes
+        # ffmpeg only: start a new file (name_1.mp4, name_2.mp4, ...) every segment_seconds and/or once
+        # one reaches segment_megabytes, without stopping the capture or the encoder.
+        self.segment_seconds = segment_seconds
+        self.segment_megabytes = segment_megabytes
+        # ffmpeg only: the encoder tuning, and "key=value:key=value" encoder options applied on top of it,
+        # e.g. "preset=veryfast:crf=18:g=120:bf=0:threads=4".
+        self.profile = profile
+        self.encoder_options = encoder_options
+        # ffmpeg only: skip frames where the screen did not change, ignoring the lowest change_tolerance
+        # bits (0-7) of each color. The frames that are encoded keep their real time so playback is true.
+        self.variable_frame_rate = variable_frame_rate
+        self.change_tolerance = change_tolerance
+        # windows stops sending frames while the screen is still, this repeats the last one after a frame
+        # interval so the video keeps frame_rate instead of stalling until something changes.
+        self.hold_last_frame = hold_last_frame
+        # ffmpeg only: when the encoder cannot keep up it keeps fewer frames, in steps down to min_frame_rate
+        # (0 means a quarter of frame_rate), and goes back up once it can. get_encoder_adjustments says when.
+        self.adaptive_frame_rate = adaptive_frame_rate
+        self.min_frame_rate = min_frame_rate
 
 
 class NativeScreenRecorder:
@@ -67,11 +225,78 @@ class NativeScreenRecorder:
         self.lib.GetCaptureBounds.restype = Rect
         self.lib.EncodeVideo.argtypes = [ct.c_uint32, ct.c_wchar_p, ct.POINTER(_EncoderPropertiesStruct)]
         self.lib.EncodeVideo.restype = ct.c_uint32
-        self.lib.GetSampleTimes.argtypes = [ct.POINTER(ct.c_double), ct.c_int]
+        self.lib.WaitForEncoder.argtypes = [ct.c_uint32]
+        self.lib.IsEncoding.argtypes = [ct.c_uint32]
+        self.lib.IsEncoding.restype = ct.c_bool
+        self.lib.StopEncoding.argtypes = [ct.c_uint32]
+        self.lib.SaveReplay.argtypes = [ct.c_uint32, ct.c_wchar_p]
+        self.lib.CloseEncoder.argtypes = [ct.c_uint32]
+        self.lib.GetErrorMessage.argtypes = [ct.c_uint32, ct.c_int]
+        self.lib.GetErrorMessage.restype = ct.c_char_p
+        self.lib.GetSampleTimes.argtypes = [ct.c_uint32, ct.POINTER(ct.c_double), ct.c_int]
         self.lib.GetSampleTimes.restype = ct.c_uint32
         self.lib.GetCaptureTimes.argtypes = [ct.c_uint32, ct.POINTER(ct.c_double), ct.c_int]
         self.lib.GetCaptureTimes.restype = ct.c_uint32
+        self.lib.ReadSampleTimes.argtypes = [
+            ct.c_uint32,
+            ct.POINTER(ct.c_uint64),
+            ct.POINTER(ct.c_double),
+            ct.c_uint32,
+        ]
+        self.lib.ReadSampleTimes.restype = ct.c_uint32
+        self.lib.ReadCaptureTimes.argtypes = [
+            ct.c_uint32,
+            ct.POINTER(ct.c_uint64),
+            ct.POINTER(ct.c_double),
+            ct.c_uint32,
+        ]
+        self.lib.ReadCaptureTimes.restype = ct.c_uint32
+        self.lib.GetSampleTimingStats.argtypes = [ct.c_uint32, ct.POINTER(FrameTimingStats)]
+        self.lib.GetSampleTimingStats.restype = ct.c_bool
+        self.lib.GetCaptureTimingStats.argtypes = [ct.c_uint32, ct.POINTER(FrameTimingStats)]
+        self.lib.GetCaptureTimingStats.restype = ct.c_bool
+        self.lib.GetEncoderAdjustments.argtypes = [ct.c_uint32, ct.POINTER(EncoderAdjustment), ct.c_uint32]
+        self.lib.GetEncoderAdjustments.restype = ct.c_uint32
+        self.lib.EnableTracing.argtypes = [ct.c_bool]
+        self.lib.SaveTrace.argtypes = [ct.c_wchar_p]
+        self.lib.SaveTrace.restype = ct.c_bool
         self.lib.SleepMicroseconds.argtypes = [ct.c_uint64]
+        self.lib.SetSleepPolicy.argtypes = [ct.c_int]
+        self.lib.SetClockSource.argtypes = [ct.c_int, ct.c_uint32]
+        self.lib.SetClockSource.restype = ct.c_bool
+        self.lib.CreateThrottle.argtypes = [ct.c_double, ct.c_int]
+        self.lib.CreateThrottle.restype = ct.c_uint32
+        self.lib.ThrottleStep.argtypes = [ct.c_uint32]
+        self.lib.ThrottleStep.restype = ct.c_double
+        self.lib.ResetThrottle.argtypes = [ct.c_uint32]
+        self.lib.AlignThrottle.argtypes = [ct.c_uint32, ct.c_uint32]
+        self.lib.GetThrottleStats.argtypes = [ct.c_uint32, ct.POINTER(ThrottleStats)]
+        self.lib.GetThrottleStats.restype = ct.c_bool
+        self.lib.GetThrottleHistogram.argtypes = [
+            ct.c_uint32,
+            ct.POINTER(ct.c_double),
+            ct.POINTER(ct.c_uint64),
+            ct.c_uint32,
+        ]
+        self.lib.GetThrottleHistogram.restype = ct.c_uint32
+        self.lib.CloseThrottle.argtypes = [ct.c_uint32]
+        self.lib.CreateFramePool.argtypes = [ct.c_uint32, ct.c_uint32]
+        self.lib.CreateFramePool.restype = ct.c_uint32
+        self.lib.LendFrameBuffer.argtypes = [ct.c_uint32, ct.c_uint64]
+        self.lib.LendFrameBuffer.restype = ct.c_void_p
+        self.lib.ReturnFrameBuffer.argtypes = [ct.c_uint32, ct.c_void_p]
+        self.lib.ReturnFrameBuffer.restype = ct.c_bool
+        self.lib.GetLentFrameBuffers.argtypes = [ct.c_uint32]
+        self.lib.GetLentFrameBuffers.restype = ct.c_uint32
+        self.lib.CloseFramePool.argtypes = [ct.c_uint32]
+        self.lib.ReadNextFrameEx.argtypes = [ct.c_uint32, ct.c_void_p, ct.c_uint32, ct.c_int, ct.c_uint32]
+        self.lib.ReadNextFrameEx.restype = ct.c_double
+        self.lib.AddRegion.argtypes = [ct.c_uint32] + [ct.c_int] * 4 + [ct.c_uint32, ct.c_uint32, ct.c_int, ct.c_int]
+        self.lib.AddRegion.restype = ct.c_uint32
+        self.lib.ReadRegion.argtypes = [ct.c_uint32, ct.c_uint32, ct.c_void_p, ct.c_uint32, ct.c_uint32]
+        self.lib.ReadRegion.restype = ct.c_double
+        self.lib.GetFrameSequence.argtypes = [ct.c_uint32]
+        self.lib.GetFrameSequence.restype = ct.c_uint64
 
     def start_capture(self, left: int, top: int, width: int, height: int, capture_cursor: bool) -> int:
         return self.lib.StartCapture(left, top, width, height, capture_cursor)
@@ -79,6 +304,40 @@ class NativeScreenRecorder:
     def stop_capture(self, handle: int) -> None:
         self.lib.StopCapture(handle)
 
+    def set_max_textures(self, handle: int, max_textures: int) -> None:
+        self.lib.SetMaxTextures(handle, max_textures)
+
+    def set_readback_latency(self, handle: int, frames: int) -> None:
+        self.lib.SetReadbackLatency(handle, frames)
+
+    def set_output_size(self, handle: int, width: int, height: int, filter: ResizeFilter, threads: int = 1) -> None:
+        """Makes read_next_frame_ex scale frames to width x height, 0 x 0 turns it off."""
+        self.lib.SetOutputSize(handle, width, height, filter.value, threads)
+
+    def add_region(
+        self,
+        handle: int,
+        x: int,
+        y: int,
+        width: int,
+        height: int,
+        output_width: int,
+        output_height: int,
+        format: PixelFormat,
+        filter: ResizeFilter,
+    ) -> int:
+        """Adds a region of interest in capture coordinates, returns its id or 0 if it is outside the capture."""
+        return self.lib.AddRegion(handle, x, y, width, height, output_width, output_height, format.value, filter.value)
+
+    def remove_region(self, handle: int, region: int) -> None:
+        self.lib.RemoveRegion(handle, region)
+
+    def read_region(self, handle: int, region: int, address: int, size: int, stride: int = 0) -> float:
+        return self.lib.ReadRegion(handle, region, address, size, stride)
+
+    def get_frame_sequence(self, handle: int) -> int:
+        return self.lib.GetFrameSequence(handle)
+
     def get_capture_bounds(self, handle: int) -> Rect:
         return self.lib.GetCaptureBounds(handle)
 
@@ -88,42 +347,199 @@ class NativeScreenRecorder:
     def create_buffer(self, size: int) -> Any:
         return ct.create_string_buffer(size)  # type: ignore
 
+    def create_frame_pool(self, alignment: int, max_buffers: int) -> int:
+        """Returns the id of a pool of native frame buffers that start on a multiple of alignment, at most
+        max_buffers of which are lent at once, or 0 if alignment is not a power of 2."""
+        return self.lib.CreateFramePool(alignment, max_buffers)
+
+    def lend_frame_buffer(self, pool: int, size: int) -> int:
+        """Returns the address of a native buffer of size bytes, or 0 if they are all lent."""
+        return self.lib.LendFrameBuffer(pool, size) or 0
+
+    def return_frame_buffer(self, pool: int, address: int) -> bool:
+        return self.lib.ReturnFrameBuffer(pool, address)
+
+    def get_lent_frame_buffers(self, pool: int) -> int:
+        return self.lib.GetLentFrameBuffers(pool)
+
+    def close_frame_pool(self, pool: int) -> None:
+        """Stops lending, the buffers still out stay valid until they are returned."""
+        self.lib.CloseFramePool(pool)
+
     def read_next_frame(self, handle: int, buffer: Any, size: int) -> float:
         return self.lib.ReadNextFrame(handle, buffer, size)
 
-    def encode_video(self, handle: int, file_name: str, properties: EncodingProperties) -> int:
+    def read_next_frame_ex(self, handle: int, address: int, size: int, format: PixelFormat, stride: int = 0) -> float:
+        """Reads the next frame into the memory at address as tightly packed pixels (or rows of stride
+        bytes), returns 0 if no frame was read."""
+        return self.lib.ReadNextFrameEx(handle, address, size, format.value, stride)
+
+    def encode_video(self, handle: int, file_name: Optional[str], properties: EncodingProperties) -> int:
+        """Starts encoding the capture on a native thread and returns the encoder id, or 0 if the
+        capture is already being encoded. Several captures can be encoded at once. file_name is not
+        used with replay_seconds."""
         props = _EncoderPropertiesStruct()
         props.bit_rate = properties.bit_rate
         props.frame_rate = properties.frame_rate
         props.quality = properties.quality.value
         props.seconds = properties.seconds
         props.ffmpeg = properties.ffmpeg
+        props.queue_depth = properties.queue_depth
+        props.drop_policy = properties.drop_policy
+        props.container = properties.container.value
+        props.fragment_milliseconds = properties.fragment_milliseconds
+        props.replay_seconds = properties.replay_seconds
+        props.replay_megabytes = properties.replay_megabytes
+        props.segment_seconds = properties.segment_seconds
+        props.segment_megabytes = properties.segment_megabytes
+        props.profile = properties.profile.value
+        props.encoder_options = properties.encoder_options.encode("utf-8") if properties.encoder_options else None
+        props.variable_frame_rate = 1 if properties.variable_frame_rate else 0
+        props.change_tolerance = properties.change_tolerance
+        props.hold_last_frame = 1 if properties.hold_last_frame else 0
+        props.adaptive_frame_rate = 1 if properties.adaptive_frame_rate else 0
+        props.min_frame_rate = properties.min_frame_rate
 
         result = self.lib.EncodeVideo(handle, file_name, ct.byref(props))
         properties.bit_rate = props.bit_rate
         properties.ffmpeg = props.ffmpeg
         return result
 
-    def stop_encoding(self) -> None:
-        self.lib.StopEncoding()
+    def wait_for_encoder(self, encoder: int) -> int:
+        """Waits for the encoder to finish, returns 0 or an error code for get_error_message."""
+        return self.lib.WaitForEncoder(encoder)
 
-    def get_sample_times(self) -> List[float]:
-        len = self.lib.GetSampleTimes(None, 0)
+    def is_encoding(self, encoder: int) -> bool:
+        return self.lib.IsEncoding(encoder)
+
+    def stop_encoding(self, encoder: int) -> None:
+        self.lib.StopEncoding(encoder)
+
+    def save_replay(self, encoder: int, file_name: str) -> int:
+        """Writes the replay the encoder keeps in memory to an mp4 without stopping it, returns 0 or
+        an error code for get_error_message."""
+        return self.lib.SaveReplay(encoder, file_name)
+
+    def close_encoder(self, encoder: int) -> None:
+        """Stops the encoder if needed, waits for it and frees the id."""
+        self.lib.CloseEncoder(encoder)
+
+    def get_error_message(self, encoder: int, error: int) -> str:
+        return self.lib.GetErrorMessage(encoder, error).decode("utf-8", errors="replace")
+
+    def get_sample_times(self, encoder: int) -> List[float]:
+        len = self.lib.GetSampleTimes(encoder, None, 0)
         if len > 0:
             array = (ct.c_double * len)()
-            self.lib.GetSampleTimes(array, len)
-            return list(array)
+            count = self.lib.GetSampleTimes(encoder, array, len)
+            return array[:count]
         return []
 
     def get_capture_times(self, handle: int) -> List[float]:
         len = self.lib.GetCaptureTimes(handle, None, 0)
         if len > 0:
             array = (ct.c_double * len)()
-            self.lib.GetCaptureTimes(handle, array, len)
-            return list(array)
+            count = self.lib.GetCaptureTimes(handle, array, len)
+            return array[:count]
+        return []
+
+    def _read_times(self, read: Any, cursor: int) -> Tuple[List[float], int]:
+        position = ct.c_uint64(cursor)
+        array = (ct.c_double * 1024)()
+        result: List[float] = []
+        while True:
+            # a read the writer lapped copies fewer than it skipped over, so a short read does not mean
+            # we caught up, only a read that does not move the cursor does.
+            previous = position.value
+            count = read(ct.byref(position), array, len(array))
+            result += array[:count]
+            if count == 0 or position.value == previous:
+                return result, position.value
+
+    def read_sample_times(self, encoder: int, cursor: int = 0) -> Tuple[List[float], int]:
+        """Returns the encoded frame times after cursor and the cursor to pass next time."""
+        return self._read_times(lambda *args: self.lib.ReadSampleTimes(encoder, *args), cursor)
+
+    def read_capture_times(self, handle: int, cursor: int = 0) -> Tuple[List[float], int]:
+        """Returns the captured frame times after cursor and the cursor to pass next time."""
+        return self._read_times(lambda *args: self.lib.ReadCaptureTimes(handle, *args), cursor)
+
+    def get_sample_timing_stats(self, encoder: int) -> FrameTimingStats:
+        stats = FrameTimingStats()
+        self.lib.GetSampleTimingStats(encoder, ct.byref(stats))
+        return stats
+
+    def get_capture_timing_stats(self, handle: int) -> FrameTimingStats:
+        stats = FrameTimingStats()
+        self.lib.GetCaptureTimingStats(handle, ct.byref(stats))
+        return stats
+
+    def get_encoder_adjustments(self, encoder: int) -> List[EncoderAdjustment]:
+        """Every time an encoder with adaptive_frame_rate lowered or raised its frame rate."""
+        count = self.lib.GetEncoderAdjustments(encoder, None, 0)
+        if count > 0:
+            array = (EncoderAdjustment * count)()
+            count = min(count, self.lib.GetEncoderAdjustments(encoder, array, count))
+            return list(array[:count])
         return []
 
+    def enable_tracing(self, enable: bool) -> None:
+        """Records how long each capture, readback, conversion and encoding step takes."""
+        self.lib.EnableTracing(enable)
+
+    def clear_trace(self) -> None:
+        self.lib.ClearTrace()
+
+    def save_trace(self, file_name: str) -> None:
+        """Writes the recorded steps as Chrome trace JSON, open it in ui.perfetto.dev or chrome://tracing."""
+        full_path = os.path.realpath(file_name)
+        if not self.lib.SaveTrace(full_path):
+            raise Exception(f"Could not write the trace to {full_path}")
+
     def sleep_microseconds(self, microseconds: int):
         if microseconds < 0:
             raise ValueError("sleep microseconds must be >= 0")
         self.lib.SleepMicroseconds(microseconds)
+
+    def set_sleep_policy(self, policy: SleepPolicy) -> None:
+        """Trades the precision of sleep_microseconds against the CPU it spends spinning, for the whole process."""
+        self.lib.SetSleepPolicy(policy.value)
+
+    def create_throttle(self, fps: float, catch_up: CatchUpPolicy = CatchUpPolicy.SkipMissed) -> int:
+        """Returns the id of a native throttle for the given frame rate, 0 if fps is not positive. It uses the
+        sleep policy set when it is created."""
+        return self.lib.CreateThrottle(fps, catch_up.value)
+
+    def throttle_step(self, throttle: int) -> float:
+        """Waits for the next deadline of the throttle and returns the seconds it waited."""
+        return self.lib.ThrottleStep(throttle)
+
+    def reset_throttle(self, throttle: int) -> None:
+        self.lib.ResetThrottle(throttle)
+
+    def align_throttle(self, throttle: int, capture_handle: int) -> None:
+        """Moves the throttle's schedule a little towards just after the frames of the capture arrive."""
+        self.lib.AlignThrottle(throttle, capture_handle)
+
+    def get_throttle_stats(self, throttle: int) -> ThrottleStats:
+        stats = ThrottleStats()
+        self.lib.GetThrottleStats(throttle, ct.byref(stats))
+        return stats
+
+    def get_throttle_histogram(self, throttle: int) -> List[Tuple[float, int]]:
+        """Returns (middle of the bucket in seconds, count) of each non empty bucket of how late the steps returned."""
+        count = self.lib.GetThrottleHistogram(throttle, None, None, 0)
+        if count > 0:
+            seconds = (ct.c_double * count)()
+            counts = (ct.c_uint64 * count)()
+            count = min(count, self.lib.GetThrottleHistogram(throttle, seconds, counts, count))
+            return list(zip(seconds[:count], counts[:count]))
+        return []
+
+    def close_throttle(self, throttle: int) -> None:
+        self.lib.CloseThrottle(throttle)
+
+    def set_clock_source(self, source: ClockSource, calibration_milliseconds: int = 100) -> bool:
+        """Picks the clock behind the native sleeps, frame pacing and encoder statistics for the whole process.
+        Returns False if the cpu has no invariant time stamp counter to use for ClockSource.Tsc."""
+        return self.lib.SetClockSource(source.value, calibration_milliseconds)
@@ -1,45 +1,48 @@
-import numpy as np
+from typing import List, Tuple
 
-from wincam.timer import Timer
+from wincam.native import CatchUpPolicy, NativeScreenRecorder, ThrottleStats
 
 
 class FpsThrottle:
     """Helper class that throttles the frame rate to a given fps. Simply set the frame rate in the constructor then call
-    step and step will sleep the right amount to make the time between step calls equal the given fps.  In order to
-    avoid large initial times it smooths this time only over the window_size (in seconds) so it settles into a nice
-    steady state more quickly than it would if it was taking the overall average."""
+    step and step will sleep until the next frame is due. The frames are due on a fixed schedule, one frame interval
+    apart from the first step, so however long each step of your loop takes the average rate does not drift. After a
+    stall of a frame or more catch_up decides whether the missed frames are run back to back (Burst), skipped
+    (SkipMissed, the default) or the schedule starts over (Reanchor). The pacing is done natively by the same accurate
+    sleep as Timer. window_size is no longer used and only kept so existing callers still work."""
 
-    def __init__(self, fps: int, window_size=10):
+    def __init__(self, fps: int, window_size=10, catch_up: CatchUpPolicy = CatchUpPolicy.SkipMissed):
         self.fps = fps
         self.window_size = window_size
-        self.reset()
         self.target_ms_per_frame = 1000.0 / self.fps
-        self.window: np.ndarray | None = None
-        self.pos = 0
+        self._native = NativeScreenRecorder()
+        self._throttle = self._native.create_throttle(fps, catch_up)
+        if self._throttle == 0:
+            raise Exception(f"Invalid frame rate {fps}")
+
+    def __del__(self):
+        throttle = getattr(self, "_throttle", 0)
+        if throttle:
+            self._native.close_throttle(throttle)
+            self._throttle = 0
 
     def reset(self):
-        self.timer = Timer()
-        self.started = False
-        self.window = None
-        self.pos = 0
-
-    def step(self):
-        if not self.started:
-            self.started = True
-            throttle_ms = 0.0
-        else:
-            # get time for full step loop since we were last called
-            average_ms_per_frame = self.timer.ticks() * 1000.0
-            if self.window is None:
-                self.window = np.ones((self.window_size,)) * average_ms_per_frame
-            else:
-                self.window[self.pos] = average_ms_per_frame
-                self.pos = (self.pos + 1) % self.window_size
-            smoothed_average = np.mean(self.window)
-            throttle_ms = self.target_ms_per_frame - smoothed_average
-
-        # sync to match the given frame rate.
-        if throttle_ms > 0:
-            self.timer.sleep(int(throttle_ms))
-        self.timer.start()
-        return throttle_ms
+        """The next step starts a new schedule."""
+        self._native.reset_throttle(self._throttle)
+
+    def step(self) -> float:
+        """Sleeps until the next frame is due and returns the milliseconds it slept."""
+        return self._native.throttle_step(self._throttle) * 1000.0
+
+    def align_to_capture(self, capture_handle: int):
+        """Moves the schedule a little towards just after the frames of the capture arrive, so a step does not return
+        just before a new frame and read the old one. Call it after each frame you read."""
+        self._native.align_throttle(self._throttle, capture_handle)
+
+    def stats(self) -> ThrottleStats:
+        """How late the steps returned after their deadlines, in seconds."""
+        return self._native.get_throttle_stats(self._throttle)
+
+    def histogram(self) -> List[Tuple[float, int]]:
+        """(middle of the bucket in seconds, count) of each non empty bucket of how late the steps returned."""
+        return self._native.get_throttle_histogram(self._throttle)